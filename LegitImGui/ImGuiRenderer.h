@@ -230,7 +230,11 @@ public:
         { legit::BlendSettings::AlphaBlend() }, 
         GetImGuiVertexDeclaration(), 
         vk::PrimitiveTopology::eTriangleList, 
-        imGuiShader.program.get());
+        imGuiShader.program.get(),
+        passContext.GetBoundState());
+      //still compiling in async mode, nothing is bound to draw with
+      if (!pipeineInfo.isReady)
+        return;
       {
         /*glm::vec2 tileSize(0.1f, 0.1f);
         glm::vec2 tilePadding(0.02f, 0.02f);
@@ -274,7 +278,19 @@ public:
         }
         frameInfo.memoryPool->EndSet();
 
-        auto shaderDataSet = this->core->GetDescriptorSetCache()->GetDescriptorSet(*shaderDataSetInfo, shaderData.uniformBufferBindings, {}, {});
+        //with a descriptor buffer, set offsets are bound instead of sets
+        auto descriptorSetCache = this->core->GetDescriptorSetCache();
+        vk::DescriptorSet shaderDataSet;
+        if (descriptorSetCache->IsDescriptorBufferEnabled())
+        {
+          descriptorSetCache->BindDescriptorBuffer(passContext.GetCommandBuffer());
+          descriptorSetCache->BindDescriptorBufferSet(passContext.GetCommandBuffer(), vk::PipelineBindPoint::eGraphics, pipeineInfo.pipelineLayout, ShaderDataSetIndex, *shaderDataSetInfo,
+            legit::DescriptorSetBindingsView().SetUniformBufferBindings(shaderData.uniformBufferBindings), shaderData.dynamicOffset);
+        }
+        else
+        {
+          shaderDataSet = descriptorSetCache->GetDescriptorSet(*shaderDataSetInfo, shaderData.uniformBufferBindings, {}, {});
+        }
 
         const legit::DescriptorSetLayoutKey *drawCallSetInfo = imGuiShader.program->GetSetInfo(DrawCallDataSetIndex);
         
@@ -292,6 +308,7 @@ public:
             if (drawCmd->UserCallback)
             {
               drawCmd->UserCallback(cmdList, drawCmd);
+              passContext.GetBoundState()->Invalidate(); //callbacks can bind anything
             }
             else
             {
@@ -301,11 +318,20 @@ public:
               legit::ImageView *texImageView = (legit::ImageView *)drawCmd->GetTexID();
               legit::ImageSamplerBinding texBinding = drawCallSetInfo->MakeImageSamplerBinding("tex", texImageView, imageSpaceSampler.get());
 
-              auto drawCallSet = this->core->GetDescriptorSetCache()->GetDescriptorSet(*drawCallSetInfo, {}, {}, { texBinding });
+              if (descriptorSetCache->IsDescriptorBufferEnabled())
+              {
+                descriptorSetCache->BindDescriptorBufferSet(passContext.GetCommandBuffer(), vk::PipelineBindPoint::eGraphics, pipeineInfo.pipelineLayout, DrawCallDataSetIndex, *drawCallSetInfo,
+                  legit::DescriptorSetBindingsView().SetImageSamplerBindings(texBinding));
+              }
+              else
+              {
+                auto drawCallSet = descriptorSetCache->GetDescriptorSet(*drawCallSetInfo, {}, {}, { texBinding });
 
-              passContext.GetCommandBuffer().bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeineInfo.pipelineLayout, ShaderDataSetIndex,
-                { shaderDataSet, drawCallSet },
-                { shaderData.dynamicOffset });
+                //only the first draw and texture changes actually bind anything
+                auto boundState = passContext.GetBoundState();
+                boundState->BindDescriptorSet(vk::PipelineBindPoint::eGraphics, pipeineInfo.pipelineLayout, ShaderDataSetIndex, shaderDataSet, shaderData.dynamicOffset);
+                boundState->BindDescriptorSet(vk::PipelineBindPoint::eGraphics, pipeineInfo.pipelineLayout, DrawCallDataSetIndex, drawCallSet, {});
+              }
 
 
               // We are using scissoring to clip some objects. All low-level graphics API should supports it.
@@ -604,8 +630,8 @@ private:
   {
     FrameResources(legit::Core *core, size_t maxVerticesCount, size_t maxIndicesCount)
     {
-      imGuiIndexBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetPhysicalDevice(), core->GetLogicalDevice(), sizeof(glm::uint32_t) * maxIndicesCount, vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
-      imGuiVertexBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetPhysicalDevice(), core->GetLogicalDevice(), sizeof(ImGuiVertex) * maxVerticesCount, vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+      imGuiIndexBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetMemoryAllocator(), sizeof(glm::uint32_t) * maxIndicesCount, vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+      imGuiVertexBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetMemoryAllocator(), sizeof(ImGuiVertex) * maxVerticesCount, vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
     }
 
     std::unique_ptr<legit::Buffer> imGuiIndexBuffer;
@@ -624,7 +650,7 @@ private:
     auto texelData = legit::CreateSimpleImageTexelData(pixels, width, height);
     auto fontCreateDesc = legit::Image::CreateInfo2d(texelData.baseSize, uint32_t(texelData.mips.size()), 1, texelData.format, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
 
-    this->fontImage = std::unique_ptr<legit::Image>(new legit::Image(core->GetPhysicalDevice(), core->GetLogicalDevice(), fontCreateDesc));
+    this->fontImage = std::unique_ptr<legit::Image>(new legit::Image(core->GetMemoryAllocator(), fontCreateDesc));
     legit::LoadTexelData(core, &texelData, fontImage->GetImageData());
     this->fontImageView = std::unique_ptr<legit::ImageView>(new legit::ImageView(core->GetLogicalDevice(), fontImage->GetImageData(), 0, fontImage->GetImageData()->GetMipsCount(), 0, 1));
 
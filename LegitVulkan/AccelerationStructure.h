@@ -4,11 +4,11 @@ namespace legit
   class AccelerationStructure
   {
   public:
-    AccelerationStructure(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, vk::AccelerationStructureTypeKHR type, vk::AccelerationStructureBuildSizesInfoKHR buildSizeInfo)
+    AccelerationStructure(legit::MemoryAllocator *memoryAllocator, vk::AccelerationStructureTypeKHR type, vk::AccelerationStructureBuildSizesInfoKHR buildSizeInfo)
     {
+      vk::Device logicalDevice = memoryAllocator->GetLogicalDevice();
       this->buffer.reset(new legit::Buffer(
-        physicalDevice,
-        logicalDevice,
+        memoryAllocator,
         buildSizeInfo.accelerationStructureSize,
         vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
         vk::MemoryPropertyFlagBits::eDeviceLocal));
@@ -25,7 +25,7 @@ namespace legit
     {
       return accelerationStructure.get();
     }
-    uint64_t GetDeviceAddress()
+    uint64_t GetDeviceAddress() const
     {
       return deviceAddress;
     }
@@ -47,12 +47,11 @@ namespace legit
     }
     return resTransform;
   }
-  std::unique_ptr<legit::Buffer> CreateTransformBuffer(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, glm::mat4 transform)
+  std::unique_ptr<legit::Buffer> CreateTransformBuffer(legit::MemoryAllocator *memoryAllocator, glm::mat4 transform)
   {
     std::unique_ptr<legit::Buffer> transformBuffer;
     transformBuffer.reset(new legit::Buffer(
-      physicalDevice,
-      logicalDevice,
+      memoryAllocator,
       sizeof(vk::TransformMatrixKHR),
       vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
       vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
@@ -3,9 +3,10 @@ namespace legit
   class BLAS
   {
   public:
-    BLAS(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, const legit::ExecuteOnceQueue &queue, legit::Buffer *vertexBuffer, size_t maxVertex, size_t vertexStride, legit::Buffer *indexBuffer, uint32_t trianglesCount)
+    BLAS(legit::MemoryAllocator *memoryAllocator, const legit::ExecuteOnceQueue &queue, legit::Buffer *vertexBuffer, size_t maxVertex, size_t vertexStride, legit::Buffer *indexBuffer, uint32_t trianglesCount)
     {
-      this->transformBuffer = CreateTransformBuffer(physicalDevice, logicalDevice, glm::translate(glm::vec3(0.0f, 0.0f, 0.0f)));
+      vk::Device logicalDevice = memoryAllocator->GetLogicalDevice();
+      this->transformBuffer = CreateTransformBuffer(memoryAllocator, glm::translate(glm::vec3(0.0f, 0.0f, 0.0f)));
 
       auto accelerationStructureGeometry = vk::AccelerationStructureGeometryKHR()
         .setFlags(vk::GeometryFlagBitsKHR::eOpaque)
@@ -35,11 +36,10 @@ namespace legit
         buildGeomInfo,
         triangleCounts);
         
-      accelerationStructure.reset(new legit::AccelerationStructure(physicalDevice, logicalDevice, vk::AccelerationStructureTypeKHR::eBottomLevel, buildSizesInfo));
+      accelerationStructure.reset(new legit::AccelerationStructure(memoryAllocator, vk::AccelerationStructureTypeKHR::eBottomLevel, buildSizesInfo));
 
       legit::Buffer scratchBuffer(
-        physicalDevice,
-        logicalDevice,
+        memoryAllocator,
         buildSizesInfo.buildScratchSize,
         vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
         vk::MemoryPropertyFlagBits::eDeviceLocal);
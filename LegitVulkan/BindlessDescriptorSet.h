@@ -0,0 +1,293 @@
+#include <unordered_map>
+#include <deque>
+#include <array>
+
+namespace legit
+{
+  //one global update-after-bind set with partially bound arrays of textures, samplers and storage buffers.
+  //resources are registered once and shaders index the unsized arrays directly, so it's bound once per pass instead of a set per draw
+  class BindlessDescriptorSet
+  {
+  public:
+    static constexpr uint32_t TexturesBinding = 0;
+    static constexpr uint32_t SamplersBinding = 1;
+    static constexpr uint32_t StorageBuffersBinding = 2;
+    static constexpr uint32_t InvalidIndex = uint32_t(-1);
+
+    BindlessDescriptorSet(vk::PhysicalDevice physicalDevice, vk::Device _logicalDevice, uint32_t maxTexturesCount = 16384, uint32_t maxSamplersCount = 256, uint32_t maxStorageBuffersCount = 4096) :
+      logicalDevice(_logicalDevice)
+    {
+      auto propertiesChain = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+      auto indexingProperties = propertiesChain.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+      textures.capacity = std::min({ maxTexturesCount, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+      samplers.capacity = std::min({ maxSamplersCount, indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers, indexingProperties.maxDescriptorSetUpdateAfterBindSamplers });
+      storageBuffers.capacity = std::min({ maxStorageBuffersCount, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers, indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+
+      std::array<vk::DescriptorSetLayoutBinding, 3> layoutBindings;
+      layoutBindings[TexturesBinding] = vk::DescriptorSetLayoutBinding()
+        .setBinding(TexturesBinding)
+        .setDescriptorCount(textures.capacity)
+        .setDescriptorType(vk::DescriptorType::eSampledImage)
+        .setStageFlags(vk::ShaderStageFlagBits::eAll);
+      layoutBindings[SamplersBinding] = vk::DescriptorSetLayoutBinding()
+        .setBinding(SamplersBinding)
+        .setDescriptorCount(samplers.capacity)
+        .setDescriptorType(vk::DescriptorType::eSampler)
+        .setStageFlags(vk::ShaderStageFlagBits::eAll);
+      layoutBindings[StorageBuffersBinding] = vk::DescriptorSetLayoutBinding()
+        .setBinding(StorageBuffersBinding)
+        .setDescriptorCount(storageBuffers.capacity)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eAll);
+
+      //slots that are never registered are never written, and new slots are written while older frames are still executing
+      vk::DescriptorBindingFlagsEXT bindingFlags =
+        vk::DescriptorBindingFlagBitsEXT::ePartiallyBound |
+        vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+        vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+      std::array<vk::DescriptorBindingFlagsEXT, 3> layoutBindingFlags = { bindingFlags, bindingFlags, bindingFlags };
+      auto bindingFlagsInfo = vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT()
+        .setBindingCount(uint32_t(layoutBindingFlags.size()))
+        .setPBindingFlags(layoutBindingFlags.data());
+
+      auto layoutInfo = vk::DescriptorSetLayoutCreateInfo()
+        .setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT)
+        .setBindingCount(uint32_t(layoutBindings.size()))
+        .setPBindings(layoutBindings.data())
+        .setPNext(&bindingFlagsInfo);
+      this->setLayout = logicalDevice.createDescriptorSetLayoutUnique(layoutInfo);
+
+      std::array<vk::DescriptorPoolSize, 3> poolSizes = {
+        vk::DescriptorPoolSize(vk::DescriptorType::eSampledImage, textures.capacity),
+        vk::DescriptorPoolSize(vk::DescriptorType::eSampler, samplers.capacity),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, storageBuffers.capacity) };
+      auto poolInfo = vk::DescriptorPoolCreateInfo()
+        .setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT)
+        .setMaxSets(1)
+        .setPoolSizeCount(uint32_t(poolSizes.size()))
+        .setPPoolSizes(poolSizes.data());
+      this->descriptorPool = logicalDevice.createDescriptorPoolUnique(poolInfo);
+
+      vk::DescriptorSetLayout layoutHandle = setLayout.get();
+      auto setAllocInfo = vk::DescriptorSetAllocateInfo()
+        .setDescriptorPool(descriptorPool.get())
+        .setDescriptorSetCount(1)
+        .setPSetLayouts(&layoutHandle);
+      this->descriptorSet = logicalDevice.allocateDescriptorSets(setAllocInfo)[0];
+    }
+
+    vk::DescriptorSetLayout GetSetLayout()
+    {
+      return setLayout.get();
+    }
+    vk::DescriptorSet GetDescriptorSet()
+    {
+      return descriptorSet;
+    }
+
+    //the set stays bound across pipeline changes as long as the layouts of this and lower set indices match
+    void Bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout pipelineLayout, uint32_t setIndex)
+    {
+      commandBuffer.bindDescriptorSets(bindPoint, pipelineLayout, setIndex, { descriptorSet }, {});
+    }
+
+    //registering the same resource again returns the same index. images have to stay in eShaderReadOnlyOptimal, the render graph can't track them here
+    uint32_t RegisterTexture(const legit::ImageView *imageView)
+    {
+      assert(imageView);
+      return Register(textures, imageView, [&](uint32_t index)
+      {
+        auto imageInfo = vk::DescriptorImageInfo()
+          .setImageView(imageView->GetHandle())
+          .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+        auto setWrite = vk::WriteDescriptorSet()
+          .setDstSet(descriptorSet)
+          .setDstBinding(TexturesBinding)
+          .setDstArrayElement(index)
+          .setDescriptorCount(1)
+          .setDescriptorType(vk::DescriptorType::eSampledImage)
+          .setPImageInfo(&imageInfo);
+        logicalDevice.updateDescriptorSets({ setWrite }, {});
+      });
+    }
+    uint32_t RegisterSampler(const legit::Sampler *sampler)
+    {
+      assert(sampler);
+      return Register(samplers, sampler, [&](uint32_t index)
+      {
+        auto imageInfo = vk::DescriptorImageInfo()
+          .setSampler(sampler->GetHandle());
+        auto setWrite = vk::WriteDescriptorSet()
+          .setDstSet(descriptorSet)
+          .setDstBinding(SamplersBinding)
+          .setDstArrayElement(index)
+          .setDescriptorCount(1)
+          .setDescriptorType(vk::DescriptorType::eSampler)
+          .setPImageInfo(&imageInfo);
+        logicalDevice.updateDescriptorSets({ setWrite }, {});
+      });
+    }
+    uint32_t RegisterStorageBuffer(const legit::Buffer *buffer)
+    {
+      assert(buffer);
+      return Register(storageBuffers, buffer, [&](uint32_t index)
+      {
+        auto bufferInfo = vk::DescriptorBufferInfo()
+          .setBuffer(buffer->GetHandle())
+          .setOffset(0)
+          .setRange(VK_WHOLE_SIZE);
+        auto setWrite = vk::WriteDescriptorSet()
+          .setDstSet(descriptorSet)
+          .setDstBinding(StorageBuffersBinding)
+          .setDstArrayElement(index)
+          .setDescriptorCount(1)
+          .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+          .setPBufferInfo(&bufferInfo);
+        logicalDevice.updateDescriptorSets({ setWrite }, {});
+      });
+    }
+
+    //has to be called before the resource is destroyed. the index is handed out again only once no frame in flight can read it
+    void UnregisterTexture(const legit::ImageView *imageView)
+    {
+      Unregister(textures, imageView);
+    }
+    void UnregisterSampler(const legit::Sampler *sampler)
+    {
+      Unregister(samplers, sampler);
+    }
+    void UnregisterStorageBuffer(const legit::Buffer *buffer)
+    {
+      Unregister(storageBuffers, buffer);
+    }
+
+    //has to be larger than the number of frames in flight
+    void SetRetireFramesCount(uint64_t framesCount)
+    {
+      std::lock_guard<std::mutex> lock(setMutex);
+      this->retireFramesCount = framesCount;
+    }
+
+    //call once per frame, after waiting for the frame that is about to be reused
+    void NextFrame()
+    {
+      std::lock_guard<std::mutex> lock(setMutex);
+      currFrameIndex++;
+      for (auto *resourceArray : { &textures, &samplers, &storageBuffers })
+      {
+        auto &retiredIndices = resourceArray->retiredIndices;
+        while (retiredIndices.size() > 0 && retiredIndices.front().second + retireFramesCount <= currFrameIndex)
+        {
+          resourceArray->freeIndices.push_back(retiredIndices.front().first);
+          retiredIndices.pop_front();
+        }
+      }
+    }
+
+    //unsized arrays in the shader have to use the same bindings as this set, nothing else can live in it
+    bool IsCompatible(const legit::DescriptorSetLayoutKey &setLayoutKey) const
+    {
+      if (setLayoutKey.GetUniformBuffersCount() > 0 || setLayoutKey.GetImageSamplersCount() > 0 || setLayoutKey.GetTexturesCount() > 0 || setLayoutKey.GetSamplersCount() > 0 ||
+        setLayoutKey.GetStorageBuffersCount() > 0 || setLayoutKey.GetStorageImagesCount() > 0 || setLayoutKey.GetAccelerationStructuresCount() > 0)
+      {
+        return false;
+      }
+      for (size_t arrayIndex = 0; arrayIndex < setLayoutKey.GetBindlessArraysCount(); arrayIndex++)
+      {
+        auto arrayInfo = setLayoutKey.GetBindlessArrayInfo(arrayIndex);
+        uint32_t expectedBinding = InvalidIndex;
+        switch (arrayInfo.type)
+        {
+          case DescriptorSetLayoutKey::BindlessArrayTypes::Textures: expectedBinding = TexturesBinding; break;
+          case DescriptorSetLayoutKey::BindlessArrayTypes::Samplers: expectedBinding = SamplersBinding; break;
+          case DescriptorSetLayoutKey::BindlessArrayTypes::StorageBuffers: expectedBinding = StorageBuffersBinding; break;
+        }
+        if (arrayInfo.shaderBindingIndex != expectedBinding)
+          return false;
+      }
+      return true;
+    }
+
+    struct Stats
+    {
+      size_t texturesCount = 0;
+      size_t texturesCapacity = 0;
+      size_t samplersCount = 0;
+      size_t samplersCapacity = 0;
+      size_t storageBuffersCount = 0;
+      size_t storageBuffersCapacity = 0;
+      size_t writesCount = 0; //total
+    };
+    Stats GetStats()
+    {
+      std::lock_guard<std::mutex> lock(setMutex);
+      Stats stats = this->stats;
+      stats.texturesCount = textures.resourceToIndex.size();
+      stats.texturesCapacity = textures.capacity;
+      stats.samplersCount = samplers.resourceToIndex.size();
+      stats.samplersCapacity = samplers.capacity;
+      stats.storageBuffersCount = storageBuffers.resourceToIndex.size();
+      stats.storageBuffersCapacity = storageBuffers.capacity;
+      return stats;
+    }
+  private:
+    struct ResourceArray
+    {
+      std::unordered_map<const void *, uint32_t> resourceToIndex;
+      std::vector<uint32_t> freeIndices;
+      std::deque<std::pair<uint32_t, uint64_t>> retiredIndices; //index and the frame it was unregistered in
+      uint32_t nextIndex = 0;
+      uint32_t capacity = 0;
+    };
+
+    template<typename WriteFunc>
+    uint32_t Register(ResourceArray &resourceArray, const void *resource, WriteFunc writeFunc)
+    {
+      std::lock_guard<std::mutex> lock(setMutex);
+      auto it = resourceArray.resourceToIndex.find(resource);
+      if (it != resourceArray.resourceToIndex.end())
+        return it->second;
+
+      uint32_t index;
+      if (resourceArray.freeIndices.size() > 0)
+      {
+        index = resourceArray.freeIndices.back();
+        resourceArray.freeIndices.pop_back();
+      }
+      else
+      {
+        if (resourceArray.nextIndex >= resourceArray.capacity)
+          throw std::runtime_error("Bindless descriptor array is full");
+        index = resourceArray.nextIndex++;
+      }
+      resourceArray.resourceToIndex[resource] = index;
+      writeFunc(index);
+      stats.writesCount++;
+      return index;
+    }
+
+    void Unregister(ResourceArray &resourceArray, const void *resource)
+    {
+      std::lock_guard<std::mutex> lock(setMutex);
+      auto it = resourceArray.resourceToIndex.find(resource);
+      if (it == resourceArray.resourceToIndex.end())
+        return;
+      //the slot keeps its stale descriptor, partially bound arrays allow that as long as shaders don't read it
+      resourceArray.retiredIndices.push_back({ it->second, currFrameIndex });
+      resourceArray.resourceToIndex.erase(it);
+    }
+
+    ResourceArray textures;
+    ResourceArray samplers;
+    ResourceArray storageBuffers;
+    uint64_t currFrameIndex = 0;
+    uint64_t retireFramesCount = 4;
+    Stats stats;
+    std::mutex setMutex;
+
+    vk::UniqueDescriptorSetLayout setLayout;
+    vk::UniqueDescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet; //freed with the pool
+    vk::Device logicalDevice;
+  };
+}
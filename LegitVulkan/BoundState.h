@@ -0,0 +1,135 @@
+namespace legit
+{
+  //pipelines and descriptor sets currently bound to one command buffer. binds that wouldn't change anything are skipped, so per-draw loops
+  //can bind unconditionally. anything bound to the command buffer directly bypasses this and has to be followed by Invalidate()
+  class BoundState
+  {
+  public:
+    BoundState(vk::CommandBuffer _commandBuffer = nullptr) :
+      commandBuffer(_commandBuffer)
+    {
+    }
+
+    void Reset(vk::CommandBuffer commandBuffer)
+    {
+      this->commandBuffer = commandBuffer;
+      Invalidate();
+    }
+    //forgets everything that has been bound, the next bind of each kind is always recorded
+    void Invalidate()
+    {
+      for (auto &bindPointState : bindPointStates)
+      {
+        bindPointState.pipeline = nullptr;
+        bindPointState.sets.clear();
+      }
+    }
+    vk::CommandBuffer GetCommandBuffer() const
+    {
+      return commandBuffer;
+    }
+
+    void BindPipeline(vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline)
+    {
+      auto &bindPointState = GetBindPointState(bindPoint);
+      if (bindPointState.pipeline == pipeline)
+      {
+        stats.skippedPipelineBindsCount++;
+        return;
+      }
+      commandBuffer.bindPipeline(bindPoint, pipeline);
+      bindPointState.pipeline = pipeline;
+      stats.pipelineBindsCount++;
+    }
+
+    void BindDescriptorSet(vk::PipelineBindPoint bindPoint, vk::PipelineLayout pipelineLayout, uint32_t setIndex, vk::DescriptorSet descriptorSet, legit::Span<const uint32_t> dynamicOffsets)
+    {
+      auto &bindPointState = GetBindPointState(bindPoint);
+      if (setIndex < bindPointState.sets.size())
+      {
+        auto &boundSet = bindPointState.sets[setIndex];
+        if (boundSet.pipelineLayout == pipelineLayout && boundSet.descriptorSet == descriptorSet &&
+          boundSet.dynamicOffsets.size() == dynamicOffsets.size() && std::equal(dynamicOffsets.begin(), dynamicOffsets.end(), boundSet.dynamicOffsets.begin()))
+        {
+          stats.skippedDescriptorSetBindsCount++;
+          return;
+        }
+      }
+      commandBuffer.bindDescriptorSets(bindPoint, pipelineLayout, setIndex, 1, &descriptorSet, uint32_t(dynamicOffsets.size()), dynamicOffsets.data());
+      auto &boundSet = MarkSetBound(bindPointState, pipelineLayout, setIndex);
+      boundSet.descriptorSet = descriptorSet;
+      boundSet.dynamicOffsets.assign(dynamicOffsets.begin(), dynamicOffsets.end());
+      stats.descriptorSetBindsCount++;
+    }
+
+    //for sets that were changed without bindDescriptorSets(), like pushed descriptors or descriptor buffer offsets
+    void InvalidateDescriptorSet(vk::PipelineBindPoint bindPoint, vk::PipelineLayout pipelineLayout, uint32_t setIndex)
+    {
+      MarkSetBound(GetBindPointState(bindPoint), pipelineLayout, setIndex);
+    }
+
+    struct Stats
+    {
+      Stats &operator +=(const Stats &other)
+      {
+        pipelineBindsCount += other.pipelineBindsCount;
+        skippedPipelineBindsCount += other.skippedPipelineBindsCount;
+        descriptorSetBindsCount += other.descriptorSetBindsCount;
+        skippedDescriptorSetBindsCount += other.skippedDescriptorSetBindsCount;
+        return *this;
+      }
+      size_t pipelineBindsCount = 0;
+      size_t skippedPipelineBindsCount = 0;
+      size_t descriptorSetBindsCount = 0;
+      size_t skippedDescriptorSetBindsCount = 0;
+    };
+    const Stats &GetStats() const
+    {
+      return stats;
+    }
+  private:
+    struct BoundSet
+    {
+      vk::PipelineLayout pipelineLayout;
+      vk::DescriptorSet descriptorSet; //null if unknown
+      std::vector<uint32_t> dynamicOffsets;
+    };
+    struct BindPointState
+    {
+      vk::Pipeline pipeline;
+      std::vector<BoundSet> sets;
+    };
+
+    BindPointState &GetBindPointState(vk::PipelineBindPoint bindPoint)
+    {
+      switch (bindPoint)
+      {
+        case vk::PipelineBindPoint::eGraphics: return bindPointStates[0];
+        case vk::PipelineBindPoint::eCompute: return bindPointStates[1];
+        default: return bindPointStates[2];
+      }
+    }
+
+    //binding a set with a layout that isn't compatible with the ones other sets were bound with disturbs them. compatibility isn't worked out
+    //here, sets bound with any other layout are just treated as unknown
+    BoundSet &MarkSetBound(BindPointState &bindPointState, vk::PipelineLayout pipelineLayout, uint32_t setIndex)
+    {
+      if (bindPointState.sets.size() <= setIndex)
+        bindPointState.sets.resize(setIndex + 1);
+      for (auto &boundSet : bindPointState.sets)
+      {
+        if (boundSet.pipelineLayout != pipelineLayout)
+          boundSet = BoundSet();
+      }
+      auto &boundSet = bindPointState.sets[setIndex];
+      boundSet.pipelineLayout = pipelineLayout;
+      boundSet.descriptorSet = nullptr;
+      boundSet.dynamicOffsets.clear();
+      return boundSet;
+    }
+
+    vk::CommandBuffer commandBuffer;
+    BindPointState bindPointStates[3]; //graphics, compute, ray tracing
+    Stats stats;
+  };
+}
@@ -24,15 +24,19 @@ namespace legit
     }
     vk::DeviceMemory GetMemory() const
     {
-      return bufferMemory.get();
+      return allocation.Get().memory ? allocation.Get().memory : bufferMemory.get();
     }
+    //sub-allocated host visible memory is persistently mapped by the allocator
     void *Map() const
     {
-      return logicalDevice.mapMemory(GetMemory(), 0, size);
+      if (allocation.Get().mappedData)
+        return allocation.Get().mappedData;
+      return logicalDevice.mapMemory(GetMemory(), allocation.Get().offset, size);
     }
     void Unmap() const
     {
-      logicalDevice.unmapMemory(GetMemory());
+      if (!allocation.Get().mappedData)
+        logicalDevice.unmapMemory(GetMemory());
     }
     Buffer(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, vk::DeviceSize size, vk::BufferUsageFlags usageFlags, vk::MemoryPropertyFlags memoryVisibility)
     {
@@ -59,17 +63,68 @@ namespace legit
 
       logicalDevice.bindBufferMemory(bufferHandle.get(), bufferMemory.get(), 0);
     }
+    Buffer(legit::MemoryAllocator *memoryAllocator, vk::DeviceSize size, vk::BufferUsageFlags usageFlags, vk::MemoryPropertyFlags memoryVisibility, legit::MemoryAllocator::AllocationTypes allocationType = legit::MemoryAllocator::AllocationTypes::Pooled)
+    {
+      this->logicalDevice = memoryAllocator->GetLogicalDevice();
+      this->size = size;
+      bool allowAllocateDeviceAddress = bool(usageFlags & vk::BufferUsageFlagBits::eShaderDeviceAddress);
+      auto bufferInfo = vk::BufferCreateInfo()
+        .setSize(size)
+        .setUsage(usageFlags)
+        .setSharingMode(vk::SharingMode::eExclusive);
+      bufferHandle = logicalDevice.createBufferUnique(bufferInfo);
+
+      allocation = memoryAllocator->Allocate(GetMemoryRequirements(), memoryVisibility, true, allowAllocateDeviceAddress, allocationType);
+      logicalDevice.bindBufferMemory(bufferHandle.get(), allocation->memory, allocation->offset);
+    }
+    //buffer without its own memory, it has to be placed into externally owned memory with BindMemory() before use
+    Buffer(vk::Device logicalDevice, vk::DeviceSize size, vk::BufferUsageFlags usageFlags)
+    {
+      this->logicalDevice = logicalDevice;
+      this->size = size;
+      auto bufferInfo = vk::BufferCreateInfo()
+        .setSize(size)
+        .setUsage(usageFlags)
+        .setSharingMode(vk::SharingMode::eExclusive);
+      bufferHandle = logicalDevice.createBufferUnique(bufferInfo);
+    }
+    vk::MemoryRequirements GetMemoryRequirements() const
+    {
+      return logicalDevice.getBufferMemoryRequirements(bufferHandle.get());
+    }
+    void BindMemory(vk::DeviceMemory memory, vk::DeviceSize offset)
+    {
+      assert(!bufferMemory && !allocation.Get().memory);
+      logicalDevice.bindBufferMemory(bufferHandle.get(), memory, offset);
+    }
     vk::DeviceAddress GetDeviceAddress() const
     {
       auto deviceAddressInfo = vk::BufferDeviceAddressInfo()
         .setBuffer(bufferHandle.get());
       return logicalDevice.getBufferAddress(deviceAddressInfo);
     }
+    vk::DeviceSize GetSize() const
+    {
+      return size;
+    }
+    //usage the buffer was left in at the end of the last frame that used it, render graph frames start from it
+    BufferUsageTypes GetLastUsageType() const
+    {
+      return lastUsageType;
+    }
+    //for accesses made outside of the render graph
+    void SetLastUsageType(BufferUsageTypes usageType)
+    {
+      this->lastUsageType = usageType;
+    }
   private:
+    legit::MemoryAllocator::UniqueAllocation allocation; //declared first so that it's freed after the buffer is destroyed
     vk::UniqueBuffer bufferHandle;
     vk::UniqueDeviceMemory bufferMemory;
     vk::Device logicalDevice;
     vk::DeviceSize size;
+    mutable BufferUsageTypes lastUsageType = BufferUsageTypes::None; //written by StateTracker through const pointers
     friend class Core;
+    friend struct StateTracker;
   };
 }
\ No newline at end of file
@@ -6,6 +6,7 @@ namespace legit
 {
   class Swapchain;
   class RenderGraph;
+  class UploadManager;
   class Core
   {
   public:    
@@ -15,7 +16,8 @@ namespace legit
       std::optional<WindowDesc> compatibleWindowDesc,
       bool enableDebugging,
       vk::PhysicalDeviceFeatures physicalDeviceFeatures = {},
-      void *physicalDeviceChainFeatures = nullptr);
+      void *physicalDeviceChainFeatures = nullptr,
+      std::string pipelineCacheFilename = "pipeline_cache.bin");
 
     inline ~Core();
     inline void ClearCaches();
@@ -45,6 +47,7 @@ namespace legit
     inline vk::Device GetLogicalDevice();
     inline vk::PhysicalDevice GetPhysicalDevice();
     inline legit::RenderGraph* GetRenderGraph();
+    inline legit::MemoryAllocator* GetMemoryAllocator();
     inline std::vector<vk::UniqueCommandBuffer> AllocateCommandBuffers(size_t count);
     inline vk::UniqueSemaphore CreateVulkanSemaphore();
     inline vk::UniqueFence CreateFence(bool state);
@@ -53,9 +56,13 @@ namespace legit
     inline void WaitIdle();
     inline vk::Queue GetGraphicsQueue();
     inline vk::Queue GetPresentQueue();
+    inline vk::Queue GetComputeQueue();
+    inline vk::Queue GetTransferQueue();
     inline uint32_t GetDynamicMemoryAlignment();
     inline legit::DescriptorSetCache* GetDescriptorSetCache();
+    inline legit::BindlessDescriptorSet* GetBindlessDescriptorSet(); //null unless VK_EXT_descriptor_indexing is enabled
     inline legit::PipelineCache* GetPipelineCache();
+    inline legit::UploadManager* GetUploadManager();
     inline vk::detail::DispatchLoaderDynamic GetLoader();
     inline QueueFamilyIndices GetQueueFamilyIndices();
   private:
@@ -92,10 +99,15 @@ namespace legit
     vk::UniqueCommandPool commandPool;
     vk::Queue graphicsQueue;
     vk::Queue presentQueue;
+    vk::Queue computeQueue;
+    vk::Queue transferQueue;
 
+    std::unique_ptr<legit::MemoryAllocator> memoryAllocator;
     std::unique_ptr<legit::DescriptorSetCache> descriptorSetCache;
+    std::unique_ptr<legit::BindlessDescriptorSet> bindlessDescriptorSet;
     std::unique_ptr<legit::PipelineCache> pipelineCache;
     std::unique_ptr<legit::RenderGraph> renderGraph;
+    std::unique_ptr<legit::UploadManager> uploadManager;
 
 
     QueueFamilyIndices queueFamilyIndices;
@@ -66,6 +66,16 @@ namespace legit
     return true;
   }
 
+  static bool IsDeviceExtensionSupported(vk::PhysicalDevice physicalDevice, std::string extensionName)
+  {
+    for (auto supportedExtension : physicalDevice.enumerateDeviceExtensionProperties())
+    {
+      if (extensionName == supportedExtension.extensionName)
+        return true;
+    }
+    return false;
+  }
+
   static bool CheckDeviceExtensions(vk::PhysicalDevice physicalDevice, std::vector<const char*> requiredExtensions)
   {
     auto supportedExtensions = physicalDevice.enumerateDeviceExtensionProperties();
@@ -96,7 +106,8 @@ namespace legit
     std::optional<WindowDesc> compatibleWindowDesc,
     bool enableDebugging,
     vk::PhysicalDeviceFeatures physicalDeviceFeatures,
-    void *physicalDeviceChainFeatures)
+    void *physicalDeviceChainFeatures,
+    std::string pipelineCacheFilename)
   {
     std::vector<const char*> resIntanceExtensions = GetCStrArray(instanceExtensions);
     std::vector<const char*> validationLayers;
@@ -106,13 +117,27 @@ namespace legit
     }
     
     bool enableRaytracing = false;
+    bool enableBindless = false;
+    bool enableDescriptorBuffer = false;
+    bool enableSynchronization2 = false;
     for(const auto &extension : deviceExtensions)
     {
       if(extension == "VK_KHR_acceleration_structure")
-      {
         enableRaytracing = true;
-        break;
-      }
+      //descriptorBindingPartiallyBound, runtimeDescriptorArray and the update after bind features have to be in physicalDeviceChainFeatures
+      if(extension == VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
+        enableBindless = true;
+      //descriptorBuffer and bufferDeviceAddress have to be in physicalDeviceChainFeatures
+      if(extension == VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)
+        enableDescriptorBuffer = true;
+      //synchronization2 has to be in physicalDeviceChainFeatures
+      if(extension == VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)
+        enableSynchronization2 = true;
+    }
+    if (enableBindless && enableDescriptorBuffer)
+    {
+      std::cout << "[BAD BUT NOT CRITICAL]: Bindless set can't be used with descriptor buffers, falling back to descriptor pools\n";
+      enableDescriptorBuffer = false;
     }
 
     std::vector<const char*> resDeviceExtensions = GetCStrArray(deviceExtensions);
@@ -150,6 +175,14 @@ namespace legit
     {
       throw std::runtime_error("Device extension unsupported");
     }
+    //optional, only used to count pipeline cache hits
+    bool enablePipelineCreationFeedback = IsDeviceExtensionSupported(physicalDevice, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    if (enablePipelineCreationFeedback)
+      resDeviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    //optional, sets declared as push descriptor sets go through DescriptorSetCache without it
+    bool enablePushDescriptors = IsDeviceExtensionSupported(physicalDevice, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if (enablePushDescriptors)
+      resDeviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
 
     if(compatibleWindowDesc)
     {
@@ -169,15 +202,32 @@ namespace legit
 
     this->graphicsQueue = GetDeviceQueue(logicalDevice.get(), queueFamilyIndices.graphicsFamilyIndex);
     this->presentQueue = GetDeviceQueue(logicalDevice.get(), queueFamilyIndices.presentFamilyIndex);
+    this->computeQueue = GetDeviceQueue(logicalDevice.get(), queueFamilyIndices.computeFamilyIndex);
+    this->transferQueue = GetDeviceQueue(logicalDevice.get(), queueFamilyIndices.transferFamilyIndex);
     this->commandPool = CreateCommandPool(logicalDevice.get(), queueFamilyIndices.graphicsFamilyIndex);
 
-    this->descriptorSetCache.reset(new legit::DescriptorSetCache(logicalDevice.get(), enableRaytracing));
-    this->pipelineCache.reset(new legit::PipelineCache(logicalDevice.get(), this->descriptorSetCache.get()));
-
-    this->renderGraph.reset(new legit::RenderGraph(physicalDevice, logicalDevice.get(), loader));
+    this->memoryAllocator.reset(new legit::MemoryAllocator(physicalDevice, logicalDevice.get()));
+    std::unique_ptr<legit::DescriptorBuffer> descriptorBuffer;
+    if (enableDescriptorBuffer)
+      descriptorBuffer.reset(new legit::DescriptorBuffer(physicalDevice, logicalDevice.get()));
+    this->descriptorSetCache.reset(new legit::DescriptorSetCache(logicalDevice.get(), enableRaytracing, enablePushDescriptors, std::move(descriptorBuffer)));
+    if (enableBindless)
+      this->bindlessDescriptorSet.reset(new legit::BindlessDescriptorSet(physicalDevice, logicalDevice.get()));
+    this->pipelineCache.reset(new legit::PipelineCache(physicalDevice, logicalDevice.get(), this->descriptorSetCache.get(), pipelineCacheFilename, enablePipelineCreationFeedback));
+    this->pipelineCache->SetBindlessDescriptorSet(this->bindlessDescriptorSet.get());
+
+    this->renderGraph.reset(new legit::RenderGraph(physicalDevice, logicalDevice.get(), memoryAllocator.get(), loader));
+    this->pipelineCache->SetRenderPassCache(renderGraph->GetRenderPassCache());
+    this->renderGraph->SetSynchronization2(enableSynchronization2);
+    //descriptors of buffers in a descriptor buffer are made from their device addresses
+    if (enableDescriptorBuffer)
+      this->renderGraph->SetTransientBufferUsageFlags(vk::BufferUsageFlagBits::eShaderDeviceAddress);
+
+    this->uploadManager.reset(new legit::UploadManager(this));
   }
   Core::~Core()
   {
+    this->pipelineCache->SaveToDisk();
   }
   void Core::ClearCaches()
   {
@@ -220,6 +270,10 @@ namespace legit
   {
     return renderGraph.get();
   }
+  legit::MemoryAllocator *Core::GetMemoryAllocator()
+  {
+    return memoryAllocator.get();
+  }
   std::vector<vk::UniqueCommandBuffer> Core::AllocateCommandBuffers(size_t count)
   {
     auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
@@ -261,6 +315,14 @@ namespace legit
   {
     return presentQueue;
   }
+  vk::Queue Core::GetComputeQueue()
+  {
+    return computeQueue;
+  }
+  vk::Queue Core::GetTransferQueue()
+  {
+    return transferQueue;
+  }
   uint32_t Core::GetDynamicMemoryAlignment()
   {
     return uint32_t(physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment);
@@ -269,10 +331,18 @@ namespace legit
   {
     return descriptorSetCache.get();
   }
+  legit::BindlessDescriptorSet *Core::GetBindlessDescriptorSet()
+  {
+    return bindlessDescriptorSet.get();
+  }
   legit::PipelineCache *Core::GetPipelineCache()
   {
     return pipelineCache.get();
   }
+  legit::UploadManager *Core::GetUploadManager()
+  {
+    return uploadManager.get();
+  }
   
   vk::detail::DispatchLoaderDynamic Core::GetLoader()
   {
@@ -360,6 +430,8 @@ namespace legit
     QueueFamilyIndices queueFamilyIndices;
     queueFamilyIndices.graphicsFamilyIndex = uint32_t(-1);
     queueFamilyIndices.presentFamilyIndex = uint32_t(-1);
+    queueFamilyIndices.computeFamilyIndex = uint32_t(-1);
+    queueFamilyIndices.transferFamilyIndex = uint32_t(-1);
     for (uint32_t familyIndex = 0; familyIndex < queueFamilies.size(); familyIndex++)
     {
       if (queueFamilies[familyIndex].queueFlags & vk::QueueFlagBits::eGraphics && queueFamilies[familyIndex].queueCount > 0 && queueFamilyIndices.graphicsFamilyIndex == uint32_t(-1))
@@ -367,9 +439,21 @@ namespace legit
 
       if(physicalDevice.getSurfaceSupportKHR(familyIndex, surface) && queueFamilies[familyIndex].queueCount > 0 && queueFamilyIndices.presentFamilyIndex == uint32_t(-1))
         queueFamilyIndices.presentFamilyIndex = familyIndex;
+
+      //a compute family without graphics support is what lets compute work run alongside rasterization
+      if (queueFamilies[familyIndex].queueFlags & vk::QueueFlagBits::eCompute && !(queueFamilies[familyIndex].queueFlags & vk::QueueFlagBits::eGraphics) && queueFamilies[familyIndex].queueCount > 0 && queueFamilyIndices.computeFamilyIndex == uint32_t(-1))
+        queueFamilyIndices.computeFamilyIndex = familyIndex;
+
+      //transfer-only families are usually backed by dma engines that copy without taking time from the other queues
+      if (queueFamilies[familyIndex].queueFlags & vk::QueueFlagBits::eTransfer && !(queueFamilies[familyIndex].queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) && queueFamilies[familyIndex].queueCount > 0 && queueFamilyIndices.transferFamilyIndex == uint32_t(-1))
+        queueFamilyIndices.transferFamilyIndex = familyIndex;
     }
     if(queueFamilyIndices.graphicsFamilyIndex == uint32_t(-1))
       throw std::runtime_error("Failed to find appropriate queue families");
+    if(queueFamilyIndices.computeFamilyIndex == uint32_t(-1))
+      queueFamilyIndices.computeFamilyIndex = queueFamilyIndices.graphicsFamilyIndex;
+    if(queueFamilyIndices.transferFamilyIndex == uint32_t(-1))
+      queueFamilyIndices.transferFamilyIndex = queueFamilyIndices.graphicsFamilyIndex;
     return queueFamilyIndices;
   }
 
@@ -381,7 +465,7 @@ namespace legit
     void *physicalDeviceChainFeatures
   )
   {
-    std::set<uint32_t> uniqueQueueFamilyIndices = { familyIndices.graphicsFamilyIndex, familyIndices.presentFamilyIndex };
+    std::set<uint32_t> uniqueQueueFamilyIndices = { familyIndices.graphicsFamilyIndex, familyIndices.presentFamilyIndex, familyIndices.computeFamilyIndex, familyIndices.transferFamilyIndex };
 
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
     float queuePriority = 1.0f;
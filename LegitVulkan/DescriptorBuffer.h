@@ -0,0 +1,151 @@
+#include <deque>
+
+namespace legit
+{
+  //VK_EXT_descriptor_buffer backend of DescriptorSetCache. descriptors are written with vkGetDescriptorEXT straight into a persistently
+  //mapped ring buffer and binding a set is just an offset update, so there are no pools to run out of and nothing to allocate per set
+  class DescriptorBuffer
+  {
+  public:
+    DescriptorBuffer(vk::PhysicalDevice physicalDevice, vk::Device _logicalDevice, vk::DeviceSize maxRingSize = 16 * 1024 * 1024) :
+      logicalDevice(_logicalDevice)
+    {
+      auto propertiesChain = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+      this->properties = propertiesChain.get<vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+
+      //samplers and resources share the ring, so both range limits apply to it
+      this->ringSize = std::min({ maxRingSize, properties.maxResourceDescriptorBufferRange, properties.maxSamplerDescriptorBufferRange });
+      this->usageFlags = vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT | vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT;
+      this->ringBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(
+        physicalDevice,
+        logicalDevice,
+        ringSize,
+        usageFlags | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+      this->ringData = (char*)ringBuffer->Map();
+      this->ringAddress = ringBuffer->GetDeviceAddress();
+    }
+    ~DescriptorBuffer()
+    {
+      ringBuffer->Unmap();
+    }
+
+    const vk::PhysicalDeviceDescriptorBufferPropertiesEXT &GetProperties() const
+    {
+      return properties;
+    }
+
+    vk::DeviceSize GetDescriptorSize(vk::DescriptorType descriptorType) const
+    {
+      switch (descriptorType)
+      {
+        case vk::DescriptorType::eUniformBuffer: return properties.uniformBufferDescriptorSize;
+        case vk::DescriptorType::eStorageBuffer: return properties.storageBufferDescriptorSize;
+        case vk::DescriptorType::eCombinedImageSampler: return properties.combinedImageSamplerDescriptorSize;
+        case vk::DescriptorType::eSampledImage: return properties.sampledImageDescriptorSize;
+        case vk::DescriptorType::eSampler: return properties.samplerDescriptorSize;
+        case vk::DescriptorType::eStorageImage: return properties.storageImageDescriptorSize;
+        case vk::DescriptorType::eAccelerationStructureKHR: return properties.accelerationStructureDescriptorSize;
+        default: assert(0); return 0;
+      }
+    }
+
+    //reserves space for one set, the returned offset is relative to the start of the ring
+    vk::DeviceSize Allocate(vk::DeviceSize size)
+    {
+      std::lock_guard<std::mutex> lock(ringMutex);
+      uint64_t position = AlignSize(headPosition, properties.descriptorBufferOffsetAlignment);
+      if (position % ringSize + size > ringSize) //sets never wrap around
+        position += ringSize - position % ringSize;
+      if (position + size - tailPosition > ringSize)
+        throw std::runtime_error("Descriptor buffer ring is full");
+      headPosition = position + size;
+      stats.peakUsedSize = std::max(stats.peakUsedSize, headPosition - tailPosition);
+      stats.writtenSetsCount++;
+      return position % ringSize;
+    }
+    void *GetData(vk::DeviceSize offset)
+    {
+      return ringData + offset;
+    }
+
+    void WriteDescriptor(vk::DescriptorType descriptorType, const vk::DescriptorDataEXT &descriptorData, void *dstData)
+    {
+      auto descriptorInfo = vk::DescriptorGetInfoEXT()
+        .setType(descriptorType)
+        .setData(descriptorData);
+      logicalDevice.getDescriptorEXT(&descriptorInfo, size_t(GetDescriptorSize(descriptorType)), dstData);
+    }
+
+    //has to be recorded into every command buffer before any set offsets are
+    void Bind(vk::CommandBuffer commandBuffer)
+    {
+      auto bindingInfo = vk::DescriptorBufferBindingInfoEXT()
+        .setAddress(ringAddress)
+        .setUsage(usageFlags);
+      commandBuffer.bindDescriptorBuffersEXT(bindingInfo);
+    }
+    void SetSetOffset(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout pipelineLayout, uint32_t setIndex, vk::DeviceSize offset)
+    {
+      uint32_t bufferIndex = 0;
+      commandBuffer.setDescriptorBufferOffsetsEXT(bindPoint, pipelineLayout, setIndex, bufferIndex, offset);
+    }
+
+    //set by InFlightQueue, the part of the ring written by a frame is reused once that many frames have begun after it
+    void SetFramesInFlightCount(size_t framesCount)
+    {
+      std::lock_guard<std::mutex> lock(ringMutex);
+      this->framesInFlightCount = std::max<size_t>(framesCount, 1);
+    }
+
+    //call once per frame, after waiting for the frame that is about to be reused
+    void NextFrame()
+    {
+      std::lock_guard<std::mutex> lock(ringMutex);
+      frameEndPositions.push_back(headPosition);
+      //every frame but the framesInFlightCount - 1 most recent ones has finished on the gpu
+      while (frameEndPositions.size() + 1 > framesInFlightCount)
+      {
+        tailPosition = frameEndPositions.front();
+        frameEndPositions.pop_front();
+      }
+    }
+
+    struct Stats
+    {
+      vk::DeviceSize ringSize = 0;
+      vk::DeviceSize usedSize = 0;
+      vk::DeviceSize peakUsedSize = 0;
+      size_t writtenSetsCount = 0; //total
+    };
+    Stats GetStats()
+    {
+      std::lock_guard<std::mutex> lock(ringMutex);
+      Stats stats = this->stats;
+      stats.ringSize = ringSize;
+      stats.usedSize = headPosition - tailPosition;
+      return stats;
+    }
+  private:
+    static uint64_t AlignSize(uint64_t size, uint64_t alignment)
+    {
+      return (size + alignment - 1) / alignment * alignment;
+    }
+
+    vk::PhysicalDeviceDescriptorBufferPropertiesEXT properties;
+    std::unique_ptr<legit::Buffer> ringBuffer;
+    vk::BufferUsageFlags usageFlags;
+    vk::DeviceSize ringSize;
+    vk::DeviceAddress ringAddress;
+    char *ringData;
+
+    //positions only grow, the ring offset is position % ringSize
+    uint64_t headPosition = 0;
+    uint64_t tailPosition = 0;
+    std::deque<uint64_t> frameEndPositions;
+    size_t framesInFlightCount = 4;
+    Stats stats;
+    std::mutex ringMutex;
+    vk::Device logicalDevice;
+  };
+}
@@ -46,462 +46,1215 @@ namespace legit
       return *this;
     }
   };
-  class DescriptorSetCache
+
+  //same bindings as DescriptorSetBindings but only referencing them, so a cache lookup doesn't copy any vectors
+  struct DescriptorSetBindingsView
   {
-  public:
-    DescriptorSetCache(vk::Device _logicalDevice, bool enableRaytracing) :
-      logicalDevice(_logicalDevice)
+    DescriptorSetBindingsView() {}
+    DescriptorSetBindingsView(const DescriptorSetBindings &bindings) :
+      uniformBufferBindings(bindings.uniformBufferBindings),
+      imageSamplerBindings(bindings.imageSamplerBindings),
+      textureBindings(bindings.textureBindings),
+      samplerBindings(bindings.samplerBindings),
+      storageBufferBindings(bindings.storageBufferBindings),
+      storageImageBindings(bindings.storageImageBindings),
+      accelerationStructureBindings(bindings.accelerationStructureBindings)
     {
-      std::vector<vk::DescriptorPoolSize> poolSizes;
-      auto uniformPoolSize = vk::DescriptorPoolSize()
-        .setDescriptorCount(1000)
-        .setType(vk::DescriptorType::eUniformBufferDynamic);
-      poolSizes.push_back(uniformPoolSize);
+    }
+
+    Span<const UniformBufferBinding> uniformBufferBindings;
+    Span<const ImageSamplerBinding> imageSamplerBindings;
+    Span<const TextureBinding> textureBindings;
+    Span<const SamplerBinding> samplerBindings;
+    Span<const StorageBufferBinding> storageBufferBindings;
+    Span<const StorageImageBinding> storageImageBindings;
+    Span<const AccelerationStructureBinding> accelerationStructureBindings;
 
-      auto imageSamplerPoolSize = vk::DescriptorPoolSize()
-        .setDescriptorCount(1000)
-        .setType(vk::DescriptorType::eCombinedImageSampler);
-      poolSizes.push_back(imageSamplerPoolSize);
+    DescriptorSetBindingsView &SetUniformBufferBindings(Span<const UniformBufferBinding> uniformBufferBindings)
+    {
+      this->uniformBufferBindings = uniformBufferBindings;
+      return *this;
+    }
+    DescriptorSetBindingsView &SetImageSamplerBindings(Span<const ImageSamplerBinding> imageSamplerBindings)
+    {
+      this->imageSamplerBindings = imageSamplerBindings;
+      return *this;
+    }
+    DescriptorSetBindingsView &SetTextureBindings(Span<const TextureBinding> textureBindings)
+    {
+      this->textureBindings = textureBindings;
+      return *this;
+    }
+    DescriptorSetBindingsView &SetSamplerBindings(Span<const SamplerBinding> samplerBindings)
+    {
+      this->samplerBindings = samplerBindings;
+      return *this;
+    }
+    DescriptorSetBindingsView &SetStorageBufferBindings(Span<const StorageBufferBinding> storageBufferBindings)
+    {
+      this->storageBufferBindings = storageBufferBindings;
+      return *this;
+    }
+    DescriptorSetBindingsView &SetStorageImageBindings(Span<const StorageImageBinding> storageImageBindings)
+    {
+      this->storageImageBindings = storageImageBindings;
+      return *this;
+    }
+    DescriptorSetBindingsView &SetAccelerationStructureBindings(Span<const AccelerationStructureBinding> accelerationStructureBindings)
+    {
+      this->accelerationStructureBindings = accelerationStructureBindings;
+      return *this;
+    }
+  };
 
-      auto texturePoolSize = vk::DescriptorPoolSize()
-        .setDescriptorCount(1000)
-        .setType(vk::DescriptorType::eSampledImage);
-      poolSizes.push_back(texturePoolSize);
+  //linear pool for sets that only live for one frame. sets are never freed one by one: the whole pool is reset once the frame that used it
+  //has finished, so there's no fragmentation and nothing is hashed or kept around. one per frame in flight, see InFlightQueue.
+  //not thread-safe by itself, DescriptorSetCache allocates from it under its lock
+  class TransientDescriptorPool
+  {
+  public:
+    TransientDescriptorPool(vk::Device _logicalDevice, std::vector<vk::DescriptorType> _descriptorTypes, uint32_t _setsPerPool = 256) :
+      logicalDevice(_logicalDevice),
+      descriptorTypes(_descriptorTypes),
+      setsPerPool(_setsPerPool)
+    {
+    }
 
-      auto samplerSize = vk::DescriptorPoolSize()
-        .setDescriptorCount(1000)
-        .setType(vk::DescriptorType::eSampler);
-      poolSizes.push_back(samplerSize);
+    //call after the fence of the frame that used the pool has signaled. if the frame didn't fit into one pool,
+    //the chain is replaced by a single pool large enough for it so that the next reset is a single resetDescriptorPool again
+    void Reset()
+    {
+      if (pools.size() > 1)
+      {
+        while (setsPerPool < allocatedSetsCount)
+          setsPerPool *= 2;
+        pools.clear();
+      }
+      else if (pools.size() == 1 && allocatedSetsCount > 0)
+      {
+        logicalDevice.resetDescriptorPool(pools[0].get());
+      }
+      stats.peakSetsCount = std::max(stats.peakSetsCount, allocatedSetsCount);
+      allocatedSetsCount = 0;
+      currPoolIndex = 0;
+      currPoolSetsCount = 0;
+      stats.resetsCount++;
+    }
 
-      auto storagePoolSize = vk::DescriptorPoolSize()
-        .setDescriptorCount(1000)
-        .setType(vk::DescriptorType::eStorageBuffer);
-      poolSizes.push_back(storagePoolSize);
+    vk::DescriptorSet Allocate(vk::DescriptorSetLayout layout)
+    {
+      auto setAllocInfo = vk::DescriptorSetAllocateInfo()
+        .setDescriptorSetCount(1)
+        .setPSetLayouts(&layout);
 
-      auto storageImagePoolSize = vk::DescriptorPoolSize()
-        .setDescriptorCount(1000)
-        .setType(vk::DescriptorType::eStorageImage);
-      poolSizes.push_back(storageImagePoolSize);
+      while (true)
+      {
+        if (currPoolIndex == pools.size())
+          pools.push_back(CreatePool());
+        setAllocInfo.setDescriptorPool(pools[currPoolIndex].get());
+        vk::DescriptorSet descriptorSet;
+        auto res = logicalDevice.allocateDescriptorSets(&setAllocInfo, &descriptorSet);
+        if (res == vk::Result::eSuccess)
+        {
+          allocatedSetsCount++;
+          currPoolSetsCount++;
+          return descriptorSet;
+        }
+        if (res != vk::Result::eErrorOutOfPoolMemory && res != vk::Result::eErrorFragmentedPool)
+          throw std::runtime_error("Failed to allocate transient descriptor set");
+        if (currPoolSetsCount == 0)
+          throw std::runtime_error("Descriptor set does not fit into an empty transient pool");
+        currPoolIndex++;
+        currPoolSetsCount = 0;
+      }
+    }
 
-      if(enableRaytracing)
+    struct Stats
+    {
+      size_t poolsCount = 0;
+      size_t setsPerPool = 0;
+      size_t allocatedSetsCount = 0; //since the last reset
+      size_t peakSetsCount = 0;
+      size_t resetsCount = 0; //total
+    };
+    Stats GetStats() const
+    {
+      Stats stats = this->stats;
+      stats.poolsCount = pools.size();
+      stats.setsPerPool = setsPerPool;
+      stats.allocatedSetsCount = allocatedSetsCount;
+      return stats;
+    }
+  private:
+    vk::UniqueDescriptorPool CreatePool()
+    {
+      std::vector<vk::DescriptorPoolSize> poolSizes;
+      for (auto descriptorType : descriptorTypes)
       {
-        auto accelerationStructurePoolSize = vk::DescriptorPoolSize()
-          .setDescriptorCount(1000)
-          .setType(vk::DescriptorType::eAccelerationStructureKHR);
-        poolSizes.push_back(accelerationStructurePoolSize);
+        poolSizes.push_back(vk::DescriptorPoolSize()
+          .setDescriptorCount(setsPerPool * descriptorsPerSet)
+          .setType(descriptorType));
       }
 
       auto poolCreateInfo = vk::DescriptorPoolCreateInfo()
-        .setMaxSets(1000)
+        .setMaxSets(setsPerPool)
         .setPoolSizeCount(uint32_t(poolSizes.size()))
-        .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet)
         .setPPoolSizes(poolSizes.data());
-      descriptorPool = logicalDevice.createDescriptorPoolUnique(poolCreateInfo);
+      return logicalDevice.createDescriptorPoolUnique(poolCreateInfo);
     }
-    vk::DescriptorSetLayout GetDescriptorSetLayout(const legit::DescriptorSetLayoutKey &descriptorSetLayoutKey)
+
+    std::vector<vk::UniqueDescriptorPool> pools;
+    size_t currPoolIndex = 0;
+    size_t currPoolSetsCount = 0;
+    size_t allocatedSetsCount = 0;
+    Stats stats;
+    vk::Device logicalDevice;
+    std::vector<vk::DescriptorType> descriptorTypes;
+    uint32_t setsPerPool;
+    static const uint32_t descriptorsPerSet = 4; //of every type
+  };
+
+  class DescriptorSetCache
+  {
+  public:
+    //with a descriptor buffer every set goes through it instead of pools: push descriptors are not used and GetDescriptorSet() is not available
+    DescriptorSetCache(vk::Device _logicalDevice, bool _enableRaytracing, bool _enablePushDescriptors = false, std::unique_ptr<legit::DescriptorBuffer> _descriptorBuffer = nullptr) :
+      logicalDevice(_logicalDevice),
+      enableRaytracing(_enableRaytracing),
+      enablePushDescriptors(_enablePushDescriptors && !_descriptorBuffer),
+      descriptorBuffer(std::move(_descriptorBuffer))
     {
-      auto &descriptorSetLayout = descriptorSetLayoutCache[descriptorSetLayoutKey];
+    }
 
-      if (!descriptorSetLayout)
-      {
-        std::vector<vk::DescriptorSetLayoutBinding> layoutBindings;
+    //VK_KHR_push_descriptor, sets declared as push descriptor sets fall back to cached sets without it
+    bool IsPushDescriptorsEnabled() const
+    {
+      return enablePushDescriptors;
+    }
+    //VK_EXT_descriptor_buffer, null unless enabled
+    legit::DescriptorBuffer *GetDescriptorBuffer()
+    {
+      return descriptorBuffer.get();
+    }
+    bool IsDescriptorBufferEnabled() const
+    {
+      return bool(descriptorBuffer);
+    }
 
-        std::vector<legit::DescriptorSetLayoutKey::UniformBufferId> uniformBufferIds;
-        uniformBufferIds.resize(descriptorSetLayoutKey.GetUniformBuffersCount());
-        descriptorSetLayoutKey.GetUniformBufferIds(uniformBufferIds.data());
+    //sets not used for this many frames get evicted. has to be larger than the number of frames in flight
+    void SetEvictionFramesCount(uint64_t framesCount)
+    {
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      this->evictionFramesCount = framesCount;
+    }
 
-        for (auto uniformBufferId : uniformBufferIds)
-        {
-          auto bufferInfo = descriptorSetLayoutKey.GetUniformBufferInfo(uniformBufferId);
-          auto bufferLayoutBinding = vk::DescriptorSetLayoutBinding()
-            .setBinding(bufferInfo.shaderBindingIndex)
-            .setDescriptorCount(1) //if this is an array of buffers
-            .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
-            .setStageFlags(bufferInfo.stageFlags);
-          layoutBindings.push_back(bufferLayoutBinding);
-        }
+    //call once per frame, after waiting for the frame that is about to be reused
+    void NextFrame()
+    {
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      currFrameIndex++;
+      if (descriptorBuffer)
+        descriptorBuffer->NextFrame();
+      //scanning every entry each frame isn't worth it, sets live for many frames anyway
+      if (currFrameIndex - lastEvictionFrameIndex >= std::max<uint64_t>(evictionFramesCount / 4, 1))
+      {
+        EvictUnused();
+        lastEvictionFrameIndex = currFrameIndex;
+      }
+    }
 
-        std::vector<legit::DescriptorSetLayoutKey::StorageBufferId> storageBufferIds;
-        storageBufferIds.resize(descriptorSetLayoutKey.GetStorageBuffersCount());
-        descriptorSetLayoutKey.GetStorageBufferIds(storageBufferIds.data());
+    //drops every cached set that uses the buffer as a uniform buffer, has to be called before the buffer is destroyed. otherwise a new
+    //buffer allocated at the same address would hit sets that still point to the old one
+    void EvictUniformBufferSets(const legit::Buffer *buffer)
+    {
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      for (auto &slot : cacheSlots)
+      {
+        if (slot.state != CacheSlot::States::Occupied)
+          continue;
+        const auto &uniformBufferBindings = slot.key.bindings.uniformBufferBindings;
+        if (std::any_of(uniformBufferBindings.begin(), uniformBufferBindings.end(), [buffer](const UniformBufferBinding &binding) { return binding.buffer == buffer; }))
+          EvictSlot(slot);
+      }
+    }
 
-        for (auto storageBufferId : storageBufferIds)
-        {
-          auto bufferInfo = descriptorSetLayoutKey.GetStorageBufferInfo(storageBufferId);
-          auto bufferLayoutBinding = vk::DescriptorSetLayoutBinding()
-            .setBinding(bufferInfo.shaderBindingIndex)
-            .setDescriptorCount(bufferInfo.count)
-            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
-            .setStageFlags(bufferInfo.stageFlags);
-          layoutBindings.push_back(bufferLayoutBinding);
-        }
+    struct Stats
+    {
+      size_t poolsCount = 0; //including recycled ones waiting for reuse
+      size_t freePoolsCount = 0;
+      size_t setsCount = 0; //alive in the cache
+      size_t allocatedSetsCount = 0; //including evicted ones whose pools haven't been reset yet
+      size_t setsCapacity = 0;
+      size_t tableSlotsCount = 0;
+      size_t evictedSetsCount = 0; //total
+      size_t poolResetsCount = 0; //total
+      size_t pushedSetsCount = 0; //total, these never go through the cache
+      size_t transientSetsCount = 0; //total, allocated from TransientDescriptorPool instead of the cache
+    };
+    Stats GetStats()
+    {
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      Stats stats = this->stats;
+      stats.poolsCount = pools.size();
+      stats.freePoolsCount = freePoolIndices.size();
+      stats.setsCount = occupiedSlotsCount;
+      stats.tableSlotsCount = cacheSlots.size();
+      stats.allocatedSetsCount = 0;
+      for (const auto &pool : pools)
+        stats.allocatedSetsCount += pool.allocatedSetsCount;
+      stats.setsCapacity = pools.size() * setsPerPool;
+      stats.pushedSetsCount = pushedSetsCount;
+      stats.transientSetsCount = transientSetsCount;
+      return stats;
+    }
 
-        std::vector<legit::DescriptorSetLayoutKey::ImageSamplerId> imageSamplerIds;
-        imageSamplerIds.resize(descriptorSetLayoutKey.GetImageSamplersCount());
-        descriptorSetLayoutKey.GetImageSamplerIds(imageSamplerIds.data());
+    vk::DescriptorSetLayout GetDescriptorSetLayout(const legit::DescriptorSetLayoutKey &descriptorSetLayoutKey)
+    {
+      assert(!descriptorSetLayoutKey.IsBindless()); //those sets come from BindlessDescriptorSet
+      return GetLayoutData(descriptorSetLayoutKey).layout.get();
+    }
+    //uniform buffers of push descriptor sets can't be dynamic, their offsets are baked into the descriptors instead
+    vk::DescriptorSetLayout GetPushDescriptorSetLayout(const legit::DescriptorSetLayoutKey &descriptorSetLayoutKey)
+    {
+      return GetPushDescriptorLayout(descriptorSetLayoutKey).layout.get();
+    }
 
-        for (auto imageSamplerId : imageSamplerIds)
-        {
-          auto imageSamplerInfo = descriptorSetLayoutKey.GetImageSamplerInfo(imageSamplerId);
-
-          auto imageSamplerLayoutBinding = vk::DescriptorSetLayoutBinding()
-            .setBinding(imageSamplerInfo.shaderBindingIndex)
-            .setDescriptorCount(1) //if this is an array of image samplers
-            .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-            .setStageFlags(imageSamplerInfo.stageFlags);
-          layoutBindings.push_back(imageSamplerLayoutBinding);
-        }
-        
-        std::vector<legit::DescriptorSetLayoutKey::TextureId> textureIds;
-        textureIds.resize(descriptorSetLayoutKey.GetTexturesCount());
-        descriptorSetLayoutKey.GetTextureIds(textureIds.data());
+    //has to be recorded into every command buffer that BindDescriptorBufferSet() is used with
+    void BindDescriptorBuffer(vk::CommandBuffer commandBuffer)
+    {
+      assert(descriptorBuffer);
+      descriptorBuffer->Bind(commandBuffer);
+    }
+    //descriptor buffer counterpart of GetDescriptorSet() + bindDescriptorSets(): the descriptors are written into the ring on every call
+    //and only the set offset is bound. uniform buffers aren't dynamic here either, uniformsOffset is added to every uniform buffer offset
+    void BindDescriptorBufferSet(
+      vk::CommandBuffer commandBuffer,
+      vk::PipelineBindPoint bindPoint,
+      vk::PipelineLayout pipelineLayout,
+      uint32_t setIndex,
+      const legit::DescriptorSetLayoutKey &setLayoutKey,
+      const legit::DescriptorSetBindingsView &setBindings,
+      vk::DeviceSize uniformsOffset = 0)
+    {
+      assert(descriptorBuffer);
+      const auto &layoutData = GetLayoutData(setLayoutKey);
+      vk::DeviceSize setOffset = descriptorBuffer->Allocate(layoutData.descriptorBufferSize);
+      char *setData = (char*)descriptorBuffer->GetData(setOffset);
+      auto writeDescriptor = [&](uint32_t shaderBindingId, uint32_t elementIndex, vk::DescriptorType descriptorType, const vk::DescriptorDataEXT &descriptorData)
+      {
+        assert(shaderBindingId < layoutData.bindingOffsets.size() && elementIndex < layoutData.bindingDescriptorsCounts[shaderBindingId]);
+        vk::DeviceSize descriptorOffset = layoutData.bindingOffsets[shaderBindingId] + elementIndex * descriptorBuffer->GetDescriptorSize(descriptorType);
+        descriptorBuffer->WriteDescriptor(descriptorType, descriptorData, setData + descriptorOffset);
+      };
+      //unlike a VkDescriptorBufferInfo, an address range can't be VK_WHOLE_SIZE
+      auto getAddressInfo = [&](const legit::Buffer *buffer, vk::DeviceSize offset, vk::DeviceSize size)
+      {
+        return vk::DescriptorAddressInfoEXT()
+          .setAddress(buffer->GetDeviceAddress() + offset)
+          .setRange(size == VK_WHOLE_SIZE ? buffer->GetSize() - offset : size);
+      };
 
-        for (auto textureId : textureIds)
+      for (const auto &uniformBinding : setBindings.uniformBufferBindings)
+      {
+        auto addressInfo = getAddressInfo(uniformBinding.buffer, uniformBinding.offset + uniformsOffset, uniformBinding.size);
+        writeDescriptor(uniformBinding.shaderBindingId, 0, vk::DescriptorType::eUniformBuffer, vk::DescriptorDataEXT().setPUniformBuffer(&addressInfo));
+      }
+      for (const auto &imageSamplerBinding : setBindings.imageSamplerBindings)
+      {
+        auto imageInfo = vk::DescriptorImageInfo()
+          .setSampler(imageSamplerBinding.sampler->GetHandle())
+          .setImageView(imageSamplerBinding.imageView->GetHandle())
+          .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+        writeDescriptor(imageSamplerBinding.shaderBindingId, 0, vk::DescriptorType::eCombinedImageSampler, vk::DescriptorDataEXT().setPCombinedImageSampler(&imageInfo));
+      }
+      for (const auto &textureBinding : setBindings.textureBindings)
+      {
+        auto imageInfo = vk::DescriptorImageInfo()
+          .setImageView(textureBinding.imageView->GetHandle())
+          .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+        writeDescriptor(textureBinding.shaderBindingId, 0, vk::DescriptorType::eSampledImage, vk::DescriptorDataEXT().setPSampledImage(&imageInfo));
+      }
+      for (const auto &samplerBinding : setBindings.samplerBindings)
+      {
+        vk::Sampler sampler = samplerBinding.sampler->GetHandle();
+        writeDescriptor(samplerBinding.shaderBindingId, 0, vk::DescriptorType::eSampler, vk::DescriptorDataEXT().setPSampler(&sampler));
+      }
+      for (const auto &storageBinding : setBindings.storageBufferBindings)
+      {
+        for (size_t descIdx = 0; descIdx < storageBinding.descriptors.size(); descIdx++)
         {
-          auto textureInfo = descriptorSetLayoutKey.GetTextureInfo(textureId);
-
-          auto textureLayoutBinding = vk::DescriptorSetLayoutBinding()
-            .setBinding(textureInfo.shaderBindingIndex)
-            .setDescriptorCount(1) //if this is an array of image samplers
-            .setDescriptorType(vk::DescriptorType::eSampledImage)
-            .setStageFlags(textureInfo.stageFlags);
-          layoutBindings.push_back(textureLayoutBinding);
+          auto &descriptor = storageBinding.descriptors[descIdx];
+          auto addressInfo = getAddressInfo(descriptor.buffer, descriptor.offset, descriptor.size);
+          writeDescriptor(storageBinding.shaderBindingId, uint32_t(descIdx), vk::DescriptorType::eStorageBuffer, vk::DescriptorDataEXT().setPStorageBuffer(&addressInfo));
         }
-        
-        std::vector<legit::DescriptorSetLayoutKey::SamplerId> samplerIds;
-        samplerIds.resize(descriptorSetLayoutKey.GetSamplersCount());
-        descriptorSetLayoutKey.GetSamplerIds(samplerIds.data());
+      }
+      for (const auto &storageBinding : setBindings.storageImageBindings)
+      {
+        auto imageInfo = vk::DescriptorImageInfo()
+          .setImageView(storageBinding.imageView->GetHandle())
+          .setImageLayout(vk::ImageLayout::eGeneral);
+        writeDescriptor(storageBinding.shaderBindingId, 0, vk::DescriptorType::eStorageImage, vk::DescriptorDataEXT().setPStorageImage(&imageInfo));
+      }
+      for (const auto &accelerationStructureBinding : setBindings.accelerationStructureBindings)
+      {
+        writeDescriptor(accelerationStructureBinding.shaderBindingId, 0, vk::DescriptorType::eAccelerationStructureKHR, vk::DescriptorDataEXT().setAccelerationStructure(accelerationStructureBinding.accelerationStructure->GetDeviceAddress()));
+      }
 
-        for (auto samplerId : samplerIds)
-        {
-          auto samplerInfo = descriptorSetLayoutKey.GetSamplerInfo(samplerId);
-
-          auto samplerLayoutBinding = vk::DescriptorSetLayoutBinding()
-            .setBinding(samplerInfo.shaderBindingIndex)
-            .setDescriptorCount(1) //if this is an array of image samplers
-            .setDescriptorType(vk::DescriptorType::eSampler)
-            .setStageFlags(samplerInfo.stageFlags);
-          layoutBindings.push_back(samplerLayoutBinding);
-        }
+      descriptorBuffer->SetSetOffset(commandBuffer, bindPoint, pipelineLayout, setIndex, setOffset);
+    }
 
+    //writes the descriptors straight into the command buffer, nothing is allocated or cached. uniformsOffset is added to every uniform buffer offset
+    void PushDescriptorSet(
+      vk::CommandBuffer commandBuffer,
+      vk::PipelineBindPoint bindPoint,
+      vk::PipelineLayout pipelineLayout,
+      uint32_t setIndex,
+      const legit::DescriptorSetLayoutKey &setLayoutKey,
+      const legit::DescriptorSetBindingsView &setBindings,
+      vk::DeviceSize uniformsOffset = 0)
+    {
+      assert(enablePushDescriptors);
+      const auto &pushLayout = GetPushDescriptorLayout(setLayoutKey);
+      pushedSetsCount++;
 
-        std::vector<legit::DescriptorSetLayoutKey::StorageImageId> storageImageIds;
-        storageImageIds.resize(descriptorSetLayoutKey.GetStorageImagesCount());
-        descriptorSetLayoutKey.GetStorageImageIds(storageImageIds.data());
+      std::vector<vk::WriteDescriptorSet> setWrites = pushLayout.writesTemplate;
+      auto getWrite = [&](uint32_t shaderBindingId) -> vk::WriteDescriptorSet&
+      {
+        assert(shaderBindingId < pushLayout.bindingToWriteIndex.size() && pushLayout.bindingToWriteIndex[shaderBindingId] != uint32_t(-1));
+        return setWrites[pushLayout.bindingToWriteIndex[shaderBindingId]];
+      };
 
-        for (auto storageImageId : storageImageIds)
-        {
-          auto imageInfo = descriptorSetLayoutKey.GetStorageImageInfo(storageImageId);
-          auto imageLayoutBinding = vk::DescriptorSetLayoutBinding()
-            .setBinding(imageInfo.shaderBindingIndex)
-            .setDescriptorCount(1) //if this is an array of buffers
-            .setDescriptorType(vk::DescriptorType::eStorageImage)
-            .setStageFlags(imageInfo.stageFlags);
-          layoutBindings.push_back(imageLayoutBinding);
-        }
-        
-        std::vector<legit::DescriptorSetLayoutKey::AccelerationStructureId> accelerationStructureIds;
-        accelerationStructureIds.resize(descriptorSetLayoutKey.GetAccelerationStructuresCount());
-        descriptorSetLayoutKey.GetAccelerationStructureIds(accelerationStructureIds.data());
+      assert(setBindings.uniformBufferBindings.size() == setLayoutKey.GetUniformBuffersCount());
+      std::vector<vk::DescriptorBufferInfo> uniformBufferInfos;
+      uniformBufferInfos.reserve(setBindings.uniformBufferBindings.size()); //write pointers must stay valid
+      for (const auto &uniformBinding : setBindings.uniformBufferBindings)
+      {
+        uniformBufferInfos.push_back(vk::DescriptorBufferInfo(uniformBinding.buffer->GetHandle(), uniformBinding.offset + uniformsOffset, uniformBinding.size));
+        getWrite(uniformBinding.shaderBindingId).setPBufferInfo(&uniformBufferInfos.back());
+      }
 
-        for (auto accelerationStructureId : accelerationStructureIds)
-        {
-          auto imageInfo = descriptorSetLayoutKey.GetAccelerationStructureInfo(accelerationStructureId);
-          auto imageLayoutBinding = vk::DescriptorSetLayoutBinding()
-            .setBinding(imageInfo.shaderBindingIndex)
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR)
-            .setStageFlags(imageInfo.stageFlags);
-          layoutBindings.push_back(imageLayoutBinding);
-        }
+      assert(setBindings.imageSamplerBindings.size() == setLayoutKey.GetImageSamplersCount());
+      assert(setBindings.textureBindings.size() == setLayoutKey.GetTexturesCount());
+      assert(setBindings.samplerBindings.size() == setLayoutKey.GetSamplersCount());
+      assert(setBindings.storageImageBindings.size() == setLayoutKey.GetStorageImagesCount());
+      std::vector<vk::DescriptorImageInfo> imageInfos;
+      imageInfos.reserve(setBindings.imageSamplerBindings.size() + setBindings.textureBindings.size() + setBindings.samplerBindings.size() + setBindings.storageImageBindings.size());
+      for (const auto &imageSamplerBinding : setBindings.imageSamplerBindings)
+      {
+        imageInfos.push_back(vk::DescriptorImageInfo(imageSamplerBinding.sampler->GetHandle(), imageSamplerBinding.imageView->GetHandle(), vk::ImageLayout::eShaderReadOnlyOptimal));
+        getWrite(imageSamplerBinding.shaderBindingId).setPImageInfo(&imageInfos.back());
+      }
+      for (const auto &textureBinding : setBindings.textureBindings)
+      {
+        imageInfos.push_back(vk::DescriptorImageInfo(nullptr, textureBinding.imageView->GetHandle(), vk::ImageLayout::eShaderReadOnlyOptimal));
+        getWrite(textureBinding.shaderBindingId).setPImageInfo(&imageInfos.back());
+      }
+      for (const auto &samplerBinding : setBindings.samplerBindings)
+      {
+        imageInfos.push_back(vk::DescriptorImageInfo(samplerBinding.sampler->GetHandle(), nullptr, vk::ImageLayout::eShaderReadOnlyOptimal));
+        getWrite(samplerBinding.shaderBindingId).setPImageInfo(&imageInfos.back());
+      }
+      for (const auto &storageImageBinding : setBindings.storageImageBindings)
+      {
+        imageInfos.push_back(vk::DescriptorImageInfo(nullptr, storageImageBinding.imageView->GetHandle(), vk::ImageLayout::eGeneral));
+        getWrite(storageImageBinding.shaderBindingId).setPImageInfo(&imageInfos.back());
+      }
 
-        auto descriptorLayoutInfo = vk::DescriptorSetLayoutCreateInfo()
-          .setBindingCount(uint32_t(layoutBindings.size()))
-          .setPBindings(layoutBindings.data());
+      assert(setBindings.storageBufferBindings.size() == setLayoutKey.GetStorageBuffersCount());
+      size_t storageBufferInfosCount = 0;
+      for (const auto &storageBinding : setBindings.storageBufferBindings)
+        storageBufferInfosCount += storageBinding.descriptors.size();
+      std::vector<vk::DescriptorBufferInfo> storageBufferInfos;
+      storageBufferInfos.reserve(storageBufferInfosCount);
+      for (const auto &storageBinding : setBindings.storageBufferBindings)
+      {
+        size_t firstInfoIndex = storageBufferInfos.size();
+        for (const auto &descriptor : storageBinding.descriptors)
+          storageBufferInfos.push_back(vk::DescriptorBufferInfo(descriptor.buffer->GetHandle(), descriptor.offset, descriptor.size));
+        auto &setWrite = getWrite(storageBinding.shaderBindingId);
+        assert(setWrite.descriptorCount == storageBinding.descriptors.size());
+        setWrite.setPBufferInfo(storageBufferInfos.data() + firstInfoIndex);
+      }
 
-        descriptorSetLayout = logicalDevice.createDescriptorSetLayoutUnique(descriptorLayoutInfo);
+      assert(setBindings.accelerationStructureBindings.size() == setLayoutKey.GetAccelerationStructuresCount());
+      std::vector<vk::AccelerationStructureKHR> accelerationStructures;
+      std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> accelerationStructureWrites;
+      accelerationStructures.reserve(setBindings.accelerationStructureBindings.size());
+      accelerationStructureWrites.reserve(setBindings.accelerationStructureBindings.size());
+      for (const auto &accelerationStructureBinding : setBindings.accelerationStructureBindings)
+      {
+        accelerationStructures.push_back(accelerationStructureBinding.accelerationStructure->GetHandle());
+        accelerationStructureWrites.push_back(vk::WriteDescriptorSetAccelerationStructureKHR()
+          .setAccelerationStructureCount(1)
+          .setPAccelerationStructures(&accelerationStructures.back()));
+        getWrite(accelerationStructureBinding.shaderBindingId).setPNext(&accelerationStructureWrites.back());
       }
-      return descriptorSetLayout.get();
+
+      commandBuffer.pushDescriptorSetKHR(bindPoint, pipelineLayout, setIndex, setWrites);
     }
 
     vk::DescriptorSet GetDescriptorSet(
-      legit::DescriptorSetLayoutKey setLayoutKey,
+      const legit::DescriptorSetLayoutKey &setLayoutKey,
       const std::vector<UniformBufferBinding> &uniformBufferBindings,
       const std::vector<StorageBufferBinding> &storageBufferBindings,
       const std::vector<ImageSamplerBinding> &imageSamplerBindings)
     {
-      auto setBindings = legit::DescriptorSetBindings()
+      auto setBindings = legit::DescriptorSetBindingsView()
         .SetUniformBufferBindings(uniformBufferBindings)
         .SetStorageBufferBindings(storageBufferBindings)
         .SetImageSamplerBindings(imageSamplerBindings);
       return GetDescriptorSet(setLayoutKey, setBindings);
     }
-    vk::DescriptorSet GetDescriptorSet(legit::DescriptorSetLayoutKey setLayoutKey, const legit::DescriptorSetBindings &setBindings)
+    vk::DescriptorSet GetDescriptorSet(const legit::DescriptorSetLayoutKey &setLayoutKey, const legit::DescriptorSetBindings &setBindings)
     {
-      DescriptorSetKey key;
-      key.bindings = setBindings;
-      key.layout = GetDescriptorSetLayout(setLayoutKey);
-      
-      auto &descriptorSet = descriptorSetCache[key];
-      if (!descriptorSet)
+      return GetDescriptorSet(setLayoutKey, DescriptorSetBindingsView(setBindings));
+    }
+    //safe to call from several recording threads at once. bindings are only copied when the set is not in the cache yet
+    vk::DescriptorSet GetDescriptorSet(const legit::DescriptorSetLayoutKey &setLayoutKey, const legit::DescriptorSetBindingsView &bindingsView)
+    {
+      assert(!descriptorBuffer); //sets are bound with BindDescriptorBufferSet() instead
+      //hashing doesn't need the lock
+      uint64_t bindingsHash = HashBindings(bindingsView);
+
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      auto &layoutData = GetLayoutData(setLayoutKey);
+      auto layout = layoutData.layout.get();
+      uint64_t hash = HashCombine(bindingsHash, uint64_t(static_cast<VkDescriptorSetLayout>(layout)));
+
+      auto *slot = FindSlot(hash, layout, bindingsView);
+      if (slot)
       {
-        auto setAllocInfo = vk::DescriptorSetAllocateInfo()
-          .setDescriptorPool(this->descriptorPool.get())
-          .setDescriptorSetCount(1)
-          .setPSetLayouts(&key.layout);
+        slot->entry.lastUsedFrameIndex = currFrameIndex;
+        return slot->entry.descriptorSet;
+      }
 
-        descriptorSet = std::move(logicalDevice.allocateDescriptorSetsUnique(setAllocInfo)[0]);
+      slot = &InsertSlot(hash, layout, bindingsView);
+      auto &cacheEntry = slot->entry;
+      cacheEntry.lastUsedFrameIndex = currFrameIndex;
+      {
+        cacheEntry.descriptorSet = AllocateDescriptorSet(layout, cacheEntry.poolIndex);
+        WriteDescriptorSet(cacheEntry.descriptorSet, layoutData, setLayoutKey, DescriptorSetBindingsView(slot->key.bindings));
+      }
+      return cacheEntry.descriptorSet;
+    }
 
-        std::vector<vk::WriteDescriptorSet> setWrites;
+    //pools have to outlive their use here, pass null before destroying the current one
+    std::unique_ptr<legit::TransientDescriptorPool> CreateTransientDescriptorPool()
+    {
+      return std::unique_ptr<legit::TransientDescriptorPool>(new legit::TransientDescriptorPool(logicalDevice, GetPoolDescriptorTypes()));
+    }
+    //sets from GetTransientDescriptorSet() come from this pool until the next call
+    void SetTransientDescriptorPool(legit::TransientDescriptorPool *transientDescriptorPool)
+    {
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      this->transientDescriptorPool = transientDescriptorPool;
+    }
+    //for sets that are used once, e.g. one-off dispatches: nothing is hashed or cached and the set is only valid during the current frame.
+    //falls back to GetDescriptorSet() when no transient pool is set
+    vk::DescriptorSet GetTransientDescriptorSet(const legit::DescriptorSetLayoutKey &setLayoutKey, const legit::DescriptorSetBindingsView &setBindings)
+    {
+      assert(!descriptorBuffer);
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      if (!transientDescriptorPool)
+        return GetDescriptorSet(setLayoutKey, setBindings);
 
-        assert(setLayoutKey.GetUniformBuffersCount() == setBindings.uniformBufferBindings.size());
-        std::vector<vk::DescriptorBufferInfo> uniformBufferInfos(setBindings.uniformBufferBindings.size()); //cannot be kept in local variable
-        for (size_t uniformBufferIndex = 0; uniformBufferIndex < setBindings.uniformBufferBindings.size(); uniformBufferIndex++)
-        {
-          auto &uniformBinding = setBindings.uniformBufferBindings[uniformBufferIndex];
+      auto &layoutData = GetLayoutData(setLayoutKey);
+      auto descriptorSet = transientDescriptorPool->Allocate(layoutData.layout.get());
+      WriteDescriptorSet(descriptorSet, layoutData, setLayoutKey, setBindings);
+      transientSetsCount++;
+      return descriptorSet;
+    }
 
+    void Clear()
+    {
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      this->cacheSlots.clear();
+      this->occupiedSlotsCount = 0;
+      this->deletedSlotsCount = 0;
+      this->descriptorSetLayoutCache.clear();
+      this->pushDescriptorLayouts.clear();
+      this->pools.clear();
+      this->freePoolIndices.clear();
+      this->currPoolIndex = size_t(-1);
+    }
+  private:
+    //one blob element per descriptor, the update template reads them with a fixed stride
+    union DescriptorData
+    {
+      VkDescriptorImageInfo imageInfo;
+      VkDescriptorBufferInfo bufferInfo;
+      VkAccelerationStructureKHR accelerationStructure;
+    };
+
+    //the update template is precomputed together with the layout, so filling a set is a single template update
+    struct LayoutData
+    {
+      vk::UniqueDescriptorSetLayout layout;
+      vk::UniqueDescriptorUpdateTemplate updateTemplate; //null if the set has no bindings
+      std::vector<uint32_t> bindingToDescriptorIndex; //first blob element of every binding
+      std::vector<uint32_t> bindingDescriptorsCounts;
+      size_t descriptorsCount = 0;
+      vk::DeviceSize descriptorBufferSize = 0; //only with a descriptor buffer, which doesn't use the template
+      std::vector<vk::DeviceSize> bindingOffsets;
+    };
+    const LayoutData &GetLayoutData(const legit::DescriptorSetLayoutKey &descriptorSetLayoutKey)
+    {
+      assert(!descriptorSetLayoutKey.IsBindless()); //those sets come from BindlessDescriptorSet
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      auto &layoutData = descriptorSetLayoutCache[descriptorSetLayoutKey];
+      if (layoutData.layout)
+        return layoutData;
+
+      if (descriptorBuffer)
+      {
+        auto layoutBindings = GetLayoutBindings(descriptorSetLayoutKey, vk::DescriptorType::eUniformBuffer);
+        layoutData.layout = CreateDescriptorSetLayout(layoutBindings, vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT);
+        layoutData.descriptorBufferSize = logicalDevice.getDescriptorSetLayoutSizeEXT(layoutData.layout.get());
+        for (const auto &layoutBinding : layoutBindings)
+        {
+          if (layoutBinding.binding >= layoutData.bindingOffsets.size())
           {
-            auto uniformBufferId = setLayoutKey.GetUniformBufferId(uniformBinding.shaderBindingId);
-            assert(uniformBufferId.IsValid());
-            auto uniformBufferData = setLayoutKey.GetUniformBufferInfo(uniformBufferId);
-            assert(uniformBufferData.size == uniformBinding.size);
+            layoutData.bindingOffsets.resize(layoutBinding.binding + 1, 0);
+            layoutData.bindingDescriptorsCounts.resize(layoutBinding.binding + 1, 0);
           }
+          layoutData.bindingOffsets[layoutBinding.binding] = logicalDevice.getDescriptorSetLayoutBindingOffsetEXT(layoutData.layout.get(), layoutBinding.binding);
+          layoutData.bindingDescriptorsCounts[layoutBinding.binding] = layoutBinding.descriptorCount;
+        }
+        return layoutData;
+      }
 
-          uniformBufferInfos[uniformBufferIndex] = vk::DescriptorBufferInfo()
-            .setBuffer(uniformBinding.buffer->GetHandle())
-            .setOffset(uniformBinding.offset)
-            .setRange(uniformBinding.size);
-
-          auto setWrite = vk::WriteDescriptorSet()
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
-            .setDstBinding(uniformBinding.shaderBindingId)
-            .setDstSet(descriptorSet.get())
-            .setPBufferInfo(&uniformBufferInfos[uniformBufferIndex]);
+      auto layoutBindings = GetLayoutBindings(descriptorSetLayoutKey, vk::DescriptorType::eUniformBufferDynamic);
+      layoutData.layout = CreateDescriptorSetLayout(layoutBindings, vk::DescriptorSetLayoutCreateFlags());
 
-          setWrites.push_back(setWrite);
+      std::vector<vk::DescriptorUpdateTemplateEntry> templateEntries;
+      for (const auto &layoutBinding : layoutBindings)
+      {
+        if (layoutBinding.binding >= layoutData.bindingToDescriptorIndex.size())
+        {
+          layoutData.bindingToDescriptorIndex.resize(layoutBinding.binding + 1, uint32_t(-1));
+          layoutData.bindingDescriptorsCounts.resize(layoutBinding.binding + 1, 0);
         }
+        layoutData.bindingToDescriptorIndex[layoutBinding.binding] = uint32_t(layoutData.descriptorsCount);
+        layoutData.bindingDescriptorsCounts[layoutBinding.binding] = layoutBinding.descriptorCount;
+        templateEntries.push_back(vk::DescriptorUpdateTemplateEntry()
+          .setDstBinding(layoutBinding.binding)
+          .setDstArrayElement(0)
+          .setDescriptorCount(layoutBinding.descriptorCount)
+          .setDescriptorType(layoutBinding.descriptorType)
+          .setOffset(layoutData.descriptorsCount * sizeof(DescriptorData))
+          .setStride(sizeof(DescriptorData)));
+        layoutData.descriptorsCount += layoutBinding.descriptorCount;
+      }
 
-        assert(setBindings.imageSamplerBindings.size() == setLayoutKey.GetImageSamplersCount());
-        std::vector<vk::DescriptorImageInfo> imageSamplerInfos(setBindings.imageSamplerBindings.size());
-        for (size_t imageSamplerIndex = 0; imageSamplerIndex < setBindings.imageSamplerBindings.size(); imageSamplerIndex++)
+      if (templateEntries.size() > 0)
+      {
+        auto templateCreateInfo = vk::DescriptorUpdateTemplateCreateInfo()
+          .setDescriptorUpdateEntryCount(uint32_t(templateEntries.size()))
+          .setPDescriptorUpdateEntries(templateEntries.data())
+          .setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet)
+          .setDescriptorSetLayout(layoutData.layout.get());
+        layoutData.updateTemplate = logicalDevice.createDescriptorUpdateTemplateUnique(templateCreateInfo);
+      }
+      return layoutData;
+    }
+    void WriteDescriptorSet(vk::DescriptorSet descriptorSet, const LayoutData &layoutData, const legit::DescriptorSetLayoutKey &setLayoutKey, const legit::DescriptorSetBindingsView &setBindings)
+    {
+      assert(setBindings.uniformBufferBindings.size() == setLayoutKey.GetUniformBuffersCount());
+      assert(setBindings.imageSamplerBindings.size() == setLayoutKey.GetImageSamplersCount());
+      assert(setBindings.textureBindings.size() == setLayoutKey.GetTexturesCount());
+      assert(setBindings.samplerBindings.size() == setLayoutKey.GetSamplersCount());
+      assert(setBindings.storageBufferBindings.size() == setLayoutKey.GetStorageBuffersCount());
+      assert(setBindings.storageImageBindings.size() == setLayoutKey.GetStorageImagesCount());
+      assert(setBindings.accelerationStructureBindings.size() == setLayoutKey.GetAccelerationStructuresCount());
+
+      //every descriptor goes straight to the blob slot precomputed for its binding, the template does the rest
+      templateData.resize(layoutData.descriptorsCount);
+      for (const auto &uniformBinding : setBindings.uniformBufferBindings)
+      {
+        auto &bufferInfo = GetTemplateData(layoutData, uniformBinding.shaderBindingId).bufferInfo;
+        bufferInfo.buffer = static_cast<VkBuffer>(uniformBinding.buffer->GetHandle());
+        bufferInfo.offset = uniformBinding.offset;
+        bufferInfo.range = uniformBinding.size;
+      }
+      for (const auto &imageSamplerBinding : setBindings.imageSamplerBindings)
+      {
+        auto &imageInfo = GetTemplateData(layoutData, imageSamplerBinding.shaderBindingId).imageInfo;
+        imageInfo.sampler = static_cast<VkSampler>(imageSamplerBinding.sampler->GetHandle());
+        imageInfo.imageView = static_cast<VkImageView>(imageSamplerBinding.imageView->GetHandle());
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      }
+      for (const auto &textureBinding : setBindings.textureBindings)
+      {
+        auto &imageInfo = GetTemplateData(layoutData, textureBinding.shaderBindingId).imageInfo;
+        imageInfo.sampler = VK_NULL_HANDLE;
+        imageInfo.imageView = static_cast<VkImageView>(textureBinding.imageView->GetHandle());
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      }
+      for (const auto &samplerBinding : setBindings.samplerBindings)
+      {
+        auto &imageInfo = GetTemplateData(layoutData, samplerBinding.shaderBindingId).imageInfo;
+        imageInfo.sampler = static_cast<VkSampler>(samplerBinding.sampler->GetHandle());
+        imageInfo.imageView = VK_NULL_HANDLE;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      }
+      for (const auto &storageBinding : setBindings.storageBufferBindings)
+      {
+        assert(storageBinding.descriptors.size() > 0);
+        size_t firstDescriptorIndex = GetTemplateDataIndex(layoutData, storageBinding.shaderBindingId);
+        uint32_t layoutDescriptorsCount = layoutData.bindingDescriptorsCounts[storageBinding.shaderBindingId];
+        assert(storageBinding.descriptors.size() <= layoutDescriptorsCount);
+        //the template always writes the whole array, the tail that isn't bound repeats the last descriptor so that no element is left invalid
+        for (uint32_t descIdx = 0; descIdx < layoutDescriptorsCount; descIdx++)
         {
-          auto &imageSamplerBinding = setBindings.imageSamplerBindings[imageSamplerIndex];
+          auto &descriptor = storageBinding.descriptors[std::min<size_t>(descIdx, storageBinding.descriptors.size() - 1)];
+          auto &bufferInfo = templateData[firstDescriptorIndex + descIdx].bufferInfo;
+          bufferInfo.buffer = static_cast<VkBuffer>(descriptor.buffer->GetHandle());
+          bufferInfo.offset = descriptor.offset;
+          bufferInfo.range = descriptor.size;
+        }
+      }
+      for (const auto &storageBinding : setBindings.storageImageBindings)
+      {
+        auto &imageInfo = GetTemplateData(layoutData, storageBinding.shaderBindingId).imageInfo;
+        imageInfo.sampler = VK_NULL_HANDLE;
+        imageInfo.imageView = static_cast<VkImageView>(storageBinding.imageView->GetHandle());
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+      }
+      for (const auto &accelerationStructureBinding : setBindings.accelerationStructureBindings)
+      {
+        GetTemplateData(layoutData, accelerationStructureBinding.shaderBindingId).accelerationStructure = static_cast<VkAccelerationStructureKHR>(accelerationStructureBinding.accelerationStructure->GetHandle());
+      }
 
-          {
-            auto imageSamplerId = setLayoutKey.GetImageSamplerId(imageSamplerBinding.shaderBindingId);
-            assert(imageSamplerId.IsValid());
-            auto imageSamplerData = setLayoutKey.GetImageSamplerInfo(imageSamplerId);
-          }
+      if (layoutData.updateTemplate)
+        //the cast picks the raw pointer overload, the templated one would write from the address of the pointer itself
+        logicalDevice.updateDescriptorSetWithTemplate(descriptorSet, layoutData.updateTemplate.get(), static_cast<const void*>(templateData.data()));
+    }
+    size_t GetTemplateDataIndex(const LayoutData &layoutData, uint32_t shaderBindingId)
+    {
+      assert(shaderBindingId < layoutData.bindingToDescriptorIndex.size() && layoutData.bindingToDescriptorIndex[shaderBindingId] != uint32_t(-1));
+      return layoutData.bindingToDescriptorIndex[shaderBindingId];
+    }
+    DescriptorData &GetTemplateData(const LayoutData &layoutData, uint32_t shaderBindingId)
+    {
+      return templateData[GetTemplateDataIndex(layoutData, shaderBindingId)];
+    }
 
-          imageSamplerInfos[imageSamplerIndex] = vk::DescriptorImageInfo()
-            .setImageView(imageSamplerBinding.imageView->GetHandle())
-            .setSampler(imageSamplerBinding.sampler->GetHandle())
-            .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+    //one write per binding with everything but the descriptor info pointers filled in, built once per layout
+    struct PushDescriptorLayout
+    {
+      vk::UniqueDescriptorSetLayout layout;
+      std::vector<vk::WriteDescriptorSet> writesTemplate;
+      std::vector<uint32_t> bindingToWriteIndex;
+    };
+    const PushDescriptorLayout &GetPushDescriptorLayout(const legit::DescriptorSetLayoutKey &descriptorSetLayoutKey)
+    {
+      assert(!descriptorSetLayoutKey.IsBindless());
+      std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+      auto &pushLayout = pushDescriptorLayouts[descriptorSetLayoutKey];
+      if (pushLayout.layout)
+        return pushLayout;
 
-          //auto imageInfo 
-          auto setWrite = vk::WriteDescriptorSet()
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-            .setDstBinding(imageSamplerBinding.shaderBindingId)
-            .setDstSet(descriptorSet.get())
-            .setPImageInfo(&imageSamplerInfos[imageSamplerIndex]);
+      pushLayout.layout = CreateDescriptorSetLayout(GetLayoutBindings(descriptorSetLayoutKey, vk::DescriptorType::eUniformBuffer), vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR);
+      auto addWrite = [&](uint32_t shaderBindingIndex, vk::DescriptorType descriptorType, uint32_t descriptorCount)
+      {
+        if (shaderBindingIndex >= pushLayout.bindingToWriteIndex.size())
+          pushLayout.bindingToWriteIndex.resize(shaderBindingIndex + 1, uint32_t(-1));
+        pushLayout.bindingToWriteIndex[shaderBindingIndex] = uint32_t(pushLayout.writesTemplate.size());
+        pushLayout.writesTemplate.push_back(vk::WriteDescriptorSet()
+          .setDstBinding(shaderBindingIndex)
+          .setDescriptorType(descriptorType)
+          .setDescriptorCount(descriptorCount));
+      };
+      std::vector<legit::DescriptorSetLayoutKey::UniformBufferId> uniformBufferIds(descriptorSetLayoutKey.GetUniformBuffersCount());
+      descriptorSetLayoutKey.GetUniformBufferIds(uniformBufferIds.data());
+      for (auto uniformBufferId : uniformBufferIds)
+        addWrite(descriptorSetLayoutKey.GetUniformBufferInfo(uniformBufferId).shaderBindingIndex, vk::DescriptorType::eUniformBuffer, 1);
+      std::vector<legit::DescriptorSetLayoutKey::StorageBufferId> storageBufferIds(descriptorSetLayoutKey.GetStorageBuffersCount());
+      descriptorSetLayoutKey.GetStorageBufferIds(storageBufferIds.data());
+      for (auto storageBufferId : storageBufferIds)
+      {
+        auto storageBufferInfo = descriptorSetLayoutKey.GetStorageBufferInfo(storageBufferId);
+        addWrite(storageBufferInfo.shaderBindingIndex, vk::DescriptorType::eStorageBuffer, storageBufferInfo.count);
+      }
+      std::vector<legit::DescriptorSetLayoutKey::ImageSamplerId> imageSamplerIds(descriptorSetLayoutKey.GetImageSamplersCount());
+      descriptorSetLayoutKey.GetImageSamplerIds(imageSamplerIds.data());
+      for (auto imageSamplerId : imageSamplerIds)
+        addWrite(descriptorSetLayoutKey.GetImageSamplerInfo(imageSamplerId).shaderBindingIndex, vk::DescriptorType::eCombinedImageSampler, 1);
+      std::vector<legit::DescriptorSetLayoutKey::TextureId> textureIds(descriptorSetLayoutKey.GetTexturesCount());
+      descriptorSetLayoutKey.GetTextureIds(textureIds.data());
+      for (auto textureId : textureIds)
+        addWrite(descriptorSetLayoutKey.GetTextureInfo(textureId).shaderBindingIndex, vk::DescriptorType::eSampledImage, 1);
+      std::vector<legit::DescriptorSetLayoutKey::SamplerId> samplerIds(descriptorSetLayoutKey.GetSamplersCount());
+      descriptorSetLayoutKey.GetSamplerIds(samplerIds.data());
+      for (auto samplerId : samplerIds)
+        addWrite(descriptorSetLayoutKey.GetSamplerInfo(samplerId).shaderBindingIndex, vk::DescriptorType::eSampler, 1);
+      std::vector<legit::DescriptorSetLayoutKey::StorageImageId> storageImageIds(descriptorSetLayoutKey.GetStorageImagesCount());
+      descriptorSetLayoutKey.GetStorageImageIds(storageImageIds.data());
+      for (auto storageImageId : storageImageIds)
+        addWrite(descriptorSetLayoutKey.GetStorageImageInfo(storageImageId).shaderBindingIndex, vk::DescriptorType::eStorageImage, 1);
+      std::vector<legit::DescriptorSetLayoutKey::AccelerationStructureId> accelerationStructureIds(descriptorSetLayoutKey.GetAccelerationStructuresCount());
+      descriptorSetLayoutKey.GetAccelerationStructureIds(accelerationStructureIds.data());
+      for (auto accelerationStructureId : accelerationStructureIds)
+        addWrite(descriptorSetLayoutKey.GetAccelerationStructureInfo(accelerationStructureId).shaderBindingIndex, vk::DescriptorType::eAccelerationStructureKHR, 1);
+      return pushLayout;
+    }
 
-          setWrites.push_back(setWrite);
-        }
+    struct DescriptorPool
+    {
+      vk::UniqueDescriptorPool pool;
+      size_t allocatedSetsCount = 0; //sets are never freed one by one, the whole pool is reset once all of them are evicted
+      size_t aliveSetsCount = 0;
+    };
 
-        assert(setBindings.textureBindings.size() == setLayoutKey.GetTexturesCount());
-        std::vector<vk::DescriptorImageInfo> textureInfos(setBindings.textureBindings.size());
-        for (size_t textureIndex = 0; textureIndex < setBindings.textureBindings.size(); textureIndex++)
-        {
-          auto &textureBinding = setBindings.textureBindings[textureIndex];
+    //uniform buffers are dynamic only in pooled sets, push descriptors and descriptor buffers bake their offsets into the descriptors
+    static std::vector<vk::DescriptorSetLayoutBinding> GetLayoutBindings(const legit::DescriptorSetLayoutKey &descriptorSetLayoutKey, vk::DescriptorType uniformBufferType)
+    {
+      std::vector<vk::DescriptorSetLayoutBinding> layoutBindings;
 
-          {
-            auto textureId = setLayoutKey.GetTextureId(textureBinding.shaderBindingId);
-            assert(textureId.IsValid());
-            auto textureData = setLayoutKey.GetTextureInfo(textureId);
-          }
+      std::vector<legit::DescriptorSetLayoutKey::UniformBufferId> uniformBufferIds;
+      uniformBufferIds.resize(descriptorSetLayoutKey.GetUniformBuffersCount());
+      descriptorSetLayoutKey.GetUniformBufferIds(uniformBufferIds.data());
 
-          textureInfos[textureIndex] = vk::DescriptorImageInfo()
-            .setImageView(textureBinding.imageView->GetHandle())
-            .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+      for (auto uniformBufferId : uniformBufferIds)
+      {
+        auto bufferInfo = descriptorSetLayoutKey.GetUniformBufferInfo(uniformBufferId);
+        auto bufferLayoutBinding = vk::DescriptorSetLayoutBinding()
+          .setBinding(bufferInfo.shaderBindingIndex)
+          .setDescriptorCount(1) //if this is an array of buffers
+          .setDescriptorType(uniformBufferType)
+          .setStageFlags(bufferInfo.stageFlags);
+        layoutBindings.push_back(bufferLayoutBinding);
+      }
 
-          //auto imageInfo 
-          auto setWrite = vk::WriteDescriptorSet()
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eSampledImage)
-            .setDstBinding(textureBinding.shaderBindingId)
-            .setDstSet(descriptorSet.get())
-            .setPImageInfo(&textureInfos[textureIndex]);
+      std::vector<legit::DescriptorSetLayoutKey::StorageBufferId> storageBufferIds;
+      storageBufferIds.resize(descriptorSetLayoutKey.GetStorageBuffersCount());
+      descriptorSetLayoutKey.GetStorageBufferIds(storageBufferIds.data());
 
-          setWrites.push_back(setWrite);
-        }
-        
-        assert(setBindings.samplerBindings.size() == setLayoutKey.GetSamplersCount());
-        std::vector<vk::DescriptorImageInfo> samplerInfos(setBindings.samplerBindings.size());
-        for (size_t samplerIndex = 0; samplerIndex < setBindings.samplerBindings.size(); samplerIndex++)
-        {
-          auto &samplerBinding = setBindings.samplerBindings[samplerIndex];
+      for (auto storageBufferId : storageBufferIds)
+      {
+        auto bufferInfo = descriptorSetLayoutKey.GetStorageBufferInfo(storageBufferId);
+        auto bufferLayoutBinding = vk::DescriptorSetLayoutBinding()
+          .setBinding(bufferInfo.shaderBindingIndex)
+          .setDescriptorCount(bufferInfo.count)
+          .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+          .setStageFlags(bufferInfo.stageFlags);
+        layoutBindings.push_back(bufferLayoutBinding);
+      }
 
-          {
-            auto samplerId = setLayoutKey.GetSamplerId(samplerBinding.shaderBindingId);
-            assert(samplerId.IsValid());
-            auto samplerData = setLayoutKey.GetSamplerInfo(samplerId);
-          }
+      std::vector<legit::DescriptorSetLayoutKey::ImageSamplerId> imageSamplerIds;
+      imageSamplerIds.resize(descriptorSetLayoutKey.GetImageSamplersCount());
+      descriptorSetLayoutKey.GetImageSamplerIds(imageSamplerIds.data());
 
-          samplerInfos[samplerIndex] = vk::DescriptorImageInfo()
-            .setSampler(samplerBinding.sampler->GetHandle())
-            .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-
-          //auto imageInfo 
-          auto setWrite = vk::WriteDescriptorSet()
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eSampler)
-            .setDstBinding(samplerBinding.shaderBindingId)
-            .setDstSet(descriptorSet.get())
-            .setPImageInfo(&samplerInfos[samplerIndex]);
-
-          setWrites.push_back(setWrite);
-        }        
-        
-        assert(setBindings.storageBufferBindings.size() == setLayoutKey.GetStorageBuffersCount());
-
-        size_t bufferInfosCount = 0;
-        for (size_t storageBufferIndex = 0; storageBufferIndex < setBindings.storageBufferBindings.size(); storageBufferIndex++)
-        {
-          bufferInfosCount += setBindings.storageBufferBindings[storageBufferIndex].descriptors.size();
-        }
-        std::vector<vk::DescriptorBufferInfo> storageBufferInfos(bufferInfosCount);
+      for (auto imageSamplerId : imageSamplerIds)
+      {
+        auto imageSamplerInfo = descriptorSetLayoutKey.GetImageSamplerInfo(imageSamplerId);
 
-        size_t bufferInfoStart = 0;
-        for (size_t storageBufferIndex = 0; storageBufferIndex < setBindings.storageBufferBindings.size(); storageBufferIndex++)
-        {
-          auto &storageBinding = setBindings.storageBufferBindings[storageBufferIndex];
+        auto imageSamplerLayoutBinding = vk::DescriptorSetLayoutBinding()
+          .setBinding(imageSamplerInfo.shaderBindingIndex)
+          .setDescriptorCount(1) //if this is an array of image samplers
+          .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+          .setStageFlags(imageSamplerInfo.stageFlags);
+        layoutBindings.push_back(imageSamplerLayoutBinding);
+      }
+      
+      std::vector<legit::DescriptorSetLayoutKey::TextureId> textureIds;
+      textureIds.resize(descriptorSetLayoutKey.GetTexturesCount());
+      descriptorSetLayoutKey.GetTextureIds(textureIds.data());
 
-          {
-            auto storageBufferId = setLayoutKey.GetStorageBufferId(storageBinding.shaderBindingId);
-            assert(storageBufferId.IsValid());
-            auto storageBufferData = setLayoutKey.GetStorageBufferInfo(storageBufferId);
-            //assert(storageBufferData.size == storageBinding.size);
-          }
+      for (auto textureId : textureIds)
+      {
+        auto textureInfo = descriptorSetLayoutKey.GetTextureInfo(textureId);
 
-          for(size_t descIdx = 0; descIdx < storageBinding.descriptors.size(); descIdx++)
-          {
-            storageBufferInfos[bufferInfoStart + descIdx] = vk::DescriptorBufferInfo()
-              .setBuffer(storageBinding.descriptors[descIdx].buffer->GetHandle())
-              .setOffset(storageBinding.descriptors[descIdx].offset)
-              .setRange(storageBinding.descriptors[descIdx].size);
-          }
-          auto setWrite = vk::WriteDescriptorSet()
-            .setDescriptorCount(storageBinding.descriptors.size())
-            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
-            .setDstBinding(storageBinding.shaderBindingId)
-            .setDstSet(descriptorSet.get())
-            .setPBufferInfo(storageBufferInfos.data() + bufferInfoStart);
-          bufferInfoStart += storageBinding.descriptors.size();
-          setWrites.push_back(setWrite);
-        }
-        assert(bufferInfoStart == bufferInfosCount);
+        auto textureLayoutBinding = vk::DescriptorSetLayoutBinding()
+          .setBinding(textureInfo.shaderBindingIndex)
+          .setDescriptorCount(1) //if this is an array of image samplers
+          .setDescriptorType(vk::DescriptorType::eSampledImage)
+          .setStageFlags(textureInfo.stageFlags);
+        layoutBindings.push_back(textureLayoutBinding);
+      }
+      
+      std::vector<legit::DescriptorSetLayoutKey::SamplerId> samplerIds;
+      samplerIds.resize(descriptorSetLayoutKey.GetSamplersCount());
+      descriptorSetLayoutKey.GetSamplerIds(samplerIds.data());
 
-        assert(setBindings.storageImageBindings.size() == setLayoutKey.GetStorageImagesCount());
-        std::vector<vk::DescriptorImageInfo> storageImageInfos(setBindings.storageImageBindings.size());
-        for (size_t storageImageIndex = 0; storageImageIndex < setBindings.storageImageBindings.size(); storageImageIndex++)
-        {
-          auto &storageBinding = setBindings.storageImageBindings[storageImageIndex];
+      for (auto samplerId : samplerIds)
+      {
+        auto samplerInfo = descriptorSetLayoutKey.GetSamplerInfo(samplerId);
 
-          {
-            auto storageImageId = setLayoutKey.GetStorageImageId(storageBinding.shaderBindingId);
-            assert(storageImageId.IsValid());
-            auto storageImageData = setLayoutKey.GetStorageImageInfo(storageImageId);
-            //assert(storageImageData.format == storageBinding.format);
-          }
+        auto samplerLayoutBinding = vk::DescriptorSetLayoutBinding()
+          .setBinding(samplerInfo.shaderBindingIndex)
+          .setDescriptorCount(1) //if this is an array of image samplers
+          .setDescriptorType(vk::DescriptorType::eSampler)
+          .setStageFlags(samplerInfo.stageFlags);
+        layoutBindings.push_back(samplerLayoutBinding);
+      }
 
-          storageImageInfos[storageImageIndex] = vk::DescriptorImageInfo()
-            .setImageView(storageBinding.imageView->GetHandle())
-            .setImageLayout(vk::ImageLayout::eGeneral);
 
-          if(setBindings.imageSamplerBindings.size() > 0)
-            storageImageInfos[storageImageIndex].setSampler(setBindings.imageSamplerBindings[0].sampler->GetHandle());
+      std::vector<legit::DescriptorSetLayoutKey::StorageImageId> storageImageIds;
+      storageImageIds.resize(descriptorSetLayoutKey.GetStorageImagesCount());
+      descriptorSetLayoutKey.GetStorageImageIds(storageImageIds.data());
 
-          auto setWrite = vk::WriteDescriptorSet()
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eStorageImage)
-            .setDstBinding(storageBinding.shaderBindingId)
-            .setDstSet(descriptorSet.get())
-            .setPImageInfo(&storageImageInfos[storageImageIndex]);
+      for (auto storageImageId : storageImageIds)
+      {
+        auto imageInfo = descriptorSetLayoutKey.GetStorageImageInfo(storageImageId);
+        auto imageLayoutBinding = vk::DescriptorSetLayoutBinding()
+          .setBinding(imageInfo.shaderBindingIndex)
+          .setDescriptorCount(1) //if this is an array of buffers
+          .setDescriptorType(vk::DescriptorType::eStorageImage)
+          .setStageFlags(imageInfo.stageFlags);
+        layoutBindings.push_back(imageLayoutBinding);
+      }
+      
+      std::vector<legit::DescriptorSetLayoutKey::AccelerationStructureId> accelerationStructureIds;
+      accelerationStructureIds.resize(descriptorSetLayoutKey.GetAccelerationStructuresCount());
+      descriptorSetLayoutKey.GetAccelerationStructureIds(accelerationStructureIds.data());
 
-          setWrites.push_back(setWrite);
-        }
-        
-        assert(setBindings.accelerationStructureBindings.size() == setLayoutKey.GetAccelerationStructuresCount());
-        std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> accelerationStructureWrites(setBindings.accelerationStructureBindings.size());
-        std::vector<vk::AccelerationStructureKHR> accelerationStructureArray(setBindings.accelerationStructureBindings.size());
-        for (size_t accelerationStructureIndex = 0; accelerationStructureIndex < setBindings.accelerationStructureBindings.size(); accelerationStructureIndex++)
-        {
-          auto &accelerationStructureBinding = setBindings.accelerationStructureBindings[accelerationStructureIndex];
+      for (auto accelerationStructureId : accelerationStructureIds)
+      {
+        auto imageInfo = descriptorSetLayoutKey.GetAccelerationStructureInfo(accelerationStructureId);
+        auto imageLayoutBinding = vk::DescriptorSetLayoutBinding()
+          .setBinding(imageInfo.shaderBindingIndex)
+          .setDescriptorCount(1)
+          .setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR)
+          .setStageFlags(imageInfo.stageFlags);
+        layoutBindings.push_back(imageLayoutBinding);
+      }
+      return layoutBindings;
+    }
+
+    vk::UniqueDescriptorSetLayout CreateDescriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding> &layoutBindings, vk::DescriptorSetLayoutCreateFlags flags)
+    {
+      auto descriptorLayoutInfo = vk::DescriptorSetLayoutCreateInfo()
+        .setBindingCount(uint32_t(layoutBindings.size()))
+        .setPBindings(layoutBindings.data())
+        .setFlags(flags);
+
+      return logicalDevice.createDescriptorSetLayoutUnique(descriptorLayoutInfo);
+    }
+
+    std::vector<vk::DescriptorType> GetPoolDescriptorTypes() const
+    {
+      std::vector<vk::DescriptorType> descriptorTypes = {
+        vk::DescriptorType::eUniformBufferDynamic,
+        vk::DescriptorType::eCombinedImageSampler,
+        vk::DescriptorType::eSampledImage,
+        vk::DescriptorType::eSampler,
+        vk::DescriptorType::eStorageBuffer,
+        vk::DescriptorType::eStorageImage };
+      if (enableRaytracing)
+        descriptorTypes.push_back(vk::DescriptorType::eAccelerationStructureKHR);
+      return descriptorTypes;
+    }
+
+    vk::UniqueDescriptorPool CreateDescriptorPool()
+    {
+      std::vector<vk::DescriptorPoolSize> poolSizes;
+      for (auto descriptorType : GetPoolDescriptorTypes())
+      {
+        poolSizes.push_back(vk::DescriptorPoolSize()
+          .setDescriptorCount(descriptorsPerPool)
+          .setType(descriptorType));
+      }
+
+      auto poolCreateInfo = vk::DescriptorPoolCreateInfo()
+        .setMaxSets(setsPerPool)
+        .setPoolSizeCount(uint32_t(poolSizes.size()))
+        .setPPoolSizes(poolSizes.data());
+      return logicalDevice.createDescriptorPoolUnique(poolCreateInfo);
+    }
+
+    //moves on to a recycled or a new pool when the current one runs out
+    vk::DescriptorSet AllocateDescriptorSet(vk::DescriptorSetLayout layout, size_t &poolIndex)
+    {
+      auto setAllocInfo = vk::DescriptorSetAllocateInfo()
+        .setDescriptorSetCount(1)
+        .setPSetLayouts(&layout);
 
+      while (true)
+      {
+        if (currPoolIndex != size_t(-1))
+        {
+          auto &pool = pools[currPoolIndex];
+          setAllocInfo.setDescriptorPool(pool.pool.get());
+          vk::DescriptorSet descriptorSet;
+          auto res = logicalDevice.allocateDescriptorSets(&setAllocInfo, &descriptorSet);
+          if (res == vk::Result::eSuccess)
           {
-            auto accelerationStructureId = setLayoutKey.GetAccelerationStructureId(accelerationStructureBinding.shaderBindingId);
-            assert(accelerationStructureId.IsValid());
-            auto accelerationStructureData = setLayoutKey.GetAccelerationStructureInfo(accelerationStructureId);
-            //assert(accelerationStructureData.format == storageBinding.format);
+            pool.allocatedSetsCount++;
+            pool.aliveSetsCount++;
+            poolIndex = currPoolIndex;
+            return descriptorSet;
           }
+          if (res != vk::Result::eErrorOutOfPoolMemory && res != vk::Result::eErrorFragmentedPool)
+            throw std::runtime_error("Failed to allocate descriptor set");
+          if (pool.allocatedSetsCount == 0)
+            throw std::runtime_error("Descriptor set does not fit into an empty pool");
+        }
 
-          accelerationStructureArray[accelerationStructureIndex] = accelerationStructureBinding.accelerationStructure->GetHandle();
-          accelerationStructureWrites[accelerationStructureIndex] = vk::WriteDescriptorSetAccelerationStructureKHR()
-            .setAccelerationStructureCount(1)
-            .setPAccelerationStructures(&accelerationStructureArray[accelerationStructureIndex]);
-            
-          auto setWrite = vk::WriteDescriptorSet()
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR)
-            .setDstBinding(accelerationStructureBinding.shaderBindingId)
-            .setDstSet(descriptorSet.get())
-            .setPNext(&accelerationStructureWrites[accelerationStructureIndex]);
-
-          setWrites.push_back(setWrite);
+        if (freePoolIndices.size() > 0)
+        {
+          currPoolIndex = freePoolIndices.back();
+          freePoolIndices.pop_back();
+        }
+        else
+        {
+          currPoolIndex = pools.size();
+          pools.emplace_back();
+          pools.back().pool = CreateDescriptorPool();
         }
-        
-        logicalDevice.updateDescriptorSets(setWrites, {});
       }
-      return descriptorSet.get();
     }
-    void Clear()
+
+    //expects cacheMutex to be locked
+    void EvictSlot(CacheSlot &slot)
     {
-      this->descriptorSetCache.clear();
-      this->descriptorSetLayoutCache.clear();
+      auto &pool = pools[slot.entry.poolIndex];
+      assert(pool.aliveSetsCount > 0);
+      pool.aliveSetsCount--;
+      stats.evictedSetsCount++;
+      //tombstone, so that probe chains going through this slot stay intact until the next rehash
+      slot.state = CacheSlot::States::Deleted;
+      slot.key = DescriptorSetKey();
+      occupiedSlotsCount--;
+      deletedSlotsCount++;
     }
-  private:
+    void EvictUnused()
+    {
+      for (auto &slot : cacheSlots)
+      {
+        if (slot.state == CacheSlot::States::Occupied && slot.entry.lastUsedFrameIndex + evictionFramesCount < currFrameIndex)
+          EvictSlot(slot);
+      }
+      //the current pool keeps being allocated from, every other empty one can be reset
+      for (size_t poolIndex = 0; poolIndex < pools.size(); poolIndex++)
+      {
+        auto &pool = pools[poolIndex];
+        if (pool.aliveSetsCount == 0 && pool.allocatedSetsCount > 0 && poolIndex != currPoolIndex)
+        {
+          logicalDevice.resetDescriptorPool(pool.pool.get());
+          pool.allocatedSetsCount = 0;
+          freePoolIndices.push_back(poolIndex);
+          stats.poolResetsCount++;
+        }
+      }
+    }
+
     struct DescriptorSetKey
     {
       vk::DescriptorSetLayout layout;
       legit::DescriptorSetBindings bindings;
-      bool operator < (const DescriptorSetKey &other) const
-      {
-        return
-          std::tie(
-            layout,
-            bindings.uniformBufferBindings,
-            bindings.imageSamplerBindings,
-            bindings.textureBindings,
-            bindings.samplerBindings,
-            bindings.storageBufferBindings,
-            bindings.storageImageBindings,
-            bindings.accelerationStructureBindings) <
-          std::tie(
-            other.layout,
-            other.bindings.uniformBufferBindings,
-            other.bindings.imageSamplerBindings,
-            other.bindings.textureBindings,
-            other.bindings.samplerBindings,
-            other.bindings.storageBufferBindings,
-            other.bindings.storageImageBindings,
-            other.bindings.accelerationStructureBindings);
-      }
     };
-    std::map<legit::DescriptorSetLayoutKey, vk::UniqueDescriptorSetLayout> descriptorSetLayoutCache;
-    vk::UniqueDescriptorPool descriptorPool;
-    std::map<DescriptorSetKey, vk::UniqueDescriptorSet> descriptorSetCache;
+    struct CacheEntry
+    {
+      vk::DescriptorSet descriptorSet;
+      size_t poolIndex;
+      uint64_t lastUsedFrameIndex;
+    };
+    //open addressing with linear probing, capacity is always a power of 2
+    struct CacheSlot
+    {
+      enum struct States
+      {
+        Empty,
+        Occupied,
+        Deleted
+      };
+      States state = States::Empty;
+      uint64_t hash = 0;
+      DescriptorSetKey key;
+      CacheEntry entry;
+    };
+
+    static uint64_t HashCombine(uint64_t hash, uint64_t value)
+    {
+      return (hash ^ value) * 1099511628211ull;
+    }
+    static uint64_t HashBinding(uint64_t hash, const UniformBufferBinding &binding)
+    {
+      hash = HashCombine(hash, uint64_t(uintptr_t(binding.buffer)));
+      hash = HashCombine(hash, binding.shaderBindingId);
+      hash = HashCombine(hash, binding.offset);
+      return HashCombine(hash, binding.size);
+    }
+    static uint64_t HashBinding(uint64_t hash, const ImageSamplerBinding &binding)
+    {
+      hash = HashCombine(hash, uint64_t(uintptr_t(binding.imageView)));
+      hash = HashCombine(hash, uint64_t(uintptr_t(binding.sampler)));
+      return HashCombine(hash, binding.shaderBindingId);
+    }
+    static uint64_t HashBinding(uint64_t hash, const TextureBinding &binding)
+    {
+      hash = HashCombine(hash, uint64_t(uintptr_t(binding.imageView)));
+      return HashCombine(hash, binding.shaderBindingId);
+    }
+    static uint64_t HashBinding(uint64_t hash, const SamplerBinding &binding)
+    {
+      hash = HashCombine(hash, uint64_t(uintptr_t(binding.sampler)));
+      return HashCombine(hash, binding.shaderBindingId);
+    }
+    static uint64_t HashBinding(uint64_t hash, const StorageBufferBinding &binding)
+    {
+      hash = HashCombine(hash, binding.shaderBindingId);
+      hash = HashCombine(hash, binding.descriptors.size());
+      for (const auto &descriptor : binding.descriptors)
+      {
+        hash = HashCombine(hash, uint64_t(uintptr_t(descriptor.buffer)));
+        hash = HashCombine(hash, descriptor.offset);
+        hash = HashCombine(hash, descriptor.size);
+      }
+      return hash;
+    }
+    static uint64_t HashBinding(uint64_t hash, const StorageImageBinding &binding)
+    {
+      hash = HashCombine(hash, uint64_t(uintptr_t(binding.imageView)));
+      return HashCombine(hash, binding.shaderBindingId);
+    }
+    static uint64_t HashBinding(uint64_t hash, const AccelerationStructureBinding &binding)
+    {
+      hash = HashCombine(hash, uint64_t(uintptr_t(binding.accelerationStructure)));
+      return HashCombine(hash, binding.shaderBindingId);
+    }
+    template<typename Binding>
+    static uint64_t HashBindings(uint64_t hash, Span<const Binding> bindings)
+    {
+      //count goes in too so that bindings can't shift between neighbouring lists
+      hash = HashCombine(hash, bindings.size());
+      for (const auto &binding : bindings)
+        hash = HashBinding(hash, binding);
+      return hash;
+    }
+    static uint64_t HashBindings(const DescriptorSetBindingsView &bindings)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      hash = HashBindings(hash, bindings.uniformBufferBindings);
+      hash = HashBindings(hash, bindings.imageSamplerBindings);
+      hash = HashBindings(hash, bindings.textureBindings);
+      hash = HashBindings(hash, bindings.samplerBindings);
+      hash = HashBindings(hash, bindings.storageBufferBindings);
+      hash = HashBindings(hash, bindings.storageImageBindings);
+      hash = HashBindings(hash, bindings.accelerationStructureBindings);
+      return hash;
+    }
+    //final avalanche, linear probing only looks at the low bits
+    static size_t GetSlotIndex(uint64_t hash, size_t slotsCount)
+    {
+      hash ^= hash >> 33;
+      hash *= 0xff51afd7ed558ccdull;
+      hash ^= hash >> 33;
+      return size_t(hash) & (slotsCount - 1);
+    }
+
+    //bindings only define operator <
+    template<typename Binding>
+    static bool AreBindingsEqual(Span<const Binding> bindings, const std::vector<Binding> &storedBindings)
+    {
+      if (bindings.size() != storedBindings.size())
+        return false;
+      return std::equal(bindings.begin(), bindings.end(), storedBindings.begin(), [](const Binding &left, const Binding &right) { return !(left < right) && !(right < left); });
+    }
+    static bool AreBindingsEqual(const DescriptorSetBindingsView &bindings, const DescriptorSetBindings &storedBindings)
+    {
+      return
+        AreBindingsEqual(bindings.uniformBufferBindings, storedBindings.uniformBufferBindings) &&
+        AreBindingsEqual(bindings.imageSamplerBindings, storedBindings.imageSamplerBindings) &&
+        AreBindingsEqual(bindings.textureBindings, storedBindings.textureBindings) &&
+        AreBindingsEqual(bindings.samplerBindings, storedBindings.samplerBindings) &&
+        AreBindingsEqual(bindings.storageBufferBindings, storedBindings.storageBufferBindings) &&
+        AreBindingsEqual(bindings.storageImageBindings, storedBindings.storageImageBindings) &&
+        AreBindingsEqual(bindings.accelerationStructureBindings, storedBindings.accelerationStructureBindings);
+    }
+
+    //expects cacheMutex to be locked
+    CacheSlot *FindSlot(uint64_t hash, vk::DescriptorSetLayout layout, const DescriptorSetBindingsView &bindings)
+    {
+      if (cacheSlots.size() == 0)
+        return nullptr;
+      //there's always at least one empty slot, so this terminates
+      for (size_t slotIndex = GetSlotIndex(hash, cacheSlots.size());; slotIndex = (slotIndex + 1) & (cacheSlots.size() - 1))
+      {
+        auto &slot = cacheSlots[slotIndex];
+        if (slot.state == CacheSlot::States::Empty)
+          return nullptr;
+        if (slot.state == CacheSlot::States::Occupied && slot.hash == hash && slot.key.layout == layout && AreBindingsEqual(bindings, slot.key.bindings))
+          return &slot;
+      }
+    }
+
+    //expects cacheMutex to be locked and the key not to be in the table yet
+    CacheSlot &InsertSlot(uint64_t hash, vk::DescriptorSetLayout layout, const DescriptorSetBindingsView &bindings)
+    {
+      if ((occupiedSlotsCount + deletedSlotsCount + 1) * 10 > cacheSlots.size() * 7)
+        Rehash();
+
+      for (size_t slotIndex = GetSlotIndex(hash, cacheSlots.size());; slotIndex = (slotIndex + 1) & (cacheSlots.size() - 1))
+      {
+        auto &slot = cacheSlots[slotIndex];
+        if (slot.state == CacheSlot::States::Occupied)
+          continue;
+        if (slot.state == CacheSlot::States::Deleted)
+          deletedSlotsCount--;
+        occupiedSlotsCount++;
+
+        slot.state = CacheSlot::States::Occupied;
+        slot.hash = hash;
+        slot.key.layout = layout;
+        slot.key.bindings.uniformBufferBindings.assign(bindings.uniformBufferBindings.begin(), bindings.uniformBufferBindings.end());
+        slot.key.bindings.imageSamplerBindings.assign(bindings.imageSamplerBindings.begin(), bindings.imageSamplerBindings.end());
+        slot.key.bindings.textureBindings.assign(bindings.textureBindings.begin(), bindings.textureBindings.end());
+        slot.key.bindings.samplerBindings.assign(bindings.samplerBindings.begin(), bindings.samplerBindings.end());
+        slot.key.bindings.storageBufferBindings.assign(bindings.storageBufferBindings.begin(), bindings.storageBufferBindings.end());
+        slot.key.bindings.storageImageBindings.assign(bindings.storageImageBindings.begin(), bindings.storageImageBindings.end());
+        slot.key.bindings.accelerationStructureBindings.assign(bindings.accelerationStructureBindings.begin(), bindings.accelerationStructureBindings.end());
+        slot.entry = CacheEntry();
+        return slot;
+      }
+    }
+
+    //drops tombstones and grows the table so that it's at most half full afterwards
+    void Rehash()
+    {
+      size_t slotsCount = std::max<size_t>(cacheSlots.size(), minSlotsCount);
+      while ((occupiedSlotsCount + 1) * 2 > slotsCount)
+        slotsCount *= 2;
+
+      std::vector<CacheSlot> oldSlots(slotsCount);
+      std::swap(oldSlots, cacheSlots);
+      for (auto &oldSlot : oldSlots)
+      {
+        if (oldSlot.state != CacheSlot::States::Occupied)
+          continue;
+        size_t slotIndex = GetSlotIndex(oldSlot.hash, cacheSlots.size());
+        while (cacheSlots[slotIndex].state == CacheSlot::States::Occupied)
+          slotIndex = (slotIndex + 1) & (cacheSlots.size() - 1);
+        cacheSlots[slotIndex] = std::move(oldSlot);
+      }
+      deletedSlotsCount = 0;
+    }
+
+    std::map<legit::DescriptorSetLayoutKey, LayoutData> descriptorSetLayoutCache; //entries are never moved, so references stay valid until Clear()
+    std::vector<DescriptorData> templateData; //scratch blob reused by every set creation, guarded by cacheMutex
+    std::map<legit::DescriptorSetLayoutKey, PushDescriptorLayout> pushDescriptorLayouts; //entries are never moved, so references stay valid until Clear()
+    std::vector<DescriptorPool> pools;
+    std::vector<size_t> freePoolIndices;
+    size_t currPoolIndex = size_t(-1);
+    static const uint32_t setsPerPool = 1000;
+    static const uint32_t descriptorsPerPool = 1000;
+
+    std::vector<CacheSlot> cacheSlots;
+    size_t occupiedSlotsCount = 0;
+    size_t deletedSlotsCount = 0;
+    static constexpr size_t minSlotsCount = 64;
+    uint64_t currFrameIndex = 0;
+    uint64_t lastEvictionFrameIndex = 0;
+    uint64_t evictionFramesCount = 120;
+    Stats stats;
+    std::recursive_mutex cacheMutex;
     vk::Device logicalDevice;
+    bool enableRaytracing;
+    bool enablePushDescriptors;
+    std::unique_ptr<legit::DescriptorBuffer> descriptorBuffer;
+    legit::TransientDescriptorPool *transientDescriptorPool = nullptr;
+    size_t transientSetsCount = 0;
+    std::atomic<size_t> pushedSetsCount{ 0 };
   };
 }
\ No newline at end of file
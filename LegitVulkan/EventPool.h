@@ -0,0 +1,42 @@
+namespace legit
+{
+  //events used by the render graph to split barriers within one frame in flight. they're handed out in order and all of them are
+  //reset together once the frame is done, the pool only grows to the largest number of events a frame has needed
+  class EventPool
+  {
+  public:
+    EventPool(vk::Device _logicalDevice) :
+      logicalDevice(_logicalDevice)
+    {
+    }
+
+    //call after the fence of the frame that used the pool has signaled
+    void Reset()
+    {
+      for (size_t eventIndex = 0; eventIndex < usedEventsCount; eventIndex++)
+        logicalDevice.resetEvent(events[eventIndex].get());
+      usedEventsCount = 0;
+    }
+
+    //unsignaled until set on the gpu
+    vk::Event GetEvent()
+    {
+      if (usedEventsCount == events.size())
+        events.push_back(logicalDevice.createEventUnique(vk::EventCreateInfo()));
+      return events[usedEventsCount++].get();
+    }
+
+    size_t GetUsedEventsCount() const
+    {
+      return usedEventsCount;
+    }
+    size_t GetEventsCount() const
+    {
+      return events.size();
+    }
+  private:
+    std::vector<vk::UniqueEvent> events;
+    size_t usedEventsCount = 0;
+    vk::Device logicalDevice;
+  };
+}
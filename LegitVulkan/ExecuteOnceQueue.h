@@ -19,6 +19,7 @@ namespace legit
     void EndCommandBuffer() const
     {
       commandBuffer->end();
+      core->GetUploadManager()->Flush();
       vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eAllCommands };
 
       auto submitInfo = vk::SubmitInfo()
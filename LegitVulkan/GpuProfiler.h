@@ -37,6 +37,11 @@ namespace legit
       timestampQuery.ResetQueryPool(frameCommandBuffer);
       return frameIndex;
     }
+    //timestamps of the following tasks go to commandBuffer, used when a frame is split into several submissions of the same queue
+    void SetFrameCommandBuffer(vk::CommandBuffer commandBuffer)
+    {
+      this->frameCommandBuffer = commandBuffer;
+    }
     void EndFrame(size_t frameId)
     {
       timestampQuery.AddTimestamp(frameCommandBuffer, profilerTasks.size(), vk::PipelineStageFlagBits::eBottomOfPipe);
@@ -77,6 +77,20 @@ namespace legit
     {
       return mipInfos[mipLevel].layerInfos[arrayLayer].baseUsageType;
     }
+    //usage the subresource was left in at the end of the last frame that used it, render graph frames start from it
+    ImageUsageTypes GetSubresourceLastUsageType(uint32_t mipLevel, uint32_t arrayLayer) const
+    {
+      return mipInfos[mipLevel].layerInfos[arrayLayer].lastUsageType;
+    }
+    //for layout changes made outside of the render graph
+    void SetLastUsageType(ImageUsageTypes usageType)
+    {
+      for (auto &mipInfo : mipInfos)
+      {
+        for (auto &layerInfo : mipInfo.layerInfos)
+          layerInfo.lastUsageType = usageType;
+      }
+    }
     bool operator <(const ImageData &other) const
     {
       return std::tie(imageHandle) < std::tie(other.imageHandle);
@@ -107,6 +121,7 @@ namespace legit
         for (size_t layerIndex = 0; layerIndex < arrayLayersCount; layerIndex++)
         {
           mipInfo.layerInfos[layerIndex].baseUsageType = baseUsageType;
+          mipInfo.layerInfos[layerIndex].lastUsageType = baseUsageType;
         }
         mipInfos.push_back(mipInfo);
       }
@@ -125,6 +140,7 @@ namespace legit
     struct SubImageInfo
     {
       legit::ImageUsageTypes baseUsageType;
+      mutable legit::ImageUsageTypes lastUsageType; //written by StateTracker through const pointers
     };
     struct MipInfo
     {
@@ -144,6 +160,7 @@ namespace legit
     friend class legit::Image;
     friend class legit::Swapchain;
     friend class Core;
+    friend struct StateTracker;
   };
   
   static void AddTransitionBarrier(legit::ImageData *imageData, legit::ImageUsageTypes srcUsageType, legit::ImageUsageTypes dstUsageType, vk::CommandBuffer commandBuffer)
@@ -194,7 +211,7 @@ namespace legit
     }
     vk::DeviceMemory GetMemory()
     {
-      return imageMemory.get();
+      return allocation.Get().memory ? allocation.Get().memory : imageMemory.get();
     }
 
     static vk::ImageCreateInfo CreateInfo1d(glm::uint size, uint32_t mipsCount, uint32_t arrayLayersCount, vk::Format format, vk::ImageUsageFlags usage)
@@ -279,29 +296,67 @@ namespace legit
       Init(physicalDevice, logicalDevice, imageInfo, memFlags, baseUsageType);
       AddTransitionBarrier(GetImageData(), legit::ImageUsageTypes::Unknown, baseUsageType, commandBuffer);
     }
+    Image(legit::MemoryAllocator *memoryAllocator, vk::ImageCreateInfo imageInfo, vk::MemoryPropertyFlags memFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, legit::MemoryAllocator::AllocationTypes allocationType = legit::MemoryAllocator::AllocationTypes::Pooled)
+    {
+      Init(memoryAllocator, imageInfo, memFlags, legit::ImageUsageTypes::None, allocationType);
+    }
+    Image(legit::MemoryAllocator *memoryAllocator, vk::ImageCreateInfo imageInfo, vk::CommandBuffer commandBuffer, legit::ImageUsageTypes baseUsageType, vk::MemoryPropertyFlags memFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, legit::MemoryAllocator::AllocationTypes allocationType = legit::MemoryAllocator::AllocationTypes::Pooled)
+    {
+      Init(memoryAllocator, imageInfo, memFlags, baseUsageType, allocationType);
+      AddTransitionBarrier(GetImageData(), legit::ImageUsageTypes::Unknown, baseUsageType, commandBuffer);
+    }
+    //image without its own memory, it has to be placed into externally owned memory with BindMemory() before use
+    Image(vk::Device logicalDevice, vk::ImageCreateInfo imageInfo)
+    {
+      CreateImage(logicalDevice, imageInfo, legit::ImageUsageTypes::None);
+    }
+    vk::MemoryRequirements GetMemoryRequirements() const
+    {
+      return memoryRequirements;
+    }
+    void BindMemory(vk::Device logicalDevice, vk::DeviceMemory memory, vk::DeviceSize offset)
+    {
+      assert(!imageMemory && !allocation.Get().memory);
+      logicalDevice.bindImageMemory(imageHandle.get(), memory, offset);
+    }
   private:
     void Init(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, vk::ImageCreateInfo imageInfo, vk::MemoryPropertyFlags memFlags, legit::ImageUsageTypes baseUsageType)
     {
-      imageHandle = logicalDevice.createImageUnique(imageInfo);
-      glm::uvec3 size = { imageInfo.extent.width, imageInfo.extent.height, imageInfo.extent.depth };
-
-      imageData.reset(new legit::ImageData(imageHandle.get(), imageInfo.imageType, size, imageInfo.mipLevels, imageInfo.arrayLayers, imageInfo.format, baseUsageType));
-
-      vk::MemoryRequirements imageMemRequirements = logicalDevice.getImageMemoryRequirements(imageHandle.get());
-
-      this->bytesPerPixelAvg = double(imageMemRequirements.size) / double(imageInfo.extent.width * imageInfo.extent.height * imageInfo.extent.depth * imageInfo.arrayLayers); //does not count mips. for padding checks
+      CreateImage(logicalDevice, imageInfo, baseUsageType);
 
       auto allocInfo = vk::MemoryAllocateInfo()
-        .setAllocationSize(imageMemRequirements.size)
-        .setMemoryTypeIndex(legit::FindMemoryTypeIndex(physicalDevice, imageMemRequirements.memoryTypeBits, memFlags));
+        .setAllocationSize(memoryRequirements.size)
+        .setMemoryTypeIndex(legit::FindMemoryTypeIndex(physicalDevice, memoryRequirements.memoryTypeBits, memFlags));
 
       imageMemory = logicalDevice.allocateMemoryUnique(allocInfo);
 
       logicalDevice.bindImageMemory(imageHandle.get(), imageMemory.get(), 0);
     }
+    void Init(legit::MemoryAllocator *memoryAllocator, vk::ImageCreateInfo imageInfo, vk::MemoryPropertyFlags memFlags, legit::ImageUsageTypes baseUsageType, legit::MemoryAllocator::AllocationTypes allocationType)
+    {
+      vk::Device logicalDevice = memoryAllocator->GetLogicalDevice();
+      CreateImage(logicalDevice, imageInfo, baseUsageType);
+
+      bool isLinearResource = imageInfo.tiling == vk::ImageTiling::eLinear;
+      allocation = memoryAllocator->Allocate(memoryRequirements, memFlags, isLinearResource, false, allocationType);
+      logicalDevice.bindImageMemory(imageHandle.get(), allocation->memory, allocation->offset);
+    }
+    void CreateImage(vk::Device logicalDevice, vk::ImageCreateInfo imageInfo, legit::ImageUsageTypes baseUsageType)
+    {
+      imageHandle = logicalDevice.createImageUnique(imageInfo);
+      glm::uvec3 size = { imageInfo.extent.width, imageInfo.extent.height, imageInfo.extent.depth };
+
+      imageData.reset(new legit::ImageData(imageHandle.get(), imageInfo.imageType, size, imageInfo.mipLevels, imageInfo.arrayLayers, imageInfo.format, baseUsageType));
+
+      memoryRequirements = logicalDevice.getImageMemoryRequirements(imageHandle.get());
+
+      this->bytesPerPixelAvg = double(memoryRequirements.size) / double(imageInfo.extent.width * imageInfo.extent.height * imageInfo.extent.depth * imageInfo.arrayLayers); //does not count mips. for padding checks
+    }
+    legit::MemoryAllocator::UniqueAllocation allocation;
     vk::UniqueImage imageHandle;
     std::unique_ptr<legit::ImageData> imageData;
     vk::UniqueDeviceMemory imageMemory;
+    vk::MemoryRequirements memoryRequirements;
     double bytesPerPixelAvg;
   };
 }
\ No newline at end of file
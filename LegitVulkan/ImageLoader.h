@@ -255,14 +255,9 @@ namespace legit
     return texelData;
   }
 
-  static void LoadTexelData(legit::Core *core, const ImageTexelData *texelData, legit::ImageData *dstImageData, legit::ImageUsageTypes dstUsageType = legit::ImageUsageTypes::GraphicsShaderRead)
+  //regions copying texels that are placed at bufferOffset in a staging buffer
+  static std::vector<vk::BufferImageCopy> GetTexelDataCopyRegions(const ImageTexelData *texelData, vk::DeviceSize bufferOffset)
   {
-    auto stagingBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetPhysicalDevice(), core->GetLogicalDevice(), texelData->texels.size(), vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
-
-    void *bufferData = stagingBuffer->Map();
-    memcpy(bufferData, texelData->texels.data(), texelData->texels.size());
-    stagingBuffer->Unmap();
-
     std::vector<vk::BufferImageCopy> copyRegions;
     for (uint32_t mipLevel = 0; mipLevel < uint32_t(texelData->mips.size()); mipLevel++)
     {
@@ -278,7 +273,7 @@ namespace legit
           .setLayerCount(1);
 
         auto copyRegion = vk::BufferImageCopy()
-          .setBufferOffset(layer.offset)
+          .setBufferOffset(bufferOffset + layer.offset)
           .setBufferRowLength(0)
           .setBufferImageHeight(0)
           .setImageSubresource(imageSubresource)
@@ -288,14 +283,6 @@ namespace legit
         copyRegions.push_back(copyRegion);
       }
     }
-
-    legit::ExecuteOnceQueue transferQueue(core);
-    auto transferCommandBuffer = transferQueue.BeginCommandBuffer();
-    {
-      AddTransitionBarrier(dstImageData, legit::ImageUsageTypes::None, legit::ImageUsageTypes::TransferDst, transferCommandBuffer);
-      transferCommandBuffer.copyBufferToImage(stagingBuffer->GetHandle(), dstImageData->GetHandle(), vk::ImageLayout::eTransferDstOptimal, copyRegions);
-      AddTransitionBarrier(dstImageData, legit::ImageUsageTypes::TransferDst, dstUsageType, transferCommandBuffer);
-    }
-    transferQueue.EndCommandBuffer();
+    return copyRegions;
   }
 }
\ No newline at end of file
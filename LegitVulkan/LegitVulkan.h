@@ -23,6 +23,7 @@
 #include "Span.h"
 #include "Handles.h"
 #include "Pool.h"
+#include "WorkerPool.h"
 #include "CpuProfiler.h"
 #include "QueueIndices.h"
 #include "WindowDesc.h"
@@ -31,6 +32,7 @@
 #include "ShaderModule.h"
 #include "ShaderProgram.h"
 #include "Synchronization.h"
+#include "MemoryAllocator.h"
 #include "Buffer.h"
 #include "Image.h"
 #include "TimestampQuery.h"
@@ -43,13 +45,19 @@
 #include "RenderPass.h"
 #include "Framebuffer.h"
 #include "ShaderMemoryPool.h"
+#include "DescriptorBuffer.h"
 #include "DescriptorSetCache.h"
-#include "PipelineCache.h"
+#include "BindlessDescriptorSet.h"
+#include "BoundState.h"
+#include "EventPool.h"
 #include "RenderPassCache.h"
+#include "PipelineCache.h"
 
 #include "Core.h"
 #include "StateTracker.h"
 #include "RenderGraph.h"
+#include "ImageLoader.h"
+#include "UploadManager.h"
 #include "CoreImpl.h"
 
 #include "PresentQueue.h"
@@ -60,5 +68,4 @@
 
 
 #include "StagedResources.h"
-#include "ImageLoader.h"
 #include "Texture.h"
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+
+namespace legit
+{
+  //buddy allocator over a power of two range. nodes are aligned to their size, so an allocation is aligned to anything up to its rounded size
+  class BuddyAllocator
+  {
+  public:
+    BuddyAllocator(vk::DeviceSize size, vk::DeviceSize minNodeSize)
+    {
+      assert((size & (size - 1)) == 0 && (minNodeSize & (minNodeSize - 1)) == 0 && minNodeSize <= size);
+      this->size = size;
+      levelsCount = 1;
+      for (vk::DeviceSize nodeSize = size; nodeSize > minNodeSize; nodeSize /= 2)
+        levelsCount++;
+      freeNodes.resize(levelsCount);
+      freeNodes[0].insert(0);
+    }
+
+    bool Allocate(vk::DeviceSize allocationSize, vk::DeviceSize alignment, vk::DeviceSize &offset)
+    {
+      vk::DeviceSize requiredSize = std::max(allocationSize, alignment);
+      if (requiredSize > size)
+        return false;
+      uint32_t level = levelsCount - 1;
+      while (level > 0 && GetNodeSize(level) < requiredSize)
+        level--;
+
+      int32_t freeLevel = int32_t(level);
+      while (freeLevel >= 0 && freeNodes[freeLevel].empty())
+        freeLevel--;
+      if (freeLevel < 0)
+        return false;
+
+      offset = *freeNodes[freeLevel].begin();
+      freeNodes[freeLevel].erase(freeNodes[freeLevel].begin());
+      for (uint32_t splitLevel = uint32_t(freeLevel) + 1; splitLevel <= level; splitLevel++)
+      {
+        freeNodes[splitLevel].insert(offset + GetNodeSize(splitLevel));
+      }
+      allocatedLevels[offset] = level;
+      usedSize += GetNodeSize(level);
+      return true;
+    }
+
+    void Free(vk::DeviceSize offset)
+    {
+      auto it = allocatedLevels.find(offset);
+      assert(it != allocatedLevels.end());
+      uint32_t level = it->second;
+      allocatedLevels.erase(it);
+      usedSize -= GetNodeSize(level);
+
+      //merging with free buddies all the way up
+      while (level > 0)
+      {
+        vk::DeviceSize buddyOffset = offset ^ GetNodeSize(level);
+        auto buddyIt = freeNodes[level].find(buddyOffset);
+        if (buddyIt == freeNodes[level].end())
+          break;
+        freeNodes[level].erase(buddyIt);
+        offset = std::min(offset, buddyOffset);
+        level--;
+      }
+      freeNodes[level].insert(offset);
+    }
+
+    vk::DeviceSize GetUsedSize() const
+    {
+      return usedSize;
+    }
+    bool IsEmpty() const
+    {
+      return allocatedLevels.empty();
+    }
+  private:
+    vk::DeviceSize GetNodeSize(uint32_t level) const
+    {
+      return size >> level;
+    }
+    vk::DeviceSize size;
+    uint32_t levelsCount;
+    std::vector<std::set<vk::DeviceSize> > freeNodes;
+    std::unordered_map<vk::DeviceSize, uint32_t> allocatedLevels;
+    vk::DeviceSize usedSize = 0;
+  };
+
+  //sub-allocates device memory from large per memory type blocks instead of making a vkAllocateMemory call per resource
+  class MemoryAllocator
+  {
+  public:
+    enum struct AllocationTypes
+    {
+      Pooled, //long-lived resources, buddy-allocated from shared blocks. big requests fall back to Dedicated
+      Dedicated //own VkDeviceMemory
+    };
+
+    MemoryAllocator(vk::PhysicalDevice _physicalDevice, vk::Device _logicalDevice, vk::DeviceSize _blockSize = 64 * 1024 * 1024) :
+      physicalDevice(_physicalDevice),
+      logicalDevice(_logicalDevice),
+      blockSize(_blockSize)
+    {
+      memoryProperties = physicalDevice.getMemoryProperties();
+      heapStats.resize(memoryProperties.memoryHeapCount);
+      for (uint32_t heapIndex = 0; heapIndex < memoryProperties.memoryHeapCount; heapIndex++)
+        heapStats[heapIndex].heapSize = memoryProperties.memoryHeaps[heapIndex].size;
+    }
+
+  private:
+    struct Block;
+  public:
+    struct AllocationInfo
+    {
+      void Reset()
+      {
+        if (allocator)
+          allocator->Free(*this);
+      }
+      vk::DeviceMemory memory;
+      vk::DeviceSize offset = 0;
+      vk::DeviceSize size = 0;
+      void *mappedData = nullptr; //only for host visible memory, already offset
+      uint32_t memoryTypeIndex = uint32_t(-1);
+    private:
+      MemoryAllocator *allocator = nullptr;
+      Block *block = nullptr; //nullptr for dedicated allocations
+      friend class MemoryAllocator;
+    };
+    using UniqueAllocation = UniqueHandle<AllocationInfo, MemoryAllocator>;
+
+    uint32_t FindMemoryTypeIndex(uint32_t suitableIndices, vk::MemoryPropertyFlags memoryVisibility) const
+    {
+      for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+      {
+        if ((suitableIndices & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & memoryVisibility) == memoryVisibility)
+        {
+          return i;
+        }
+      }
+      return uint32_t(-1);
+    }
+
+    //linear resources (buffers) and optimal ones (images) never share a block, so bufferImageGranularity doesn't have to be respected between them
+    UniqueAllocation Allocate(vk::MemoryRequirements memoryRequirements, vk::MemoryPropertyFlags memoryVisibility, bool isLinearResource, bool isDeviceAddressUsed = false, AllocationTypes allocationType = AllocationTypes::Pooled)
+    {
+      uint32_t memoryTypeIndex = FindMemoryTypeIndex(memoryRequirements.memoryTypeBits, memoryVisibility);
+      if (memoryTypeIndex == uint32_t(-1))
+        throw std::runtime_error("Failed to find suitable memory type");
+
+      std::lock_guard<std::mutex> lock(allocatorMutex);
+      AllocationInfo allocationInfo;
+      allocationInfo.allocator = this;
+      allocationInfo.memoryTypeIndex = memoryTypeIndex;
+      allocationInfo.size = memoryRequirements.size;
+
+      if (allocationType == AllocationTypes::Dedicated || memoryRequirements.size > blockSize / 2)
+      {
+        auto memory = AllocateDeviceMemory(memoryTypeIndex, memoryRequirements.size, isDeviceAddressUsed);
+        allocationInfo.memory = memory.get();
+        allocationInfo.mappedData = memory.mappedData;
+        dedicatedAllocations[allocationInfo.memory] = std::move(memory);
+        auto &stats = GetHeapStats(memoryTypeIndex);
+        stats.dedicatedAllocationsCount++;
+        stats.usedSize += memoryRequirements.size;
+        return UniqueAllocation(allocationInfo);
+      }
+
+      PoolKey poolKey = { memoryTypeIndex, isLinearResource, isDeviceAddressUsed };
+      auto &pool = pools[poolKey];
+      vk::DeviceSize alignment = std::max(memoryRequirements.alignment, vk::DeviceSize(minNodeSize));
+      for (auto &block : pool)
+      {
+        if (block->buddyAllocator.Allocate(memoryRequirements.size, alignment, allocationInfo.offset))
+        {
+          allocationInfo.block = block.get();
+          break;
+        }
+      }
+      if (!allocationInfo.block)
+      {
+        pool.emplace_back(new Block(AllocateDeviceMemory(memoryTypeIndex, blockSize, isDeviceAddressUsed), blockSize, minNodeSize));
+        auto &block = pool.back();
+        block->poolKey = poolKey;
+        bool isAllocated = block->buddyAllocator.Allocate(memoryRequirements.size, alignment, allocationInfo.offset);
+        assert(isAllocated);
+        allocationInfo.block = block.get();
+        GetHeapStats(memoryTypeIndex).blocksCount++;
+      }
+      allocationInfo.memory = allocationInfo.block->memory.get();
+      if (allocationInfo.block->memory.mappedData)
+        allocationInfo.mappedData = (char*)allocationInfo.block->memory.mappedData + allocationInfo.offset;
+      auto &stats = GetHeapStats(memoryTypeIndex);
+      stats.pooledAllocationsCount++;
+      stats.usedSize += memoryRequirements.size;
+      return UniqueAllocation(allocationInfo);
+    }
+
+    struct HeapStats
+    {
+      vk::DeviceSize heapSize = 0;
+      vk::DeviceSize allocatedSize = 0; //device memory reserved from the driver
+      vk::DeviceSize usedSize = 0; //requested by live allocations
+      size_t deviceMemoryCount = 0; //counts towards maxMemoryAllocationCount
+      size_t blocksCount = 0;
+      size_t pooledAllocationsCount = 0;
+      size_t dedicatedAllocationsCount = 0;
+    };
+    std::vector<HeapStats> GetHeapStats()
+    {
+      std::lock_guard<std::mutex> lock(allocatorMutex);
+      return heapStats;
+    }
+
+    vk::PhysicalDevice GetPhysicalDevice()
+    {
+      return physicalDevice;
+    }
+    vk::Device GetLogicalDevice()
+    {
+      return logicalDevice;
+    }
+  private:
+    struct DeviceMemory
+    {
+      vk::DeviceMemory get() const
+      {
+        return memory.get();
+      }
+      vk::UniqueDeviceMemory memory;
+      void *mappedData = nullptr;
+      vk::DeviceSize size = 0;
+    };
+    struct PoolKey
+    {
+      uint32_t memoryTypeIndex;
+      bool isLinearResource;
+      bool isDeviceAddressUsed;
+      bool operator < (const PoolKey &other) const
+      {
+        return std::tie(memoryTypeIndex, isLinearResource, isDeviceAddressUsed) < std::tie(other.memoryTypeIndex, other.isLinearResource, other.isDeviceAddressUsed);
+      }
+    };
+    struct Block
+    {
+      Block(DeviceMemory &&_memory, vk::DeviceSize size, vk::DeviceSize minNodeSize) :
+        memory(std::move(_memory)),
+        buddyAllocator(size, minNodeSize)
+      {
+      }
+      DeviceMemory memory;
+      BuddyAllocator buddyAllocator;
+      PoolKey poolKey;
+    };
+
+    //host visible memory stays mapped for its whole lifetime, so sub-allocations can be written without mapping the same memory twice
+    DeviceMemory AllocateDeviceMemory(uint32_t memoryTypeIndex, vk::DeviceSize size, bool isDeviceAddressUsed)
+    {
+      auto allocateFlagsInfo = vk::MemoryAllocateFlagsInfo()
+        .setFlags(vk::MemoryAllocateFlagBits::eDeviceAddress);
+      auto allocInfo = vk::MemoryAllocateInfo()
+        .setAllocationSize(size)
+        .setMemoryTypeIndex(memoryTypeIndex)
+        .setPNext(isDeviceAddressUsed ? &allocateFlagsInfo : nullptr);
+
+      DeviceMemory deviceMemory;
+      deviceMemory.memory = logicalDevice.allocateMemoryUnique(allocInfo);
+      deviceMemory.size = size;
+      if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        deviceMemory.mappedData = logicalDevice.mapMemory(deviceMemory.get(), 0, size);
+
+      auto &stats = GetHeapStats(memoryTypeIndex);
+      stats.allocatedSize += size;
+      stats.deviceMemoryCount++;
+      return deviceMemory;
+    }
+
+    void Free(const AllocationInfo &allocationInfo)
+    {
+      std::lock_guard<std::mutex> lock(allocatorMutex);
+      auto &stats = GetHeapStats(allocationInfo.memoryTypeIndex);
+      stats.usedSize -= allocationInfo.size;
+      if (!allocationInfo.block)
+      {
+        auto it = dedicatedAllocations.find(allocationInfo.memory);
+        assert(it != dedicatedAllocations.end());
+        stats.allocatedSize -= it->second.size;
+        stats.deviceMemoryCount--;
+        stats.dedicatedAllocationsCount--;
+        dedicatedAllocations.erase(it);
+        return;
+      }
+
+      stats.pooledAllocationsCount--;
+      auto block = allocationInfo.block;
+      block->buddyAllocator.Free(allocationInfo.offset);
+      if (block->buddyAllocator.IsEmpty())
+      {
+        //one empty block per pool is kept around so that allocating and freeing a single resource doesn't hit the driver every time
+        auto &pool = pools[block->poolKey];
+        size_t emptyBlocksCount = 0;
+        for (auto &poolBlock : pool)
+          emptyBlocksCount += poolBlock->buddyAllocator.IsEmpty() ? 1 : 0;
+        if (emptyBlocksCount > 1)
+        {
+          stats.allocatedSize -= block->memory.size;
+          stats.deviceMemoryCount--;
+          stats.blocksCount--;
+          pool.erase(std::find_if(pool.begin(), pool.end(), [block](const std::unique_ptr<Block> &poolBlock) { return poolBlock.get() == block; }));
+        }
+      }
+    }
+
+    HeapStats &GetHeapStats(uint32_t memoryTypeIndex)
+    {
+      return heapStats[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+    }
+
+    static const vk::DeviceSize minNodeSize = 256;
+
+    vk::PhysicalDevice physicalDevice;
+    vk::Device logicalDevice;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+    vk::DeviceSize blockSize;
+
+    std::mutex allocatorMutex;
+    std::map<PoolKey, std::vector<std::unique_ptr<Block> > > pools;
+    std::map<vk::DeviceMemory, DeviceMemory> dedicatedAllocations;
+    std::vector<HeapStats> heapStats;
+  };
+}
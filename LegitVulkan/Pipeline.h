@@ -121,6 +121,11 @@ namespace legit
     {
       return pipelineLayout;
     }
+    //only meaningful if the pipeline was created with creation feedback enabled
+    bool IsCacheHit()
+    {
+      return isCacheHit;
+    }
     GraphicsPipeline(
       vk::Device logicalDevice,
       vk::ShaderModule vertexShader, vk::ShaderModule fragmentShader,
@@ -130,7 +135,10 @@ namespace legit
       vk::CullModeFlags cullMode,
       const std::vector<BlendSettings> &attachmentBlendSettings,
       vk::PrimitiveTopology primitiveTopology,
-      vk::RenderPass renderPass)
+      vk::RenderPass renderPass,
+      vk::PipelineCache pipelineCache = nullptr,
+      bool useCreationFeedback = false,
+      vk::PipelineCreateFlags flags = vk::PipelineCreateFlags())
     {
       this->pipelineLayout = pipelineLayout;
       auto vertexStageCreateInfo = vk::PipelineShaderStageCreateInfo()
@@ -195,6 +203,7 @@ namespace legit
         .setScissorCount(1)
         .setViewportCount(1);
       auto pipelineCreateInfo = vk::GraphicsPipelineCreateInfo()
+        .setFlags(flags)
         .setStageCount(2)
         .setPStages(shaderStageInfos)
         .setPVertexInputState(&vertexInputInfo)
@@ -211,11 +220,19 @@ namespace legit
         .setBasePipelineHandle(nullptr) //use later
         .setBasePipelineIndex(-1);
 
-      pipeline = logicalDevice.createGraphicsPipelineUnique(nullptr, pipelineCreateInfo).value;
+      vk::PipelineCreationFeedbackEXT creationFeedback;
+      auto creationFeedbackInfo = vk::PipelineCreationFeedbackCreateInfoEXT()
+        .setPPipelineCreationFeedback(&creationFeedback);
+      if (useCreationFeedback)
+        pipelineCreateInfo.setPNext(&creationFeedbackInfo);
+
+      pipeline = logicalDevice.createGraphicsPipelineUnique(pipelineCache, pipelineCreateInfo).value;
+      isCacheHit = bool(creationFeedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit);
     }
   private:
     vk::PipelineLayout pipelineLayout;
     vk::UniquePipeline pipeline;
+    bool isCacheHit = false;
     friend class Core;
   };
 
@@ -230,10 +247,17 @@ namespace legit
     {
       return pipelineLayout;
     }
+    bool IsCacheHit()
+    {
+      return isCacheHit;
+    }
     ComputePipeline(
       vk::Device logicalDevice,
       vk::ShaderModule computeShader,
-      vk::PipelineLayout pipelineLayout)
+      vk::PipelineLayout pipelineLayout,
+      vk::PipelineCache pipelineCache = nullptr,
+      bool useCreationFeedback = false,
+      vk::PipelineCreateFlags flags = vk::PipelineCreateFlags())
     {
       this->pipelineLayout = pipelineLayout;
       auto computeStageCreateInfo = vk::PipelineShaderStageCreateInfo()
@@ -245,17 +269,25 @@ namespace legit
         .setScissorCount(1)
         .setViewportCount(1);
       auto pipelineCreateInfo = vk::ComputePipelineCreateInfo()
-        .setFlags(vk::PipelineCreateFlags())
+        .setFlags(flags)
         .setStage(computeStageCreateInfo)
         .setLayout(pipelineLayout)
         .setBasePipelineHandle(nullptr) //use later
         .setBasePipelineIndex(-1);
 
-      pipeline = logicalDevice.createComputePipelineUnique(nullptr, pipelineCreateInfo).value;
+      vk::PipelineCreationFeedbackEXT creationFeedback;
+      auto creationFeedbackInfo = vk::PipelineCreationFeedbackCreateInfoEXT()
+        .setPPipelineCreationFeedback(&creationFeedback);
+      if (useCreationFeedback)
+        pipelineCreateInfo.setPNext(&creationFeedbackInfo);
+
+      pipeline = logicalDevice.createComputePipelineUnique(pipelineCache, pipelineCreateInfo).value;
+      isCacheHit = bool(creationFeedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit);
     }
   private:
     vk::PipelineLayout pipelineLayout;
     vk::UniquePipeline pipeline;
+    bool isCacheHit = false;
     friend class Core;
   };
 }
\ No newline at end of file
@@ -1,20 +1,149 @@
 #include <map>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
 namespace legit
 {
   class PipelineCache
   {
   public:
-    PipelineCache(vk::Device _logicalDevice, DescriptorSetCache *_descriptorSetCache) :
+    //empty filename disables persistence. cache hits can only be detected with VK_EXT_pipeline_creation_feedback enabled
+    PipelineCache(vk::PhysicalDevice _physicalDevice, vk::Device _logicalDevice, DescriptorSetCache *_descriptorSetCache, std::string _cacheFilename = "", bool _useCreationFeedback = false) :
       logicalDevice(_logicalDevice),
-      descriptorSetCache(_descriptorSetCache)
+      descriptorSetCache(_descriptorSetCache),
+      cacheFilename(_cacheFilename),
+      useCreationFeedback(_useCreationFeedback)
     {
+      deviceProperties = _physicalDevice.getProperties();
+
+      std::vector<uint8_t> initialData;
+      if (!cacheFilename.empty())
+        initialData = LoadFromDisk();
+      stats.loadedDataSize = initialData.size();
+
+      auto pipelineCacheInfo = vk::PipelineCacheCreateInfo()
+        .setInitialDataSize(initialData.size())
+        .setPInitialData(initialData.data());
+      pipelineCache = logicalDevice.createPipelineCacheUnique(pipelineCacheInfo);
+      lastSaveTime = std::chrono::steady_clock::now();
+    }
+
+    struct Stats
+    {
+      size_t loadedDataSize = 0; //0 if there was no valid cache on disk
+      size_t savedDataSize = 0;
+      size_t graphicsPipelinesCount = 0;
+      size_t computePipelinesCount = 0;
+      size_t cacheHitsCount = 0;
+      size_t savesCount = 0;
+      size_t notReadyBindsCount = 0; //async mode only: binds that skipped the draw or used the fallback
+      size_t fallbackBindsCount = 0;
+    };
+    Stats GetStats()
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      return stats;
+    }
+
+    //writes to a temporary file first and renames it over the old one, so a crash mid-save can't leave a truncated cache behind
+    void SaveToDisk()
+    {
+      if (cacheFilename.empty())
+        return;
+      auto cacheData = logicalDevice.getPipelineCacheData(pipelineCache.get());
+
+      DiskHeader header = GetExpectedHeader();
+      header.dataSize = cacheData.size();
+      header.dataHash = ComputeHash(cacheData.data(), cacheData.size());
+
+      std::string tmpFilename = cacheFilename + ".tmp";
+      {
+        std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+          std::cout << "[BAD BUT NOT CRITICAL]: Failed to write pipeline cache " << tmpFilename << "\n";
+          return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)cacheData.data(), cacheData.size());
+        if (!file)
+          return;
+      }
+      std::error_code errorCode;
+      std::filesystem::rename(tmpFilename, cacheFilename, errorCode);
+      if (errorCode)
+      {
+        std::cout << "[BAD BUT NOT CRITICAL]: Failed to replace pipeline cache " << cacheFilename << ": " << errorCode.message() << "\n";
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      stats.savedDataSize = cacheData.size();
+      stats.savesCount++;
+      pipelinesCreatedSinceSave = 0;
+      lastSaveTime = std::chrono::steady_clock::now();
     }
+
+    //cheap to call every frame, only saves when new pipelines were created and the interval has passed
+    void SaveCheckpoint(std::chrono::seconds checkpointInterval = std::chrono::seconds(30))
+    {
+      {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (pipelinesCreatedSinceSave == 0 || std::chrono::steady_clock::now() - lastSaveTime < checkpointInterval)
+          return;
+      }
+      SaveToDisk();
+    }
+    //in async mode cache misses are compiled on background threads instead of stalling the recording thread
+    void SetAsyncCompilation(bool isEnabled, size_t threadsCount = 2)
+    {
+      if (compileQueue)
+        compileQueue->WaitIdle();
+      compileQueue.reset(isEnabled ? new legit::JobQueue(threadsCount) : nullptr);
+    }
+    bool IsAsyncCompilationEnabled()
+    {
+      return compileQueue != nullptr;
+    }
+    size_t GetPendingCompilationsCount()
+    {
+      return compileQueue ? compileQueue->GetPendingJobsCount() : 0;
+    }
+
     struct PipelineInfo
     {
+      bool isReady = true; //false if the pipeline is still compiling and nothing got bound, draws using it have to be skipped
       vk::PipelineLayout pipelineLayout;
       legit::ShaderProgram *shaderProgram = nullptr;
       legit::Shader *computeShader = nullptr;
       std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
+
+      const std::vector<vk::PushConstantRange> &GetPushConstantRanges() const
+      {
+        return shaderProgram ? shaderProgram->GetPushConstantRanges() : computeShader->GetPushConstantRanges();
+      }
+      bool IsPushDescriptorSet(size_t setIndex) const
+      {
+        return shaderProgram ? shaderProgram->IsPushDescriptorSet(setIndex) : computeShader->IsPushDescriptorSet(setIndex);
+      }
+      //stages of every range that overlaps the pushed bytes. each of these ranges has to contain all of them
+      vk::ShaderStageFlags GetPushConstantStageFlags(uint32_t offset, uint32_t size) const
+      {
+        vk::ShaderStageFlags stageFlags;
+        for (const auto &range : GetPushConstantRanges())
+        {
+          if (offset < range.offset + range.size && range.offset < offset + size)
+          {
+            assert(range.offset <= offset && offset + size <= range.offset + range.size);
+            stageFlags |= range.stageFlags;
+          }
+        }
+        assert(stageFlags); //no push constant block covers these bytes
+        return stageFlags;
+      }
     };
 
     PipelineInfo BindGraphicsPipeline(
@@ -24,9 +153,10 @@ namespace legit
       const std::vector<legit::BlendSettings> &attachmentBlendSettings,
       legit::VertexDeclaration vertexDeclaration,
       vk::PrimitiveTopology topology,
-      legit::ShaderProgram *shaderProgram)
+      legit::ShaderProgram *shaderProgram,
+      legit::BoundState *boundState = nullptr)
     {
-      return BindGraphicsPipeline(commandBuffer, renderPass, depthSettings, vk::CullModeFlagBits::eNone, attachmentBlendSettings, vertexDeclaration, topology, shaderProgram);
+      return BindGraphicsPipeline(commandBuffer, renderPass, depthSettings, vk::CullModeFlagBits::eNone, attachmentBlendSettings, vertexDeclaration, topology, shaderProgram, nullptr, boundState);
     }
     
     PipelineInfo BindGraphicsPipeline(
@@ -37,106 +167,422 @@ namespace legit
       const std::vector<legit::BlendSettings> &attachmentBlendSettings,
       legit::VertexDeclaration vertexDeclaration,
       vk::PrimitiveTopology topology,
-      legit::ShaderProgram *shaderProgram)
+      legit::ShaderProgram *shaderProgram,
+      vk::Pipeline fallbackPipeline = nullptr, //bound while the pipeline is compiling in async mode, must have a compatible layout
+      legit::BoundState *boundState = nullptr) //skips the bind if the pipeline is already bound to commandBuffer
     {
-      GraphicsPipelineKey pipelineKey;
-      pipelineKey.vertexShaderModule = shaderProgram->vertexShader->GetModule()->GetHandle();
-      pipelineKey.vertexShaderHash = shaderProgram->vertexShader->GetModule()->GetHash();
-      pipelineKey.fragmentShaderModule = shaderProgram->fragmentShader->GetModule()->GetHandle();
-      pipelineKey.fragmentShaderHash = shaderProgram->fragmentShader->GetModule()->GetHash();
-      pipelineKey.vertexDecl = vertexDeclaration;
-      pipelineKey.depthSettings = depthSettings;
-      pipelineKey.cullMode = cullMode;
-      pipelineKey.attachmentBlendSettings = attachmentBlendSettings;
-      pipelineKey.topology = topology;
-
-      PipelineInfo pipelineInfo;
-
-      legit::Shader *targetShader = shaderProgram->vertexShader;
+      GraphicsPipelineKey pipelineKey = MakeGraphicsPipelineKey(renderPass, depthSettings, cullMode, attachmentBlendSettings, vertexDeclaration, topology, shaderProgram);
 
-      PipelineLayoutKey pipelineLayoutKey;
-      for (auto &setLayoutKey : shaderProgram->combinedDescriptorSetLayoutKeys)
+      legit::GraphicsPipeline *pipeline = nullptr;
       {
-        pipelineLayoutKey.setLayouts.push_back(descriptorSetCache->GetDescriptorSetLayout(setLayoutKey));
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (!graphicsPipelineCache.count(pipelineKey))
+          AddGraphicsManifestEntry(pipelineKey, shaderProgram);
+        pipeline = GetGraphicsPipeline(pipelineKey);
+        if (!pipeline)
+          stats.notReadyBindsCount++;
       }
 
-      pipelineKey.pipelineLayout = GetPipelineLayout(pipelineLayoutKey);
-
-      pipelineKey.renderPass = renderPass;
-
-      legit::GraphicsPipeline *pipeline = GetGraphicsPipeline(pipelineKey);
-
-      commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline->GetHandle());
-
-      pipelineInfo.pipelineLayout = pipeline->GetLayout();
+      PipelineInfo pipelineInfo;
+      pipelineInfo.pipelineLayout = pipelineKey.pipelineLayout;
       pipelineInfo.shaderProgram = shaderProgram;
+      pipelineInfo.isReady = BindPipelineOrFallback(commandBuffer, boundState, vk::PipelineBindPoint::eGraphics, pipeline ? pipeline->GetHandle() : nullptr, fallbackPipeline);
       return pipelineInfo;
     }
 
 
     PipelineInfo BindComputePipeline(
       vk::CommandBuffer commandBuffer,
-      legit::Shader *computeShader)
+      legit::Shader *computeShader,
+      vk::Pipeline fallbackPipeline = nullptr,
+      legit::BoundState *boundState = nullptr)
     {
-      ComputePipelineKey pipelineKey;
-      pipelineKey.computeShader = computeShader->GetModule()->GetHandle();
+      ComputePipelineKey pipelineKey = MakeComputePipelineKey(computeShader);
+
+      legit::ComputePipeline *pipeline = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (!computePipelineCache.count(pipelineKey))
+          computeManifestEntries.push_back({ computeShader->GetModule()->GetContentHash() });
+        pipeline = GetComputePipeline(pipelineKey);
+        if (!pipeline)
+          stats.notReadyBindsCount++;
+      }
 
       PipelineInfo pipelineInfo;
-      legit::Shader *targetShader = computeShader;
+      pipelineInfo.computeShader = computeShader;
+      pipelineInfo.pipelineLayout = pipelineKey.pipelineLayout;
+      pipelineInfo.isReady = BindPipelineOrFallback(commandBuffer, boundState, vk::PipelineBindPoint::eCompute, pipeline ? pipeline->GetHandle() : nullptr, fallbackPipeline);
+      return pipelineInfo;
+    }
+    //render passes are described by their RenderPassKey in the manifest, so they have to come from this cache
+    void SetRenderPassCache(legit::RenderPassCache *_renderPassCache)
+    {
+      this->renderPassCache = _renderPassCache;
+    }
+    //null when descriptor indexing is not enabled, shaders with unsized arrays can't be used then
+    void SetBindlessDescriptorSet(legit::BindlessDescriptorSet *_bindlessDescriptorSet)
+    {
+      this->bindlessDescriptorSet = _bindlessDescriptorSet;
+    }
 
-      PipelineLayoutKey pipelineLayoutKey;
-      pipelineLayoutKey.setLayouts.resize(computeShader->GetSetsCount());
-      for (size_t setIndex = 0; setIndex < pipelineLayoutKey.setLayouts.size(); setIndex++)
+    //every pipeline created so far, identified by shader content hashes and render pass descriptions instead of handles
+    void SaveManifest(std::string filename)
+    {
+      std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+      if (!file)
       {
-        vk::DescriptorSetLayout setLayoutHandle = nullptr;
-        auto computeSetInfo = computeShader->GetSetInfo(setIndex);
-        if (!computeSetInfo->IsEmpty())
-          setLayoutHandle = descriptorSetCache->GetDescriptorSetLayout(*computeSetInfo);
+        std::cout << "[BAD BUT NOT CRITICAL]: Failed to write pipeline manifest " << filename << "\n";
+        return;
+      }
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      WritePod(file, manifestMagic);
+      WritePod(file, manifestVersion);
+      WritePod(file, uint32_t(graphicsManifestEntries.size()));
+      for (const auto &entry : graphicsManifestEntries)
+      {
+        WritePod(file, entry.vertexShaderHash);
+        WritePod(file, entry.fragmentShaderHash);
+        WriteVector(file, entry.vertexDecl.GetBindingDescriptors());
+        WriteVector(file, entry.vertexDecl.GetVertexAttributes());
+        WritePod(file, entry.depthSettings);
+        WritePod(file, entry.cullMode);
+        WriteVector(file, entry.attachmentBlendSettings);
+        WritePod(file, entry.topology);
+        WriteVector(file, entry.renderPassKey.colorAttachmentDescs);
+        WritePod(file, entry.renderPassKey.depthAttachmentDesc);
+      }
+      WritePod(file, uint32_t(computeManifestEntries.size()));
+      for (const auto &entry : computeManifestEntries)
+        WritePod(file, entry.computeShaderHash);
+    }
 
-        pipelineLayoutKey.setLayouts[setIndex] = setLayoutHandle;
+    //compiles every manifest pipeline whose shaders are among the given ones, spread over the worker pool. blocks until done, meant for loading screens
+    //returns the number of pipelines compiled
+    size_t ReplayManifest(std::string filename, const std::vector<legit::ShaderProgram*> &shaderPrograms, const std::vector<legit::Shader*> &computeShaders, legit::WorkerPool *workerPool)
+    {
+      std::vector<GraphicsManifestEntry> graphicsEntries;
+      std::vector<ComputeManifestEntry> computeEntries;
+      if (!LoadManifest(filename, graphicsEntries, computeEntries))
+        return 0;
+
+      std::map<std::pair<uint64_t, uint64_t>, legit::ShaderProgram*> programsByHash;
+      for (auto shaderProgram : shaderPrograms)
+        programsByHash[{ shaderProgram->vertexShader->GetModule()->GetContentHash(), shaderProgram->fragmentShader->GetModule()->GetContentHash() }] = shaderProgram;
+      std::map<uint64_t, legit::Shader*> computeShadersByHash;
+      for (auto computeShader : computeShaders)
+        computeShadersByHash[computeShader->GetModule()->GetContentHash()] = computeShader;
+
+      //keys and slots are prepared serially since render pass and layout creation isn't thread safe, only compilation itself runs in parallel
+      std::vector<std::function<void()> > compileJobs;
+      for (const auto &entry : graphicsEntries)
+      {
+        auto programIt = programsByHash.find({ entry.vertexShaderHash, entry.fragmentShaderHash });
+        if (programIt == programsByHash.end() || !renderPassCache)
+          continue;
+        vk::RenderPass renderPass = renderPassCache->GetRenderPass(entry.renderPassKey)->GetHandle();
+        auto pipelineKey = MakeGraphicsPipelineKey(renderPass, entry.depthSettings, entry.cullMode, entry.attachmentBlendSettings, entry.vertexDecl, entry.topology, programIt->second);
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto &slot = graphicsPipelineCache[pipelineKey];
+        if (slot)
+          continue;
+        slot.reset(new PipelineSlot<legit::GraphicsPipeline>());
+        slot->isQueued = true;
+        graphicsManifestEntries.push_back(entry);
+        auto *slotPtr = slot.get();
+        compileJobs.push_back([this, slotPtr, pipelineKey]() { CompileIntoSlot(slotPtr, stats.graphicsPipelinesCount, [&]() { return CreateGraphicsPipeline(pipelineKey); }); });
       }
-      pipelineKey.pipelineLayout = GetPipelineLayout(pipelineLayoutKey);
+      for (const auto &entry : computeEntries)
+      {
+        auto shaderIt = computeShadersByHash.find(entry.computeShaderHash);
+        if (shaderIt == computeShadersByHash.end())
+          continue;
+        auto pipelineKey = MakeComputePipelineKey(shaderIt->second);
 
-      legit::ComputePipeline *pipeline = GetComputePipeline(pipelineKey);
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto &slot = computePipelineCache[pipelineKey];
+        if (slot)
+          continue;
+        slot.reset(new PipelineSlot<legit::ComputePipeline>());
+        slot->isQueued = true;
+        computeManifestEntries.push_back(entry);
+        auto *slotPtr = slot.get();
+        compileJobs.push_back([this, slotPtr, pipelineKey]() { CompileIntoSlot(slotPtr, stats.computePipelinesCount, [&]() { return CreateComputePipeline(pipelineKey); }); });
+      }
 
-      commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline->GetHandle());
-      pipelineInfo.computeShader = computeShader;
-      pipelineInfo.pipelineLayout = pipeline->GetLayout();
-      return pipelineInfo;
+      workerPool->Run(compileJobs.size(), [&](size_t jobIndex, size_t workerIndex)
+      {
+        compileJobs[jobIndex]();
+      });
+      return compileJobs.size();
     }
+
     void Clear()
     {
+      //jobs are only pushed with cacheMutex locked, so once the queue is seen idle under it nothing can start compiling into a cleared slot.
+      //running jobs lock cacheMutex themselves, so waiting for them has to happen without it
+      std::unique_lock<std::mutex> lock(cacheMutex);
+      while (compileQueue && compileQueue->GetPendingJobsCount() > 0)
+      {
+        lock.unlock();
+        compileQueue->WaitIdle();
+        lock.lock();
+      }
+      this->graphicsManifestEntries.clear();
+      this->computeManifestEntries.clear();
       this->computePipelineCache.clear();
       this->graphicsPipelineCache.clear();
       this->pipelineLayoutCache.clear();
     }
   private:
+    static void BindPipeline(vk::CommandBuffer commandBuffer, legit::BoundState *boundState, vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline)
+    {
+      if (boundState)
+      {
+        assert(boundState->GetCommandBuffer() == commandBuffer);
+        boundState->BindPipeline(bindPoint, pipeline);
+      }
+      else
+      {
+        commandBuffer.bindPipeline(bindPoint, pipeline);
+      }
+    }
+    bool BindPipelineOrFallback(vk::CommandBuffer commandBuffer, legit::BoundState *boundState, vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline, vk::Pipeline fallbackPipeline)
+    {
+      if (pipeline)
+      {
+        BindPipeline(commandBuffer, boundState, bindPoint, pipeline);
+        return true;
+      }
+      if (fallbackPipeline)
+      {
+        {
+          std::lock_guard<std::mutex> lock(cacheMutex);
+          stats.fallbackBindsCount++;
+        }
+        BindPipeline(commandBuffer, boundState, bindPoint, fallbackPipeline);
+        return true;
+      }
+      return false;
+    }
+
+    //the map itself is guarded by cacheMutex, but a compiled pipeline is published through an atomic pointer so compile threads never block on recording ones
+    template<typename PipelineType>
+    struct PipelineSlot
+    {
+      std::atomic<PipelineType*> pipeline = nullptr;
+      std::unique_ptr<PipelineType> storage; //only touched by whoever compiles the pipeline
+      bool isQueued = false;
+      //set by a compile thread if creating the pipeline threw, rethrown on the next bind
+      std::exception_ptr compileError;
+      std::atomic<bool> hasCompileError = false;
+    };
+
+    template<typename PipelineType>
+    void PublishPipeline(PipelineSlot<PipelineType> *slot, std::unique_ptr<PipelineType> &&pipeline)
+    {
+      slot->storage = std::move(pipeline);
+      slot->pipeline.store(slot->storage.get(), std::memory_order_release);
+    }
+
+    //expects cacheMutex to be locked
+    void RegisterCreatedPipeline(bool isCacheHit)
+    {
+      stats.cacheHitsCount += isCacheHit ? 1 : 0;
+      pipelinesCreatedSinceSave++;
+    }
+
+    //for pipelines compiled off the recording thread, cacheMutex must not be locked. an exception would terminate the compile thread,
+    //so it's kept in the slot instead
+    template<typename PipelineType, typename CreateFunc>
+    void CompileIntoSlot(PipelineSlot<PipelineType> *slot, size_t &createdCount, CreateFunc createFunc)
+    {
+      std::unique_ptr<PipelineType> newPipeline;
+      try
+      {
+        newPipeline = createFunc();
+      }
+      catch (...)
+      {
+        slot->compileError = std::current_exception();
+        slot->hasCompileError.store(true, std::memory_order_release);
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        createdCount++;
+        RegisterCreatedPipeline(newPipeline->IsCacheHit());
+      }
+      PublishPipeline(slot, std::move(newPipeline));
+    }
+
+    //returns nullptr in async mode if the pipeline isn't compiled yet. expects cacheMutex to be locked
+    template<typename PipelineType, typename KeyType, typename CreateFunc>
+    PipelineType *GetOrQueuePipeline(std::unique_ptr<PipelineSlot<PipelineType> > &slot, const KeyType &key, size_t &createdCount, CreateFunc createFunc)
+    {
+      if (!slot)
+        slot.reset(new PipelineSlot<PipelineType>());
+      PipelineType *pipeline = slot->pipeline.load(std::memory_order_acquire);
+      if (pipeline)
+        return pipeline;
+
+      if (slot->hasCompileError.load(std::memory_order_acquire))
+      {
+        //rethrown once on the recording thread, the next bind tries to compile it again like a synchronous miss would
+        std::exception_ptr compileError = slot->compileError;
+        slot->compileError = nullptr;
+        slot->hasCompileError.store(false, std::memory_order_relaxed);
+        slot->isQueued = false;
+        std::rethrow_exception(compileError);
+      }
+
+      if (!compileQueue)
+      {
+        //a replayed pipeline may still be compiling on a worker
+        if (slot->isQueued)
+          return nullptr;
+        PublishPipeline(slot.get(), createFunc(key));
+        createdCount++;
+        RegisterCreatedPipeline(slot->storage->IsCacheHit());
+        return slot->storage.get();
+      }
+
+      if (!slot->isQueued)
+      {
+        slot->isQueued = true;
+        auto *slotPtr = slot.get();
+        compileQueue->Push([this, slotPtr, key, &createdCount, createFunc]()
+        {
+          CompileIntoSlot(slotPtr, createdCount, [&]() { return createFunc(key); });
+        });
+      }
+      return nullptr;
+    }
+
+    struct DiskHeader
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t vendorID;
+      uint32_t deviceID;
+      uint32_t driverVersion;
+      uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+      uint64_t dataSize;
+      uint64_t dataHash;
+    };
+    static const uint32_t diskHeaderMagic = 0x4c505343; //"LPSC"
+    static const uint32_t diskHeaderVersion = 1;
+
+    DiskHeader GetExpectedHeader() const
+    {
+      DiskHeader header = {};
+      header.magic = diskHeaderMagic;
+      header.version = diskHeaderVersion;
+      header.vendorID = deviceProperties.vendorID;
+      header.deviceID = deviceProperties.deviceID;
+      header.driverVersion = deviceProperties.driverVersion;
+      std::memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+      return header;
+    }
+
+    static uint64_t ComputeHash(const uint8_t *data, size_t size)
+    {
+      uint64_t hash = 14695981039346656037ull; //FNV-1a
+      for (size_t i = 0; i < size; i++)
+      {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+      }
+      return hash;
+    }
+
+    //a cache from another device or driver is at best useless and at worst crashes the driver, so anything that doesn't match exactly is dropped
+    std::vector<uint8_t> LoadFromDisk()
+    {
+      std::ifstream file(cacheFilename, std::ios::binary);
+      if (!file)
+        return {};
+
+      DiskHeader header;
+      if (!file.read((char*)&header, sizeof(header)))
+        return {};
+      DiskHeader expectedHeader = GetExpectedHeader();
+      if (header.magic != expectedHeader.magic || header.version != expectedHeader.version ||
+        header.vendorID != expectedHeader.vendorID || header.deviceID != expectedHeader.deviceID || header.driverVersion != expectedHeader.driverVersion ||
+        std::memcmp(header.pipelineCacheUUID, expectedHeader.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+      {
+        std::cout << "Pipeline cache " << cacheFilename << " was created for a different device or driver, ignoring it\n";
+        return {};
+      }
+
+      //dataSize comes from the file, so it's checked against what's actually left in it before anything is allocated
+      auto dataBegin = file.tellg();
+      file.seekg(0, std::ios::end);
+      auto fileEnd = file.tellg();
+      file.seekg(dataBegin);
+      if (dataBegin < 0 || fileEnd < dataBegin || header.dataSize > uint64_t(fileEnd - dataBegin))
+      {
+        std::cout << "[BAD BUT NOT CRITICAL]: Pipeline cache " << cacheFilename << " is corrupted, ignoring it\n";
+        return {};
+      }
+
+      std::vector<uint8_t> data(size_t(header.dataSize));
+      if (!file.read((char*)data.data(), data.size()) || ComputeHash(data.data(), data.size()) != header.dataHash)
+      {
+        std::cout << "[BAD BUT NOT CRITICAL]: Pipeline cache " << cacheFilename << " is corrupted, ignoring it\n";
+        return {};
+      }
+      return data;
+    }
+
     struct PipelineLayoutKey
     {
       std::vector<vk::DescriptorSetLayout> setLayouts;
+      std::vector<vk::PushConstantRange> pushConstantRanges;
       bool operator < (const PipelineLayoutKey &other) const
       {
-        return
-          std::tie(setLayouts) < std::tie(other.setLayouts);
+        auto rangeLess = [](const vk::PushConstantRange &left, const vk::PushConstantRange &right)
+        {
+          return std::tie(left.stageFlags, left.offset, left.size) < std::tie(right.stageFlags, right.offset, right.size);
+        };
+        if (setLayouts != other.setLayouts)
+          return setLayouts < other.setLayouts;
+        return std::lexicographical_compare(pushConstantRanges.begin(), pushConstantRanges.end(), other.pushConstantRanges.begin(), other.pushConstantRanges.end(), rangeLess);
       }
     };
 
-    vk::UniquePipelineLayout CreatePipelineLayout(const std::vector<vk::DescriptorSetLayout> &setLayouts/*, push constant ranges*/)
+    vk::UniquePipelineLayout CreatePipelineLayout(const std::vector<vk::DescriptorSetLayout> &setLayouts, const std::vector<vk::PushConstantRange> &pushConstantRanges)
     {
       auto pipelineLayoutInfo = vk::PipelineLayoutCreateInfo()
-        .setPushConstantRangeCount(0)
-        .setPPushConstantRanges(nullptr)
+        .setPushConstantRangeCount(uint32_t(pushConstantRanges.size()))
+        .setPPushConstantRanges(pushConstantRanges.data())
         .setSetLayoutCount(uint32_t(setLayouts.size()))
         .setPSetLayouts(setLayouts.data());
 
       return logicalDevice.createPipelineLayoutUnique(pipelineLayoutInfo);
     }
 
+    //sets declaring unsized arrays are all backed by the one global bindless set
+    vk::DescriptorSetLayout GetDescriptorSetLayout(const legit::DescriptorSetLayoutKey &setLayoutKey, bool isPushDescriptorSet)
+    {
+      if (setLayoutKey.IsBindless())
+      {
+        if (!bindlessDescriptorSet)
+          throw std::runtime_error("Shader declares unsized descriptor arrays, but bindless descriptors are not enabled");
+        assert(bindlessDescriptorSet->IsCompatible(setLayoutKey));
+        return bindlessDescriptorSet->GetSetLayout();
+      }
+      if (isPushDescriptorSet && descriptorSetCache->IsPushDescriptorsEnabled())
+        return descriptorSetCache->GetPushDescriptorSetLayout(setLayoutKey);
+      return descriptorSetCache->GetDescriptorSetLayout(setLayoutKey);
+    }
+
     vk::PipelineLayout GetPipelineLayout(const PipelineLayoutKey &key)
     {
       auto &pipelineLayout = pipelineLayoutCache[key];
       if (!pipelineLayout)
-        pipelineLayout = CreatePipelineLayout(key.setLayouts);
+        pipelineLayout = CreatePipelineLayout(key.setLayouts, key.pushConstantRanges);
       return pipelineLayout.get();
     }
 
@@ -168,24 +614,61 @@ namespace legit
       }
     };
 
+    GraphicsPipelineKey MakeGraphicsPipelineKey(
+      vk::RenderPass renderPass,
+      legit::DepthSettings depthSettings,
+      vk::CullModeFlags cullMode,
+      const std::vector<legit::BlendSettings> &attachmentBlendSettings,
+      const legit::VertexDeclaration &vertexDeclaration,
+      vk::PrimitiveTopology topology,
+      legit::ShaderProgram *shaderProgram)
+    {
+      GraphicsPipelineKey pipelineKey;
+      pipelineKey.vertexShaderModule = shaderProgram->vertexShader->GetModule()->GetHandle();
+      pipelineKey.vertexShaderHash = shaderProgram->vertexShader->GetModule()->GetHash();
+      pipelineKey.fragmentShaderModule = shaderProgram->fragmentShader->GetModule()->GetHandle();
+      pipelineKey.fragmentShaderHash = shaderProgram->fragmentShader->GetModule()->GetHash();
+      pipelineKey.vertexDecl = vertexDeclaration;
+      pipelineKey.depthSettings = depthSettings;
+      pipelineKey.cullMode = cullMode;
+      pipelineKey.attachmentBlendSettings = attachmentBlendSettings;
+      pipelineKey.topology = topology;
+      pipelineKey.renderPass = renderPass;
+
+      PipelineLayoutKey pipelineLayoutKey;
+      for (size_t setIndex = 0; setIndex < shaderProgram->combinedDescriptorSetLayoutKeys.size(); setIndex++)
+      {
+        pipelineLayoutKey.setLayouts.push_back(GetDescriptorSetLayout(shaderProgram->combinedDescriptorSetLayoutKeys[setIndex], shaderProgram->IsPushDescriptorSet(setIndex)));
+      }
+      pipelineLayoutKey.pushConstantRanges = shaderProgram->GetPushConstantRanges();
+
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      pipelineKey.pipelineLayout = GetPipelineLayout(pipelineLayoutKey);
+      return pipelineKey;
+    }
+
+    std::unique_ptr<legit::GraphicsPipeline> CreateGraphicsPipeline(const GraphicsPipelineKey &key)
+    {
+      return std::unique_ptr<legit::GraphicsPipeline>(new legit::GraphicsPipeline(
+        logicalDevice,
+        key.vertexShaderModule,
+        key.fragmentShaderModule,
+        key.vertexDecl,
+        key.pipelineLayout,
+        key.depthSettings,
+        key.cullMode,
+        key.attachmentBlendSettings,
+        key.topology,
+        key.renderPass,
+        pipelineCache.get(),
+        useCreationFeedback,
+        GetPipelineCreateFlags()));
+    }
+
     legit::GraphicsPipeline *GetGraphicsPipeline(const GraphicsPipelineKey &key)
     {
-      auto &pipeline = graphicsPipelineCache[key];
-      if (!pipeline)
-        pipeline = std::unique_ptr<legit::GraphicsPipeline>(new legit::GraphicsPipeline(
-          logicalDevice,
-          key.vertexShaderModule,
-          key.fragmentShaderModule,
-          key.vertexDecl,
-          key.pipelineLayout,
-          key.depthSettings,
-          key.cullMode,
-          key.attachmentBlendSettings,
-          key.topology,
-          key.renderPass));
-      return pipeline.get();
+      return GetOrQueuePipeline(graphicsPipelineCache[key], key, stats.graphicsPipelinesCount, [this](const GraphicsPipelineKey &key) { return CreateGraphicsPipeline(key); });
     }
-    
 
     struct ComputePipelineKey
     {
@@ -203,18 +686,189 @@ namespace legit
       }
     };
 
+    ComputePipelineKey MakeComputePipelineKey(legit::Shader *computeShader)
+    {
+      ComputePipelineKey pipelineKey;
+      pipelineKey.computeShader = computeShader->GetModule()->GetHandle();
+
+      PipelineLayoutKey pipelineLayoutKey;
+      pipelineLayoutKey.setLayouts.resize(computeShader->GetSetsCount());
+      for (size_t setIndex = 0; setIndex < pipelineLayoutKey.setLayouts.size(); setIndex++)
+      {
+        vk::DescriptorSetLayout setLayoutHandle = nullptr;
+        auto computeSetInfo = computeShader->GetSetInfo(setIndex);
+        if (!computeSetInfo->IsEmpty())
+          setLayoutHandle = GetDescriptorSetLayout(*computeSetInfo, computeShader->IsPushDescriptorSet(setIndex));
+
+        pipelineLayoutKey.setLayouts[setIndex] = setLayoutHandle;
+      }
+      pipelineLayoutKey.pushConstantRanges = computeShader->GetPushConstantRanges();
+
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      pipelineKey.pipelineLayout = GetPipelineLayout(pipelineLayoutKey);
+      return pipelineKey;
+    }
+
+    std::unique_ptr<legit::ComputePipeline> CreateComputePipeline(const ComputePipelineKey &key)
+    {
+      return std::unique_ptr<legit::ComputePipeline>(new legit::ComputePipeline(logicalDevice, key.computeShader, key.pipelineLayout, pipelineCache.get(), useCreationFeedback, GetPipelineCreateFlags()));
+    }
+
+    //pipelines can only use descriptor buffer set layouts if they're created for it
+    vk::PipelineCreateFlags GetPipelineCreateFlags()
+    {
+      return descriptorSetCache->IsDescriptorBufferEnabled() ? vk::PipelineCreateFlags(vk::PipelineCreateFlagBits::eDescriptorBufferEXT) : vk::PipelineCreateFlags();
+    }
+
     legit::ComputePipeline *GetComputePipeline(const ComputePipelineKey &key)
     {
-      auto &pipeline = computePipelineCache[key];
-      if (!pipeline)
-        pipeline = std::unique_ptr<legit::ComputePipeline>(new legit::ComputePipeline(logicalDevice, key.computeShader, key.pipelineLayout));
-      return pipeline.get();
+      return GetOrQueuePipeline(computePipelineCache[key], key, stats.computePipelinesCount, [this](const ComputePipelineKey &key) { return CreateComputePipeline(key); });
+    }
+
+    struct GraphicsManifestEntry
+    {
+      uint64_t vertexShaderHash;
+      uint64_t fragmentShaderHash;
+      legit::VertexDeclaration vertexDecl;
+      legit::DepthSettings depthSettings;
+      vk::CullModeFlags cullMode;
+      std::vector<legit::BlendSettings> attachmentBlendSettings;
+      vk::PrimitiveTopology topology;
+      legit::RenderPassCache::RenderPassKey renderPassKey;
+    };
+    struct ComputeManifestEntry
+    {
+      uint64_t computeShaderHash;
+    };
+    static constexpr uint32_t manifestMagic = 0x4c504d46; //"LPMF"
+    static constexpr uint32_t manifestVersion = 1;
+
+    //expects cacheMutex to be locked. pipelines for render passes that didn't come from the render pass cache can't be described and are skipped
+    void AddGraphicsManifestEntry(const GraphicsPipelineKey &key, legit::ShaderProgram *shaderProgram)
+    {
+      GraphicsManifestEntry entry;
+      if (!renderPassCache || !renderPassCache->FindRenderPassKey(key.renderPass, entry.renderPassKey))
+        return;
+      entry.vertexShaderHash = shaderProgram->vertexShader->GetModule()->GetContentHash();
+      entry.fragmentShaderHash = shaderProgram->fragmentShader->GetModule()->GetContentHash();
+      entry.vertexDecl = key.vertexDecl;
+      entry.depthSettings = key.depthSettings;
+      entry.cullMode = key.cullMode;
+      entry.attachmentBlendSettings = key.attachmentBlendSettings;
+      entry.topology = key.topology;
+      graphicsManifestEntries.push_back(entry);
+    }
+
+    //everything written is trivially copyable, the manifest is only meant to be read back by the same build
+    template<typename T>
+    static void WritePod(std::ofstream &file, const T &value)
+    {
+      file.write((const char*)&value, sizeof(T));
+    }
+    template<typename T>
+    static void WriteVector(std::ofstream &file, const std::vector<T> &values)
+    {
+      WritePod(file, uint32_t(values.size()));
+      file.write((const char*)values.data(), values.size() * sizeof(T));
+    }
+    template<typename T>
+    static bool ReadPod(std::ifstream &file, T &value)
+    {
+      return bool(file.read((char*)&value, sizeof(T)));
+    }
+    //counts come from the file, so they're checked against what's left in it before anything gets allocated for them
+    static bool IsCountInFile(std::ifstream &file, uint32_t count, size_t elementSize)
+    {
+      auto pos = file.tellg();
+      file.seekg(0, std::ios::end);
+      auto end = file.tellg();
+      file.seekg(pos);
+      return pos >= 0 && end >= pos && uint64_t(count) * elementSize <= uint64_t(end - pos);
+    }
+    template<typename T>
+    static bool ReadVector(std::ifstream &file, std::vector<T> &values)
+    {
+      uint32_t count;
+      if (!ReadPod(file, count) || !IsCountInFile(file, count, sizeof(T)))
+        return false;
+      values.resize(count);
+      return bool(file.read((char*)values.data(), count * sizeof(T)));
+    }
+
+    static bool LoadManifest(std::string filename, std::vector<GraphicsManifestEntry> &graphicsEntries, std::vector<ComputeManifestEntry> &computeEntries)
+    {
+      std::ifstream file(filename, std::ios::binary);
+      if (!file)
+        return false;
+      if (!ReadManifest(file, graphicsEntries, computeEntries))
+      {
+        std::cout << "[BAD BUT NOT CRITICAL]: Pipeline manifest " << filename << " has wrong format, ignoring it\n";
+        graphicsEntries.clear();
+        computeEntries.clear();
+        return false;
+      }
+      return true;
+    }
+    static bool ReadManifest(std::ifstream &file, std::vector<GraphicsManifestEntry> &graphicsEntries, std::vector<ComputeManifestEntry> &computeEntries)
+    {
+      uint32_t magic, version, graphicsCount, computeCount;
+      if (!ReadPod(file, magic) || !ReadPod(file, version) || magic != manifestMagic || version != manifestVersion || !ReadPod(file, graphicsCount))
+        return false;
+      for (uint32_t entryIndex = 0; entryIndex < graphicsCount; entryIndex++)
+      {
+        GraphicsManifestEntry entry;
+        std::vector<vk::VertexInputBindingDescription> bindingDescs;
+        std::vector<vk::VertexInputAttributeDescription> vertexAttributes;
+        bool isRead =
+          ReadPod(file, entry.vertexShaderHash) &&
+          ReadPod(file, entry.fragmentShaderHash) &&
+          ReadVector(file, bindingDescs) &&
+          ReadVector(file, vertexAttributes) &&
+          ReadPod(file, entry.depthSettings) &&
+          ReadPod(file, entry.cullMode) &&
+          ReadVector(file, entry.attachmentBlendSettings) &&
+          ReadPod(file, entry.topology) &&
+          ReadVector(file, entry.renderPassKey.colorAttachmentDescs) &&
+          ReadPod(file, entry.renderPassKey.depthAttachmentDesc);
+        if (!isRead)
+          return false;
+        for (auto bindingDesc : bindingDescs)
+          entry.vertexDecl.AddVertexInputBinding(bindingDesc);
+        for (auto vertexAttribute : vertexAttributes)
+          entry.vertexDecl.AddVertexAttribute(vertexAttribute);
+        graphicsEntries.push_back(entry);
+      }
+      if (!ReadPod(file, computeCount) || !IsCountInFile(file, computeCount, sizeof(uint64_t)))
+        return false;
+      computeEntries.resize(computeCount);
+      for (auto &entry : computeEntries)
+      {
+        if (!ReadPod(file, entry.computeShaderHash))
+          return false;
+      }
+      return true;
     }
 
-    std::map<GraphicsPipelineKey, std::unique_ptr<legit::GraphicsPipeline>> graphicsPipelineCache;
-    std::map<ComputePipelineKey, std::unique_ptr<legit::ComputePipeline>> computePipelineCache;
+    std::map<GraphicsPipelineKey, std::unique_ptr<PipelineSlot<legit::GraphicsPipeline> > > graphicsPipelineCache;
+    std::map<ComputePipelineKey, std::unique_ptr<PipelineSlot<legit::ComputePipeline> > > computePipelineCache;
     std::map<PipelineLayoutKey, vk::UniquePipelineLayout> pipelineLayoutCache;
+    std::vector<GraphicsManifestEntry> graphicsManifestEntries;
+    std::vector<ComputeManifestEntry> computeManifestEntries;
+    legit::RenderPassCache *renderPassCache = nullptr;
+    legit::BindlessDescriptorSet *bindlessDescriptorSet = nullptr;
     legit::DescriptorSetCache *descriptorSetCache;
+    //pipelines get bound from render graph record callbacks, which may run on several threads
+    std::mutex cacheMutex;
+
+    vk::UniquePipelineCache pipelineCache;
+    std::string cacheFilename;
+    bool useCreationFeedback;
+    vk::PhysicalDeviceProperties deviceProperties;
+    Stats stats;
+    size_t pipelinesCreatedSinceSave = 0;
+    std::chrono::steady_clock::time_point lastSaveTime;
+    //declared after the caches so that running compilations finish before their slots are destroyed
+    std::unique_ptr<legit::JobQueue> compileQueue;
 
     vk::Device logicalDevice;
   };
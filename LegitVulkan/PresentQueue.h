@@ -75,7 +75,15 @@ namespace legit
     InFlightQueue(legit::Core *core, legit::WindowDesc windowDesc, glm::uvec2 defaultSize, uint32_t inFlightCount, uint32_t desiredSwapchainImageCount, vk::PresentModeKHR preferredMode, bool waitForPreviousFrame = false)
     {
       this->core = core;
-      this->memoryPool = std::make_unique<legit::ShaderMemoryPool>(core->GetDynamicMemoryAlignment());
+      //descriptors in a descriptor buffer address uniforms by their device address
+      vk::BufferUsageFlags shaderMemoryUsage = vk::BufferUsageFlagBits::eUniformBuffer;
+      if (core->GetDescriptorSetCache()->IsDescriptorBufferEnabled())
+        shaderMemoryUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
+      this->memoryPool = std::make_unique<legit::ShaderMemoryPool>(core->GetMemoryAllocator(), core->GetDynamicMemoryAlignment(), inFlightCount, shaderMemoryUsage);
+      this->memoryPool->SetBufferReleaseCallback([core](const legit::Buffer *buffer) { core->GetDescriptorSetCache()->EvictUniformBufferSets(buffer); });
+      if (core->GetDescriptorSetCache()->IsDescriptorBufferEnabled())
+        core->GetDescriptorSetCache()->GetDescriptorBuffer()->SetFramesInFlightCount(inFlightCount);
+      core->GetRenderGraph()->SetFramesInFlightCount(inFlightCount);
       this->waitForPreviousFrame = waitForPreviousFrame;
       presentQueue.reset(new PresentQueue(core, windowDesc, defaultSize, desiredSwapchainImageCount, preferredMode));
 
@@ -89,13 +97,19 @@ namespace legit
 
         frame.commandBuffer = std::move(core->AllocateCommandBuffers(1)[0]);
         core->SetObjectDebugName(frame.commandBuffer.get(), std::string("Frame") + std::to_string(frameIndex) + " command buffer");
-        frame.shaderMemoryBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetPhysicalDevice(), core->GetLogicalDevice(), 100000000, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostCoherent));
         frame.gpuProfiler = std::unique_ptr<legit::GpuProfiler>(new legit::GpuProfiler(core->GetPhysicalDevice(), core->GetLogicalDevice(), 4096));
+        frame.transientDescriptorPool = core->GetDescriptorSetCache()->CreateTransientDescriptorPool();
+        frame.eventPool = std::make_unique<legit::EventPool>(core->GetLogicalDevice());
         frames.push_back(std::move(frame));
       }
 
       frameIndex = 0;
     }
+    ~InFlightQueue()
+    {
+      core->GetDescriptorSetCache()->SetTransientDescriptorPool(nullptr);
+      core->GetRenderGraph()->SetEventPool(nullptr);
+    }
     vk::Extent2D GetImageSize()
     {
       return presentQueue->GetImageSize();
@@ -122,6 +136,20 @@ namespace legit
         core->WaitForFence(currFrame.submitToRecordFence.get());
         core->ResetFence(currFrame.submitToRecordFence.get());
       }
+      //sets used by the frame that just finished are safe to evict now
+      core->GetDescriptorSetCache()->NextFrame();
+      if (core->GetBindlessDescriptorSet())
+        core->GetBindlessDescriptorSet()->NextFrame();
+      //transient sets of that frame are not in use anymore either
+      currFrame.transientDescriptorPool->Reset();
+      core->GetDescriptorSetCache()->SetTransientDescriptorPool(currFrame.transientDescriptorPool.get());
+      //and so is its part of the uniform ring
+      memoryPool->BeginFrame();
+      //and its split barrier events
+      currFrame.eventPool->Reset();
+      core->GetRenderGraph()->SetEventPool(currFrame.eventPool.get());
+      //and transient resources retired by earlier frames
+      core->GetRenderGraph()->NextFrame();
 
       {
         auto imageAcquireTask = cpuProfiler.StartScopedTask("ImageAcquire", legit::Colors::emerald);
@@ -138,11 +166,25 @@ namespace legit
         .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient)
         .setQueueFamilyIndex(core->GetQueueFamilyIndices().graphicsFamilyIndex);
       currFrame.transientCommandPool = core->GetLogicalDevice().createCommandPoolUnique(commandPoolInfo);
+
+      //recreated like the transient pool: the render graph allocates new secondary command buffers from them every frame and a reset
+      //wouldn't give those back
+      size_t recordingWorkersCount = core->GetRenderGraph()->GetRecordingWorkersCount();
+      currFrame.workerCommandPools.clear();
+      for (size_t workerIndex = 0; workerIndex < recordingWorkersCount; workerIndex++)
+        currFrame.workerCommandPools.push_back(core->GetLogicalDevice().createCommandPoolUnique(commandPoolInfo));
+
+      auto queueFamilyIndices = core->GetQueueFamilyIndices();
+      if (queueFamilyIndices.computeFamilyIndex != queueFamilyIndices.graphicsFamilyIndex)
+      {
+        currFrame.computeCommandPool.reset();
+        auto computeCommandPoolInfo = vk::CommandPoolCreateInfo(commandPoolInfo)
+          .setQueueFamilyIndex(queueFamilyIndices.computeFamilyIndex);
+        currFrame.computeCommandPool = core->GetLogicalDevice().createCommandPoolUnique(computeCommandPoolInfo);
+      }
       
       core->GetRenderGraph()->AddPass(legit::RenderGraph::FrameSyncBeginPassDesc());
 
-      memoryPool->MapBuffer(currFrame.shaderMemoryBuffer.get());
-
       FrameInfo frameInfo;
       frameInfo.memoryPool = memoryPool.get();
       frameInfo.frameIndex = frameIndex;
@@ -153,7 +195,17 @@ namespace legit
     }
     void EndFrame()
     {
-      const auto &currFrame = frames[frameIndex];
+      auto &currFrame = frames[frameIndex];
+
+      std::vector<vk::CommandPool> workerCommandPools;
+      for (auto &workerCommandPool : currFrame.workerCommandPools)
+        workerCommandPools.push_back(workerCommandPool.get());
+
+      legit::RenderGraph::AsyncComputeResources asyncComputeResources;
+      asyncComputeResources.graphicsFamilyIndex = core->GetQueueFamilyIndices().graphicsFamilyIndex;
+      asyncComputeResources.computeFamilyIndex = core->GetQueueFamilyIndices().computeFamilyIndex;
+      asyncComputeResources.computeCommandPool = currFrame.computeCommandPool.get();
+      asyncComputeResources.semaphores = &currFrame.queueSyncSemaphores;
 
       core->GetRenderGraph()->AddImagePresent(acquiredSwapchainImage.imageViewProxyId);
       core->GetRenderGraph()->AddPass(legit::RenderGraph::FrameSyncEndPassDesc());
@@ -161,39 +213,62 @@ namespace legit
       auto bufferBeginInfo = vk::CommandBufferBeginInfo()
         .setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
       currFrame.commandBuffer->begin(bufferBeginInfo);
+      std::vector<legit::RenderGraph::QueueBatch> queueBatches;
       {
         auto gpuFrame = currFrame.gpuProfiler->StartScopedFrame(currFrame.commandBuffer.get());
-        core->GetRenderGraph()->Execute(core->GetLogicalDevice(), currFrame.transientCommandPool.get(), core->GetDescriptorSetCache(), memoryPool.get(), currFrame.commandBuffer.get(), &cpuProfiler, currFrame.gpuProfiler.get());
+        queueBatches = core->GetRenderGraph()->Execute(core->GetLogicalDevice(), currFrame.transientCommandPool.get(), core->GetDescriptorSetCache(), memoryPool.get(), currFrame.commandBuffer.get(), &cpuProfiler, currFrame.gpuProfiler.get(), workerCommandPools, currFrame.computeCommandPool ? &asyncComputeResources : nullptr);
       }
-      currFrame.commandBuffer->end();
+      for (auto &queueBatch : queueBatches)
+        queueBatch.commandBuffer.end();
 
-      memoryPool->UnmapBuffer();
+      memoryPool->EndFrame();
 
       {
         auto presentTask = cpuProfiler.StartScopedTask("Submit", legit::Colors::amethyst);
-        std::vector<vk::Semaphore> waitSemaphores = { currFrame.acquireToSubmitSemaphore.get() };
-        std::vector<vk::PipelineStageFlags> waitStages = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
-        std::vector<vk::Semaphore> signalSemaphores = { acquiredSwapchainImage.submitToPresentSemaphore };
+        //pending uploads have to be on the gpu queues ahead of the frame that uses them
+        core->GetUploadManager()->Flush();
 
-        if (this->waitForPreviousFrame)
+        //the first batch is always the frame's own command buffer and the last one always goes to the graphics queue
+        for (size_t batchIndex = 0; batchIndex < queueBatches.size(); batchIndex++)
         {
-          if (previousFrameIndex != size_t(-1))
+          auto &queueBatch = queueBatches[batchIndex];
+          std::vector<vk::Semaphore> waitSemaphores = queueBatch.waitSemaphores;
+          std::vector<vk::PipelineStageFlags> waitStages = queueBatch.waitStages;
+          std::vector<vk::Semaphore> signalSemaphores = queueBatch.signalSemaphores;
+          vk::Fence fence = nullptr;
+
+          if (batchIndex == 0)
           {
-            const auto& prevFrame = frames[previousFrameIndex];
-            waitSemaphores.push_back(prevFrame.thisToNextFrameSemaphore.get());
-            waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+            waitSemaphores.push_back(currFrame.acquireToSubmitSemaphore.get());
+            waitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+            if (this->waitForPreviousFrame && previousFrameIndex != size_t(-1))
+            {
+              const auto& prevFrame = frames[previousFrameIndex];
+              waitSemaphores.push_back(prevFrame.thisToNextFrameSemaphore.get());
+              waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+            }
           }
-          signalSemaphores.push_back(currFrame.thisToNextFrameSemaphore.get());
-        }
 
+          if (batchIndex == queueBatches.size() - 1)
+          {
+            assert(queueBatch.queueFamilyType == legit::QueueFamilyTypes::Graphics);
+            signalSemaphores.push_back(acquiredSwapchainImage.submitToPresentSemaphore);
+            if (this->waitForPreviousFrame)
+              signalSemaphores.push_back(currFrame.thisToNextFrameSemaphore.get());
+            fence = currFrame.submitToRecordFence.get();
+          }
 
-        auto submitInfo = vk::SubmitInfo()
-          .setWaitSemaphores(waitSemaphores)
-          .setWaitDstStageMask(waitStages)
-          .setCommandBuffers({ currFrame.commandBuffer.get() })
-          .setSignalSemaphores(signalSemaphores);
+          auto submitInfo = vk::SubmitInfo()
+            .setWaitSemaphores(waitSemaphores)
+            .setWaitDstStageMask(waitStages)
+            .setCommandBuffers(queueBatch.commandBuffer)
+            .setSignalSemaphores(signalSemaphores);
 
-        core->GetGraphicsQueue().submit({ submitInfo }, currFrame.submitToRecordFence.get());
+          if (queueBatch.queueFamilyType == legit::QueueFamilyTypes::Compute)
+            core->GetComputeQueue().submit({ submitInfo }, nullptr);
+          else
+            core->GetGraphicsQueue().submit({ submitInfo }, fence);
+        }
       }
 
       {
@@ -203,6 +278,8 @@ namespace legit
       previousFrameIndex = frameIndex;
       frameIndex = (frameIndex + 1) % frames.size();
 
+      core->GetPipelineCache()->SaveCheckpoint();
+
       cpuProfiler.EndFrame(profilerFrameId);
       lastFrameCpuProfilerTasks = cpuProfiler.GetProfilerTasks();
     }
@@ -233,8 +310,13 @@ namespace legit
 
       vk::UniqueCommandBuffer commandBuffer;
       vk::UniqueCommandPool transientCommandPool;
-      std::unique_ptr<legit::Buffer> shaderMemoryBuffer;
+      std::vector<vk::UniqueCommandPool> workerCommandPools;
+      //only created when the device has a separate compute queue family
+      vk::UniqueCommandPool computeCommandPool;
+      std::vector<vk::UniqueSemaphore> queueSyncSemaphores;
       std::unique_ptr<legit::GpuProfiler> gpuProfiler;
+      std::unique_ptr<legit::TransientDescriptorPool> transientDescriptorPool;
+      std::unique_ptr<legit::EventPool> eventPool;
     };
     std::vector<FrameResources> frames;
     size_t frameIndex = 0;
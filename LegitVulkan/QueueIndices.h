@@ -4,5 +4,9 @@ namespace legit
   {
     uint32_t graphicsFamilyIndex;
     uint32_t presentFamilyIndex;
+    //same as graphicsFamilyIndex when the device has no separate compute family
+    uint32_t computeFamilyIndex;
+    //same as graphicsFamilyIndex when the device has no transfer-only family
+    uint32_t transferFamilyIndex;
   };
 }
\ No newline at end of file
@@ -35,7 +35,7 @@ namespace legit
   class ImageCache
   {
   public:
-    ImageCache(vk::PhysicalDevice _physicalDevice, vk::Device _logicalDevice, vk::detail::DispatchLoaderDynamic _loader) : physicalDevice(_physicalDevice), logicalDevice(_logicalDevice), loader(_loader)
+    ImageCache(legit::MemoryAllocator *_memoryAllocator, vk::detail::DispatchLoaderDynamic _loader) : memoryAllocator(_memoryAllocator), logicalDevice(_memoryAllocator->GetLogicalDevice()), loader(_loader)
     {}
 
     struct ImageKey
@@ -62,12 +62,15 @@ namespace legit
       }
     }
 
-    void PurgeUnused()
+    //returns true if any image was destroyed
+    bool PurgeUnused()
     {
+      bool isPurged = false;
       std::vector<ImageKey> toRemoveKeys;
       for (auto& cacheEntry : imageCache)
       {
         assert(cacheEntry.second.usedCount <= cacheEntry.second.images.size());
+        isPurged |= cacheEntry.second.usedCount < cacheEntry.second.images.size();
         cacheEntry.second.images.resize(cacheEntry.second.usedCount);
         if (cacheEntry.second.usedCount == 0)
           toRemoveKeys.push_back(cacheEntry.first);
@@ -76,6 +79,7 @@ namespace legit
       {
         imageCache.erase(toRemoveKey);
       }
+      return isPurged;
     }
 
     legit::ImageData *GetImage(ImageKey imageKey)
@@ -88,7 +92,7 @@ namespace legit
           imageCreateInfo = legit::Image::CreateInfo2d(glm::uvec2(imageKey.size.x, imageKey.size.y), imageKey.mipsCount, imageKey.arrayLayersCount, imageKey.format, imageKey.usageFlags);
         else
           imageCreateInfo = legit::Image::CreateInfoVolume(imageKey.size, imageKey.mipsCount, imageKey.arrayLayersCount, imageKey.format, imageKey.usageFlags);
-        auto newImage = std::unique_ptr<legit::Image>(new legit::Image(physicalDevice, logicalDevice, imageCreateInfo));
+        auto newImage = std::unique_ptr<legit::Image>(new legit::Image(memoryAllocator, imageCreateInfo));
         Core::SetObjectDebugName(logicalDevice, loader, newImage->GetImageData()->GetHandle(), imageKey.debugName);
         cacheEntry.images.emplace_back(std::move(newImage));
       }
@@ -102,7 +106,7 @@ namespace legit
       size_t usedCount;
     };
     std::map<ImageKey, ImageCacheEntry> imageCache;
-    vk::PhysicalDevice physicalDevice;
+    legit::MemoryAllocator *memoryAllocator;
     vk::Device logicalDevice;
     vk::detail::DispatchLoaderDynamic loader;
   };
@@ -136,6 +140,19 @@ namespace legit
           imageViewKey.subresourceRange.arrayLayersCount));
       return imageView.get();
     }
+    void Clear()
+    {
+      imageViewCache.clear();
+    }
+    //empties the cache without destroying the views, for when frames in flight may still use them
+    std::vector<std::unique_ptr<legit::ImageView> > Retire()
+    {
+      std::vector<std::unique_ptr<legit::ImageView> > imageViews;
+      for (auto &cacheEntry : imageViewCache)
+        imageViews.push_back(std::move(cacheEntry.second));
+      imageViewCache.clear();
+      return imageViews;
+    }
   private:
     std::map<ImageViewKey, std::unique_ptr<legit::ImageView> > imageViewCache;
     vk::PhysicalDevice physicalDevice;
@@ -148,9 +165,15 @@ namespace legit
   class BufferCache
   {
   public:
-    BufferCache(vk::PhysicalDevice _physicalDevice, vk::Device _logicalDevice) : physicalDevice(_physicalDevice), logicalDevice(_logicalDevice)
+    BufferCache(legit::MemoryAllocator *_memoryAllocator) : memoryAllocator(_memoryAllocator)
     {}
 
+    void SetExtraUsageFlags(vk::BufferUsageFlags usageFlags)
+    {
+      this->extraUsageFlags = usageFlags;
+      bufferCache.clear();
+    }
+
     struct BufferKey
     {
       uint32_t elementSize;
@@ -169,12 +192,15 @@ namespace legit
       }
     }
 
-    void PurgeUnused()
+    //returns true if any buffer was destroyed
+    bool PurgeUnused()
     {
+      bool isPurged = false;
       std::vector<BufferKey> toRemoveKeys;
       for (auto& cacheEntry : bufferCache)
       {
         assert(cacheEntry.second.usedCount <= cacheEntry.second.buffers.size());
+        isPurged |= cacheEntry.second.usedCount < cacheEntry.second.buffers.size();
         cacheEntry.second.buffers.resize(cacheEntry.second.usedCount);
         if (cacheEntry.second.usedCount == 0)
           toRemoveKeys.push_back(cacheEntry.first);
@@ -183,6 +209,7 @@ namespace legit
       {
         bufferCache.erase(toRemoveKey);
       }
+      return isPurged;
     }
 
     legit::Buffer *GetBuffer(BufferKey bufferKey)
@@ -191,10 +218,9 @@ namespace legit
       if (cacheEntry.usedCount + 1 > cacheEntry.buffers.size())
       {
         auto newBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(
-          physicalDevice,
-          logicalDevice,
+          memoryAllocator,
           bufferKey.elementSize * bufferKey.elementsCount,
-          vk::BufferUsageFlagBits::eStorageBuffer,
+          vk::BufferUsageFlagBits::eStorageBuffer | extraUsageFlags,
           vk::MemoryPropertyFlagBits::eDeviceLocal));
         cacheEntry.buffers.emplace_back(std::move(newBuffer));
       }
@@ -208,11 +234,304 @@ namespace legit
       size_t usedCount;
     };
     std::map<BufferKey, BufferCacheEntry> bufferCache;
+    legit::MemoryAllocator *memoryAllocator;
+    vk::BufferUsageFlags extraUsageFlags;
+  };
+
+
+  class AliasedResourceCache
+  {
+  public:
+    AliasedResourceCache(vk::PhysicalDevice _physicalDevice, vk::Device _logicalDevice, legit::MemoryAllocator *_memoryAllocator, vk::detail::DispatchLoaderDynamic _loader) : physicalDevice(_physicalDevice), logicalDevice(_logicalDevice), memoryAllocator(_memoryAllocator), loader(_loader)
+    {}
+
+    //buffers are recreated on the next Allocate()
+    void SetExtraBufferUsageFlags(vk::BufferUsageFlags usageFlags)
+    {
+      this->extraBufferUsageFlags = usageFlags;
+      this->imageRequests.clear();
+      this->bufferRequests.clear();
+    }
+
+    struct ResourceLifetime
+    {
+      bool Overlaps(const ResourceLifetime &other) const
+      {
+        return firstTaskIndex <= other.lastTaskIndex && other.firstTaskIndex <= lastTaskIndex;
+      }
+      bool operator == (const ResourceLifetime &other) const
+      {
+        return std::tie(firstTaskIndex, lastTaskIndex) == std::tie(other.firstTaskIndex, other.lastTaskIndex);
+      }
+      size_t firstTaskIndex;
+      size_t lastTaskIndex;
+    };
+
+    struct ImageRequest
+    {
+      ImageCache::ImageKey imageKey;
+      ResourceLifetime lifetime;
+    };
+    struct BufferRequest
+    {
+      BufferCache::BufferKey bufferKey;
+      ResourceLifetime lifetime;
+    };
+
+    struct Stats
+    {
+      vk::DeviceSize requestedSize = 0; //what transient resources would take without aliasing
+      vk::DeviceSize allocatedSize = 0; //actual size of all memory blocks
+      vk::DeviceSize peakAliveSize = 0; //largest total size of resources alive during a single task
+      size_t imagesCount = 0;
+      size_t buffersCount = 0;
+      size_t aliasedCount = 0;
+    };
+
+    //resources of a previous layout, frames in flight may still be using them
+    struct RetiredResources
+    {
+      std::vector<legit::MemoryAllocator::UniqueAllocation> memoryBlocks; //declared first so that it's freed after the resources are destroyed
+      std::vector<std::unique_ptr<legit::Image> > images;
+      std::vector<std::unique_ptr<legit::Buffer> > buffers;
+    };
+
+    //returns true if resources had to be recreated, every previously returned image and buffer is moved to retiredResources after that
+    bool Allocate(const std::vector<ImageRequest> &imageRequests, const std::vector<BufferRequest> &bufferRequests, RetiredResources &retiredResources)
+    {
+      if (IsSameLayout(imageRequests, bufferRequests))
+        return false;
+
+      retiredResources.memoryBlocks = std::move(memoryBlocks);
+      retiredResources.images = std::move(images);
+      retiredResources.buffers = std::move(buffers);
+      images.clear();
+      buffers.clear();
+      resources.clear();
+      memoryBlocks.clear();
+      this->imageRequests = imageRequests;
+      this->bufferRequests = bufferRequests;
+
+      for (const auto &imageRequest : imageRequests)
+      {
+        auto imageKey = imageRequest.imageKey;
+        vk::ImageCreateInfo imageCreateInfo;
+        if (imageKey.size.z == glm::u32(-1))
+          imageCreateInfo = legit::Image::CreateInfo2d(glm::uvec2(imageKey.size.x, imageKey.size.y), imageKey.mipsCount, imageKey.arrayLayersCount, imageKey.format, imageKey.usageFlags);
+        else
+          imageCreateInfo = legit::Image::CreateInfoVolume(imageKey.size, imageKey.mipsCount, imageKey.arrayLayersCount, imageKey.format, imageKey.usageFlags);
+        auto newImage = std::unique_ptr<legit::Image>(new legit::Image(logicalDevice, imageCreateInfo));
+        Core::SetObjectDebugName(logicalDevice, loader, newImage->GetImageData()->GetHandle(), imageKey.debugName);
+
+        Resource resource;
+        resource.memoryRequirements = newImage->GetMemoryRequirements();
+        resource.lifetime = imageRequest.lifetime;
+        resources.push_back(resource);
+        images.emplace_back(std::move(newImage));
+      }
+      for (const auto &bufferRequest : bufferRequests)
+      {
+        auto newBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(
+          logicalDevice,
+          bufferRequest.bufferKey.elementSize * bufferRequest.bufferKey.elementsCount,
+          vk::BufferUsageFlagBits::eStorageBuffer | extraBufferUsageFlags));
+
+        Resource resource;
+        resource.memoryRequirements = newBuffer->GetMemoryRequirements();
+        resource.lifetime = bufferRequest.lifetime;
+        resources.push_back(resource);
+        buffers.emplace_back(std::move(newBuffer));
+      }
+
+      PlaceResources();
+
+      for (size_t imageIndex = 0; imageIndex < images.size(); imageIndex++)
+      {
+        const auto &resource = resources[imageIndex];
+        const auto &memoryBlock = memoryBlocks[resource.memoryBlockIndex];
+        images[imageIndex]->BindMemory(logicalDevice, memoryBlock->memory, memoryBlock->offset + resource.offset);
+      }
+      for (size_t bufferIndex = 0; bufferIndex < buffers.size(); bufferIndex++)
+      {
+        const auto &resource = resources[images.size() + bufferIndex];
+        const auto &memoryBlock = memoryBlocks[resource.memoryBlockIndex];
+        buffers[bufferIndex]->BindMemory(memoryBlock->memory, memoryBlock->offset + resource.offset);
+      }
+      return true;
+    }
+
+    legit::ImageData *GetImage(size_t imageIndex)
+    {
+      return images[imageIndex]->GetImageData();
+    }
+    legit::Buffer *GetBuffer(size_t bufferIndex)
+    {
+      return buffers[bufferIndex].get();
+    }
+
+    //resources that occupied the same memory earlier in the frame, indices of images come first, then buffers
+    const std::vector<size_t> &GetAliasedPredecessors(size_t resourceIndex) const
+    {
+      return resources[resourceIndex].aliasedPredecessors;
+    }
+    size_t GetImagesCount() const
+    {
+      return images.size();
+    }
+    const Stats &GetStats() const
+    {
+      return stats;
+    }
+  private:
+    struct Resource
+    {
+      vk::MemoryRequirements memoryRequirements;
+      ResourceLifetime lifetime;
+      uint32_t memoryTypeIndex;
+      size_t memoryBlockIndex;
+      vk::DeviceSize offset;
+      std::vector<size_t> aliasedPredecessors;
+    };
+
+    bool IsSameLayout(const std::vector<ImageRequest> &imageRequests, const std::vector<BufferRequest> &bufferRequests)
+    {
+      if (imageRequests.size() != this->imageRequests.size() || bufferRequests.size() != this->bufferRequests.size())
+        return false;
+      for (size_t imageIndex = 0; imageIndex < imageRequests.size(); imageIndex++)
+      {
+        const auto &lhs = imageRequests[imageIndex];
+        const auto &rhs = this->imageRequests[imageIndex];
+        if (lhs.imageKey < rhs.imageKey || rhs.imageKey < lhs.imageKey || !(lhs.lifetime == rhs.lifetime))
+          return false;
+      }
+      for (size_t bufferIndex = 0; bufferIndex < bufferRequests.size(); bufferIndex++)
+      {
+        const auto &lhs = bufferRequests[bufferIndex];
+        const auto &rhs = this->bufferRequests[bufferIndex];
+        if (lhs.bufferKey < rhs.bufferKey || rhs.bufferKey < lhs.bufferKey || !(lhs.lifetime == rhs.lifetime))
+          return false;
+      }
+      return true;
+    }
+
+    static vk::DeviceSize AlignOffset(vk::DeviceSize offset, vk::DeviceSize alignment)
+    {
+      return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    static bool RangesOverlap(const Resource &lhs, const Resource &rhs)
+    {
+      return lhs.offset < rhs.offset + rhs.memoryRequirements.size && rhs.offset < lhs.offset + lhs.memoryRequirements.size;
+    }
+
+    //greedy placement: biggest resources first, each one goes to the lowest offset that does not collide with any placed resource alive at the same time
+    void PlaceResources()
+    {
+      vk::DeviceSize granularity = physicalDevice.getProperties().limits.bufferImageGranularity;
+
+      std::vector<size_t> order(resources.size());
+      for (size_t resourceIndex = 0; resourceIndex < resources.size(); resourceIndex++)
+      {
+        order[resourceIndex] = resourceIndex;
+        resources[resourceIndex].memoryTypeIndex = legit::FindMemoryTypeIndex(physicalDevice, resources[resourceIndex].memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      }
+      std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+      {
+        return resources[lhs].memoryRequirements.size > resources[rhs].memoryRequirements.size;
+      });
+
+      std::map<uint32_t, vk::DeviceSize> memoryTypeToBlockSize;
+      std::vector<size_t> placed;
+      for (size_t resourceIndex : order)
+      {
+        auto &resource = resources[resourceIndex];
+        vk::DeviceSize alignment = std::max(resource.memoryRequirements.alignment, granularity);
+
+        std::vector<std::pair<vk::DeviceSize, vk::DeviceSize> > occupiedRanges;
+        for (size_t placedIndex : placed)
+        {
+          const auto &placedResource = resources[placedIndex];
+          if (placedResource.memoryTypeIndex == resource.memoryTypeIndex && placedResource.lifetime.Overlaps(resource.lifetime))
+            occupiedRanges.push_back({ placedResource.offset, placedResource.offset + placedResource.memoryRequirements.size });
+        }
+        std::sort(occupiedRanges.begin(), occupiedRanges.end());
+
+        vk::DeviceSize offset = 0;
+        for (const auto &occupiedRange : occupiedRanges)
+        {
+          if (offset + resource.memoryRequirements.size <= occupiedRange.first)
+            break;
+          offset = std::max(offset, AlignOffset(occupiedRange.second, alignment));
+        }
+        resource.offset = offset;
+
+        auto &blockSize = memoryTypeToBlockSize[resource.memoryTypeIndex];
+        blockSize = std::max(blockSize, offset + resource.memoryRequirements.size);
+        placed.push_back(resourceIndex);
+      }
+
+      stats = Stats();
+      stats.imagesCount = images.size();
+      stats.buffersCount = buffers.size();
+
+      std::map<uint32_t, size_t> memoryTypeToBlockIndex;
+      for (auto &memoryTypeBlock : memoryTypeToBlockSize)
+      {
+        //aliasing blocks are large and recreated together, so each one gets its own device memory
+        auto memoryRequirements = vk::MemoryRequirements()
+          .setSize(memoryTypeBlock.second)
+          .setAlignment(1)
+          .setMemoryTypeBits(1 << memoryTypeBlock.first);
+        memoryTypeToBlockIndex[memoryTypeBlock.first] = memoryBlocks.size();
+        bool isDeviceAddressUsed = bool(extraBufferUsageFlags & vk::BufferUsageFlagBits::eShaderDeviceAddress);
+        memoryBlocks.push_back(memoryAllocator->Allocate(memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, false, isDeviceAddressUsed, legit::MemoryAllocator::AllocationTypes::Dedicated));
+        stats.allocatedSize += memoryTypeBlock.second;
+      }
+
+      for (size_t resourceIndex = 0; resourceIndex < resources.size(); resourceIndex++)
+      {
+        auto &resource = resources[resourceIndex];
+        resource.memoryBlockIndex = memoryTypeToBlockIndex[resource.memoryTypeIndex];
+        stats.requestedSize += resource.memoryRequirements.size;
+
+        for (size_t otherIndex = 0; otherIndex < resources.size(); otherIndex++)
+        {
+          const auto &other = resources[otherIndex];
+          if (otherIndex != resourceIndex && other.memoryTypeIndex == resource.memoryTypeIndex && other.lifetime.lastTaskIndex < resource.lifetime.firstTaskIndex && RangesOverlap(resource, other))
+            resource.aliasedPredecessors.push_back(otherIndex);
+        }
+        if (resource.aliasedPredecessors.size() > 0)
+          stats.aliasedCount++;
+      }
+
+      for (const auto &resource : resources)
+      {
+        vk::DeviceSize aliveSize = 0;
+        for (const auto &other : resources)
+        {
+          if (other.lifetime.firstTaskIndex <= resource.lifetime.firstTaskIndex && resource.lifetime.firstTaskIndex <= other.lifetime.lastTaskIndex)
+            aliveSize += other.memoryRequirements.size;
+        }
+        stats.peakAliveSize = std::max(stats.peakAliveSize, aliveSize);
+      }
+    }
+
+    std::vector<ImageRequest> imageRequests;
+    std::vector<BufferRequest> bufferRequests;
+
+    std::vector<legit::MemoryAllocator::UniqueAllocation> memoryBlocks;
+    std::vector<std::unique_ptr<legit::Image> > images;
+    std::vector<std::unique_ptr<legit::Buffer> > buffers;
+    std::vector<Resource> resources;
+    Stats stats;
+    vk::BufferUsageFlags extraBufferUsageFlags;
+
     vk::PhysicalDevice physicalDevice;
     vk::Device logicalDevice;
+    legit::MemoryAllocator *memoryAllocator;
+    vk::detail::DispatchLoaderDynamic loader;
   };
 
-
   class RenderGraph
   {
   private:
@@ -303,15 +622,17 @@ namespace legit
     };
 
   public:
-    RenderGraph(vk::PhysicalDevice _physicalDevice, vk::Device _logicalDevice, vk::detail::DispatchLoaderDynamic _loader) :
+    RenderGraph(vk::PhysicalDevice _physicalDevice, vk::Device _logicalDevice, legit::MemoryAllocator *_memoryAllocator, vk::detail::DispatchLoaderDynamic _loader) :
       physicalDevice(_physicalDevice),
       logicalDevice(_logicalDevice),
+      memoryAllocator(_memoryAllocator),
       loader(_loader),
       renderPassCache(_logicalDevice),
       framebufferCache(_logicalDevice),
-      imageCache(_physicalDevice, _logicalDevice, _loader),
+      imageCache(_memoryAllocator, _loader),
       imageViewCache(_physicalDevice, _logicalDevice),
-      bufferCache(_physicalDevice, _logicalDevice)
+      bufferCache(_memoryAllocator),
+      aliasedResourceCache(_physicalDevice, _logicalDevice, _memoryAllocator, _loader)
     {
     }
 
@@ -361,6 +682,8 @@ namespace legit
       imageViewProxy.debugName = "View";
       return ImageViewProxyUnique(ImageViewHandleInfo(this, imageViewProxies.Add(std::move(imageViewProxy))));
     }
+    //usageType is what the view is transitioned to at the end of the frame, like Present for swapchain images. with Unknown it's left in the
+    //usage of the last pass that used it and the next frame starts from there
     ImageViewProxyUnique AddExternalImageView(legit::ImageView *imageView, legit::ImageUsageTypes usageType = legit::ImageUsageTypes::Unknown)
     {
       ImageViewProxy imageViewProxy;
@@ -456,6 +779,116 @@ namespace legit
       return BufferProxyUnique(BufferHandleInfo(this, bufferProxies.Add(std::move(bufferProxy))));
     }
 
+    //transient images and buffers that are never used at the same time share device memory
+    void SetResourceAliasing(bool enabled)
+    {
+      this->resourceAliasingEnabled = enabled;
+      compiledGraphs.clear();
+    }
+    //frames with the same topology as an earlier one reuse its resolved resources, barriers, render passes and framebuffers
+    void SetGraphCompilation(bool enabled)
+    {
+      this->graphCompilationEnabled = enabled;
+      compiledGraphs.clear();
+    }
+    const AliasedResourceCache::Stats &GetTransientMemoryStats() const
+    {
+      return aliasedResourceCache.GetStats();
+    }
+    //binds recorded and skipped through pass contexts during the last Execute()
+    const legit::BoundState::Stats &GetBindStats() const
+    {
+      return bindStats;
+    }
+    //requires VK_KHR_synchronization2 to be enabled on the device. can be switched at any time, e.g. to compare gpu timings of both paths
+    void SetSynchronization2(bool enabled)
+    {
+      this->synchronization2Enabled = enabled;
+    }
+    bool IsSynchronization2Enabled() const
+    {
+      return synchronization2Enabled;
+    }
+    //on frames that replay compiled barriers, a barrier on resources last used more than one task earlier is split into an event set right
+    //after that task and a wait right before the task that needs it, so the tasks in between don't wait for it.
+    //only done with synchronization2 and an event pool, can be switched at any time to compare gpu timings
+    void SetBarrierSplitting(bool enabled)
+    {
+      this->barrierSplittingEnabled = enabled;
+    }
+    bool IsBarrierSplittingEnabled() const
+    {
+      return barrierSplittingEnabled;
+    }
+    //events of the frame that is being recorded, the owner resets them once the frame is done
+    void SetEventPool(legit::EventPool *eventPool)
+    {
+      this->eventPool = eventPool;
+    }
+    //set by InFlightQueue, transient resources replaced by a new aliasing layout are destroyed that many frames later
+    void SetFramesInFlightCount(size_t framesCount)
+    {
+      this->framesInFlightCount = std::max<size_t>(framesCount, 1);
+    }
+    //call once per frame, after waiting for the frame that is about to be reused
+    void NextFrame()
+    {
+      frameIndex++;
+      while (retiredResources.size() > 0 && retiredResources.front().frameIndex + framesInFlightCount <= frameIndex)
+        retiredResources.pop_front();
+    }
+    //duplicate barriers are dropped and barriers on adjacent subresources or buffer ranges are merged. on frames that replay compiled barriers,
+    //the barriers of consecutive tasks are also hoisted into one pipeline barrier as long as nothing in between touches their resources.
+    //that makes the hoisted barriers wait earlier than they have to, can be switched off to compare gpu timings
+    void SetBarrierOptimization(bool enabled)
+    {
+      this->barrierOptimizationEnabled = enabled;
+      compiledGraphs.clear();
+    }
+    bool IsBarrierOptimizationEnabled() const
+    {
+      return barrierOptimizationEnabled;
+    }
+    struct BarrierStats
+    {
+      //as created from resource usages, one pipeline barrier per task that has any
+      size_t imageBarriersCount = 0;
+      size_t bufferBarriersCount = 0;
+      size_t pipelineBarriersCount = 0;
+      //recorded after optimization, without split barriers
+      size_t submittedImageBarriersCount = 0;
+      size_t submittedBufferBarriersCount = 0;
+      size_t submittedPipelineBarriersCount = 0;
+      size_t splitImageBarriersCount = 0;
+      size_t splitBufferBarriersCount = 0;
+      size_t eventsCount = 0;
+    };
+    //barriers of the last Execute()
+    const BarrierStats &GetBarrierStats() const
+    {
+      return barrierStats;
+    }
+    //added to the usage of every transient buffer, e.g. eShaderDeviceAddress when they're bound through a descriptor buffer
+    void SetTransientBufferUsageFlags(vk::BufferUsageFlags usageFlags)
+    {
+      bufferCache.SetExtraUsageFlags(usageFlags);
+      aliasedResourceCache.SetExtraBufferUsageFlags(usageFlags);
+      compiledGraphs.clear();
+    }
+    //RenderPassDesc2/ComputePassDesc2 record callbacks run concurrently on workersCount threads (including the calling one), 0 or 1 records serially.
+    //callbacks must only touch thread-safe state: PassContext2 bindings, PipelineCache and their own command buffer
+    void SetParallelRecording(size_t workersCount)
+    {
+      if (workersCount > 1)
+        workerPool.reset(new WorkerPool(workersCount));
+      else
+        workerPool.reset();
+    }
+    size_t GetRecordingWorkersCount() const
+    {
+      return workerPool ? workerPool->GetWorkersCount() : 0;
+    }
+
     struct PassContext
     {
       legit::ImageView *GetImageView(ImageViewProxyId imageViewProxyId)
@@ -470,10 +903,16 @@ namespace legit
       {
         return commandBuffer;
       }
+      //pass it to PipelineCache binds and bind sets through it to skip redundant binds within the pass
+      legit::BoundState *GetBoundState()
+      {
+        return &boundState;
+      }
     private:
       std::vector<legit::ImageView *> resolvedImageViews;
       std::vector<legit::Buffer *> resolvedBuffers;
       vk::CommandBuffer commandBuffer;
+      legit::BoundState boundState;
       friend class RenderGraph;
     };
 
@@ -595,7 +1034,8 @@ namespace legit
         DescriptorSetBindings(const legit::PipelineCache::PipelineInfo &pipelineInfo, size_t setIndex) :
           setIndex(setIndex),
           shaderDataSetInfo(pipelineInfo.shaderProgram ? pipelineInfo.shaderProgram->GetSetInfo(setIndex) : pipelineInfo.computeShader->GetSetInfo(setIndex)),
-          pipelineLayout(pipelineInfo.pipelineLayout)
+          pipelineLayout(pipelineInfo.pipelineLayout),
+          isPushDescriptorSet(pipelineInfo.IsPushDescriptorSet(setIndex))
         {
         }
         DescriptorSetBindings &AddImageSamplerBinding(std::string name, const legit::ImageView *imageView, legit::Sampler *sampler)
@@ -633,6 +1073,12 @@ namespace legit
           accelerationStructureBindings.push_back(shaderDataSetInfo->MakeAccelerationStructureBinding(name, accelerationStructure));
           return *this;
         }
+        //the set is allocated from the frame's transient pool instead of the cache, for bindings that won't be seen again
+        DescriptorSetBindings &SetTransient(bool isTransient = true)
+        {
+          this->isTransient = isTransient;
+          return *this;
+        }
         
         struct UniformBinding
         {
@@ -661,6 +1107,8 @@ namespace legit
         const legit::DescriptorSetLayoutKey *shaderDataSetInfo;
         const vk::PipelineLayout pipelineLayout;
         size_t setIndex;
+        bool isPushDescriptorSet;
+        bool isTransient = false;
       };
       using BindDescriptorSetFunc = std::function<void(const DescriptorSetBindings &bindings)>;
       
@@ -672,13 +1120,27 @@ namespace legit
       {
         bindDescriptorSetFunc(bindings);
       }
+      //small per-draw values without a uniform allocation and a descriptor bind. offset is relative to the start of the push constant block
+      template<typename T>
+      void PushConstants(const legit::PipelineCache::PipelineInfo &pipelineInfo, const T &data, uint32_t offset = 0)
+      {
+        static_assert(std::is_trivially_copyable<T>::value, "push constants are copied byte by byte");
+        commandBuffer.pushConstants(pipelineInfo.pipelineLayout, pipelineInfo.GetPushConstantStageFlags(offset, uint32_t(sizeof(T))), offset, uint32_t(sizeof(T)), &data);
+      }
+      //sets bound directly through it need GetBoundState()->Invalidate() before the next BindDescriptorSet()
       vk::CommandBuffer GetCommandBuffer()
       {
         return commandBuffer;
       }
+      //BindDescriptorSet() goes through it, passing it to PipelineCache binds skips redundant pipeline binds as well
+      legit::BoundState *GetBoundState()
+      {
+        return &boundState;
+      }
     private:
       BindDescriptorSetFunc bindDescriptorSetFunc;
       vk::CommandBuffer commandBuffer;
+      legit::BoundState boundState;
       friend class RenderGraph;
     };
     
@@ -852,9 +1314,15 @@ namespace legit
       renderPassDescs2.emplace_back(renderPassDesc2);
     }
 
+    //render passes are owned by the graph, pipeline cache resolves them through it when recording and replaying manifests
+    legit::RenderPassCache *GetRenderPassCache()
+    {
+      return &renderPassCache;
+    }
+
     void Clear()
     {
-      *this = RenderGraph(physicalDevice, logicalDevice, loader);
+      *this = RenderGraph(physicalDevice, logicalDevice, memoryAllocator, loader);
     }
 
     struct ComputePassDesc
@@ -919,8 +1387,15 @@ namespace legit
         this->profilerTaskName = taskName;
         return *this;
       }
+      //async passes go to the compute queue and overlap with graphics work that doesn't depend on them
+      ComputePassDesc2 &SetAsync(bool _isAsync)
+      {
+        this->isAsync = _isAsync;
+        return *this;
+      }
 
       std::function<void(ComputePassContext2)> recordFunc;
+      bool isAsync = false;
 
       std::string profilerTaskName;
       uint32_t profilerTaskColor;
@@ -1078,8 +1553,16 @@ namespace legit
       frameSyncEndDescs.push_back(frameSyncEndDesc);
     }
     
-    static void SubmitBarriers(vk::CommandBuffer commandBuffer, Span<StateTracker::ImageBarrier> imageBarriers, Span<StateTracker::BufferBarrier> bufferBarriers)
+    //the legacy path merges the stages of all barriers into one pipelineBarrier call, so every barrier waits for the union of them.
+    //with synchronization2 each barrier keeps its own stages and narrower access flags
+    static void SubmitBarriers(vk::CommandBuffer commandBuffer, Span<StateTracker::ImageBarrier> imageBarriers, Span<StateTracker::BufferBarrier> bufferBarriers, bool useSynchronization2 = false)
     {
+      if (useSynchronization2)
+      {
+        SubmitBarriers2(commandBuffer, imageBarriers, bufferBarriers);
+        return;
+      }
+
       vk::PipelineStageFlags srcStage = {};
       vk::PipelineStageFlags dstStage = {};
 
@@ -1102,428 +1585,544 @@ namespace legit
       if (imageBarriers.size() > 0 || bufferBarriers.size() > 0)
         commandBuffer.pipelineBarrier(srcStage, dstStage, vk::DependencyFlags(), {}, vkBufferMemoryBarriers, vkImageMemoryBarriers);
     }
-
-    void Execute(vk::Device logicalDevice, vk::CommandPool transientCommandPool, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool, vk::CommandBuffer commandBuffer, legit::CpuProfiler *cpuProfiler, legit::GpuProfiler *gpuProfiler)
+    static vk::ImageMemoryBarrier2 GetImageMemoryBarrier2(const StateTracker::ImageBarrier &imageBarrier)
+    {
+      const auto &barrier = imageBarrier.imageMemoryBarrier;
+      return vk::ImageMemoryBarrier2()
+        .setSrcStageMask(GetSrcStageMask2(imageBarrier.srcStage))
+        .setSrcAccessMask(GetImageAccessMask2(barrier.srcAccessMask, barrier.oldLayout))
+        .setDstStageMask(GetDstStageMask2(imageBarrier.dstStage))
+        .setDstAccessMask(GetImageAccessMask2(barrier.dstAccessMask, barrier.newLayout))
+        .setOldLayout(barrier.oldLayout)
+        .setNewLayout(barrier.newLayout)
+        .setSrcQueueFamilyIndex(barrier.srcQueueFamilyIndex)
+        .setDstQueueFamilyIndex(barrier.dstQueueFamilyIndex)
+        .setImage(barrier.image)
+        .setSubresourceRange(barrier.subresourceRange);
+    }
+    static vk::BufferMemoryBarrier2 GetBufferMemoryBarrier2(const StateTracker::BufferBarrier &bufferBarrier)
     {
-      ResolveImages();
-      ResolveImageViews();
-      ResolveBuffers();
+      const auto &barrier = bufferBarrier.bufferMemoryBarrier;
+      return vk::BufferMemoryBarrier2()
+        .setSrcStageMask(GetSrcStageMask2(bufferBarrier.srcStage))
+        .setSrcAccessMask(GetBufferAccessMask2(barrier.srcAccessMask))
+        .setDstStageMask(GetDstStageMask2(bufferBarrier.dstStage))
+        .setDstAccessMask(GetBufferAccessMask2(barrier.dstAccessMask))
+        .setSrcQueueFamilyIndex(barrier.srcQueueFamilyIndex)
+        .setDstQueueFamilyIndex(barrier.dstQueueFamilyIndex)
+        .setBuffer(barrier.buffer)
+        .setOffset(barrier.offset)
+        .setSize(barrier.size);
+    }
+    static void SubmitBarriers2(vk::CommandBuffer commandBuffer, Span<StateTracker::ImageBarrier> imageBarriers, Span<StateTracker::BufferBarrier> bufferBarriers)
+    {
+      std::vector<vk::ImageMemoryBarrier2> vkImageMemoryBarriers;
+      for(const auto &imageBarrier : imageBarriers)
+        vkImageMemoryBarriers.push_back(GetImageMemoryBarrier2(imageBarrier));
 
-      StateTracker stateTracker;
-      
-      for (size_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+      std::vector<vk::BufferMemoryBarrier2> vkBufferMemoryBarriers;
+      for(const auto &bufferBarrier : bufferBarriers)
+        vkBufferMemoryBarriers.push_back(GetBufferMemoryBarrier2(bufferBarrier));
+
+      if (imageBarriers.size() > 0 || bufferBarriers.size() > 0)
       {
-        auto &task = tasks[taskIndex];
-        switch (task.type)
-        {
-          case Task::Types::RenderPass:
-          {
-            auto &renderPassDesc = renderPassDescs[task.index];
-            auto profilerTask = CreateProfilerTask(renderPassDesc);
-            auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
-            auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
+        auto dependencyInfo = vk::DependencyInfo()
+          .setImageMemoryBarriers(vkImageMemoryBarriers)
+          .setBufferMemoryBarriers(vkBufferMemoryBarriers);
+        //the device is created with api version 1.2, so only the extension entry point is guaranteed to be there
+        commandBuffer.pipelineBarrier2KHR(dependencyInfo);
+      }
+    }
 
-            RenderPassContext passContext;
-            passContext.resolvedImageViews.resize(imageViewProxies.GetSize(), nullptr);
-            passContext.resolvedBuffers.resize(bufferProxies.GetSize(), nullptr);
+    //a command buffer that has to be submitted to the queue of queueFamilyType after all batches preceding it
+    struct QueueBatch
+    {
+      QueueFamilyTypes queueFamilyType;
+      vk::CommandBuffer commandBuffer;
+      std::vector<vk::Semaphore> waitSemaphores;
+      std::vector<vk::PipelineStageFlags> waitStages;
+      std::vector<vk::Semaphore> signalSemaphores;
+    };
+    struct AsyncComputeResources
+    {
+      uint32_t graphicsFamilyIndex;
+      uint32_t computeFamilyIndex;
+      vk::CommandPool computeCommandPool;
+      //grown on demand, must not be in use by the gpu anymore
+      std::vector<vk::UniqueSemaphore> *semaphores;
+    };
 
-            for (auto &inputImageViewProxy : renderPassDesc.inputImageViewProxies)
-            {
-              passContext.resolvedImageViews[inputImageViewProxy.asInt] = GetResolvedImageView(taskIndex, inputImageViewProxy);
-            }
+    //workerCommandPools need one pool per recording worker, otherwise passes are recorded serially on the calling thread
+    //without asyncComputeResources async passes run on the graphics queue and the only returned batch is primaryCommandBuffer.
+    //otherwise every returned command buffer is still recording and has to be ended by the caller
+    std::vector<QueueBatch> Execute(vk::Device logicalDevice, vk::CommandPool transientCommandPool, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool, vk::CommandBuffer primaryCommandBuffer, legit::CpuProfiler *cpuProfiler, legit::GpuProfiler *gpuProfiler, const std::vector<vk::CommandPool> &workerCommandPools = {}, const AsyncComputeResources *asyncComputeResources = nullptr)
+    {
+      bool hasAsyncTasks = false;
+      for (auto &task : tasks)
+      {
+        if (task.type == Task::Types::ComputePass2 && computePassDescs2[task.index].isAsync)
+          hasAsyncTasks = true;
+      }
+      bool isMultiQueue = hasAsyncTasks && asyncComputeResources && asyncComputeResources->computeFamilyIndex != asyncComputeResources->graphicsFamilyIndex;
+      auto isAsyncTask = [&](const Task &task)
+      {
+        return isMultiQueue && task.type == Task::Types::ComputePass2 && computePassDescs2[task.index].isAsync;
+      };
 
-            for (auto &inoutStorageImageProxy : renderPassDesc.inoutStorageImageProxies)
-            {
-              passContext.resolvedImageViews[inoutStorageImageProxy.asInt] = GetResolvedImageView(taskIndex, inoutStorageImageProxy);
-            }
+      std::vector<uint64_t> topologyKey;
+      bool isStaticGraph = BuildTopologyKey(topologyKey);
+      //resources are resolved differently when async passes run on their own queue
+      topologyKey.push_back(isMultiQueue ? 1 : 0);
+      uint64_t graphHash = HashTopologyKey(topologyKey);
 
-            for (auto &inoutBufferProxy : renderPassDesc.inoutStorageBufferProxies)
-            {
-              passContext.resolvedBuffers[inoutBufferProxy.asInt] = GetResolvedBuffer(taskIndex, inoutBufferProxy);
-            }
+      CompiledGraph *compiledGraph = nullptr;
+      if (graphCompilationEnabled)
+      {
+        auto it = compiledGraphs.find(graphHash);
+        if (it != compiledGraphs.end() && it->second.topologyKey == topologyKey)
+          compiledGraph = &it->second;
+      }
+      bool isReplaying = (compiledGraph != nullptr);
 
-            for (auto& vertexBufferProxy : renderPassDesc.vertexBufferProxies)
-            {
-              passContext.resolvedBuffers[vertexBufferProxy.asInt] = GetResolvedBuffer(taskIndex, vertexBufferProxy);
-            }
+      if (!isReplaying)
+      {
+        bool resourcesRecreated = false;
+        if (resourceAliasingEnabled)
+        {
+          resourcesRecreated = ResolveAliasedResources(isMultiQueue);
+        }
+        else
+        {
+          resourcesRecreated |= ResolveImages();
+          resourcesRecreated |= ResolveBuffers();
+        }
+        ResolveImageViews();
 
-            std::vector<StateTracker::ImageBarrier> imageBarriers;
-            for (auto inputImageViewProxy : renderPassDesc.inputImageViewProxies)
-            {
-              auto imageView = GetResolvedImageView(taskIndex, inputImageViewProxy);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::GraphicsShaderRead));
-            }
+        if (resourcesRecreated || compiledGraphs.size() >= maxCompiledGraphsCount)
+          compiledGraphs.clear();
+        if (graphCompilationEnabled)
+        {
+          compiledGraph = &compiledGraphs[graphHash];
+          compiledGraph->topologyKey = std::move(topologyKey);
+          compiledGraph->isStatic = isStaticGraph;
+          compiledGraph->tasks.clear();
+          compiledGraph->tasks.resize(tasks.size());
+          compiledGraph->taskAliasedResources = taskAliasedResources;
+        }
+      }
+      //external resources start the frame in whatever usage the previous frame left them in, barriers compiled from different
+      //starting usages can't be replayed
+      StateTracker stateTracker;
+      GetPersistentResources(persistentImages, persistentBuffers);
+      stateTracker.GetPersistentUsages(persistentImages, persistentBuffers, entryUsages);
 
-            for (auto &inoutStorageImageProxy : renderPassDesc.inoutStorageImageProxies)
-            {
-              auto imageView = GetResolvedImageView(taskIndex, inoutStorageImageProxy);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::GraphicsShaderReadWrite));
-            }
+      //barriers of passes that bind resources in their record callbacks can only be known after recording them.
+      //queue ownership at the end of the frame is only known to the state tracker, so multi-queue frames don't replay barriers either
+      bool isReplayingBarriers = isReplaying && compiledGraph->isStatic && !isMultiQueue && compiledGraph->entryUsages == entryUsages;
 
-            for (auto colorAttachment : renderPassDesc.colorAttachments)
-            {
-              auto imageView = GetResolvedImageView(taskIndex, colorAttachment.imageViewProxyId);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ColorAttachment));
-            }
+      std::vector<CompiledTask> uncompiledTasks;
+      if (!compiledGraph)
+        uncompiledTasks.resize(tasks.size());
+      if (isReplaying && !isReplayingBarriers)
+        taskAliasedResources = compiledGraph->taskAliasedResources;
 
-            if(!(renderPassDesc.depthAttachment.imageViewProxyId == ImageViewProxyId()))
-            {
-              auto imageView = GetResolvedImageView(taskIndex, renderPassDesc.depthAttachment.imageViewProxyId);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::DepthAttachment));
-            }
+      auto getCompiledTask = [&](size_t taskIndex) -> CompiledTask&
+      {
+        return compiledGraph ? compiledGraph->tasks[taskIndex] : uncompiledTasks[taskIndex];
+      };
 
-            std::vector<StateTracker::BufferBarrier> bufferBarriers;
-            for (auto vertexBufferProxy : renderPassDesc.vertexBufferProxies)
-            {
-              auto storageBuffer = GetResolvedBuffer(taskIndex, vertexBufferProxy);
-              AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::VertexBuffer));
-            }
+      bindStats = legit::BoundState::Stats();
+      std::vector<PassRecording> passRecordings(tasks.size());
+      bool isRecordingInParallel = workerPool && workerCommandPools.size() >= workerPool->GetWorkersCount();
+      if (isRecordingInParallel)
+      {
+        std::vector<size_t> recordedTaskIndices;
+        for (size_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+        {
+          auto &task = tasks[taskIndex];
+          if (task.type == Task::Types::RenderPass2)
+          {
+            //render pass and framebuffer caches are not thread-safe, so the inheritance info is resolved up front
+            if (!isReplaying)
+              PrepareRenderPass2(renderPassDescs2[task.index], getCompiledTask(taskIndex));
+            recordedTaskIndices.push_back(taskIndex);
+          }
+          //worker pools belong to the graphics queue family
+          if (task.type == Task::Types::ComputePass2 && !isAsyncTask(task))
+            recordedTaskIndices.push_back(taskIndex);
+        }
 
-            for (auto inoutBufferProxy : renderPassDesc.inoutStorageBufferProxies)
-            {
-              auto storageBuffer = GetResolvedBuffer(taskIndex, inoutBufferProxy);
-              AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::GraphicsShaderReadWrite));
-            }
-
-            SubmitBarriers(commandBuffer, imageBarriers, bufferBarriers);
-            
-            std::vector<FramebufferCache::Attachment> colorAttachments;
-            FramebufferCache::Attachment depthAttachment;
-
-            legit::RenderPassCache::RenderPassKey renderPassKey;
+        auto cpuTask = cpuProfiler->StartScopedTask("ParallelRecording", legit::Colors::peterRiver);
+        workerPool->Run(recordedTaskIndices.size(), [&](size_t jobIndex, size_t workerIndex)
+        {
+          size_t taskIndex = recordedTaskIndices[jobIndex];
+          auto &task = tasks[taskIndex];
+          auto secondaryCommandBuffer = AllocateSecondaryCommandBuffer(logicalDevice, workerCommandPools[workerIndex]);
+          if (task.type == Task::Types::RenderPass2)
+            RecordRenderPass2(renderPassDescs2[task.index], getCompiledTask(taskIndex), secondaryCommandBuffer, descriptorSetCache, memoryPool, passRecordings[taskIndex]);
+          else
+            RecordComputePass2(computePassDescs2[task.index], secondaryCommandBuffer, descriptorSetCache, memoryPool, passRecordings[taskIndex]);
+        });
+      }
 
-            for (auto &attachment : renderPassDesc.colorAttachments)
-            {
-              auto imageView = GetResolvedImageView(taskIndex, attachment.imageViewProxyId);
+      //barriers of passes recorded into secondary command buffers are built here, the buffers keep their capacity between passes
+      std::vector<StateTracker::ImageBarrier> scratchImageBarriers;
+      std::vector<StateTracker::BufferBarrier> scratchBufferBarriers;
+      QueueSchedule queueSchedule(logicalDevice, transientCommandPool, primaryCommandBuffer, gpuProfiler, isMultiQueue ? asyncComputeResources : nullptr, synchronization2Enabled);
+      if (isMultiQueue)
+      {
+        stateTracker.baseQueueFamilyIndex = asyncComputeResources->graphicsFamilyIndex;
+      }
+      barrierStats = BarrierStats();
+      bool isSplittingBarriers = isReplayingBarriers && barrierSplittingEnabled && synchronization2Enabled && eventPool;
+      if (isSplittingBarriers)
+        PlanSplitBarriers(*compiledGraph);
+      if (isReplayingBarriers)
+      {
+        PlanBarrierBatches(*compiledGraph, isSplittingBarriers);
+        const auto &createdBarrierStats = compiledGraph->createdBarrierStats;
+        barrierStats.imageBarriersCount = createdBarrierStats.imageBarriersCount;
+        barrierStats.bufferBarriersCount = createdBarrierStats.bufferBarriersCount;
+        barrierStats.pipelineBarriersCount = createdBarrierStats.pipelineBarriersCount;
+      }
+      std::vector<StateTracker::ImageBarrier> batchImageBarriers;
+      std::vector<StateTracker::BufferBarrier> batchBufferBarriers;
 
-              renderPassKey.colorAttachmentDescs.push_back({imageView->GetImageData()->GetFormat(), attachment.loadOp, attachment.clearValue });
-              colorAttachments.push_back({ imageView, attachment.clearValue });
-            }
-            bool depthPresent = !(renderPassDesc.depthAttachment.imageViewProxyId == ImageViewProxyId());
-            if (depthPresent)
+      vk::CommandBuffer commandBuffer;
+      //acquiring resources from the compute queue may start a new graphics submission
+      auto submitBarriers = [&](std::vector<StateTracker::ImageBarrier> &imageBarriers, std::vector<StateTracker::BufferBarrier> &bufferBarriers)
+      {
+        if (isReplayingBarriers)
+        {
+          //the first task of a batch submits the barriers of all of its tasks, the rest submit nothing.
+          //split barriers of a task have been waited on before it
+          size_t taskIndex = stateTracker.taskIndex;
+          batchImageBarriers.clear();
+          batchBufferBarriers.clear();
+          for (size_t batchTaskIndex = taskIndex; batchTaskIndex < batchTaskIndices.size() && batchTaskIndices[batchTaskIndex] == taskIndex; batchTaskIndex++)
+          {
+            const auto &batchTask = compiledGraph->tasks[batchTaskIndex];
+            for (const auto &imageBarrier : batchTask.imageBarriers)
             {
-              auto imageView = GetResolvedImageView(taskIndex, renderPassDesc.depthAttachment.imageViewProxyId);
-
-              renderPassKey.depthAttachmentDesc = { imageView->GetImageData()->GetFormat(), renderPassDesc.depthAttachment.loadOp, renderPassDesc.depthAttachment.clearValue };
-              depthAttachment = { imageView, renderPassDesc.depthAttachment.clearValue };
+              if (!isSplittingBarriers || !IsSplitBarrier(imageBarrier.srcTaskIndex, batchTaskIndex))
+                batchImageBarriers.push_back(imageBarrier);
             }
-            else
+            for (const auto &bufferBarrier : batchTask.bufferBarriers)
             {
-              renderPassKey.depthAttachmentDesc.format = vk::Format::eUndefined;
+              if (!isSplittingBarriers || !IsSplitBarrier(bufferBarrier.srcTaskIndex, batchTaskIndex))
+                batchBufferBarriers.push_back(bufferBarrier);
             }
-
-            auto renderPass = renderPassCache.GetRenderPass(renderPassKey);
-            passContext.renderPass = renderPass;
-
-            framebufferCache.BeginPass(commandBuffer, colorAttachments, depthPresent ? (&depthAttachment) : nullptr, renderPass, renderPassDesc.renderAreaExtent);
-            passContext.commandBuffer = commandBuffer;
-            renderPassDesc.recordFunc(passContext);
-            framebufferCache.EndPass(commandBuffer);
-          }break;
-          case Task::Types::RenderPass2:
+          }
+          if (barrierOptimizationEnabled)
+            StateTracker::CoalesceBarriers(batchImageBarriers, batchBufferBarriers);
+          AddSubmittedBarrierStats(batchImageBarriers.size(), batchBufferBarriers.size());
+          queueSchedule.SubmitBarriers(batchImageBarriers, batchBufferBarriers);
+        }
+        else
+        {
+          //coalesced in place, so compiled barriers are stored already coalesced
+          barrierStats.imageBarriersCount += imageBarriers.size();
+          barrierStats.bufferBarriersCount += bufferBarriers.size();
+          if (imageBarriers.size() > 0 || bufferBarriers.size() > 0)
+            barrierStats.pipelineBarriersCount++;
+          if (barrierOptimizationEnabled)
+            StateTracker::CoalesceBarriers(imageBarriers, bufferBarriers);
+          AddSubmittedBarrierStats(imageBarriers.size(), bufferBarriers.size());
+          queueSchedule.SubmitBarriers(imageBarriers, bufferBarriers);
+        }
+        commandBuffer = queueSchedule.GetCommandBuffer();
+      };
+      
+      for (size_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+      {
+        auto &task = tasks[taskIndex];
+        CompiledTask &compiledTask = getCompiledTask(taskIndex);
+        stateTracker.taskIndex = taskIndex;
+        if (isMultiQueue)
+        {
+          if (isAsyncTask(task))
           {
-            auto &renderPassDesc2 = renderPassDescs2[task.index];
-            auto profilerTask = CreateProfilerTask(renderPassDesc2);
+            queueSchedule.BeginComputeTask();
+            stateTracker.queueFamilyIndex = asyncComputeResources->computeFamilyIndex;
+          }
+          else
+          {
+            queueSchedule.BeginGraphicsTask();
+            stateTracker.queueFamilyIndex = asyncComputeResources->graphicsFamilyIndex;
+          }
+        }
+        commandBuffer = queueSchedule.GetCommandBuffer();
+        if (isSplittingBarriers)
+          RecordSplitBarrierWaits(commandBuffer, taskIndex);
+        switch (task.type)
+        {
+          case Task::Types::RenderPass:
+          {
+            auto &renderPassDesc = renderPassDescs[task.index];
+            auto profilerTask = CreateProfilerTask(renderPassDesc);
             auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
             auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
-            
-            auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
-              .setCommandPool(transientCommandPool)
-              .setLevel(vk::CommandBufferLevel::eSecondary)
-              .setCommandBufferCount(1u);
-            auto transientCommandBuffer = logicalDevice.allocateCommandBuffers(commandBufferAllocateInfo)[0];
-
-            std::vector<StateTracker::ImageBarrier> imageBarriers;
-            std::vector<StateTracker::BufferBarrier> bufferBarriers;
 
-            RenderPassContext2 passContext([&](const PassContext2::DescriptorSetBindings &bindings)
+            if (!isReplaying)
             {
-              std::vector<legit::DescriptorSetLayoutKey::UniformBufferId> uniformBufferIds;
-              uniformBufferIds.resize(bindings.shaderDataSetInfo->GetUniformBuffersCount());
-              bindings.shaderDataSetInfo->GetUniformBufferIds(uniformBufferIds.data());
-              assert(uniformBufferIds.size() == bindings.uniformBindings.size());
-              
-              auto uniforms = memoryPool->BeginSet(bindings.shaderDataSetInfo);
-              size_t bufIndex = 0;
-              for(auto uniformBinding : bindings.uniformBindings)
+              compiledTask.resolvedImageViews.assign(imageViewProxies.GetSize(), nullptr);
+              compiledTask.resolvedBuffers.assign(bufferProxies.GetSize(), nullptr);
+
+              for (auto &colorAttachment : renderPassDesc.colorAttachments)
               {
-                auto uniformBufferInfo = bindings.shaderDataSetInfo->GetUniformBufferInfo(uniformBufferIds[bufIndex]);
-                assert(uniformBinding.size == uniformBufferInfo.size);
-                void *uniformData = memoryPool->GetUniformBufferData(uniformBinding.name, uniformBinding.size);
-                memcpy(uniformData, uniformBinding.data, uniformBinding.size);
-                bufIndex++;
+                compiledTask.resolvedImageViews[colorAttachment.imageViewProxyId.asInt] = GetResolvedImageView(taskIndex, colorAttachment.imageViewProxyId);
               }
-              memoryPool->EndSet();
-
-              auto descriptoSetBindings = legit::DescriptorSetBindings()
-                .SetUniformBufferBindings(uniforms.uniformBufferBindings)
-                .SetImageSamplerBindings(bindings.imageSamplerBindings)
-                .SetTextureBindings(bindings.textureBindings)
-                .SetSamplerBindings(bindings.samplerBindings)
-                .SetStorageImageBindings(bindings.storageImageBindings)
-                .SetStorageBufferBindings(bindings.storageBufferBindings)
-                .SetAccelerationStructureBindings(bindings.accelerationStructureBindings);
-
-              for (auto binding : bindings.imageSamplerBindings)
+
+              if (!(renderPassDesc.depthAttachment.imageViewProxyId == ImageViewProxyId()))
               {
-                AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(binding.imageView, ImageUsageTypes::GraphicsShaderRead));
+                compiledTask.resolvedImageViews[renderPassDesc.depthAttachment.imageViewProxyId.asInt] = GetResolvedImageView(taskIndex, renderPassDesc.depthAttachment.imageViewProxyId);
               }
 
-              for (auto binding : bindings.textureBindings)
+              for (auto &inputImageViewProxy : renderPassDesc.inputImageViewProxies)
               {
-                AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(binding.imageView, ImageUsageTypes::GraphicsShaderRead));
+                compiledTask.resolvedImageViews[inputImageViewProxy.asInt] = GetResolvedImageView(taskIndex, inputImageViewProxy);
               }
 
-              for (auto &binding : bindings.storageImageBindings)
+              for (auto &inoutStorageImageProxy : renderPassDesc.inoutStorageImageProxies)
               {
-                AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(binding.imageView, ImageUsageTypes::GraphicsShaderReadWrite));
+                compiledTask.resolvedImageViews[inoutStorageImageProxy.asInt] = GetResolvedImageView(taskIndex, inoutStorageImageProxy);
               }
 
-              for (auto storageBuffer : bindings.storageBufferBindings)
+              for (auto &inoutBufferProxy : renderPassDesc.inoutStorageBufferProxies)
               {
-                for(auto desc : storageBuffer.descriptors)
-                {
-                  AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(desc.buffer, BufferUsageTypes::GraphicsShaderReadWrite));
-                }
+                compiledTask.resolvedBuffers[inoutBufferProxy.asInt] = GetResolvedBuffer(taskIndex, inoutBufferProxy);
               }
 
-              auto descriptorSet = descriptorSetCache->GetDescriptorSet(*bindings.shaderDataSetInfo, descriptoSetBindings);
-              std::vector<uint32_t> dynamicOffsets;
-              if(bindings.uniformBindings.size() > 0)
+              for (auto& vertexBufferProxy : renderPassDesc.vertexBufferProxies)
               {
-                dynamicOffsets.push_back(uniforms.dynamicOffset);
+                compiledTask.resolvedBuffers[vertexBufferProxy.asInt] = GetResolvedBuffer(taskIndex, vertexBufferProxy);
               }
-              transientCommandBuffer.bindDescriptorSets(
-                vk::PipelineBindPoint::eGraphics,
-                bindings.pipelineLayout,
-                bindings.setIndex,
-                { descriptorSet },
-                dynamicOffsets);
-            },
-            [&](const legit::Buffer *indirectBuf)
-            {
-              AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(indirectBuf, BufferUsageTypes::DrawIndirect));
-              transientCommandBuffer.drawIndirect(indirectBuf->GetHandle(), 0, 1, sizeof(uint32_t) * 4);
-            });
-            // for (auto storageBuffer : bindings.vertexBuffers)
-            // {
-            //   AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::VertexBuffer));
-            // }
-
-            for (auto colorAttachment : renderPassDesc2.colorAttachments)
-            {
-              auto imageView = colorAttachment.imageView;
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ColorAttachment));
             }
 
-            if(auto imageView = renderPassDesc2.depthAttachment.imageView)
-            {
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::DepthAttachment));
-            }
+            RenderPassContext passContext;
+            passContext.resolvedImageViews = compiledTask.resolvedImageViews;
+            passContext.resolvedBuffers = compiledTask.resolvedBuffers;
 
-            std::vector<FramebufferCache::Attachment> colorAttachments;
-            FramebufferCache::Attachment depthAttachment;
+            if (!isReplayingBarriers)
+            {
+              compiledTask.imageBarriers.clear();
+              for (auto inputImageViewProxy : renderPassDesc.inputImageViewProxies)
+              {
+                auto imageView = passContext.GetImageView(inputImageViewProxy);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::GraphicsShaderRead, compiledTask.imageBarriers);
+              }
 
-            legit::RenderPassCache::RenderPassKey renderPassKey;
+              for (auto &inoutStorageImageProxy : renderPassDesc.inoutStorageImageProxies)
+              {
+                auto imageView = passContext.GetImageView(inoutStorageImageProxy);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::GraphicsShaderReadWrite, compiledTask.imageBarriers);
+              }
 
-            for (auto &attachment : renderPassDesc2.colorAttachments)
-            {
-              renderPassKey.colorAttachmentDescs.push_back({attachment.imageView->GetImageData()->GetFormat(), attachment.loadOp, attachment.clearValue });
-              colorAttachments.push_back({ attachment.imageView, attachment.clearValue });
-            }
-            if (auto imageView = renderPassDesc2.depthAttachment.imageView)
-            {
-              renderPassKey.depthAttachmentDesc = { imageView->GetImageData()->GetFormat(), renderPassDesc2.depthAttachment.loadOp, renderPassDesc2.depthAttachment.clearValue };
-              depthAttachment = { imageView, renderPassDesc2.depthAttachment.clearValue };
-            }
-            else
-            {
-              renderPassKey.depthAttachmentDesc.format = vk::Format::eUndefined;
-            }
+              for (auto colorAttachment : renderPassDesc.colorAttachments)
+              {
+                auto imageView = passContext.GetImageView(colorAttachment.imageViewProxyId);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ColorAttachment, compiledTask.imageBarriers);
+              }
 
-            auto renderPass = renderPassCache.GetRenderPass(renderPassKey);
-            passContext.renderPass = renderPass;
-            passContext.commandBuffer = transientCommandBuffer;
+              if(!(renderPassDesc.depthAttachment.imageViewProxyId == ImageViewProxyId()))
+              {
+                auto imageView = passContext.GetImageView(renderPassDesc.depthAttachment.imageViewProxyId);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::DepthAttachment, compiledTask.imageBarriers);
+              }
 
-            auto renderAreaExtent = renderPassDesc2.renderAreaExtent;
-            if(renderAreaExtent.width == 0 && renderAreaExtent.height == 0)
-            {
-              if(colorAttachments.size() > 0)
+              compiledTask.bufferBarriers.clear();
+              for (auto vertexBufferProxy : renderPassDesc.vertexBufferProxies)
               {
-                auto mipSize = colorAttachments[0].imageView->GetBaseSize();
-                renderAreaExtent = vk::Extent2D(mipSize.x, mipSize.y);
-              }else
+                auto storageBuffer = passContext.GetBuffer(vertexBufferProxy);
+                stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::VertexBuffer, compiledTask.bufferBarriers);
+              }
+
+              for (auto inoutBufferProxy : renderPassDesc.inoutStorageBufferProxies)
               {
-                assert(depthAttachment.imageView);
-                auto mipSize = depthAttachment.imageView->GetBaseSize();
-                renderAreaExtent = vk::Extent2D(mipSize.x, mipSize.y);                
+                auto storageBuffer = passContext.GetBuffer(inoutBufferProxy);
+                stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::GraphicsShaderReadWrite, compiledTask.bufferBarriers);
               }
+
+              AddAliasingBarriers(taskIndex, stateTracker, compiledTask.imageBarriers, compiledTask.bufferBarriers);
             }
+            submitBarriers(compiledTask.imageBarriers, compiledTask.bufferBarriers);
             
-            auto passInfo = framebufferCache.GetPassInfo(colorAttachments, renderPassDesc2.depthAttachment.imageView ? (&depthAttachment) : nullptr, renderPass, renderAreaExtent);
-            auto inheritanceInfo = vk::CommandBufferInheritanceInfo()
-              .setRenderPass(renderPass->GetHandle())
-              .setFramebuffer(passInfo.framebuffer->GetHandle());
-            auto oneTimeBeginInfo = vk::CommandBufferBeginInfo()
-              .setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue)
-              .setPInheritanceInfo(&inheritanceInfo);      
-            passContext.commandBuffer.begin(oneTimeBeginInfo);
+            if (!isReplaying)
             {
-              passContext.commandBuffer.setViewport(0, { passInfo.viewport });
-              passContext.commandBuffer.setScissor(0, { passInfo.scissorRect });                
-              renderPassDesc2.recordFunc(passContext);
-            }
-            passContext.commandBuffer.end();            
-            
-            SubmitBarriers(commandBuffer, imageBarriers, bufferBarriers);
+              std::vector<FramebufferCache::Attachment> colorAttachments;
+              FramebufferCache::Attachment depthAttachment;
 
-            framebufferCache.BeginPass(commandBuffer, colorAttachments, renderPassDesc2.depthAttachment.imageView ? (&depthAttachment) : nullptr, renderPass, renderAreaExtent, vk::SubpassContents::eSecondaryCommandBuffers);
-            {
-              commandBuffer.executeCommands({passContext.commandBuffer});
+              legit::RenderPassCache::RenderPassKey renderPassKey;
+
+              for (auto &attachment : renderPassDesc.colorAttachments)
+              {
+                auto imageView = passContext.GetImageView(attachment.imageViewProxyId);
+
+                renderPassKey.colorAttachmentDescs.push_back({imageView->GetImageData()->GetFormat(), attachment.loadOp, attachment.clearValue });
+                colorAttachments.push_back({ imageView, attachment.clearValue });
+              }
+              bool depthPresent = !(renderPassDesc.depthAttachment.imageViewProxyId == ImageViewProxyId());
+              if (depthPresent)
+              {
+                auto imageView = passContext.GetImageView(renderPassDesc.depthAttachment.imageViewProxyId);
+
+                renderPassKey.depthAttachmentDesc = { imageView->GetImageData()->GetFormat(), renderPassDesc.depthAttachment.loadOp, renderPassDesc.depthAttachment.clearValue };
+                depthAttachment = { imageView, renderPassDesc.depthAttachment.clearValue };
+              }
+              else
+              {
+                renderPassKey.depthAttachmentDesc.format = vk::Format::eUndefined;
+              }
+
+              compiledTask.renderPass = renderPassCache.GetRenderPass(renderPassKey);
+              compiledTask.passInfo = framebufferCache.GetPassInfo(colorAttachments, depthPresent ? (&depthAttachment) : nullptr, compiledTask.renderPass, renderPassDesc.renderAreaExtent);
+              compiledTask.clearValues = FramebufferCache::GetClearValues(colorAttachments, depthPresent ? (&depthAttachment) : nullptr);
             }
+            passContext.renderPass = compiledTask.renderPass;
+
+            framebufferCache.BeginPass(commandBuffer, compiledTask.passInfo, compiledTask.clearValues);
+            passContext.commandBuffer = commandBuffer;
+            passContext.boundState.Reset(commandBuffer);
+            renderPassDesc.recordFunc(passContext);
+            bindStats += passContext.boundState.GetStats();
             framebufferCache.EndPass(commandBuffer);
           }break;
-          case Task::Types::ComputePass:
+          case Task::Types::RenderPass2:
           {
-            auto &computePassDesc = computePassDescs[task.index];
-            auto profilerTask = CreateProfilerTask(computePassDesc);
+            auto &renderPassDesc2 = renderPassDescs2[task.index];
+            auto profilerTask = CreateProfilerTask(renderPassDesc2);
             auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
             auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
 
-            PassContext passContext;
-            passContext.resolvedImageViews.resize(imageViewProxies.GetSize(), nullptr);
-            passContext.resolvedBuffers.resize(bufferProxies.GetSize(), nullptr);
-
-            for (auto &inputImageViewProxy : computePassDesc.inputImageViewProxies)
+            auto &passRecording = passRecordings[taskIndex];
+            if (!isRecordingInParallel)
             {
-              passContext.resolvedImageViews[inputImageViewProxy.asInt] = GetResolvedImageView(taskIndex, inputImageViewProxy);
+              if (!isReplaying)
+                PrepareRenderPass2(renderPassDesc2, compiledTask);
+              RecordRenderPass2(renderPassDesc2, compiledTask, AllocateSecondaryCommandBuffer(logicalDevice, transientCommandPool), descriptorSetCache, memoryPool, passRecording);
             }
 
-            for (auto &inoutBufferProxy : computePassDesc.inoutStorageBufferProxies)
-            {
-              passContext.resolvedBuffers[inoutBufferProxy.asInt] = GetResolvedBuffer(taskIndex, inoutBufferProxy);
-            }
+            auto &imageBarriers = scratchImageBarriers;
+            auto &bufferBarriers = scratchBufferBarriers;
+            imageBarriers.clear();
+            bufferBarriers.clear();
+            // for (auto storageBuffer : bindings.vertexBuffers)
+            // {
+            //   stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::VertexBuffer, bufferBarriers);
+            // }
 
-            for (auto &inoutStorageImageProxy : computePassDesc.inoutStorageImageProxies)
+            for (auto colorAttachment : renderPassDesc2.colorAttachments)
             {
-              passContext.resolvedImageViews[inoutStorageImageProxy.asInt] = GetResolvedImageView(taskIndex, inoutStorageImageProxy);
+              auto imageView = colorAttachment.imageView;
+              stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ColorAttachment, imageBarriers);
             }
 
-            std::vector<StateTracker::ImageBarrier> imageBarriers;
-            for (auto inputImageViewProxy : computePassDesc.inputImageViewProxies)
+            if(auto imageView = renderPassDesc2.depthAttachment.imageView)
             {
-              auto imageView = GetResolvedImageView(taskIndex, inputImageViewProxy);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ComputeShaderRead));
+              stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::DepthAttachment, imageBarriers);
             }
+            ApplyRecordedTransitions(passRecording, stateTracker, imageBarriers, bufferBarriers);
+            bindStats += passRecording.bindStats;
 
-            for (auto &inoutStorageImageProxy : computePassDesc.inoutStorageImageProxies)
-            {
-              auto imageView = GetResolvedImageView(taskIndex, inoutStorageImageProxy);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ComputeShaderReadWrite));
-            }
+            submitBarriers(imageBarriers, bufferBarriers);
 
-            std::vector<StateTracker::BufferBarrier> bufferBarriers;
-            for (auto inoutBufferProxy : computePassDesc.inoutStorageBufferProxies)
+            framebufferCache.BeginPass(commandBuffer, compiledTask.passInfo, compiledTask.clearValues, vk::SubpassContents::eSecondaryCommandBuffers);
             {
-              auto storageBuffer = GetResolvedBuffer(taskIndex, inoutBufferProxy);
-              AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::ComputeShaderReadWrite));
+              commandBuffer.executeCommands({passRecording.commandBuffer});
             }
-
-            SubmitBarriers(commandBuffer, imageBarriers, bufferBarriers);
-
-            passContext.commandBuffer = commandBuffer;
-            if(computePassDesc.recordFunc)
-              computePassDesc.recordFunc(passContext);
+            framebufferCache.EndPass(commandBuffer);
           }break;
-          case Task::Types::ComputePass2:
+          case Task::Types::ComputePass:
           {
-            auto &computePassDesc2 = computePassDescs2[task.index];
-            auto profilerTask = CreateProfilerTask(computePassDesc2);
+            auto &computePassDesc = computePassDescs[task.index];
+            auto profilerTask = CreateProfilerTask(computePassDesc);
             auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
             auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
-            
-            auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
-              .setCommandPool(transientCommandPool)
-              .setLevel(vk::CommandBufferLevel::eSecondary)
-              .setCommandBufferCount(1u);
-            auto transientCommandBuffer = logicalDevice.allocateCommandBuffers(commandBufferAllocateInfo)[0];
-
-            std::vector<StateTracker::ImageBarrier> imageBarriers;
-            std::vector<StateTracker::BufferBarrier> bufferBarriers;
 
-            ComputePassContext2 passContext([&](const PassContext2::DescriptorSetBindings &bindings)
+            if (!isReplaying)
             {
-              auto uniforms = memoryPool->BeginSet(bindings.shaderDataSetInfo);
-              for(auto uniformBinding : bindings.uniformBindings)
+              compiledTask.resolvedImageViews.assign(imageViewProxies.GetSize(), nullptr);
+              compiledTask.resolvedBuffers.assign(bufferProxies.GetSize(), nullptr);
+
+              for (auto &inputImageViewProxy : computePassDesc.inputImageViewProxies)
               {
-                void *uniformData = memoryPool->GetUniformBufferData(uniformBinding.name, uniformBinding.size);
-                memcpy(uniformData, uniformBinding.data, uniformBinding.size);
+                compiledTask.resolvedImageViews[inputImageViewProxy.asInt] = GetResolvedImageView(taskIndex, inputImageViewProxy);
               }
-              memoryPool->EndSet();
-
-              auto descriptoSetBindings = legit::DescriptorSetBindings()
-                .SetUniformBufferBindings(uniforms.uniformBufferBindings)
-                .SetImageSamplerBindings(bindings.imageSamplerBindings)
-                .SetTextureBindings(bindings.textureBindings)
-                .SetSamplerBindings(bindings.samplerBindings)
-                .SetStorageImageBindings(bindings.storageImageBindings)
-                .SetStorageBufferBindings(bindings.storageBufferBindings)
-                .SetAccelerationStructureBindings(bindings.accelerationStructureBindings);
 
-
-              for (auto binding : bindings.imageSamplerBindings)
+              for (auto &inoutBufferProxy : computePassDesc.inoutStorageBufferProxies)
               {
-                AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(binding.imageView, ImageUsageTypes::ComputeShaderRead));
+                compiledTask.resolvedBuffers[inoutBufferProxy.asInt] = GetResolvedBuffer(taskIndex, inoutBufferProxy);
               }
 
-              for (auto binding : bindings.textureBindings)
+              for (auto &inoutStorageImageProxy : computePassDesc.inoutStorageImageProxies)
               {
-                AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(binding.imageView, ImageUsageTypes::ComputeShaderRead));
+                compiledTask.resolvedImageViews[inoutStorageImageProxy.asInt] = GetResolvedImageView(taskIndex, inoutStorageImageProxy);
               }
+            }
 
-              for (auto &binding : bindings.storageImageBindings)
+            PassContext passContext;
+            passContext.resolvedImageViews = compiledTask.resolvedImageViews;
+            passContext.resolvedBuffers = compiledTask.resolvedBuffers;
+
+            if (!isReplayingBarriers)
+            {
+              compiledTask.imageBarriers.clear();
+              for (auto inputImageViewProxy : computePassDesc.inputImageViewProxies)
               {
-                AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(binding.imageView, ImageUsageTypes::ComputeShaderReadWrite));
+                auto imageView = passContext.GetImageView(inputImageViewProxy);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ComputeShaderRead, compiledTask.imageBarriers);
               }
 
-              for (auto storageBuffer : bindings.storageBufferBindings)
+              for (auto &inoutStorageImageProxy : computePassDesc.inoutStorageImageProxies)
               {
-                for(auto desc : storageBuffer.descriptors)
-                {
-                  AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(desc.buffer, BufferUsageTypes::ComputeShaderReadWrite));
-                }
+                auto imageView = passContext.GetImageView(inoutStorageImageProxy);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::ComputeShaderReadWrite, compiledTask.imageBarriers);
               }
 
-              auto descriptorSet = descriptorSetCache->GetDescriptorSet(*bindings.shaderDataSetInfo, descriptoSetBindings);
-
-              std::vector<uint32_t> dynamicOffsets;
-              if(bindings.uniformBindings.size() > 0)
+              compiledTask.bufferBarriers.clear();
+              for (auto inoutBufferProxy : computePassDesc.inoutStorageBufferProxies)
               {
-                dynamicOffsets.push_back(uniforms.dynamicOffset);
+                auto storageBuffer = passContext.GetBuffer(inoutBufferProxy);
+                stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::ComputeShaderReadWrite, compiledTask.bufferBarriers);
               }
-              transientCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, bindings.pipelineLayout, bindings.setIndex, { descriptorSet }, dynamicOffsets);
-            },
-            [&](legit::Buffer *indirectBuf)
-            {
-              AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(indirectBuf, BufferUsageTypes::DispatchIndirect));
-              transientCommandBuffer.dispatchIndirect(indirectBuf->GetHandle(), 0);
-            });
 
-            passContext.commandBuffer = transientCommandBuffer;
+              AddAliasingBarriers(taskIndex, stateTracker, compiledTask.imageBarriers, compiledTask.bufferBarriers);
+            }
+            submitBarriers(compiledTask.imageBarriers, compiledTask.bufferBarriers);
+
+            passContext.commandBuffer = commandBuffer;
+            passContext.boundState.Reset(commandBuffer);
+            if(computePassDesc.recordFunc)
+              computePassDesc.recordFunc(passContext);
+            bindStats += passContext.boundState.GetStats();
+          }break;
+          case Task::Types::ComputePass2:
+          {
+            auto &computePassDesc2 = computePassDescs2[task.index];
+            auto profilerTask = CreateProfilerTask(computePassDesc2);
+            auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
+            auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
 
-            auto inheritanceInfo = vk::CommandBufferInheritanceInfo();
-            auto oneTimeBeginInfo = vk::CommandBufferBeginInfo()
-              .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
-              .setPInheritanceInfo(&inheritanceInfo);      
-            passContext.commandBuffer.begin(oneTimeBeginInfo);
+            auto &passRecording = passRecordings[taskIndex];
+            if (isAsyncTask(task))
+            {
+              RecordComputePass2(computePassDesc2, AllocateSecondaryCommandBuffer(logicalDevice, asyncComputeResources->computeCommandPool), descriptorSetCache, memoryPool, passRecording);
+            }
+            else if (!isRecordingInParallel)
             {
-              computePassDesc2.recordFunc(passContext);
+              RecordComputePass2(computePassDesc2, AllocateSecondaryCommandBuffer(logicalDevice, transientCommandPool), descriptorSetCache, memoryPool, passRecording);
             }
-            passContext.commandBuffer.end();            
+
+            auto &imageBarriers = scratchImageBarriers;
+            auto &bufferBarriers = scratchBufferBarriers;
+            imageBarriers.clear();
+            bufferBarriers.clear();
+            ApplyRecordedTransitions(passRecording, stateTracker, imageBarriers, bufferBarriers);
+            bindStats += passRecording.bindStats;
             
-            SubmitBarriers(commandBuffer, imageBarriers, bufferBarriers);
+            submitBarriers(imageBarriers, bufferBarriers);
 
-            commandBuffer.executeCommands({passContext.commandBuffer});
+            commandBuffer.executeCommands({passRecording.commandBuffer});
           }break;
           case Task::Types::TransferPass:
           {
@@ -1532,58 +2131,69 @@ namespace legit
             auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
             auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
 
-            PassContext passContext;
-            passContext.resolvedImageViews.resize(imageViewProxies.GetSize(), nullptr);
-            passContext.resolvedBuffers.resize(bufferProxies.GetSize(), nullptr);
-
-            for (auto& srcImageViewProxy : transferPassDesc.srcImageViewProxies)
+            if (!isReplaying)
             {
-              passContext.resolvedImageViews[srcImageViewProxy.asInt] = GetResolvedImageView(taskIndex, srcImageViewProxy);
-            }
-            for (auto& dstImageViewProxy : transferPassDesc.dstImageViewProxies)
-            {
-              passContext.resolvedImageViews[dstImageViewProxy.asInt] = GetResolvedImageView(taskIndex, dstImageViewProxy);
-            }
+              compiledTask.resolvedImageViews.assign(imageViewProxies.GetSize(), nullptr);
+              compiledTask.resolvedBuffers.assign(bufferProxies.GetSize(), nullptr);
 
-            for (auto& srcBufferProxy : transferPassDesc.srcBufferProxies)
-            {
-              passContext.resolvedBuffers[srcBufferProxy.asInt] = GetResolvedBuffer(taskIndex, srcBufferProxy);
-            }
+              for (auto& srcImageViewProxy : transferPassDesc.srcImageViewProxies)
+              {
+                compiledTask.resolvedImageViews[srcImageViewProxy.asInt] = GetResolvedImageView(taskIndex, srcImageViewProxy);
+              }
+              for (auto& dstImageViewProxy : transferPassDesc.dstImageViewProxies)
+              {
+                compiledTask.resolvedImageViews[dstImageViewProxy.asInt] = GetResolvedImageView(taskIndex, dstImageViewProxy);
+              }
 
-            for (auto& dstBufferProxy : transferPassDesc.dstBufferProxies)
-            {
-              passContext.resolvedBuffers[dstBufferProxy.asInt] = GetResolvedBuffer(taskIndex, dstBufferProxy);
-            }
+              for (auto& srcBufferProxy : transferPassDesc.srcBufferProxies)
+              {
+                compiledTask.resolvedBuffers[srcBufferProxy.asInt] = GetResolvedBuffer(taskIndex, srcBufferProxy);
+              }
 
-            std::vector<StateTracker::ImageBarrier> imageBarriers;
-            for (auto srcImageViewProxy : transferPassDesc.srcImageViewProxies)
-            {
-              auto imageView = GetResolvedImageView(taskIndex, srcImageViewProxy);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::TransferSrc));
+              for (auto& dstBufferProxy : transferPassDesc.dstBufferProxies)
+              {
+                compiledTask.resolvedBuffers[dstBufferProxy.asInt] = GetResolvedBuffer(taskIndex, dstBufferProxy);
+              }
             }
 
-            for (auto dstImageViewProxy : transferPassDesc.dstImageViewProxies)
-            {
-              auto imageView = GetResolvedImageView(taskIndex, dstImageViewProxy);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::TransferDst));
-            }
+            PassContext passContext;
+            passContext.resolvedImageViews = compiledTask.resolvedImageViews;
+            passContext.resolvedBuffers = compiledTask.resolvedBuffers;
 
-            std::vector<StateTracker::BufferBarrier> bufferBarriers;
-            for (auto srcBufferProxy : transferPassDesc.srcBufferProxies)
+            if (!isReplayingBarriers)
             {
-              auto storageBuffer = GetResolvedBuffer(taskIndex, srcBufferProxy);
-              AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::TransferSrc));
-            }
+              compiledTask.imageBarriers.clear();
+              for (auto srcImageViewProxy : transferPassDesc.srcImageViewProxies)
+              {
+                auto imageView = passContext.GetImageView(srcImageViewProxy);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::TransferSrc, compiledTask.imageBarriers);
+              }
 
-            for (auto dstBufferProxy : transferPassDesc.dstBufferProxies)
-            {
-              auto storageBuffer = GetResolvedBuffer(taskIndex, dstBufferProxy);
-              AppendVectors(bufferBarriers, stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::TransferDst));
-            }
+              for (auto dstImageViewProxy : transferPassDesc.dstImageViewProxies)
+              {
+                auto imageView = passContext.GetImageView(dstImageViewProxy);
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::TransferDst, compiledTask.imageBarriers);
+              }
+
+              compiledTask.bufferBarriers.clear();
+              for (auto srcBufferProxy : transferPassDesc.srcBufferProxies)
+              {
+                auto storageBuffer = passContext.GetBuffer(srcBufferProxy);
+                stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::TransferSrc, compiledTask.bufferBarriers);
+              }
+
+              for (auto dstBufferProxy : transferPassDesc.dstBufferProxies)
+              {
+                auto storageBuffer = passContext.GetBuffer(dstBufferProxy);
+                stateTracker.TransitionBufferAndCreateBarriers(storageBuffer, BufferUsageTypes::TransferDst, compiledTask.bufferBarriers);
+              }
 
-            SubmitBarriers(commandBuffer, imageBarriers, bufferBarriers);
+              AddAliasingBarriers(taskIndex, stateTracker, compiledTask.imageBarriers, compiledTask.bufferBarriers);
+            }
+            submitBarriers(compiledTask.imageBarriers, compiledTask.bufferBarriers);
 
             passContext.commandBuffer = commandBuffer;
+            passContext.boundState.Reset(commandBuffer);
             if (transferPassDesc.recordFunc)
               transferPassDesc.recordFunc(passContext);
           }break;
@@ -1594,14 +2204,24 @@ namespace legit
             auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
             auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
 
-            std::vector<StateTracker::ImageBarrier> imageBarriers;
+            if (!isReplaying)
             {
-              auto imageView = GetResolvedImageView(taskIndex, imagePesentDesc.presentImageViewProxyId);
-              AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::Present));
+              compiledTask.resolvedImageViews.assign(imageViewProxies.GetSize(), nullptr);
+              compiledTask.resolvedImageViews[imagePesentDesc.presentImageViewProxyId.asInt] = GetResolvedImageView(taskIndex, imagePesentDesc.presentImageViewProxyId);
             }
 
-            std::vector<StateTracker::BufferBarrier> bufferBarriers;
-            SubmitBarriers(commandBuffer, imageBarriers, bufferBarriers);
+            if (!isReplayingBarriers)
+            {
+              compiledTask.imageBarriers.clear();
+              {
+                auto imageView = compiledTask.resolvedImageViews[imagePesentDesc.presentImageViewProxyId.asInt];
+                stateTracker.TransitionImageAndCreateBarriers(imageView, ImageUsageTypes::Present, compiledTask.imageBarriers);
+              }
+
+              compiledTask.bufferBarriers.clear();
+              AddAliasingBarriers(taskIndex, stateTracker, compiledTask.imageBarriers, compiledTask.bufferBarriers);
+            }
+            submitBarriers(compiledTask.imageBarriers, compiledTask.bufferBarriers);
           }break;
           case Task::Types::FrameSyncBegin:
           {
@@ -1624,31 +2244,60 @@ namespace legit
             auto gpuTask = gpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color, vk::PipelineStageFlagBits::eBottomOfPipe);
             auto cpuTask = cpuProfiler->StartScopedTask(profilerTask.name, profilerTask.color);
 
-            std::vector<StateTracker::ImageBarrier> imageBarriers;
+            if (!isReplayingBarriers)
+            {
+              compiledTask.imageBarriers.clear();
 
-            // Not transitioning any images into Undefined at the end of the frame if they're transitioned from Undefined next frame, because:
-            
-            // VUID-VkImageMemoryBarrier-oldLayout-01197
-            // If srcQueueFamilyIndex and dstQueueFamilyIndex define a queue family ownership transfer or oldLayout and newLayout define an image layout transition,
-            // oldLayout must be VK_IMAGE_LAYOUT_UNDEFINED or the current layout of the image subresources affected by the barrier
+              // Not transitioning any images into Undefined at the end of the frame if they're transitioned from Undefined next frame, because:
+              
+              // VUID-VkImageMemoryBarrier-oldLayout-01197
+              // If srcQueueFamilyIndex and dstQueueFamilyIndex define a queue family ownership transfer or oldLayout and newLayout define an image layout transition,
+              // oldLayout must be VK_IMAGE_LAYOUT_UNDEFINED or the current layout of the image subresources affected by the barrier
 
-            for (auto imageViewProxy : imageViewProxies)
-            {
-              if(imageViewProxy.externalView != nullptr && imageViewProxy.externalUsageType != legit::ImageUsageTypes::Unknown && imageViewProxy.externalUsageType != legit::ImageUsageTypes::None)
+              for (auto imageViewProxy : imageViewProxies)
               {
-                AppendVectors(imageBarriers, stateTracker.TransitionImageAndCreateBarriers(imageViewProxy.externalView, imageViewProxy.externalUsageType));
+                if(imageViewProxy.externalView != nullptr && imageViewProxy.externalUsageType != legit::ImageUsageTypes::Unknown && imageViewProxy.externalUsageType != legit::ImageUsageTypes::None)
+                {
+                  stateTracker.TransitionImageAndCreateBarriers(imageViewProxy.externalView, imageViewProxy.externalUsageType, compiledTask.imageBarriers);
+                }
               }
+              compiledTask.bufferBarriers.clear();
             }
-            
-            for(auto &imageBarrier : imageBarriers)
-            {
-              imageBarrier.srcStage |= vk::PipelineStageFlagBits::eBottomOfPipe;
-              imageBarrier.dstStage |= vk::PipelineStageFlagBits::eTopOfPipe;
-            }
-            std::vector<StateTracker::BufferBarrier> bufferBarriers;
-            SubmitBarriers(commandBuffer, imageBarriers, bufferBarriers);
+            submitBarriers(compiledTask.imageBarriers, compiledTask.bufferBarriers);
           }break;
         }
+        if (isSplittingBarriers)
+          RecordSplitBarrierSets(queueSchedule.GetCommandBuffer(), taskIndex);
+      }
+
+      if (isMultiQueue)
+      {
+        //the next frame expects every resource to be owned by the graphics queue
+        std::vector<StateTracker::ImageBarrier> imageBarriers;
+        std::vector<StateTracker::BufferBarrier> bufferBarriers;
+        queueSchedule.BeginGraphicsTask();
+        stateTracker.queueFamilyIndex = asyncComputeResources->graphicsFamilyIndex;
+        stateTracker.TransferOwnershipAndCreateBarriers(asyncComputeResources->computeFamilyIndex, asyncComputeResources->graphicsFamilyIndex, imageBarriers, bufferBarriers);
+        queueSchedule.SubmitBarriers(imageBarriers, bufferBarriers);
+        queueSchedule.JoinComputeBatches();
+      }
+
+      if (isReplayingBarriers)
+      {
+        StateTracker::CommitPersistentUsages(compiledGraph->exitUsages);
+      }
+      else
+      {
+        StateTracker::PersistentUsages exitUsages;
+        AddTrackedPersistentResources(stateTracker, persistentImages, persistentBuffers);
+        stateTracker.GetPersistentUsages(persistentImages, persistentBuffers, exitUsages);
+        StateTracker::CommitPersistentUsages(exitUsages);
+        if (compiledGraph)
+        {
+          compiledGraph->entryUsages = entryUsages;
+          compiledGraph->exitUsages = std::move(exitUsages);
+          compiledGraph->createdBarrierStats = barrierStats;
+        }
       }
 
       renderPassDescs.clear();
@@ -1657,6 +2306,8 @@ namespace legit
       frameSyncBeginDescs.clear();
       frameSyncEndDescs.clear();
       tasks.clear();
+
+      return queueSchedule.GetBatches();
     }
     
   private:
@@ -1978,6 +2629,7 @@ namespace legit
       legit::ImageData *externalImage;
 
       legit::ImageData *resolvedImage;
+      size_t aliasedResourceIndex;
 
       Types type;
     };
@@ -1986,7 +2638,7 @@ namespace legit
     ImageCache imageCache;
 
     ImageProxyPool imageProxies;
-    void ResolveImages()
+    bool ResolveImages()
     {
       imageCache.Release();
 
@@ -2005,7 +2657,7 @@ namespace legit
         }
       }
 
-      imageCache.PurgeUnused();
+      return imageCache.PurgeUnused();
     }
     legit::ImageData *GetResolvedImage(size_t taskIndex, ImageProxyId imageProxy)
     {
@@ -2085,13 +2737,14 @@ namespace legit
       legit::Buffer *externalBuffer;
 
       legit::Buffer *resolvedBuffer;
+      size_t aliasedResourceIndex;
 
       Types type;
     };
 
     BufferCache bufferCache;
     BufferProxyPool bufferProxies;
-    void ResolveBuffers()
+    bool ResolveBuffers()
     {
       bufferCache.Release();
 
@@ -2109,51 +2762,381 @@ namespace legit
           }break;
         }
       }
-      bufferCache.PurgeUnused();
+      return bufferCache.PurgeUnused();
     }
     legit::Buffer *GetResolvedBuffer(size_t taskIndex, BufferProxyId bufferProxyId)
     {
       return bufferProxies.Get(bufferProxyId).resolvedBuffer;
     }
 
+    static void ExtendLifetime(AliasedResourceCache::ResourceLifetime &lifetime, size_t taskIndex)
+    {
+      lifetime.firstTaskIndex = std::min(lifetime.firstTaskIndex, taskIndex);
+      lifetime.lastTaskIndex = std::max(lifetime.lastTaskIndex, taskIndex);
+    }
 
-
-    std::vector<RenderPassDesc> renderPassDescs;
-    std::vector<RenderPassDesc2> renderPassDescs2;
-    std::vector<ComputePassDesc> computePassDescs;
-    std::vector<ComputePassDesc2> computePassDescs2;
-    std::vector<TransferPassDesc> transferPassDescs;
-
-
-    std::vector<ImagePresentPassDesc> imagePresentDescs;
-    std::vector<FrameSyncBeginPassDesc> frameSyncBeginDescs;
-    std::vector<FrameSyncEndPassDesc> frameSyncEndDescs;
-
-    struct Task
+    void ComputeProxyLifetimes(bool isMultiQueue, std::vector<AliasedResourceCache::ResourceLifetime> &imageLifetimes, std::vector<AliasedResourceCache::ResourceLifetime> &bufferLifetimes)
     {
-      enum struct Types
+      imageLifetimes.assign(imageProxies.GetSize(), { size_t(-1), 0 });
+      bufferLifetimes.assign(bufferProxies.GetSize(), { size_t(-1), 0 });
+
+      auto useImageView = [&](ImageViewProxyId imageViewProxyId, size_t taskIndex)
       {
-        RenderPass,
-        RenderPass2,
-        ComputePass,
-        ComputePass2,
-        TransferPass,
-        ImagePresent,
-        FrameSyncBegin,
-        FrameSyncEnd
+        if (imageViewProxyId == ImageViewProxyId())
+          return;
+        auto &imageViewProxy = imageViewProxies.Get(imageViewProxyId);
+        if (imageViewProxy.type == ImageViewProxy::Types::Transient)
+          ExtendLifetime(imageLifetimes[imageViewProxy.imageProxyId.asInt], taskIndex);
+      };
+      auto useBuffer = [&](BufferProxyId bufferProxyId, size_t taskIndex)
+      {
+        if (bufferProxies.Get(bufferProxyId).type == BufferProxy::Types::Transient)
+          ExtendLifetime(bufferLifetimes[bufferProxyId.asInt], taskIndex);
       };
-      Types type;
-      size_t index;
-    };
-    std::vector<Task> tasks;
-    void AddTask(Task task)
-    {
-      tasks.push_back(task);
-    }
 
-    legit::ProfilerTask CreateProfilerTask(const RenderPassDesc &renderPassDesc)
-    {
-      legit::ProfilerTask task;
+      for (size_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+      {
+        auto &task = tasks[taskIndex];
+        switch (task.type)
+        {
+          case Task::Types::RenderPass:
+          {
+            auto &renderPassDesc = renderPassDescs[task.index];
+            for (auto &colorAttachment : renderPassDesc.colorAttachments)
+              useImageView(colorAttachment.imageViewProxyId, taskIndex);
+            useImageView(renderPassDesc.depthAttachment.imageViewProxyId, taskIndex);
+            for (auto imageViewProxyId : renderPassDesc.inputImageViewProxies)
+              useImageView(imageViewProxyId, taskIndex);
+            for (auto imageViewProxyId : renderPassDesc.inoutStorageImageProxies)
+              useImageView(imageViewProxyId, taskIndex);
+            for (auto bufferProxyId : renderPassDesc.vertexBufferProxies)
+              useBuffer(bufferProxyId, taskIndex);
+            for (auto bufferProxyId : renderPassDesc.inoutStorageBufferProxies)
+              useBuffer(bufferProxyId, taskIndex);
+          }break;
+          case Task::Types::ComputePass:
+          {
+            auto &computePassDesc = computePassDescs[task.index];
+            for (auto imageViewProxyId : computePassDesc.inputImageViewProxies)
+              useImageView(imageViewProxyId, taskIndex);
+            for (auto imageViewProxyId : computePassDesc.inoutStorageImageProxies)
+              useImageView(imageViewProxyId, taskIndex);
+            for (auto bufferProxyId : computePassDesc.inoutStorageBufferProxies)
+              useBuffer(bufferProxyId, taskIndex);
+          }break;
+          case Task::Types::TransferPass:
+          {
+            auto &transferPassDesc = transferPassDescs[task.index];
+            for (auto imageViewProxyId : transferPassDesc.srcImageViewProxies)
+              useImageView(imageViewProxyId, taskIndex);
+            for (auto imageViewProxyId : transferPassDesc.dstImageViewProxies)
+              useImageView(imageViewProxyId, taskIndex);
+            for (auto bufferProxyId : transferPassDesc.srcBufferProxies)
+              useBuffer(bufferProxyId, taskIndex);
+            for (auto bufferProxyId : transferPassDesc.dstBufferProxies)
+              useBuffer(bufferProxyId, taskIndex);
+          }break;
+          case Task::Types::ImagePresent:
+          {
+            useImageView(imagePresentDescs[task.index].presentImageViewProxyId, taskIndex);
+          }break;
+          default: {}
+        }
+      }
+
+      //proxies not referenced by any task this frame can't be reasoned about, they're kept alive for the whole frame
+      AliasedResourceCache::ResourceLifetime wholeFrame = { 0, tasks.size() };
+      for (auto &imageLifetime : imageLifetimes)
+      {
+        if (imageLifetime.firstTaskIndex == size_t(-1))
+          imageLifetime = wholeFrame;
+      }
+      for (auto &bufferLifetime : bufferLifetimes)
+      {
+        if (bufferLifetime.firstTaskIndex == size_t(-1))
+          bufferLifetime = wholeFrame;
+      }
+
+      //aliasing barriers are recorded on the queue that uses the new resource, nothing would order them against a predecessor last used
+      //on the compute queue. which resources async passes touch is only known once they're recorded, so nothing is aliased in such frames
+      if (isMultiQueue)
+      {
+        imageLifetimes.assign(imageLifetimes.size(), wholeFrame);
+        bufferLifetimes.assign(bufferLifetimes.size(), wholeFrame);
+      }
+    }
+
+    //returns true if transient resources were recreated
+    bool ResolveAliasedResources(bool isMultiQueue)
+    {
+      std::vector<AliasedResourceCache::ResourceLifetime> imageLifetimes;
+      std::vector<AliasedResourceCache::ResourceLifetime> bufferLifetimes;
+      ComputeProxyLifetimes(isMultiQueue, imageLifetimes, bufferLifetimes);
+
+      std::vector<AliasedResourceCache::ImageRequest> imageRequests;
+      for (size_t proxyIndex = 0; proxyIndex < imageProxies.GetSize(); proxyIndex++)
+      {
+        if (!imageProxies.IsPresent(ImageProxyId(proxyIndex)))
+          continue;
+        auto &imageProxy = imageProxies.Get(ImageProxyId(proxyIndex));
+        if (imageProxy.type == ImageProxy::Types::Transient)
+        {
+          imageProxy.aliasedResourceIndex = imageRequests.size();
+          imageRequests.push_back({ imageProxy.imageKey, imageLifetimes[proxyIndex] });
+        }
+      }
+
+      std::vector<AliasedResourceCache::BufferRequest> bufferRequests;
+      for (size_t proxyIndex = 0; proxyIndex < bufferProxies.GetSize(); proxyIndex++)
+      {
+        if (!bufferProxies.IsPresent(BufferProxyId(proxyIndex)))
+          continue;
+        auto &bufferProxy = bufferProxies.Get(BufferProxyId(proxyIndex));
+        if (bufferProxy.type == BufferProxy::Types::Transient)
+        {
+          bufferProxy.aliasedResourceIndex = bufferRequests.size();
+          bufferRequests.push_back({ bufferProxy.bufferKey, bufferLifetimes[proxyIndex] });
+        }
+      }
+
+      RetiredResources retired;
+      retired.frameIndex = frameIndex;
+      bool resourcesRecreated = aliasedResourceCache.Allocate(imageRequests, bufferRequests, retired.aliasedResources);
+      if (resourcesRecreated)
+      {
+        //views and framebuffers are keyed by pointers to resources that are going away. nothing is destroyed until the frames
+        //that may still use it have finished, so a layout change doesn't have to wait for the device
+        retired.imageViews = imageViewCache.Retire();
+        retired.framebuffers = framebufferCache.Retire();
+        retiredResources.push_back(std::move(retired));
+      }
+
+      for (auto &imageProxy : imageProxies)
+      {
+        if (imageProxy.type == ImageProxy::Types::External)
+          imageProxy.resolvedImage = imageProxy.externalImage;
+        else
+          imageProxy.resolvedImage = aliasedResourceCache.GetImage(imageProxy.aliasedResourceIndex);
+      }
+      for (auto &bufferProxy : bufferProxies)
+      {
+        if (bufferProxy.type == BufferProxy::Types::External)
+          bufferProxy.resolvedBuffer = bufferProxy.externalBuffer;
+        else
+          bufferProxy.resolvedBuffer = aliasedResourceCache.GetBuffer(bufferProxy.aliasedResourceIndex);
+      }
+
+      taskAliasedResources.assign(tasks.size() + 1, {});
+      for (size_t resourceIndex = 0; resourceIndex < imageRequests.size() + bufferRequests.size(); resourceIndex++)
+      {
+        if (aliasedResourceCache.GetAliasedPredecessors(resourceIndex).size() == 0)
+          continue;
+        size_t firstTaskIndex = resourceIndex < imageRequests.size() ?
+          imageRequests[resourceIndex].lifetime.firstTaskIndex :
+          bufferRequests[resourceIndex - imageRequests.size()].lifetime.firstTaskIndex;
+        taskAliasedResources[firstTaskIndex].push_back(resourceIndex);
+      }
+      return resourcesRecreated;
+    }
+
+    //a resource placed over the memory of resources that are done for this frame has to wait for all their accesses before its first use
+    void AddAliasingBarriers(size_t taskIndex, const StateTracker &stateTracker, std::vector<StateTracker::ImageBarrier> &imageBarriers, std::vector<StateTracker::BufferBarrier> &bufferBarriers)
+    {
+      if (!resourceAliasingEnabled || taskIndex >= taskAliasedResources.size())
+        return;
+
+      size_t imagesCount = aliasedResourceCache.GetImagesCount();
+      for (size_t resourceIndex : taskAliasedResources[taskIndex])
+      {
+        vk::PipelineStageFlags srcStage = {};
+        vk::AccessFlags srcAccessMask = {};
+        //last task that used any of the predecessors, the barrier can't be moved before it
+        size_t srcTaskIndex = StateTracker::NoTask;
+        auto addSrcTaskIndex = [&](size_t predecessorTaskIndex)
+        {
+          if (predecessorTaskIndex != StateTracker::NoTask && (srcTaskIndex == StateTracker::NoTask || predecessorTaskIndex > srcTaskIndex))
+            srcTaskIndex = predecessorTaskIndex;
+        };
+        for (size_t predecessorIndex : aliasedResourceCache.GetAliasedPredecessors(resourceIndex))
+        {
+          if (predecessorIndex < imagesCount)
+          {
+            const legit::ImageData *imageData = aliasedResourceCache.GetImage(predecessorIndex);
+            for (uint32_t mipLevel = 0; mipLevel < imageData->GetMipsCount(); mipLevel++)
+            {
+              for (uint32_t arrayLayer = 0; arrayLayer < imageData->GetArrayLayersCount(); arrayLayer++)
+              {
+                auto accessPattern = GetSrcImageAccessPattern(stateTracker.GetImageSubresourceUsage({ imageData, mipLevel, arrayLayer }));
+                srcStage |= accessPattern.stage;
+                srcAccessMask |= accessPattern.accessMask;
+                addSrcTaskIndex(stateTracker.GetImageSubresourceTaskIndex({ imageData, mipLevel, arrayLayer }));
+              }
+            }
+          }
+          else
+          {
+            const legit::Buffer *buffer = aliasedResourceCache.GetBuffer(predecessorIndex - imagesCount);
+            auto accessPattern = GetSrcBufferAccessPattern(stateTracker.GetBufferUsage(buffer));
+            srcStage |= accessPattern.stage;
+            srcAccessMask |= accessPattern.accessMask;
+            addSrcTaskIndex(stateTracker.GetBufferTaskIndex(buffer));
+          }
+        }
+        auto getSrcTaskIndex = [&](size_t barrierSrcTaskIndex)
+        {
+          if (barrierSrcTaskIndex == StateTracker::NoTask)
+            return srcTaskIndex;
+          return srcTaskIndex == StateTracker::NoTask ? barrierSrcTaskIndex : std::max(barrierSrcTaskIndex, srcTaskIndex);
+        };
+
+        //predecessors that were never accessed leave nothing to wait for
+        if (!srcStage || srcStage == vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe))
+          continue;
+
+        if (resourceIndex < imagesCount)
+        {
+          const legit::ImageData *imageData = aliasedResourceCache.GetImage(resourceIndex);
+          vk::Image imageHandle = imageData->GetHandle();
+          for (auto &imageBarrier : imageBarriers)
+          {
+            if (imageBarrier.imageMemoryBarrier.image == imageHandle)
+            {
+              imageBarrier.srcStage |= srcStage;
+              imageBarrier.imageMemoryBarrier.srcAccessMask |= srcAccessMask;
+              imageBarrier.srcTaskIndex = getSrcTaskIndex(imageBarrier.srcTaskIndex);
+            }
+          }
+
+          //subresources used by this task without a transition still have to wait for the predecessors
+          size_t imageBarriersCount = imageBarriers.size();
+          for (uint32_t mipLevel = 0; mipLevel < imageData->GetMipsCount(); mipLevel++)
+          {
+            for (uint32_t arrayLayer = 0; arrayLayer < imageData->GetArrayLayersCount(); arrayLayer++)
+            {
+              if (stateTracker.GetImageSubresourceTaskIndex({ imageData, mipLevel, arrayLayer }) != taskIndex)
+                continue;
+              bool isCovered = false;
+              for (size_t barrierIndex = 0; barrierIndex < imageBarriersCount; barrierIndex++)
+              {
+                const auto &imageMemoryBarrier = imageBarriers[barrierIndex].imageMemoryBarrier;
+                const auto &range = imageMemoryBarrier.subresourceRange;
+                isCovered |=
+                  imageMemoryBarrier.image == imageHandle &&
+                  mipLevel >= range.baseMipLevel && mipLevel < range.baseMipLevel + range.levelCount &&
+                  arrayLayer >= range.baseArrayLayer && arrayLayer < range.baseArrayLayer + range.layerCount;
+              }
+              if (isCovered)
+                continue;
+
+              auto dstAccessPattern = GetDstImageAccessPattern(stateTracker.GetImageSubresourceUsage({ imageData, mipLevel, arrayLayer }));
+              StateTracker::ImageBarrier imageBarrier;
+              imageBarrier.imageMemoryBarrier = vk::ImageMemoryBarrier()
+                .setSrcAccessMask(srcAccessMask)
+                .setDstAccessMask(dstAccessPattern.accessMask)
+                .setOldLayout(dstAccessPattern.layout)
+                .setNewLayout(dstAccessPattern.layout)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setImage(imageHandle)
+                .setSubresourceRange(vk::ImageSubresourceRange(imageData->GetAspectFlags(), mipLevel, 1, arrayLayer, 1));
+              imageBarrier.srcStage = srcStage;
+              imageBarrier.dstStage = dstAccessPattern.stage;
+              imageBarrier.srcTaskIndex = srcTaskIndex;
+              imageBarriers.push_back(imageBarrier);
+            }
+          }
+        }
+        else
+        {
+          const legit::Buffer *buffer = aliasedResourceCache.GetBuffer(resourceIndex - imagesCount);
+          vk::Buffer bufferHandle = buffer->GetHandle();
+          bool isCovered = false;
+          for (auto &bufferBarrier : bufferBarriers)
+          {
+            if (bufferBarrier.bufferMemoryBarrier.buffer == bufferHandle)
+            {
+              bufferBarrier.srcStage |= srcStage;
+              bufferBarrier.bufferMemoryBarrier.srcAccessMask |= srcAccessMask;
+              bufferBarrier.srcTaskIndex = getSrcTaskIndex(bufferBarrier.srcTaskIndex);
+              isCovered = true;
+            }
+          }
+
+          //a first use that needed no barrier of its own, e.g. one without a previous usage, still has to wait for the predecessors
+          if (!isCovered && stateTracker.GetBufferTaskIndex(buffer) == taskIndex)
+          {
+            auto dstAccessPattern = GetDstBufferAccessPattern(stateTracker.GetBufferUsage(buffer));
+            StateTracker::BufferBarrier bufferBarrier;
+            bufferBarrier.bufferMemoryBarrier = vk::BufferMemoryBarrier()
+              .setSrcAccessMask(srcAccessMask)
+              .setDstAccessMask(dstAccessPattern.accessMask)
+              .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+              .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+              .setBuffer(bufferHandle)
+              .setOffset(0)
+              .setSize(VK_WHOLE_SIZE);
+            bufferBarrier.srcStage = srcStage;
+            bufferBarrier.dstStage = dstAccessPattern.stage;
+            bufferBarrier.srcTaskIndex = srcTaskIndex;
+            bufferBarriers.push_back(bufferBarrier);
+          }
+        }
+      }
+    }
+
+    AliasedResourceCache aliasedResourceCache;
+    bool resourceAliasingEnabled = true;
+    struct RetiredResources
+    {
+      uint64_t frameIndex;
+      AliasedResourceCache::RetiredResources aliasedResources;
+      //declared after the resources so that they're destroyed first
+      std::vector<std::unique_ptr<legit::ImageView> > imageViews;
+      std::vector<std::unique_ptr<legit::Framebuffer> > framebuffers;
+    };
+    std::deque<RetiredResources> retiredResources;
+    uint64_t frameIndex = 0;
+    size_t framesInFlightCount = 4;
+    std::vector<std::vector<size_t> > taskAliasedResources;
+
+
+
+    std::vector<RenderPassDesc> renderPassDescs;
+    std::vector<RenderPassDesc2> renderPassDescs2;
+    std::vector<ComputePassDesc> computePassDescs;
+    std::vector<ComputePassDesc2> computePassDescs2;
+    std::vector<TransferPassDesc> transferPassDescs;
+
+
+    std::vector<ImagePresentPassDesc> imagePresentDescs;
+    std::vector<FrameSyncBeginPassDesc> frameSyncBeginDescs;
+    std::vector<FrameSyncEndPassDesc> frameSyncEndDescs;
+
+    struct Task
+    {
+      enum struct Types
+      {
+        RenderPass,
+        RenderPass2,
+        ComputePass,
+        ComputePass2,
+        TransferPass,
+        ImagePresent,
+        FrameSyncBegin,
+        FrameSyncEnd
+      };
+      Types type;
+      size_t index;
+    };
+    std::vector<Task> tasks;
+    void AddTask(Task task)
+    {
+      tasks.push_back(task);
+    }
+
+    legit::ProfilerTask CreateProfilerTask(const RenderPassDesc &renderPassDesc)
+    {
+      legit::ProfilerTask task;
       task.startTime = -1.0f;
       task.endTime = -1.0f;
       task.name = renderPassDesc.profilerTaskName;
@@ -2225,11 +3208,915 @@ namespace legit
       return task;
     }
 
+    struct CompiledTask
+    {
+      std::vector<legit::ImageView *> resolvedImageViews;
+      std::vector<legit::Buffer *> resolvedBuffers;
+      std::vector<StateTracker::ImageBarrier> imageBarriers;
+      std::vector<StateTracker::BufferBarrier> bufferBarriers;
+      legit::RenderPass *renderPass = nullptr;
+      FramebufferCache::PassInfo passInfo;
+      std::vector<vk::ClearValue> clearValues;
+    };
+    struct CompiledGraph
+    {
+      std::vector<uint64_t> topologyKey;
+      std::vector<CompiledTask> tasks;
+      std::vector<std::vector<size_t> > taskAliasedResources;
+      bool isStatic;
+      //usages of external resources the barriers were compiled from and the ones they leave behind
+      StateTracker::PersistentUsages entryUsages;
+      StateTracker::PersistentUsages exitUsages;
+      //before optimization, replayed frames only have the optimized barriers
+      BarrierStats createdBarrierStats;
+    };
+
+    struct PassRecording
+    {
+      vk::CommandBuffer commandBuffer;
+      //resources bound by the record callback, transitioned in graph order once the pass is stitched into the primary command buffer
+      std::vector<std::pair<const legit::ImageView *, ImageUsageTypes> > imageTransitions;
+      std::vector<std::pair<const legit::Buffer *, BufferUsageTypes> > bufferTransitions;
+      legit::BoundState::Stats bindStats;
+    };
+
+    //splits the frame into per-queue batches. the graphics submission is cut every time a compute batch starts, so compute work waits for
+    //everything recorded before it and overlaps with what comes after. graphics only waits for compute when it acquires something compute owns
+    struct QueueSchedule
+    {
+      QueueSchedule(vk::Device _logicalDevice, vk::CommandPool _graphicsCommandPool, vk::CommandBuffer primaryCommandBuffer, legit::GpuProfiler *_gpuProfiler, const AsyncComputeResources *_asyncComputeResources, bool _useSynchronization2) :
+        logicalDevice(_logicalDevice),
+        graphicsCommandPool(_graphicsCommandPool),
+        gpuProfiler(_gpuProfiler),
+        asyncComputeResources(_asyncComputeResources),
+        useSynchronization2(_useSynchronization2)
+      {
+        QueueBatch primaryBatch;
+        primaryBatch.queueFamilyType = QueueFamilyTypes::Graphics;
+        primaryBatch.commandBuffer = primaryCommandBuffer;
+        batches.push_back(primaryBatch);
+      }
+
+      vk::CommandBuffer GetCommandBuffer()
+      {
+        return batches[isComputeBatchOpen ? lastComputeBatchIndex : graphicsBatchIndex].commandBuffer;
+      }
+
+      void BeginGraphicsTask()
+      {
+        isComputeBatchOpen = false;
+      }
+
+      void BeginComputeTask()
+      {
+        if (isComputeBatchOpen)
+          return;
+        auto graphicsSemaphore = GetSemaphore();
+        batches[graphicsBatchIndex].signalSemaphores.push_back(graphicsSemaphore);
+        computeWaitedBatchIndex = graphicsBatchIndex;
+
+        auto computeSemaphore = GetSemaphore();
+        QueueBatch computeBatch;
+        computeBatch.queueFamilyType = QueueFamilyTypes::Compute;
+        computeBatch.commandBuffer = BeginPrimaryCommandBuffer(asyncComputeResources->computeCommandPool);
+        computeBatch.waitSemaphores.push_back(graphicsSemaphore);
+        computeBatch.waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+        computeBatch.signalSemaphores.push_back(computeSemaphore);
+        batches.push_back(computeBatch);
+        lastComputeBatchIndex = batches.size() - 1;
+        isComputeBatchOpen = true;
+        pendingComputeSemaphores.push_back(computeSemaphore);
+
+        BeginGraphicsBatch();
+      }
+
+      //makes the graphics queue wait for all compute batches it doesn't wait for yet
+      void JoinComputeBatches()
+      {
+        if (pendingComputeSemaphores.empty())
+          return;
+        BeginGraphicsBatch();
+        auto &graphicsBatch = batches[graphicsBatchIndex];
+        graphicsBatch.waitSemaphores = pendingComputeSemaphores;
+        graphicsBatch.waitStages.assign(pendingComputeSemaphores.size(), vk::PipelineStageFlagBits::eAllCommands);
+        pendingComputeSemaphores.clear();
+      }
+
+      //ownership transfers are split into a release on the queue that used the resource last and an acquire on the current one
+      void SubmitBarriers(Span<StateTracker::ImageBarrier> imageBarriers, Span<StateTracker::BufferBarrier> bufferBarriers)
+      {
+        if (!asyncComputeResources)
+        {
+          RenderGraph::SubmitBarriers(GetCommandBuffer(), imageBarriers, bufferBarriers, useSynchronization2);
+          return;
+        }
+
+        std::vector<StateTracker::ImageBarrier> acquireImageBarriers(imageBarriers.begin(), imageBarriers.end());
+        std::vector<StateTracker::BufferBarrier> acquireBufferBarriers(bufferBarriers.begin(), bufferBarriers.end());
+        std::vector<StateTracker::ImageBarrier> releaseImageBarriers;
+        std::vector<StateTracker::BufferBarrier> releaseBufferBarriers;
+        for (auto &imageBarrier : acquireImageBarriers)
+        {
+          if (StateTracker::IsOwnershipTransfer(imageBarrier))
+          {
+            releaseImageBarriers.push_back(StateTracker::GetReleaseBarrier(imageBarrier));
+            imageBarrier = StateTracker::GetAcquireBarrier(imageBarrier);
+          }
+        }
+        for (auto &bufferBarrier : acquireBufferBarriers)
+        {
+          if (StateTracker::IsOwnershipTransfer(bufferBarrier))
+          {
+            releaseBufferBarriers.push_back(StateTracker::GetReleaseBarrier(bufferBarrier));
+            bufferBarrier = StateTracker::GetAcquireBarrier(bufferBarrier);
+          }
+        }
+
+        if (releaseImageBarriers.size() > 0 || releaseBufferBarriers.size() > 0)
+        {
+          if (isComputeBatchOpen)
+          {
+            //the batch waits for the graphics submission the release is recorded into
+            RenderGraph::SubmitBarriers(batches[computeWaitedBatchIndex].commandBuffer, releaseImageBarriers, releaseBufferBarriers, useSynchronization2);
+          }
+          else
+          {
+            //compute batches execute in order, so the last one comes after whichever used the resources
+            RenderGraph::SubmitBarriers(batches[lastComputeBatchIndex].commandBuffer, releaseImageBarriers, releaseBufferBarriers, useSynchronization2);
+            JoinComputeBatches();
+          }
+        }
+
+        if (isComputeBatchOpen)
+        {
+          //graphics stages can't be used on the compute queue, their work is already covered by the semaphore the batch waits on
+          for (auto &imageBarrier : acquireImageBarriers)
+          {
+            if (imageBarrier.srcStage & ~computeQueueStages)
+            {
+              imageBarrier.imageMemoryBarrier.setSrcAccessMask({});
+              imageBarrier.srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
+            }
+          }
+          for (auto &bufferBarrier : acquireBufferBarriers)
+          {
+            if (bufferBarrier.srcStage & ~computeQueueStages)
+            {
+              bufferBarrier.bufferMemoryBarrier.setSrcAccessMask({});
+              bufferBarrier.srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
+            }
+          }
+        }
+        RenderGraph::SubmitBarriers(GetCommandBuffer(), acquireImageBarriers, acquireBufferBarriers, useSynchronization2);
+      }
+
+      const std::vector<QueueBatch> &GetBatches()
+      {
+        return batches;
+      }
+    private:
+      void BeginGraphicsBatch()
+      {
+        QueueBatch graphicsBatch;
+        graphicsBatch.queueFamilyType = QueueFamilyTypes::Graphics;
+        graphicsBatch.commandBuffer = BeginPrimaryCommandBuffer(graphicsCommandPool);
+        batches.push_back(graphicsBatch);
+        graphicsBatchIndex = batches.size() - 1;
+        gpuProfiler->SetFrameCommandBuffer(graphicsBatch.commandBuffer);
+      }
+
+      vk::CommandBuffer BeginPrimaryCommandBuffer(vk::CommandPool commandPool)
+      {
+        auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
+          .setCommandPool(commandPool)
+          .setLevel(vk::CommandBufferLevel::ePrimary)
+          .setCommandBufferCount(1u);
+        auto commandBuffer = logicalDevice.allocateCommandBuffers(commandBufferAllocateInfo)[0];
+        auto bufferBeginInfo = vk::CommandBufferBeginInfo()
+          .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        commandBuffer.begin(bufferBeginInfo);
+        return commandBuffer;
+      }
+
+      vk::Semaphore GetSemaphore()
+      {
+        auto &semaphores = *asyncComputeResources->semaphores;
+        if (usedSemaphoresCount == semaphores.size())
+          semaphores.push_back(logicalDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo()));
+        return semaphores[usedSemaphoresCount++].get();
+      }
+
+      const vk::PipelineStageFlags computeQueueStages =
+        vk::PipelineStageFlagBits::eTopOfPipe |
+        vk::PipelineStageFlagBits::eDrawIndirect |
+        vk::PipelineStageFlagBits::eComputeShader |
+        vk::PipelineStageFlagBits::eTransfer |
+        vk::PipelineStageFlagBits::eHost |
+        vk::PipelineStageFlagBits::eAllCommands |
+        vk::PipelineStageFlagBits::eBottomOfPipe;
+
+      vk::Device logicalDevice;
+      vk::CommandPool graphicsCommandPool;
+      legit::GpuProfiler *gpuProfiler;
+      const AsyncComputeResources *asyncComputeResources;
+      bool useSynchronization2;
+
+      std::vector<QueueBatch> batches;
+      size_t graphicsBatchIndex = 0;
+      size_t lastComputeBatchIndex = 0;
+      size_t computeWaitedBatchIndex = 0;
+      bool isComputeBatchOpen = false;
+      std::vector<vk::Semaphore> pendingComputeSemaphores;
+      size_t usedSemaphoresCount = 0;
+    };
+
+    static vk::CommandBuffer AllocateSecondaryCommandBuffer(vk::Device logicalDevice, vk::CommandPool commandPool)
+    {
+      auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
+        .setCommandPool(commandPool)
+        .setLevel(vk::CommandBufferLevel::eSecondary)
+        .setCommandBufferCount(1u);
+      return logicalDevice.allocateCommandBuffers(commandBufferAllocateInfo)[0];
+    }
+
+    static void ApplyRecordedTransitions(const PassRecording &passRecording, StateTracker &stateTracker, std::vector<StateTracker::ImageBarrier> &imageBarriers, std::vector<StateTracker::BufferBarrier> &bufferBarriers)
+    {
+      for (auto &imageTransition : passRecording.imageTransitions)
+      {
+        stateTracker.TransitionImageAndCreateBarriers(imageTransition.first, imageTransition.second, imageBarriers);
+      }
+      for (auto &bufferTransition : passRecording.bufferTransitions)
+      {
+        stateTracker.TransitionBufferAndCreateBarriers(bufferTransition.first, bufferTransition.second, bufferBarriers);
+      }
+    }
+
+    static void CopyUniforms(const PassContext2::DescriptorSetBindings &bindings, char *setData)
+    {
+      for(auto uniformBinding : bindings.uniformBindings)
+      {
+        auto uniformBufferId = bindings.shaderDataSetInfo->GetUniformBufferId(uniformBinding.name);
+        assert(!(uniformBufferId == legit::DescriptorSetLayoutKey::UniformBufferId()));
+        auto uniformBufferInfo = bindings.shaderDataSetInfo->GetUniformBufferInfo(uniformBufferId);
+        assert(uniformBinding.size == uniformBufferInfo.size);
+        memcpy(setData + uniformBufferInfo.offsetInSet, uniformBinding.data, uniformBinding.size);
+      }
+    }
+
+    //uniform data goes through ShaderMemoryPool::AllocateSet() and descriptor sets through the locked DescriptorSetCache, so this can run on any worker
+    static legit::ShaderMemoryPool::SetDynamicUniformBindings WriteUniforms(const PassContext2::DescriptorSetBindings &bindings, legit::ShaderMemoryPool *memoryPool)
+    {
+      if (bindings.uniformBindings.size() > 0 && memoryPool->IsDeduplicationEnabled())
+      {
+        //the set is assembled on the cpu first so that it can be compared against the ones already uploaded this frame
+        std::vector<char> setData(bindings.shaderDataSetInfo->GetTotalConstantBufferSize(), 0);
+        CopyUniforms(bindings, setData.data());
+        return memoryPool->AllocateSetDeduplicated(bindings.shaderDataSetInfo, setData.data());
+      }
+      void *setData = nullptr;
+      auto uniforms = memoryPool->AllocateSet(bindings.shaderDataSetInfo, &setData);
+      CopyUniforms(bindings, (char*)setData);
+      return uniforms;
+    }
+
+    static vk::DescriptorSet MakeDescriptorSet(const PassContext2::DescriptorSetBindings &bindings, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool, std::vector<uint32_t> &dynamicOffsets)
+    {
+      auto uniforms = WriteUniforms(bindings, memoryPool);
+      auto descriptoSetBindings = legit::DescriptorSetBindingsView()
+        .SetUniformBufferBindings(uniforms.uniformBufferBindings)
+        .SetImageSamplerBindings(bindings.imageSamplerBindings)
+        .SetTextureBindings(bindings.textureBindings)
+        .SetSamplerBindings(bindings.samplerBindings)
+        .SetStorageImageBindings(bindings.storageImageBindings)
+        .SetStorageBufferBindings(bindings.storageBufferBindings)
+        .SetAccelerationStructureBindings(bindings.accelerationStructureBindings);
+
+      if(bindings.uniformBindings.size() > 0)
+      {
+        dynamicOffsets.push_back(uniforms.dynamicOffset);
+      }
+      if (bindings.isTransient)
+        return descriptorSetCache->GetTransientDescriptorSet(*bindings.shaderDataSetInfo, descriptoSetBindings);
+      return descriptorSetCache->GetDescriptorSet(*bindings.shaderDataSetInfo, descriptoSetBindings);
+    }
+
+    //same data as MakeDescriptorSet() but pushed into the command buffer, the uniforms offset goes into the descriptors since they can't be dynamic
+    static void PushDescriptorSet(const PassContext2::DescriptorSetBindings &bindings, vk::PipelineBindPoint bindPoint, vk::CommandBuffer commandBuffer, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool)
+    {
+      auto uniforms = WriteUniforms(bindings, memoryPool);
+      auto descriptoSetBindings = legit::DescriptorSetBindingsView()
+        .SetUniformBufferBindings(uniforms.uniformBufferBindings)
+        .SetImageSamplerBindings(bindings.imageSamplerBindings)
+        .SetTextureBindings(bindings.textureBindings)
+        .SetSamplerBindings(bindings.samplerBindings)
+        .SetStorageImageBindings(bindings.storageImageBindings)
+        .SetStorageBufferBindings(bindings.storageBufferBindings)
+        .SetAccelerationStructureBindings(bindings.accelerationStructureBindings);
+      descriptorSetCache->PushDescriptorSet(commandBuffer, bindPoint, bindings.pipelineLayout, uint32_t(bindings.setIndex), *bindings.shaderDataSetInfo, descriptoSetBindings, uniforms.dynamicOffset);
+    }
+
+    //same again for the descriptor buffer backend, which replaces both cached and pushed sets
+    static void BindDescriptorBufferSet(const PassContext2::DescriptorSetBindings &bindings, vk::PipelineBindPoint bindPoint, vk::CommandBuffer commandBuffer, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool)
+    {
+      auto uniforms = WriteUniforms(bindings, memoryPool);
+      auto descriptoSetBindings = legit::DescriptorSetBindingsView()
+        .SetUniformBufferBindings(uniforms.uniformBufferBindings)
+        .SetImageSamplerBindings(bindings.imageSamplerBindings)
+        .SetTextureBindings(bindings.textureBindings)
+        .SetSamplerBindings(bindings.samplerBindings)
+        .SetStorageImageBindings(bindings.storageImageBindings)
+        .SetStorageBufferBindings(bindings.storageBufferBindings)
+        .SetAccelerationStructureBindings(bindings.accelerationStructureBindings);
+      descriptorSetCache->BindDescriptorBufferSet(commandBuffer, bindPoint, bindings.pipelineLayout, uint32_t(bindings.setIndex), *bindings.shaderDataSetInfo, descriptoSetBindings, uniforms.dynamicOffset);
+    }
+
+    //picks the descriptor buffer, push descriptor or cached set path. only cached sets can be skipped when nothing changed, the other two
+    //write new descriptors on every call
+    static void BindDescriptorSet(const PassContext2::DescriptorSetBindings &bindings, vk::PipelineBindPoint bindPoint, legit::BoundState &boundState, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool)
+    {
+      uint32_t setIndex = uint32_t(bindings.setIndex);
+      if (descriptorSetCache->IsDescriptorBufferEnabled())
+      {
+        BindDescriptorBufferSet(bindings, bindPoint, boundState.GetCommandBuffer(), descriptorSetCache, memoryPool);
+        boundState.InvalidateDescriptorSet(bindPoint, bindings.pipelineLayout, setIndex);
+        return;
+      }
+      if (bindings.isPushDescriptorSet && descriptorSetCache->IsPushDescriptorsEnabled())
+      {
+        PushDescriptorSet(bindings, bindPoint, boundState.GetCommandBuffer(), descriptorSetCache, memoryPool);
+        boundState.InvalidateDescriptorSet(bindPoint, bindings.pipelineLayout, setIndex);
+        return;
+      }
+      std::vector<uint32_t> dynamicOffsets;
+      auto descriptorSet = MakeDescriptorSet(bindings, descriptorSetCache, memoryPool, dynamicOffsets);
+      boundState.BindDescriptorSet(bindPoint, bindings.pipelineLayout, setIndex, descriptorSet, dynamicOffsets);
+    }
+
+    //render pass, framebuffer and clear values only depend on the attachments, so they're resolved before recording
+    void PrepareRenderPass2(const RenderPassDesc2 &renderPassDesc2, CompiledTask &compiledTask)
+    {
+      std::vector<FramebufferCache::Attachment> colorAttachments;
+      FramebufferCache::Attachment depthAttachment;
+
+      legit::RenderPassCache::RenderPassKey renderPassKey;
+
+      for (auto &attachment : renderPassDesc2.colorAttachments)
+      {
+        renderPassKey.colorAttachmentDescs.push_back({attachment.imageView->GetImageData()->GetFormat(), attachment.loadOp, attachment.clearValue });
+        colorAttachments.push_back({ attachment.imageView, attachment.clearValue });
+      }
+      if (auto imageView = renderPassDesc2.depthAttachment.imageView)
+      {
+        renderPassKey.depthAttachmentDesc = { imageView->GetImageData()->GetFormat(), renderPassDesc2.depthAttachment.loadOp, renderPassDesc2.depthAttachment.clearValue };
+        depthAttachment = { imageView, renderPassDesc2.depthAttachment.clearValue };
+      }
+      else
+      {
+        renderPassKey.depthAttachmentDesc.format = vk::Format::eUndefined;
+      }
+
+      auto renderAreaExtent = renderPassDesc2.renderAreaExtent;
+      if(renderAreaExtent.width == 0 && renderAreaExtent.height == 0)
+      {
+        if(colorAttachments.size() > 0)
+        {
+          auto mipSize = colorAttachments[0].imageView->GetBaseSize();
+          renderAreaExtent = vk::Extent2D(mipSize.x, mipSize.y);
+        }else
+        {
+          assert(depthAttachment.imageView);
+          auto mipSize = depthAttachment.imageView->GetBaseSize();
+          renderAreaExtent = vk::Extent2D(mipSize.x, mipSize.y);                
+        }
+      }
+
+      compiledTask.renderPass = renderPassCache.GetRenderPass(renderPassKey);
+      compiledTask.passInfo = framebufferCache.GetPassInfo(colorAttachments, renderPassDesc2.depthAttachment.imageView ? (&depthAttachment) : nullptr, compiledTask.renderPass, renderAreaExtent);
+      compiledTask.clearValues = FramebufferCache::GetClearValues(colorAttachments, renderPassDesc2.depthAttachment.imageView ? (&depthAttachment) : nullptr);
+    }
+
+    static void RecordRenderPass2(RenderPassDesc2 &renderPassDesc2, const CompiledTask &compiledTask, vk::CommandBuffer transientCommandBuffer, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool, PassRecording &passRecording)
+    {
+      passRecording.commandBuffer = transientCommandBuffer;
+
+      RenderPassContext2 passContext([&](const PassContext2::DescriptorSetBindings &bindings)
+      {
+        for (auto binding : bindings.imageSamplerBindings)
+        {
+          passRecording.imageTransitions.push_back({ binding.imageView, ImageUsageTypes::GraphicsShaderRead });
+        }
+
+        for (auto binding : bindings.textureBindings)
+        {
+          passRecording.imageTransitions.push_back({ binding.imageView, ImageUsageTypes::GraphicsShaderRead });
+        }
+
+        for (auto &binding : bindings.storageImageBindings)
+        {
+          passRecording.imageTransitions.push_back({ binding.imageView, ImageUsageTypes::GraphicsShaderReadWrite });
+        }
+
+        for (auto storageBuffer : bindings.storageBufferBindings)
+        {
+          for(auto desc : storageBuffer.descriptors)
+          {
+            passRecording.bufferTransitions.push_back({ desc.buffer, BufferUsageTypes::GraphicsShaderReadWrite });
+          }
+        }
+
+        assert(bindings.shaderDataSetInfo->GetUniformBuffersCount() == bindings.uniformBindings.size());
+        BindDescriptorSet(bindings, vk::PipelineBindPoint::eGraphics, passContext.boundState, descriptorSetCache, memoryPool);
+      },
+      [&](const legit::Buffer *indirectBuf)
+      {
+        passRecording.bufferTransitions.push_back({ indirectBuf, BufferUsageTypes::DrawIndirect });
+        transientCommandBuffer.drawIndirect(indirectBuf->GetHandle(), 0, 1, sizeof(uint32_t) * 4);
+      });
+
+      const auto &passInfo = compiledTask.passInfo;
+      passContext.renderPass = compiledTask.renderPass;
+      passContext.commandBuffer = transientCommandBuffer;
+      passContext.boundState.Reset(transientCommandBuffer);
+      
+      auto inheritanceInfo = vk::CommandBufferInheritanceInfo()
+        .setRenderPass(passInfo.renderPass->GetHandle())
+        .setFramebuffer(passInfo.framebuffer->GetHandle());
+      auto oneTimeBeginInfo = vk::CommandBufferBeginInfo()
+        .setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+        .setPInheritanceInfo(&inheritanceInfo);      
+      passContext.commandBuffer.begin(oneTimeBeginInfo);
+      if (descriptorSetCache->IsDescriptorBufferEnabled())
+        descriptorSetCache->BindDescriptorBuffer(passContext.commandBuffer);
+      {
+        passContext.commandBuffer.setViewport(0, { passInfo.viewport });
+        passContext.commandBuffer.setScissor(0, { passInfo.scissorRect });                
+        renderPassDesc2.recordFunc(passContext);
+      }
+      passContext.commandBuffer.end();
+      passRecording.bindStats = passContext.boundState.GetStats();
+    }
+
+    static void RecordComputePass2(ComputePassDesc2 &computePassDesc2, vk::CommandBuffer transientCommandBuffer, legit::DescriptorSetCache *descriptorSetCache, legit::ShaderMemoryPool *memoryPool, PassRecording &passRecording)
+    {
+      passRecording.commandBuffer = transientCommandBuffer;
+
+      ComputePassContext2 passContext([&](const PassContext2::DescriptorSetBindings &bindings)
+      {
+        for (auto binding : bindings.imageSamplerBindings)
+        {
+          passRecording.imageTransitions.push_back({ binding.imageView, ImageUsageTypes::ComputeShaderRead });
+        }
+
+        for (auto binding : bindings.textureBindings)
+        {
+          passRecording.imageTransitions.push_back({ binding.imageView, ImageUsageTypes::ComputeShaderRead });
+        }
+
+        for (auto &binding : bindings.storageImageBindings)
+        {
+          passRecording.imageTransitions.push_back({ binding.imageView, ImageUsageTypes::ComputeShaderReadWrite });
+        }
+
+        for (auto storageBuffer : bindings.storageBufferBindings)
+        {
+          for(auto desc : storageBuffer.descriptors)
+          {
+            passRecording.bufferTransitions.push_back({ desc.buffer, BufferUsageTypes::ComputeShaderReadWrite });
+          }
+        }
+
+        BindDescriptorSet(bindings, vk::PipelineBindPoint::eCompute, passContext.boundState, descriptorSetCache, memoryPool);
+      },
+      [&](legit::Buffer *indirectBuf)
+      {
+        passRecording.bufferTransitions.push_back({ indirectBuf, BufferUsageTypes::DispatchIndirect });
+        transientCommandBuffer.dispatchIndirect(indirectBuf->GetHandle(), 0);
+      });
+
+      passContext.commandBuffer = transientCommandBuffer;
+      passContext.boundState.Reset(transientCommandBuffer);
+
+      auto inheritanceInfo = vk::CommandBufferInheritanceInfo();
+      auto oneTimeBeginInfo = vk::CommandBufferBeginInfo()
+        .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+        .setPInheritanceInfo(&inheritanceInfo);      
+      passContext.commandBuffer.begin(oneTimeBeginInfo);
+      if (descriptorSetCache->IsDescriptorBufferEnabled())
+        descriptorSetCache->BindDescriptorBuffer(passContext.commandBuffer);
+      {
+        computePassDesc2.recordFunc(passContext);
+      }
+      passContext.commandBuffer.end();
+      passRecording.bindStats = passContext.boundState.GetStats();
+    }
+
+    template<typename Handle>
+    static uint64_t GetHandleKey(Handle handle)
+    {
+      return uint64_t(typename Handle::CType(handle));
+    }
+    static void AddClearValueKey(std::vector<uint64_t> &topologyKey, vk::ClearValue clearValue, bool isDepth)
+    {
+      if (isDepth)
+      {
+        uint32_t depthBits;
+        memcpy(&depthBits, &clearValue.depthStencil.depth, sizeof(depthBits));
+        topologyKey.push_back((uint64_t(depthBits) << 32) | clearValue.depthStencil.stencil);
+      }
+      else
+      {
+        topologyKey.push_back((uint64_t(uint32_t(clearValue.color.int32[0])) << 32) | uint32_t(clearValue.color.int32[1]));
+        topologyKey.push_back((uint64_t(uint32_t(clearValue.color.int32[2])) << 32) | uint32_t(clearValue.color.int32[3]));
+      }
+    }
+
+    //the two halves of the barriers from one task to a later one. set and wait have to use the same dependency info
+    struct SplitBarrier
+    {
+      vk::Event event;
+      size_t srcTaskIndex;
+      size_t dstTaskIndex;
+      std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+      std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+      vk::DependencyInfo GetDependencyInfo() const
+      {
+        return vk::DependencyInfo()
+          .setImageMemoryBarriers(imageBarriers)
+          .setBufferMemoryBarriers(bufferBarriers);
+      }
+    };
+    //a barrier right after the task it waits for has nothing to overlap with
+    static bool IsSplitBarrier(size_t srcTaskIndex, size_t dstTaskIndex)
+    {
+      return srcTaskIndex != StateTracker::NoTask && srcTaskIndex + 1 < dstTaskIndex;
+    }
+    void PlanSplitBarriers(const CompiledGraph &compiledGraph)
+    {
+      splitBarriers.clear();
+      for (size_t taskIndex = 0; taskIndex < compiledGraph.tasks.size(); taskIndex++)
+      {
+        size_t firstSplitBarrierIndex = splitBarriers.size();
+        auto getSplitBarrier = [&](size_t srcTaskIndex) -> SplitBarrier&
+        {
+          for (size_t splitBarrierIndex = firstSplitBarrierIndex; splitBarrierIndex < splitBarriers.size(); splitBarrierIndex++)
+          {
+            if (splitBarriers[splitBarrierIndex].srcTaskIndex == srcTaskIndex)
+              return splitBarriers[splitBarrierIndex];
+          }
+          SplitBarrier splitBarrier;
+          splitBarrier.event = eventPool->GetEvent();
+          splitBarrier.srcTaskIndex = srcTaskIndex;
+          splitBarrier.dstTaskIndex = taskIndex;
+          splitBarriers.push_back(std::move(splitBarrier));
+          return splitBarriers.back();
+        };
+
+        const auto &compiledTask = compiledGraph.tasks[taskIndex];
+        for (const auto &imageBarrier : compiledTask.imageBarriers)
+        {
+          if (!IsSplitBarrier(imageBarrier.srcTaskIndex, taskIndex))
+            continue;
+          getSplitBarrier(imageBarrier.srcTaskIndex).imageBarriers.push_back(GetImageMemoryBarrier2(imageBarrier));
+          barrierStats.splitImageBarriersCount++;
+        }
+        for (const auto &bufferBarrier : compiledTask.bufferBarriers)
+        {
+          if (!IsSplitBarrier(bufferBarrier.srcTaskIndex, taskIndex))
+            continue;
+          getSplitBarrier(bufferBarrier.srcTaskIndex).bufferBarriers.push_back(GetBufferMemoryBarrier2(bufferBarrier));
+          barrierStats.splitBufferBarriersCount++;
+        }
+      }
+      barrierStats.eventsCount = splitBarriers.size();
+    }
+    //tasks that submit their compiled barriers through submitBarriers once per frame. frame sync begin records its own barrier and
+    //the recorded passes aren't replayed
+    static bool IsSubmittingCompiledBarriers(Task::Types taskType)
+    {
+      return taskType != Task::Types::FrameSyncBegin && taskType != Task::Types::RenderPass2 && taskType != Task::Types::ComputePass2;
+    }
+    //batchTaskIndices[taskIndex] is the task whose pipeline barrier also carries the barriers of taskIndex. a task's barriers can only be
+    //hoisted into an earlier task's barrier if everything they wait for happened before that task, otherwise it starts a new batch
+    void PlanBarrierBatches(const CompiledGraph &compiledGraph, bool isSplittingBarriers)
+    {
+      batchTaskIndices.assign(compiledGraph.tasks.size(), StateTracker::NoTask);
+      size_t batchTaskIndex = StateTracker::NoTask;
+      for (size_t taskIndex = 0; taskIndex < compiledGraph.tasks.size(); taskIndex++)
+      {
+        if (!IsSubmittingCompiledBarriers(tasks[taskIndex].type))
+        {
+          batchTaskIndex = StateTracker::NoTask;
+          continue;
+        }
+
+        bool hasBarriers = false;
+        bool isHoistable = barrierOptimizationEnabled && batchTaskIndex != StateTracker::NoTask;
+        auto addBarrier = [&](size_t srcTaskIndex)
+        {
+          if (isSplittingBarriers && IsSplitBarrier(srcTaskIndex, taskIndex))
+            return;
+          hasBarriers = true;
+          if (srcTaskIndex != StateTracker::NoTask && srcTaskIndex >= batchTaskIndex)
+            isHoistable = false;
+        };
+        const auto &compiledTask = compiledGraph.tasks[taskIndex];
+        for (const auto &imageBarrier : compiledTask.imageBarriers)
+          addBarrier(imageBarrier.srcTaskIndex);
+        for (const auto &bufferBarrier : compiledTask.bufferBarriers)
+          addBarrier(bufferBarrier.srcTaskIndex);
+
+        if (hasBarriers && !isHoistable)
+          batchTaskIndex = taskIndex;
+        batchTaskIndices[taskIndex] = batchTaskIndex;
+      }
+    }
+    void AddSubmittedBarrierStats(size_t imageBarriersCount, size_t bufferBarriersCount)
+    {
+      barrierStats.submittedImageBarriersCount += imageBarriersCount;
+      barrierStats.submittedBufferBarriersCount += bufferBarriersCount;
+      if (imageBarriersCount > 0 || bufferBarriersCount > 0)
+        barrierStats.submittedPipelineBarriersCount++;
+    }
+    void RecordSplitBarrierSets(vk::CommandBuffer commandBuffer, size_t taskIndex)
+    {
+      for (const auto &splitBarrier : splitBarriers)
+      {
+        if (splitBarrier.srcTaskIndex == taskIndex)
+          commandBuffer.setEvent2KHR(splitBarrier.event, splitBarrier.GetDependencyInfo());
+      }
+    }
+    void RecordSplitBarrierWaits(vk::CommandBuffer commandBuffer, size_t taskIndex)
+    {
+      std::vector<vk::Event> events;
+      std::vector<vk::DependencyInfo> dependencyInfos;
+      for (const auto &splitBarrier : splitBarriers)
+      {
+        if (splitBarrier.dstTaskIndex != taskIndex)
+          continue;
+        events.push_back(splitBarrier.event);
+        dependencyInfos.push_back(splitBarrier.GetDependencyInfo());
+      }
+      if (events.size() > 0)
+        commandBuffer.waitEvents2KHR(events, dependencyInfos);
+    }
+
+    //external images and buffers, sorted and without duplicates. their usage is carried over from one frame to the next
+    void GetPersistentResources(std::vector<const legit::ImageData *> &images, std::vector<const legit::Buffer *> &buffers)
+    {
+      images.clear();
+      for (auto &imageProxy : imageProxies)
+      {
+        if (imageProxy.type == ImageProxy::Types::External)
+          images.push_back(imageProxy.externalImage);
+      }
+      for (auto &imageViewProxy : imageViewProxies)
+      {
+        if (imageViewProxy.externalView)
+          images.push_back(imageViewProxy.externalView->GetImageData());
+      }
+      std::sort(images.begin(), images.end());
+      images.erase(std::unique(images.begin(), images.end()), images.end());
+
+      buffers.clear();
+      for (auto &bufferProxy : bufferProxies)
+      {
+        if (bufferProxy.type == BufferProxy::Types::External)
+          buffers.push_back(bufferProxy.externalBuffer);
+      }
+      std::sort(buffers.begin(), buffers.end());
+      buffers.erase(std::unique(buffers.begin(), buffers.end()), buffers.end());
+    }
+
+    //adds every non-transient resource the frame transitioned. pass 2 descs and pass contexts use images and buffers that no proxy refers to
+    void AddTrackedPersistentResources(const StateTracker &stateTracker, std::vector<const legit::ImageData *> &images, std::vector<const legit::Buffer *> &buffers)
+    {
+      std::vector<const legit::ImageData *> transientImages;
+      for (auto &imageProxy : imageProxies)
+      {
+        if (imageProxy.type == ImageProxy::Types::Transient)
+          transientImages.push_back(imageProxy.resolvedImage);
+      }
+      std::sort(transientImages.begin(), transientImages.end());
+      for (auto &imageState : stateTracker.imageStates)
+      {
+        if (!std::binary_search(transientImages.begin(), transientImages.end(), imageState.first))
+          images.push_back(imageState.first);
+      }
+      std::sort(images.begin(), images.end());
+      images.erase(std::unique(images.begin(), images.end()), images.end());
+
+      std::vector<const legit::Buffer *> transientBuffers;
+      for (auto &bufferProxy : bufferProxies)
+      {
+        if (bufferProxy.type == BufferProxy::Types::Transient)
+          transientBuffers.push_back(bufferProxy.resolvedBuffer);
+      }
+      std::sort(transientBuffers.begin(), transientBuffers.end());
+      for (auto &bufferState : stateTracker.bufferStates)
+      {
+        if (!std::binary_search(transientBuffers.begin(), transientBuffers.end(), bufferState.first))
+          buffers.push_back(bufferState.first);
+      }
+      std::sort(buffers.begin(), buffers.end());
+      buffers.erase(std::unique(buffers.begin(), buffers.end()), buffers.end());
+    }
+
+    //everything that affects resolved resources and barriers goes into the key. returns false if the graph has passes whose barriers are only known after recording them
+    bool BuildTopologyKey(std::vector<uint64_t> &topologyKey)
+    {
+      bool isStatic = true;
+      topologyKey.clear();
+
+      topologyKey.push_back(imageProxies.GetSize());
+      for (size_t proxyIndex = 0; proxyIndex < imageProxies.GetSize(); proxyIndex++)
+      {
+        if (!imageProxies.IsPresent(ImageProxyId(proxyIndex)))
+          continue;
+        const auto &imageProxy = imageProxies.Get(ImageProxyId(proxyIndex));
+        topologyKey.push_back(proxyIndex);
+        topologyKey.push_back(uint64_t(imageProxy.type));
+        if (imageProxy.type == ImageProxy::Types::External)
+        {
+          topologyKey.push_back(uint64_t(size_t(imageProxy.externalImage)));
+          topologyKey.push_back(GetHandleKey(imageProxy.externalImage->GetHandle()));
+        }
+        else
+        {
+          const auto &imageKey = imageProxy.imageKey;
+          topologyKey.push_back(uint64_t(imageKey.format));
+          topologyKey.push_back(uint64_t(VkImageUsageFlags(imageKey.usageFlags)));
+          topologyKey.push_back(imageKey.mipsCount);
+          topologyKey.push_back(imageKey.arrayLayersCount);
+          topologyKey.push_back(imageKey.size.x);
+          topologyKey.push_back(imageKey.size.y);
+          topologyKey.push_back(imageKey.size.z);
+        }
+      }
+
+      topologyKey.push_back(imageViewProxies.GetSize());
+      for (size_t proxyIndex = 0; proxyIndex < imageViewProxies.GetSize(); proxyIndex++)
+      {
+        if (!imageViewProxies.IsPresent(ImageViewProxyId(proxyIndex)))
+          continue;
+        const auto &imageViewProxy = imageViewProxies.Get(ImageViewProxyId(proxyIndex));
+        topologyKey.push_back(proxyIndex);
+        topologyKey.push_back(uint64_t(imageViewProxy.type));
+        if (imageViewProxy.type == ImageViewProxy::Types::External)
+        {
+          topologyKey.push_back(uint64_t(size_t(imageViewProxy.externalView)));
+          topologyKey.push_back(GetHandleKey(imageViewProxy.externalView->GetHandle()));
+          topologyKey.push_back(GetHandleKey(imageViewProxy.externalView->GetImageData()->GetHandle()));
+          topologyKey.push_back(uint64_t(imageViewProxy.externalUsageType));
+        }
+        else
+        {
+          topologyKey.push_back(imageViewProxy.imageProxyId.asInt);
+          topologyKey.push_back(imageViewProxy.subresourceRange.baseMipLevel);
+          topologyKey.push_back(imageViewProxy.subresourceRange.mipsCount);
+          topologyKey.push_back(imageViewProxy.subresourceRange.baseArrayLayer);
+          topologyKey.push_back(imageViewProxy.subresourceRange.arrayLayersCount);
+        }
+      }
+
+      topologyKey.push_back(bufferProxies.GetSize());
+      for (size_t proxyIndex = 0; proxyIndex < bufferProxies.GetSize(); proxyIndex++)
+      {
+        if (!bufferProxies.IsPresent(BufferProxyId(proxyIndex)))
+          continue;
+        const auto &bufferProxy = bufferProxies.Get(BufferProxyId(proxyIndex));
+        topologyKey.push_back(proxyIndex);
+        topologyKey.push_back(uint64_t(bufferProxy.type));
+        if (bufferProxy.type == BufferProxy::Types::External)
+        {
+          topologyKey.push_back(uint64_t(size_t(bufferProxy.externalBuffer)));
+          topologyKey.push_back(GetHandleKey(bufferProxy.externalBuffer->GetHandle()));
+        }
+        else
+        {
+          topologyKey.push_back(bufferProxy.bufferKey.elementSize);
+          topologyKey.push_back(bufferProxy.bufferKey.elementsCount);
+        }
+      }
+
+      auto addProxyIds = [&](const auto &proxyIds)
+      {
+        topologyKey.push_back(proxyIds.size());
+        for (const auto &proxyId : proxyIds)
+          topologyKey.push_back(proxyId.asInt);
+      };
+      auto addAttachment = [&](const legit::ImageView *imageView, vk::AttachmentLoadOp loadOp, vk::ClearValue clearValue, bool isDepth)
+      {
+        topologyKey.push_back(uint64_t(size_t(imageView)));
+        if (!imageView)
+          return;
+        topologyKey.push_back(GetHandleKey(imageView->GetHandle()));
+        topologyKey.push_back(uint64_t(loadOp));
+        AddClearValueKey(topologyKey, clearValue, isDepth);
+      };
+
+      topologyKey.push_back(tasks.size());
+      for (const auto &task : tasks)
+      {
+        topologyKey.push_back(uint64_t(task.type));
+        switch (task.type)
+        {
+          case Task::Types::RenderPass:
+          {
+            const auto &renderPassDesc = renderPassDescs[task.index];
+            topologyKey.push_back(renderPassDesc.colorAttachments.size());
+            for (const auto &colorAttachment : renderPassDesc.colorAttachments)
+            {
+              topologyKey.push_back(colorAttachment.imageViewProxyId.asInt);
+              topologyKey.push_back(uint64_t(colorAttachment.loadOp));
+              AddClearValueKey(topologyKey, colorAttachment.clearValue, false);
+            }
+            topologyKey.push_back(renderPassDesc.depthAttachment.imageViewProxyId.asInt);
+            if (!(renderPassDesc.depthAttachment.imageViewProxyId == ImageViewProxyId()))
+            {
+              topologyKey.push_back(uint64_t(renderPassDesc.depthAttachment.loadOp));
+              AddClearValueKey(topologyKey, renderPassDesc.depthAttachment.clearValue, true);
+            }
+            addProxyIds(renderPassDesc.inputImageViewProxies);
+            addProxyIds(renderPassDesc.vertexBufferProxies);
+            addProxyIds(renderPassDesc.inoutStorageBufferProxies);
+            addProxyIds(renderPassDesc.inoutStorageImageProxies);
+            topologyKey.push_back(renderPassDesc.renderAreaExtent.width);
+            topologyKey.push_back(renderPassDesc.renderAreaExtent.height);
+          }break;
+          case Task::Types::RenderPass2:
+          {
+            const auto &renderPassDesc2 = renderPassDescs2[task.index];
+            topologyKey.push_back(renderPassDesc2.colorAttachments.size());
+            for (const auto &colorAttachment : renderPassDesc2.colorAttachments)
+              addAttachment(colorAttachment.imageView, colorAttachment.loadOp, colorAttachment.clearValue, false);
+            addAttachment(renderPassDesc2.depthAttachment.imageView, renderPassDesc2.depthAttachment.loadOp, renderPassDesc2.depthAttachment.clearValue, true);
+            topologyKey.push_back(renderPassDesc2.renderAreaExtent.width);
+            topologyKey.push_back(renderPassDesc2.renderAreaExtent.height);
+            isStatic = false;
+          }break;
+          case Task::Types::ComputePass:
+          {
+            const auto &computePassDesc = computePassDescs[task.index];
+            addProxyIds(computePassDesc.inoutStorageBufferProxies);
+            addProxyIds(computePassDesc.inputImageViewProxies);
+            addProxyIds(computePassDesc.inoutStorageImageProxies);
+          }break;
+          case Task::Types::ComputePass2:
+          {
+            isStatic = false;
+          }break;
+          case Task::Types::TransferPass:
+          {
+            const auto &transferPassDesc = transferPassDescs[task.index];
+            addProxyIds(transferPassDesc.srcBufferProxies);
+            addProxyIds(transferPassDesc.srcImageViewProxies);
+            addProxyIds(transferPassDesc.dstBufferProxies);
+            addProxyIds(transferPassDesc.dstImageViewProxies);
+          }break;
+          case Task::Types::ImagePresent:
+          {
+            topologyKey.push_back(imagePresentDescs[task.index].presentImageViewProxyId.asInt);
+          }break;
+          default: {}
+        }
+      }
+      return isStatic;
+    }
+
+    static uint64_t HashTopologyKey(const std::vector<uint64_t> &topologyKey)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      for (auto word : topologyKey)
+      {
+        hash ^= word + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+      }
+      return hash;
+    }
+
+    std::map<uint64_t, CompiledGraph> compiledGraphs;
+    bool graphCompilationEnabled = true;
+    bool synchronization2Enabled = false;
+    bool barrierSplittingEnabled = true;
+    bool barrierOptimizationEnabled = true;
+    std::vector<size_t> batchTaskIndices;
+    legit::EventPool *eventPool = nullptr;
+    std::vector<SplitBarrier> splitBarriers;
+    BarrierStats barrierStats;
+    legit::BoundState::Stats bindStats;
+    std::unique_ptr<WorkerPool> workerPool;
+    //one graph per swapchain image is typical, anything above that means the topology keeps changing
+    static const size_t maxCompiledGraphsCount = 16;
+    //kept between frames to avoid reallocating them
+    std::vector<const legit::ImageData *> persistentImages;
+    std::vector<const legit::Buffer *> persistentBuffers;
+    StateTracker::PersistentUsages entryUsages;
+
     RenderPassCache renderPassCache;
     FramebufferCache framebufferCache;
 
     vk::Device logicalDevice;
     vk::PhysicalDevice physicalDevice;
+    legit::MemoryAllocator *memoryAllocator;
     vk::detail::DispatchLoaderDynamic loader;
     size_t imageAllocations = 0;
   };
@@ -13,7 +13,7 @@ namespace legit
   class RenderPass
   {
   public:
-    vk::RenderPass GetHandle()
+    vk::RenderPass GetHandle() const
     {
       return renderPass.get();
     }
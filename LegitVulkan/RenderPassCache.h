@@ -1,5 +1,7 @@
 #pragma once
 #include <map>
+#include <memory>
+#include <mutex>
 #include "RenderPass.h"
 namespace legit
 {
@@ -25,15 +27,32 @@ namespace legit
 
     legit::RenderPass *GetRenderPass(const RenderPassKey &key)
     {
+      std::lock_guard<std::mutex> lock(*mutex);
       auto &renderPass = renderPassCache[key];
       if (!renderPass)
       {
         renderPass = std::unique_ptr<legit::RenderPass>(new legit::RenderPass(logicalDevice, key.colorAttachmentDescs, key.depthAttachmentDesc));
+        handleToKey[renderPass->GetHandle()] = key;
       }
       return renderPass.get();
     }
+
+    //handles differ between runs, keys don't
+    bool FindRenderPassKey(vk::RenderPass renderPassHandle, RenderPassKey &key) const
+    {
+      std::lock_guard<std::mutex> lock(*mutex);
+      auto it = handleToKey.find(renderPassHandle);
+      if (it == handleToKey.end())
+        return false;
+      key = it->second;
+      return true;
+    }
   private:
     std::map<RenderPassKey, std::unique_ptr<legit::RenderPass>> renderPassCache;
+    std::map<vk::RenderPass, RenderPassKey> handleToKey;
+    //pipeline binds look up keys from record callbacks on other threads while passes are being created.
+    //held by pointer so that the cache stays movable, RenderGraph::Clear() move-assigns it
+    std::unique_ptr<std::mutex> mutex = std::make_unique<std::mutex>();
     vk::Device logicalDevice;
   };
 
@@ -58,28 +77,16 @@ namespace legit
     PassInfo BeginPass(vk::CommandBuffer commandBuffer, const std::vector<Attachment> colorAttachments, Attachment *depthAttachment, legit::RenderPass *renderPass, vk::Extent2D renderAreaExtent, vk::SubpassContents contents = vk::SubpassContents::eInline)
     {
       PassInfo passInfo = GetPassInfo(colorAttachments,  depthAttachment, renderPass, renderAreaExtent);
+      BeginPass(commandBuffer, passInfo, GetClearValues(colorAttachments, depthAttachment), contents);
+      return passInfo;
+    }
 
-
-      FramebufferKey framebufferKey;
-
-      std::vector<vk::ClearValue> clearValues;
-
-      size_t attachmentsUsed = 0;
-      for (auto attachment : colorAttachments)
-      {
-        clearValues.push_back(attachment.clearValue);
-      }
-      if (depthAttachment)
-      {
-        clearValues.push_back(depthAttachment->clearValue);
-      }
-
-
-      vk::Rect2D rect = vk::Rect2D(vk::Offset2D(), renderAreaExtent);
+    void BeginPass(vk::CommandBuffer commandBuffer, const PassInfo &passInfo, const std::vector<vk::ClearValue> &clearValues, vk::SubpassContents contents = vk::SubpassContents::eInline)
+    {
       auto passBeginInfo = vk::RenderPassBeginInfo()
-        .setRenderPass(renderPass->GetHandle())
+        .setRenderPass(passInfo.renderPass->GetHandle())
         .setFramebuffer(passInfo.framebuffer->GetHandle())
-        .setRenderArea(rect)
+        .setRenderArea(passInfo.scissorRect)
         .setClearValueCount(uint32_t(clearValues.size()))
         .setPClearValues(clearValues.data());
 
@@ -89,8 +96,20 @@ namespace legit
         commandBuffer.setViewport(0, { passInfo.viewport });
         commandBuffer.setScissor(0, { passInfo.scissorRect });
       }
+    }
 
-      return passInfo;
+    static std::vector<vk::ClearValue> GetClearValues(const std::vector<Attachment> &colorAttachments, const Attachment *depthAttachment)
+    {
+      std::vector<vk::ClearValue> clearValues;
+      for (auto attachment : colorAttachments)
+      {
+        clearValues.push_back(attachment.clearValue);
+      }
+      if (depthAttachment)
+      {
+        clearValues.push_back(depthAttachment->clearValue);
+      }
+      return clearValues;
     }
 
     void EndPass(vk::CommandBuffer commandBuffer)
@@ -135,6 +154,20 @@ namespace legit
     FramebufferCache(vk::Device _logicalDevice) : logicalDevice(_logicalDevice)
     {
     }
+
+    void Clear()
+    {
+      framebufferCache.clear();
+    }
+    //empties the cache without destroying the framebuffers, for when frames in flight may still use them
+    std::vector<std::unique_ptr<legit::Framebuffer> > Retire()
+    {
+      std::vector<std::unique_ptr<legit::Framebuffer> > framebuffers;
+      for (auto &cacheEntry : framebufferCache)
+        framebuffers.push_back(std::move(cacheEntry.second));
+      framebufferCache.clear();
+      return framebuffers;
+    }
   private:
 
 
@@ -1,30 +1,92 @@
+#include <deque>
+#include <unordered_map>
+
 namespace legit
 {
   class ShaderMemoryPool
   {
   public:
-    ShaderMemoryPool(uint32_t _alignment)
+    //one persistently mapped ring shared by all frames in flight. memory written during a frame is reused once BeginFrame() is called
+    //framesInFlightCount frames later, i.e. after that frame's fence has been waited for. when a frame doesn't fit, the rest of it goes to
+    //overflow blocks and the ring is regrown from the observed peak at the start of the next frame
+    ShaderMemoryPool(legit::MemoryAllocator *_memoryAllocator, uint32_t _alignment, size_t _framesInFlightCount, vk::BufferUsageFlags _usageFlags = vk::BufferUsageFlagBits::eUniformBuffer, vk::DeviceSize initialRingSize = 4 * 1024 * 1024) :
+      memoryAllocator(_memoryAllocator),
+      alignment(_alignment),
+      framesInFlightCount(std::max<size_t>(_framesInFlightCount, 1)),
+      usageFlags(_usageFlags)
     {
-      alignment = _alignment;
+      ring = CreateBlock(AlignSize(initialRingSize, alignment));
     }
-    void MapBuffer(legit::Buffer *_buffer)
+
+    //called right before a ring or overflow buffer is destroyed, so that descriptor sets referencing it can be dropped
+    void SetBufferReleaseCallback(std::function<void(const legit::Buffer *)> bufferReleaseCallback)
     {
-      this->buffer = _buffer;
-      dstMemory = buffer->Map();
-      currOffset = 0;
-      currSize = 0;
-      currSetInfo = nullptr;
+      std::lock_guard<std::mutex> lock(allocationMutex);
+      this->bufferReleaseCallback = bufferReleaseCallback;
     }
-    void UnmapBuffer()
+
+    //sets whose uniform buffers are laid out the same way and hold the same bytes share one upload and one dynamic offset within a frame
+    void SetDeduplicationEnabled(bool isDeduplicationEnabled)
     {
-      buffer->Unmap();
-      buffer = nullptr;
-      dstMemory = nullptr;
+      std::lock_guard<std::mutex> lock(deduplicationMutex);
+      this->isDeduplicationEnabled = isDeduplicationEnabled;
     }
-    legit::Buffer *GetBuffer()
+    bool IsDeduplicationEnabled()
     {
-      return buffer;
+      std::lock_guard<std::mutex> lock(deduplicationMutex);
+      return isDeduplicationEnabled;
     }
+
+    //call after waiting for the fence of the frame that is about to be reused
+    void BeginFrame()
+    {
+      std::lock_guard<std::mutex> deduplicationLock(deduplicationMutex);
+      deduplicatedSets.clear();
+      deduplicationKeys.clear();
+
+      std::lock_guard<std::mutex> lock(allocationMutex);
+      currFrameIndex++;
+      //every frame but the framesInFlightCount - 1 most recent ones has finished on the gpu
+      while (frameEndPositions.size() + 1 > framesInFlightCount)
+      {
+        tailPosition = frameEndPositions.front();
+        frameEndPositions.pop_front();
+      }
+      while (retiredBlocks.size() > 0 && retiredBlocks.front().second + framesInFlightCount <= currFrameIndex)
+      {
+        if (bufferReleaseCallback)
+          bufferReleaseCallback(retiredBlocks.front().first.buffer.get());
+        retiredBlocks.pop_front();
+      }
+
+      //the whole ring is replaced rather than extended, frames still in flight keep using the old one until it's retired
+      if (isOverflowed)
+      {
+        vk::DeviceSize ringSize = ring.size;
+        while (ringSize < stats.peakFrameSize * framesInFlightCount)
+          ringSize *= 2;
+        retiredBlocks.push_back({ std::move(ring), currFrameIndex - 1 });
+        ring = CreateBlock(ringSize);
+        headPosition = 0;
+        tailPosition = 0;
+        frameEndPositions.clear();
+        stats.ringGrowsCount++;
+        isOverflowed = false;
+      }
+      currFrameSize = 0;
+    }
+    void EndFrame()
+    {
+      std::lock_guard<std::mutex> lock(allocationMutex);
+      assert(!currSetInfo);
+      frameEndPositions.push_back(headPosition);
+      for (auto &overflowBlock : overflowBlocks)
+        retiredBlocks.push_back({ std::move(overflowBlock), currFrameIndex });
+      overflowBlocks.clear();
+      stats.lastFrameSize = currFrameSize;
+      stats.peakFrameSize = std::max(stats.peakFrameSize, currFrameSize);
+    }
+
     struct SetDynamicUniformBindings
     {
       std::vector<UniformBufferBinding> uniformBufferBindings;
@@ -32,41 +94,98 @@ namespace legit
     };
     SetDynamicUniformBindings BeginSet(const legit::DescriptorSetLayoutKey *setInfo)
     {
+      assert(!currSetInfo);
       this->currSetInfo = setInfo;
-      currSize += currSetInfo->GetTotalConstantBufferSize();
-      currSize = AlignSize(currSize, alignment);
+      auto allocation = Allocate(setInfo->GetTotalConstantBufferSize());
+      currSetData = allocation.data;
+      return MakeSetBindings(setInfo, allocation.buffer, allocation.offset);
+    }
+    void EndSet()
+    {
+      currSetInfo = nullptr;
+      currSetData = nullptr;
+    }
 
-      SetDynamicUniformBindings dynamicBindings;
-      dynamicBindings.dynamicOffset = currOffset;
+    //thread-safe alternative to BeginSet()/EndSet(), must not overlap with them: reserves the whole set at once, uniform buffer data goes to setData + offsetInSet
+    SetDynamicUniformBindings AllocateSet(const legit::DescriptorSetLayoutKey *setInfo, void **setData)
+    {
+      assert(!currSetInfo);
+      auto allocation = Allocate(setInfo->GetTotalConstantBufferSize());
+      *setData = allocation.data;
+      return MakeSetBindings(setInfo, allocation.buffer, allocation.offset);
+    }
 
+    //same as AllocateSet() with the whole set already written to setData, reuses an earlier allocation of this frame if the contents match
+    SetDynamicUniformBindings AllocateSetDeduplicated(const legit::DescriptorSetLayoutKey *setInfo, const void *setData)
+    {
+      assert(!currSetInfo);
+      size_t setSize = setInfo->GetTotalConstantBufferSize();
+
+      std::lock_guard<std::mutex> lock(deduplicationMutex);
+      //the key is the uniform buffer layout followed by the data, it's appended to the frame's key storage and dropped again on a hit
+      size_t keyOffset = deduplicationKeys.size();
       std::vector<legit::DescriptorSetLayoutKey::UniformBufferId> uniformBufferIds;
       uniformBufferIds.resize(setInfo->GetUniformBuffersCount());
       setInfo->GetUniformBufferIds(uniformBufferIds.data());
-
-      uint32_t setUniformTotalSize = 0;
       for (auto uniformBufferId : uniformBufferIds)
       {
         auto uniformBufferInfo = setInfo->GetUniformBufferInfo(uniformBufferId);
-        setUniformTotalSize += uniformBufferInfo.size;
-        dynamicBindings.uniformBufferBindings.push_back(legit::UniformBufferBinding(this->GetBuffer(), uniformBufferInfo.shaderBindingIndex, uniformBufferInfo.offsetInSet, uniformBufferInfo.size));
+        uint32_t layout[] = { uniformBufferInfo.shaderBindingIndex, uniformBufferInfo.offsetInSet, uniformBufferInfo.size };
+        deduplicationKeys.insert(deduplicationKeys.end(), (const char*)layout, (const char*)layout + sizeof(layout));
       }
-      assert(currSetInfo->GetTotalConstantBufferSize() == setUniformTotalSize);
+      deduplicationKeys.insert(deduplicationKeys.end(), (const char*)setData, (const char*)setData + setSize);
+      size_t keySize = deduplicationKeys.size() - keyOffset;
+      uint64_t hash = HashBytes(deduplicationKeys.data() + keyOffset, keySize);
 
-      return dynamicBindings;
+      auto range = deduplicatedSets.equal_range(hash);
+      for (auto it = range.first; it != range.second; it++)
+      {
+        const auto &deduplicatedSet = it->second;
+        if (deduplicatedSet.keySize == keySize && memcmp(deduplicationKeys.data() + deduplicatedSet.keyOffset, deduplicationKeys.data() + keyOffset, keySize) == 0)
+        {
+          deduplicationKeys.resize(keyOffset);
+          stats.deduplicatedSetsCount++;
+          stats.deduplicatedSize += setSize;
+          return MakeSetBindings(setInfo, deduplicatedSet.buffer, deduplicatedSet.offset);
+        }
+      }
+
+      auto allocation = Allocate(setSize);
+      memcpy(allocation.data, setData, setSize);
+      DeduplicatedSet deduplicatedSet;
+      deduplicatedSet.keyOffset = keyOffset;
+      deduplicatedSet.keySize = keySize;
+      deduplicatedSet.buffer = allocation.buffer;
+      deduplicatedSet.offset = allocation.offset;
+      deduplicatedSets.insert({ hash, deduplicatedSet });
+      return MakeSetBindings(setInfo, allocation.buffer, allocation.offset);
     }
-    void EndSet()
+
+    struct Stats
     {
-      currOffset = currSize;
-      currSetInfo = nullptr;
+      vk::DeviceSize ringSize = 0;
+      vk::DeviceSize lastFrameSize = 0;
+      vk::DeviceSize peakFrameSize = 0; //high-water mark of a single frame
+      size_t overflowBlocksCount = 0; //total
+      size_t ringGrowsCount = 0; //total
+      size_t deduplicatedSetsCount = 0; //total, sets that reused an earlier upload
+      vk::DeviceSize deduplicatedSize = 0; //total, bytes not uploaded thanks to that
+    };
+    Stats GetStats()
+    {
+      std::lock_guard<std::mutex> deduplicationLock(deduplicationMutex);
+      std::lock_guard<std::mutex> lock(allocationMutex);
+      Stats stats = this->stats;
+      stats.ringSize = ring.size;
+      return stats;
     }
 
     void *GetUniformBufferData(legit::DescriptorSetLayoutKey::UniformBufferId uniformBufferId, size_t size)
     {
       auto bufferInfo = currSetInfo->GetUniformBufferInfo(uniformBufferId);
       assert(bufferInfo.size == size);
-      size_t totalOffset = currOffset + bufferInfo.offsetInSet;
-      assert(totalOffset + size <= currSize);
-      return ((char*)dstMemory + totalOffset);
+      assert(bufferInfo.offsetInSet + size <= currSetInfo->GetTotalConstantBufferSize());
+      return currSetData + bufferInfo.offsetInSet;
     }
 
     void *GetUniformBufferData(std::string bufferName, size_t size)
@@ -80,11 +199,9 @@ namespace legit
     BufferType *GetUniformBufferData(legit::DescriptorSetLayoutKey::UniformBufferId uniformBufferId)
     {
       auto bufferInfo = currSetInfo->GetUniformBufferInfo(uniformBufferId);
-      size_t tmp = sizeof(BufferType);
       assert(bufferInfo.size == sizeof(BufferType));
-      size_t totalOffset = currOffset + bufferInfo.offsetInSet;
-      assert(totalOffset + sizeof(BufferType) <= currSize);
-      return (BufferType*)((char*)dstMemory + totalOffset);
+      assert(bufferInfo.offsetInSet + sizeof(BufferType) <= currSetInfo->GetTotalConstantBufferSize());
+      return (BufferType*)(currSetData + bufferInfo.offsetInSet);
     }
 
     template<typename BufferType>
@@ -108,23 +225,130 @@ namespace legit
       auto uniformInfo = currSetInfo->GetUniformInfo(uniformId);
       auto bufferInfo = currSetInfo->GetUniformBufferInfo(uniformInfo.uniformBufferId);
 
-      size_t totalOffset = currOffset + bufferInfo.offsetInSet + uniformInfo.offsetInBinding;
-      assert(totalOffset + sizeof(UniformType) < currSize);
-      return (UniformType*)((char*)dstMemory + totalOffset);
+      size_t offsetInSet = bufferInfo.offsetInSet + uniformInfo.offsetInBinding;
+      assert(offsetInSet + sizeof(UniformType) <= currSetInfo->GetTotalConstantBufferSize());
+      return (UniformType*)(currSetData + offsetInSet);
     }
   private:
-    static uint32_t AlignSize(uint32_t size, uint32_t alignment)
+    struct Block
     {
-      uint32_t res_size = size;
+      std::unique_ptr<legit::Buffer> buffer;
+      char *mappedData = nullptr;
+      vk::DeviceSize size = 0;
+    };
+    Block CreateBlock(vk::DeviceSize size)
+    {
+      Block block;
+      block.buffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(memoryAllocator, size, usageFlags, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, legit::MemoryAllocator::AllocationTypes::Dedicated));
+      block.mappedData = (char*)block.buffer->Map(); //never unmapped, freeing the memory takes care of it
+      block.size = size;
+      return block;
+    }
+
+    struct Allocation
+    {
+      legit::Buffer *buffer;
+      uint32_t offset;
+      char *data;
+    };
+    Allocation Allocate(vk::DeviceSize size)
+    {
+      std::lock_guard<std::mutex> lock(allocationMutex);
+      currFrameSize += size;
+
+      //positions only grow, the ring offset is position % ring.size. sets never wrap around
+      uint64_t position = AlignSize(headPosition, alignment);
+      if (position % ring.size + size > ring.size)
+        position += ring.size - position % ring.size;
+      if (!isOverflowed && position + size - tailPosition <= ring.size)
+      {
+        headPosition = position + size;
+        uint32_t offset = uint32_t(position % ring.size);
+        return { ring.buffer.get(), offset, ring.mappedData + offset };
+      }
+
+      //the rest of the frame goes to overflow blocks so that the allocation order within the frame stays linear
+      isOverflowed = true;
+      if (overflowBlocks.size() == 0 || overflowOffset + size > overflowBlocks.back().size)
+      {
+        overflowBlocks.push_back(CreateBlock(AlignSize(std::max(size, ring.size / 2), alignment)));
+        overflowOffset = 0;
+        stats.overflowBlocksCount++;
+      }
+      auto &overflowBlock = overflowBlocks.back();
+      uint32_t offset = uint32_t(overflowOffset);
+      overflowOffset = AlignSize(overflowOffset + size, alignment);
+      return { overflowBlock.buffer.get(), offset, overflowBlock.mappedData + offset };
+    }
+
+    SetDynamicUniformBindings MakeSetBindings(const legit::DescriptorSetLayoutKey *setInfo, legit::Buffer *buffer, uint32_t setOffset)
+    {
+      SetDynamicUniformBindings dynamicBindings;
+      dynamicBindings.dynamicOffset = setOffset;
+
+      std::vector<legit::DescriptorSetLayoutKey::UniformBufferId> uniformBufferIds;
+      uniformBufferIds.resize(setInfo->GetUniformBuffersCount());
+      setInfo->GetUniformBufferIds(uniformBufferIds.data());
+
+      uint32_t setUniformTotalSize = 0;
+      for (auto uniformBufferId : uniformBufferIds)
+      {
+        auto uniformBufferInfo = setInfo->GetUniformBufferInfo(uniformBufferId);
+        setUniformTotalSize += uniformBufferInfo.size;
+        dynamicBindings.uniformBufferBindings.push_back(legit::UniformBufferBinding(buffer, uniformBufferInfo.shaderBindingIndex, uniformBufferInfo.offsetInSet, uniformBufferInfo.size));
+      }
+      assert(setInfo->GetTotalConstantBufferSize() == setUniformTotalSize);
+
+      return dynamicBindings;
+    }
+
+    static uint64_t HashBytes(const char *data, size_t size)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      for (size_t i = 0; i < size; i++)
+        hash = (hash ^ uint8_t(data[i])) * 1099511628211ull;
+      return hash;
+    }
+
+    static uint64_t AlignSize(uint64_t size, uint64_t alignment)
+    {
+      uint64_t res_size = size;
       if (res_size % alignment != 0)
         res_size += (alignment - (res_size % alignment));
       return res_size;
     }
+    legit::MemoryAllocator *memoryAllocator;
     uint32_t alignment;
-    legit::Buffer *buffer;
-    const legit::DescriptorSetLayoutKey *currSetInfo;
-    void *dstMemory;
-    uint32_t currOffset;
-    uint32_t currSize;
+    size_t framesInFlightCount;
+    vk::BufferUsageFlags usageFlags;
+
+    Block ring;
+    uint64_t headPosition = 0;
+    uint64_t tailPosition = 0;
+    std::deque<uint64_t> frameEndPositions; //of frames that may still be in flight
+    std::vector<Block> overflowBlocks; //of the current frame
+    vk::DeviceSize overflowOffset = 0;
+    bool isOverflowed = false;
+    std::deque<std::pair<Block, uint64_t>> retiredBlocks; //and the last frame that used them
+    uint64_t currFrameIndex = 0;
+    vk::DeviceSize currFrameSize = 0;
+    Stats stats;
+    std::function<void(const legit::Buffer *)> bufferReleaseCallback;
+
+    struct DeduplicatedSet
+    {
+      size_t keyOffset;
+      size_t keySize;
+      legit::Buffer *buffer;
+      uint32_t offset;
+    };
+    bool isDeduplicationEnabled = false;
+    std::unordered_multimap<uint64_t, DeduplicatedSet> deduplicatedSets; //of the current frame, by key hash
+    std::vector<char> deduplicationKeys;
+    std::mutex deduplicationMutex; //always locked before allocationMutex
+
+    const legit::DescriptorSetLayoutKey *currSetInfo = nullptr;
+    char *currSetData = nullptr;
+    std::mutex allocationMutex;
   };
 }
\ No newline at end of file
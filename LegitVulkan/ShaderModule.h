@@ -16,6 +16,11 @@ namespace legit
     {
       return hash;
     }
+    //stable across runs, unlike the handle
+    uint64_t GetContentHash()
+    {
+      return contentHash;
+    }
     ShaderModule(vk::Device device, const std::vector<uint32_t> &bytecode)
     {
       Init(device, bytecode);
@@ -32,9 +37,19 @@ namespace legit
       {
         this->hash ^= b; //actually terrible hash
       }
+      this->contentHash = 14695981039346656037ull; //FNV-1a
+      for (auto word : bytecode)
+      {
+        for (uint32_t byteIndex = 0; byteIndex < 4; byteIndex++)
+        {
+          this->contentHash ^= (word >> (byteIndex * 8)) & 0xff;
+          this->contentHash *= 1099511628211ull;
+        }
+      }
     }
     vk::UniqueShaderModule shaderModule;
     uint32_t hash;
+    uint64_t contentHash;
     friend class Core;
   };
 }
\ No newline at end of file
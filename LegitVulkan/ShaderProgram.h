@@ -285,6 +285,25 @@ namespace legit
       uint32_t shaderBindingIndex;
       vk::ShaderStageFlags stageFlags;
     };
+    enum struct BindlessArrayTypes
+    {
+      Textures,
+      Samplers,
+      StorageBuffers
+    };
+    //unsized arrays are not part of the regular bindings, the set that declares them is the global bindless one
+    struct BindlessArrayData
+    {
+      bool operator<(const BindlessArrayData &other) const
+      {
+        return std::tie(name, shaderBindingIndex, type) < std::tie(other.name, other.shaderBindingIndex, other.type);
+      }
+
+      std::string name;
+      uint32_t shaderBindingIndex;
+      BindlessArrayTypes type;
+      vk::ShaderStageFlags stageFlags;
+    };
 
     size_t GetUniformBuffersCount() const
     {
@@ -609,6 +628,19 @@ namespace legit
       return AccelerationStructureBinding(_accelerationStructure, accelerationStructureInfo.shaderBindingIndex);
     }
 
+    size_t GetBindlessArraysCount() const
+    {
+      return bindlessArrayDatum.size();
+    }
+    BindlessArrayData GetBindlessArrayInfo(size_t bindlessArrayIndex) const
+    {
+      return bindlessArrayDatum[bindlessArrayIndex];
+    }
+    bool IsBindless() const
+    {
+      return bindlessArrayDatum.size() > 0;
+    }
+
     uint32_t GetTotalConstantBufferSize() const
     {
       return size;
@@ -616,14 +648,14 @@ namespace legit
 
     bool IsEmpty() const
     {
-      return GetImageSamplersCount() == 0 && GetTexturesCount() == 0 && GetSamplersCount() == 0 && GetUniformBuffersCount() == 0 && GetStorageImagesCount() == 0 && GetStorageBuffersCount() == 0;
+      return GetImageSamplersCount() == 0 && GetTexturesCount() == 0 && GetSamplersCount() == 0 && GetUniformBuffersCount() == 0 && GetStorageImagesCount() == 0 && GetStorageBuffersCount() == 0 && GetBindlessArraysCount() == 0;
     }
 
     bool operator<(const DescriptorSetLayoutKey &other) const
     {
       return 
-        std::tie(uniformDatum, uniformBufferDatum, imageSamplerDatum, textureDatum, samplerDatum, storageBufferDatum, storageImageDatum, accelerationStructureDatum) < 
-        std::tie(other.uniformDatum, other.uniformBufferDatum, other.imageSamplerDatum, other.textureDatum, other.samplerDatum, other.storageBufferDatum, other.storageImageDatum, other.accelerationStructureDatum);
+        std::tie(uniformDatum, uniformBufferDatum, imageSamplerDatum, textureDatum, samplerDatum, storageBufferDatum, storageImageDatum, accelerationStructureDatum, bindlessArrayDatum) < 
+        std::tie(other.uniformDatum, other.uniformBufferDatum, other.imageSamplerDatum, other.textureDatum, other.samplerDatum, other.storageBufferDatum, other.storageImageDatum, other.accelerationStructureDatum, other.bindlessArrayDatum);
     }
 
     static DescriptorSetLayoutKey Merge(DescriptorSetLayoutKey *setLayouts, size_t setsCount)
@@ -918,6 +950,25 @@ namespace legit
         }
       }
 
+      for (size_t setIndex = 0; setIndex < setsCount; setIndex++)
+      {
+        for (auto &srcBindlessArray : setLayouts[setIndex].bindlessArrayDatum)
+        {
+          auto it = std::find_if(res.bindlessArrayDatum.begin(), res.bindlessArrayDatum.end(), [&](const BindlessArrayData &dstBindlessArray) { return dstBindlessArray.shaderBindingIndex == srcBindlessArray.shaderBindingIndex; });
+          if (it == res.bindlessArrayDatum.end())
+          {
+            res.bindlessArrayDatum.push_back(srcBindlessArray);
+          }
+          else
+          {
+            it->stageFlags |= srcBindlessArray.stageFlags;
+            assert(srcBindlessArray.name == it->name);
+            assert(srcBindlessArray.type == it->type);
+          }
+        }
+      }
+      std::sort(res.bindlessArrayDatum.begin(), res.bindlessArrayDatum.end());
+
 
       res.RebuildIndex();
       return res;
@@ -1019,6 +1070,7 @@ namespace legit
     std::vector<StorageBufferData> storageBufferDatum;
     std::vector<StorageImageData> storageImageDatum;
     std::vector<AccelerationStructureData> accelerationStructureDatum;
+    std::vector<BindlessArrayData> bindlessArrayDatum;
 
     std::map<std::string, UniformId> uniformNameToIds;
     std::map<std::string, UniformBufferId> uniformBufferNameToIds;
@@ -1082,7 +1134,37 @@ namespace legit
     {
       return localSize;
     }
+    const std::vector<vk::PushConstantRange> &GetPushConstantRanges() const
+    {
+      return pushConstantRanges;
+    }
+
+    //descriptors of this set are pushed on every bind instead of going through DescriptorSetCache.
+    //has to be set before the first pipeline is bound, a pipeline layout can only have one push descriptor set
+    void SetPushDescriptorSetIndex(size_t setIndex)
+    {
+      pushDescriptorSetIndex = setIndex;
+    }
+    bool IsPushDescriptorSet(size_t setIndex) const
+    {
+      return setIndex == pushDescriptorSetIndex;
+    }
   private:
+    //runtime arrays like texture2D textures[]
+    static bool IsUnsizedArray(const spirv_cross::SPIRType &type)
+    {
+      return type.array.size() == 1 && type.array[0] == 0 && type.array_size_literal[0];
+    }
+    static void AddBindlessArray(DescriptorSetLayoutKey &descriptorSetLayoutKey, const spirv_cross::Compiler &compiler, const spirv_cross::Resource &resource, DescriptorSetLayoutKey::BindlessArrayTypes type, vk::ShaderStageFlags stageFlags)
+    {
+      descriptorSetLayoutKey.bindlessArrayDatum.push_back(DescriptorSetLayoutKey::BindlessArrayData());
+      auto &bindlessArrayData = descriptorSetLayoutKey.bindlessArrayDatum.back();
+      bindlessArrayData.shaderBindingIndex = compiler.get_decoration(resource.id, spv::DecorationBinding);
+      bindlessArrayData.type = type;
+      bindlessArrayData.stageFlags = stageFlags;
+      bindlessArrayData.name = resource.name;
+    }
+
     void Init(vk::Device logicalDevice, const std::vector<uint32_t> &bytecode)
     {
       shaderModule.reset(new ShaderModule(logicalDevice, bytecode));
@@ -1114,6 +1196,23 @@ namespace legit
 
       spirv_cross::ShaderResources resources = compiler.get_shader_resources();
 
+      //glsl allows only one push constant block per stage, but its first member can start at an offset
+      for (const auto &pushConstantBuffer : resources.push_constant_buffers)
+      {
+        auto bufferType = compiler.get_type(pushConstantBuffer.base_type_id);
+        uint32_t declaredSize = uint32_t(compiler.get_declared_struct_size(bufferType));
+        uint32_t minOffset = declaredSize;
+        for (uint32_t memberIndex = 0; memberIndex < bufferType.member_types.size(); memberIndex++)
+          minOffset = std::min(minOffset, compiler.type_struct_member_offset(bufferType, memberIndex));
+        if (minOffset >= declaredSize)
+          continue;
+
+        pushConstantRanges.push_back(vk::PushConstantRange()
+          .setStageFlags(stageFlags)
+          .setOffset(minOffset)
+          .setSize(declaredSize - minOffset));
+      }
+
 
       struct SetResources
       {
@@ -1258,6 +1357,11 @@ namespace legit
         
         for (auto texture : setResources[setIndex].textures)
         {
+          if (IsUnsizedArray(compiler.get_type(texture.type_id)))
+          {
+            AddBindlessArray(descriptorSetLayoutKey, compiler, texture, DescriptorSetLayoutKey::BindlessArrayTypes::Textures, stageFlags);
+            continue;
+          }
           auto textureId = DescriptorSetLayoutKey::TextureId(descriptorSetLayoutKey.textureDatum.size());
 
           uint32_t shaderBindingIndex = compiler.get_decoration(texture.id, spv::DecorationBinding);
@@ -1270,6 +1374,11 @@ namespace legit
         
         for (auto sampler : setResources[setIndex].samplers)
         {
+          if (IsUnsizedArray(compiler.get_type(sampler.type_id)))
+          {
+            AddBindlessArray(descriptorSetLayoutKey, compiler, sampler, DescriptorSetLayoutKey::BindlessArrayTypes::Samplers, stageFlags);
+            continue;
+          }
           auto samplerId = DescriptorSetLayoutKey::SamplerId(descriptorSetLayoutKey.samplerDatum.size());
 
           uint32_t shaderBindingIndex = compiler.get_decoration(sampler.id, spv::DecorationBinding);
@@ -1286,6 +1395,11 @@ namespace legit
 
           auto bufferType = compiler.get_type(buffer.type_id);
 
+          if (IsUnsizedArray(bufferType))
+          {
+            AddBindlessArray(descriptorSetLayoutKey, compiler, buffer, DescriptorSetLayoutKey::BindlessArrayTypes::StorageBuffers, stageFlags);
+            continue;
+          }
           if (bufferType.basetype == spirv_cross::SPIRType::BaseType::Struct)
           {
             auto storageBufferId = DescriptorSetLayoutKey::StorageBufferId(descriptorSetLayoutKey.storageBufferDatum.size());
@@ -1297,6 +1411,7 @@ namespace legit
             bufferData.name = buffer.name;
             assert(bufferType.array.size() == 1 || bufferType.array.size() == 0);
             bufferData.count = bufferType.array.size() == 1 ? bufferType.array[0] : 1u;
+            assert(bufferData.count > 0); //unsized arrays go to the bindless set
             bufferData.podPartSize = 0;
             bufferData.arrayMemberSize = 0;
             bufferData.offsetInSet = 0; //should not be used
@@ -1345,6 +1460,8 @@ namespace legit
 
 
     std::vector<DescriptorSetLayoutKey> descriptorSetLayoutKeys;
+    std::vector<vk::PushConstantRange> pushConstantRanges;
+    size_t pushDescriptorSetIndex = size_t(-1);
 
     std::unique_ptr<legit::ShaderModule> shaderModule;
     glm::uvec3 localSize;
@@ -1381,6 +1498,19 @@ namespace legit
         }
         this->combinedDescriptorSetLayoutKeys[setIndex] = DescriptorSetLayoutKey::Merge(setLayoutStageKeys.data(), setLayoutStageKeys.size());
       }
+
+      //a stage can only appear in one range, so stages sharing the same block are merged into one range and the rest are kept apart
+      for (auto shader : { vertexShader, fragmentShader })
+      {
+        for (const auto &stageRange : shader->GetPushConstantRanges())
+        {
+          auto it = std::find_if(pushConstantRanges.begin(), pushConstantRanges.end(), [&](const vk::PushConstantRange &range) { return range.offset == stageRange.offset && range.size == stageRange.size; });
+          if (it == pushConstantRanges.end())
+            pushConstantRanges.push_back(stageRange);
+          else
+            it->stageFlags |= stageRange.stageFlags;
+        }
+      }
     }
 
     size_t GetSetsCount()
@@ -1391,8 +1521,24 @@ namespace legit
     {
       return &combinedDescriptorSetLayoutKeys[setIndex];
     }
+    const std::vector<vk::PushConstantRange> &GetPushConstantRanges() const
+    {
+      return pushConstantRanges;
+    }
+
+    //same as Shader::SetPushDescriptorSetIndex()
+    void SetPushDescriptorSetIndex(size_t setIndex)
+    {
+      pushDescriptorSetIndex = setIndex;
+    }
+    bool IsPushDescriptorSet(size_t setIndex) const
+    {
+      return setIndex == pushDescriptorSetIndex;
+    }
 
     std::vector<DescriptorSetLayoutKey> combinedDescriptorSetLayoutKeys;
+    std::vector<vk::PushConstantRange> pushConstantRanges;
+    size_t pushDescriptorSetIndex = size_t(-1);
     Shader *vertexShader;
     Shader *fragmentShader;
   };
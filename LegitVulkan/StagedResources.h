@@ -37,28 +37,6 @@ namespace legit
     vk::DeviceSize size;
   };
 
-  static void LoadBufferData(legit::Core *core, const void *bufferData, size_t bufferSize, legit::Buffer *dstBuffer)
-  {
-    auto stagingBuffer = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetPhysicalDevice(), core->GetLogicalDevice(), bufferSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
-
-    void *bufferMappedData = stagingBuffer->Map();
-    memcpy(bufferMappedData, bufferData, bufferSize);
-    stagingBuffer->Unmap();
-
-    auto copyRegion = vk::BufferCopy()
-      .setSrcOffset(0)
-      .setDstOffset(0)
-      .setSize(bufferSize);
-
-    legit::ExecuteOnceQueue transferQueue(core);
-    auto transferCommandBuffer = transferQueue.BeginCommandBuffer();
-    {
-      transferCommandBuffer.copyBuffer(stagingBuffer->GetHandle(), dstBuffer->GetHandle(), { copyRegion });
-    }
-    transferQueue.EndCommandBuffer();
-  }
-
-
   /*class StagedImage
   {
   public:
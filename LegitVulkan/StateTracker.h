@@ -14,20 +14,40 @@ namespace legit
       }
     };
     
+    //tasks are the ones of a render graph frame, resources that weren't used yet in the frame have none
+    static constexpr size_t NoTask = size_t(-1);
+
     struct ImageBarrier
     {
       vk::ImageMemoryBarrier imageMemoryBarrier;
       vk::PipelineStageFlags srcStage;
       vk::PipelineStageFlags dstStage;
+      size_t srcTaskIndex = NoTask; //task that used the subresources last
     };
+    //resources without content to preserve (None/Unknown usage) are never handed over between queue families
+    static bool IsOwnershipTransferNeeded(bool hasContents, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex)
+    {
+      return
+        hasContents &&
+        srcQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED &&
+        dstQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED &&
+        srcQueueFamilyIndex != dstQueueFamilyIndex;
+    }
+
     static std::optional<ImageBarrier> CreateImageBarrierIfNeeded(
       const legit::ImageData *imageData,
       vk::ImageSubresourceRange range,
       ImageUsageTypes srcUsageType,
-      ImageUsageTypes dstUsageType)
+      ImageUsageTypes dstUsageType,
+      uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED)
     {
+      bool isOwnershipTransfer = IsOwnershipTransferNeeded(
+        srcUsageType != ImageUsageTypes::None && srcUsageType != ImageUsageTypes::Unknown,
+        srcQueueFamilyIndex,
+        dstQueueFamilyIndex);
       if (
-        IsImageBarrierNeeded(srcUsageType, dstUsageType) &&
+        (IsImageBarrierNeeded(srcUsageType, dstUsageType) || isOwnershipTransfer) &&
         //srcUsageType != ImageUsageTypes::ColorAttachment && //this is done automatically when constructing render pass
         //srcUsageType != ImageUsageTypes::DepthAttachment &&
         range.layerCount > 0 &&
@@ -43,7 +63,7 @@ namespace legit
           .setSubresourceRange(range)
           .setImage(imageData->GetHandle());
 
-        if (srcImageAccessPattern.queueFamilyType == dstImageAccessPattern.queueFamilyType)
+        if (!isOwnershipTransfer)
         {
           imageBarrier
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -52,11 +72,8 @@ namespace legit
         else
         {
           imageBarrier
-            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
-          /*imageBarrier
-            .setSrcQueueFamilyIndex(srcImageAccessPattern.queueFamilyIndex)
-            .setDstQueueFamilyIndex(dstImageAccessPattern.queueFamilyIndex);*/
+            .setSrcQueueFamilyIndex(srcQueueFamilyIndex)
+            .setDstQueueFamilyIndex(dstQueueFamilyIndex);
         }
         ImageBarrier barrier;
         barrier.srcStage = srcImageAccessPattern.stage;
@@ -67,65 +84,42 @@ namespace legit
       return {};
     }
     
-    legit::ImageUsageTypes TransitionImageSubresource(ImageSubresource imgSubresource, ImageUsageTypes newUsageType)
+    struct SubresourceState
     {
-      auto it = imgSubresourceToCurrUsage.find(imgSubresource);
-      if(it != imgSubresourceToCurrUsage.end())
+      legit::ImageUsageTypes usageType;
+      uint32_t queueFamilyIndex;
+      size_t taskIndex;
+      bool operator ==(const SubresourceState &other) const
       {
-        auto lastUsage = it->second;
-        it->second = newUsageType;
-        return lastUsage;
+        return usageType == other.usageType && queueFamilyIndex == other.queueFamilyIndex && taskIndex == other.taskIndex;
       }
-      
-      // VUID-VkImageMemoryBarrier-oldLayout-01197
-      // If srcQueueFamilyIndex and dstQueueFamilyIndex define a queue family ownership transfer or oldLayout and newLayout define an image layout transition,
-      // oldLayout must be VK_IMAGE_LAYOUT_UNDEFINED or the current layout of the image subresources affected by the barrier
-
-
-      auto baseUsage = imgSubresource.imageData->GetSubresourceBaseUsageType(imgSubresource.mipLevel, imgSubresource.arrayLayer);
-      imgSubresourceToCurrUsage[imgSubresource] = newUsageType;
-      return baseUsage;
-    }
-    
-    std::vector<ImageBarrier> TransitionImageAndCreateBarriers(const legit::ImageView *imageView, ImageUsageTypes dstUsageType)
+      bool operator !=(const SubresourceState &other) const
+      {
+        return !(*this == other);
+      }
+    };
+    //every subresource of an image, indexed by mipLevel * arrayLayersCount + arrayLayer. filled from the last usage on first use, so a
+    //transition is one lookup per image rather than one per subresource
+    struct ImageState
     {
-      auto range = vk::ImageSubresourceRange()
-        .setAspectMask(imageView->GetImageData()->GetAspectFlags());
-      const legit::ImageData *imageData = imageView->GetImageData();
-      std::vector<ImageBarrier> barriers;
-      
-      for (uint32_t arrayLayer = imageView->GetBaseArrayLayer(); arrayLayer < imageView->GetBaseArrayLayer() + imageView->GetArrayLayersCount(); arrayLayer++)
+      uint32_t arrayLayersCount;
+      std::vector<SubresourceState> subresources;
+      SubresourceState &Get(uint32_t mipLevel, uint32_t arrayLayer)
       {
-        range
-          .setBaseArrayLayer(arrayLayer)
-          .setLayerCount(1)
-          .setBaseMipLevel(imageView->GetBaseMipLevel())
-          .setLevelCount(0);
-        ImageUsageTypes prevSubresourceUsageType = ImageUsageTypes::None;
-
-        for (uint32_t mipLevel = imageView->GetBaseMipLevel(); mipLevel < imageView->GetBaseMipLevel() + imageView->GetMipLevelsCount(); mipLevel++)
-        {
-          auto lastUsageType = TransitionImageSubresource({imageView->GetImageData(), mipLevel, arrayLayer}, dstUsageType);
-          if (prevSubresourceUsageType != lastUsageType)
-          {
-            if(auto maybeBarrier = CreateImageBarrierIfNeeded(imageView->GetImageData(), range, prevSubresourceUsageType, dstUsageType))
-            {
-              barriers.push_back(*maybeBarrier);
-            }
-            range
-              .setBaseMipLevel(mipLevel)
-              .setLevelCount(0);
-            prevSubresourceUsageType = lastUsageType;
-          }
-          range.levelCount++;
-        }
-        if(auto maybeBarrier = CreateImageBarrierIfNeeded(imageView->GetImageData(), range, prevSubresourceUsageType, dstUsageType))
-        {
-          barriers.push_back(*maybeBarrier);
-        }
+        return subresources[mipLevel * arrayLayersCount + arrayLayer];
       }
-      
-      return barriers;
+    };
+
+    //barriers are appended to dstBarriers, which is meant to be a scratch buffer reused by the caller
+    void TransitionImageAndCreateBarriers(const legit::ImageView *imageView, ImageUsageTypes dstUsageType, std::vector<ImageBarrier> &dstBarriers)
+    {
+      SubresourceState dstState = { dstUsageType, queueFamilyIndex, taskIndex };
+      TransitionImageRange(
+        imageView->GetImageData(),
+        imageView->GetBaseMipLevel(), imageView->GetMipLevelsCount(),
+        imageView->GetBaseArrayLayer(), imageView->GetArrayLayersCount(),
+        [dstState](SubresourceState) { return std::optional<SubresourceState>(dstState); },
+        dstBarriers);
     }
     
     struct BufferBarrier
@@ -133,11 +127,21 @@ namespace legit
       vk::BufferMemoryBarrier bufferMemoryBarrier;
       vk::PipelineStageFlags srcStage;
       vk::PipelineStageFlags dstStage;
+      size_t srcTaskIndex = NoTask; //task that used the buffer last
     };
     
-    static std::optional<BufferBarrier> CreateBufferBufferBarrierIfNeeded(const legit::Buffer *buffer, BufferUsageTypes srcUsageType, BufferUsageTypes dstUsageType)
+    static std::optional<BufferBarrier> CreateBufferBufferBarrierIfNeeded(
+      const legit::Buffer *buffer,
+      BufferUsageTypes srcUsageType,
+      BufferUsageTypes dstUsageType,
+      uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED)
     {
-      if (IsBufferBarrierNeeded(srcUsageType, dstUsageType))
+      bool isOwnershipTransfer = IsOwnershipTransferNeeded(
+        srcUsageType != BufferUsageTypes::None && srcUsageType != BufferUsageTypes::Unknown,
+        srcQueueFamilyIndex,
+        dstQueueFamilyIndex);
+      if (IsBufferBarrierNeeded(srcUsageType, dstUsageType) || isOwnershipTransfer)
       {
         auto srcBufferAccessPattern = GetSrcBufferAccessPattern(srcUsageType);
         auto dstBufferAccessPattern = GetDstBufferAccessPattern(dstUsageType);
@@ -148,7 +152,7 @@ namespace legit
           .setDstAccessMask(dstBufferAccessPattern.accessMask)
           .setBuffer(buffer->GetHandle());
 
-        if (srcBufferAccessPattern.queueFamilyType == dstBufferAccessPattern.queueFamilyType)
+        if (!isOwnershipTransfer)
         {
           bufferBarrier
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -157,11 +161,8 @@ namespace legit
         else
         {
           bufferBarrier
-            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
-          /*imageBarrier
-          .setSrcQueueFamilyIndex(srcImageAccessPattern.queueFamilyIndex)
-          .setDstQueueFamilyIndex(dstImageAccessPattern.queueFamilyIndex);*/
+            .setSrcQueueFamilyIndex(srcQueueFamilyIndex)
+            .setDstQueueFamilyIndex(dstQueueFamilyIndex);
         }
         BufferBarrier barrier;
         barrier.srcStage = srcBufferAccessPattern.stage;
@@ -171,34 +172,386 @@ namespace legit
       }
       return {};
     }
+
+    //an ownership transfer is executed as a release on the source queue followed by an acquire with the same layouts on the destination queue
+    static bool IsOwnershipTransfer(const ImageBarrier &barrier)
+    {
+      return barrier.imageMemoryBarrier.srcQueueFamilyIndex != barrier.imageMemoryBarrier.dstQueueFamilyIndex;
+    }
+    static ImageBarrier GetReleaseBarrier(ImageBarrier barrier)
+    {
+      barrier.imageMemoryBarrier.setDstAccessMask({});
+      barrier.dstStage = vk::PipelineStageFlagBits::eBottomOfPipe;
+      return barrier;
+    }
+    static ImageBarrier GetAcquireBarrier(ImageBarrier barrier)
+    {
+      barrier.imageMemoryBarrier.setSrcAccessMask({});
+      barrier.srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
+      return barrier;
+    }
+    static bool IsOwnershipTransfer(const BufferBarrier &barrier)
+    {
+      return barrier.bufferMemoryBarrier.srcQueueFamilyIndex != barrier.bufferMemoryBarrier.dstQueueFamilyIndex;
+    }
+    static BufferBarrier GetReleaseBarrier(BufferBarrier barrier)
+    {
+      barrier.bufferMemoryBarrier.setDstAccessMask({});
+      barrier.dstStage = vk::PipelineStageFlagBits::eBottomOfPipe;
+      return barrier;
+    }
+    static BufferBarrier GetAcquireBarrier(BufferBarrier barrier)
+    {
+      barrier.bufferMemoryBarrier.setSrcAccessMask({});
+      barrier.srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
+      return barrier;
+    }
     
-    legit::BufferUsageTypes TransitionBuffer(const legit::Buffer *buffer, BufferUsageTypes newUsageType)
+    void TransitionBufferAndCreateBarriers(const legit::Buffer *buffer, BufferUsageTypes dstUsageType, std::vector<BufferBarrier> &dstBarriers)
     {
-      auto it = bufferToCurrUsage.find(buffer);
-      if(it != bufferToCurrUsage.end())
+      auto it = bufferStates.find(buffer);
+      if (it == bufferStates.end())
+        it = bufferStates.insert({ buffer, { buffer->GetLastUsageType(), baseQueueFamilyIndex, NoTask } }).first;
+      auto &bufferState = it->second;
+      if(auto maybeBarrier = CreateBufferBufferBarrierIfNeeded(buffer, bufferState.usageType, dstUsageType, bufferState.queueFamilyIndex, queueFamilyIndex))
       {
-        auto lastUsage = it->second;
-        it->second = newUsageType;
-        return lastUsage;
+        maybeBarrier->srcTaskIndex = bufferState.taskIndex;
+        dstBarriers.push_back(*maybeBarrier);
       }
-      auto baseUsage = BufferUsageTypes::None;
-      bufferToCurrUsage[buffer] = newUsageType;
-      return baseUsage;
+      bufferState = { dstUsageType, queueFamilyIndex, taskIndex };
+    }
+
+    legit::ImageUsageTypes GetImageSubresourceUsage(ImageSubresource imgSubresource) const
+    {
+      auto it = imageStates.find(imgSubresource.imageData);
+      if(it != imageStates.end())
+        return it->second.subresources[imgSubresource.mipLevel * it->second.arrayLayersCount + imgSubresource.arrayLayer].usageType;
+      return imgSubresource.imageData->GetSubresourceLastUsageType(imgSubresource.mipLevel, imgSubresource.arrayLayer);
+    }
+
+    //task that used the subresource last in this frame
+    size_t GetImageSubresourceTaskIndex(ImageSubresource imgSubresource) const
+    {
+      auto it = imageStates.find(imgSubresource.imageData);
+      if(it != imageStates.end())
+        return it->second.subresources[imgSubresource.mipLevel * it->second.arrayLayersCount + imgSubresource.arrayLayer].taskIndex;
+      return NoTask;
+    }
+    size_t GetBufferTaskIndex(const legit::Buffer *buffer) const
+    {
+      auto it = bufferStates.find(buffer);
+      if(it != bufferStates.end())
+        return it->second.taskIndex;
+      return NoTask;
+    }
+
+    //merges barriers that only differ in adjacent subresource or buffer ranges and drops duplicates. barriers with different src tasks
+    //are kept apart, so that they can still be split by task
+    static void CoalesceBarriers(std::vector<ImageBarrier> &imageBarriers, std::vector<BufferBarrier> &bufferBarriers)
+    {
+      CoalesceBarrierList(imageBarriers, TryMergeImageBarriers);
+      CoalesceBarrierList(bufferBarriers, TryMergeBufferBarriers);
     }
 
-    std::vector<BufferBarrier> TransitionBufferAndCreateBarriers(const legit::Buffer *buffer, BufferUsageTypes dstUsageType)
+    legit::BufferUsageTypes GetBufferUsage(const legit::Buffer *buffer) const
     {
-      auto lastUsageType = TransitionBuffer(buffer, dstUsageType);
-      std::vector<BufferBarrier> bufferBarriers;
-      if(auto maybeBarrier = CreateBufferBufferBarrierIfNeeded(buffer, lastUsageType, dstUsageType))
+      auto it = bufferStates.find(buffer);
+      if(it != bufferStates.end())
+        return it->second.usageType;
+      return buffer->GetLastUsageType();
+    }
+
+    //hands everything srcQueueFamilyIndex owns over to dstQueueFamilyIndex without changing its usage
+    void TransferOwnershipAndCreateBarriers(uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex, std::vector<ImageBarrier> &imageBarriers, std::vector<BufferBarrier> &bufferBarriers)
+    {
+      for (auto &imageState : imageStates)
+      {
+        auto imageData = imageState.first;
+        TransitionImageRange(imageData, 0, imageData->GetMipsCount(), 0, imageData->GetArrayLayersCount(), [&](SubresourceState srcState)
+        {
+          if (srcState.queueFamilyIndex != srcQueueFamilyIndex)
+            return std::optional<SubresourceState>();
+          return std::optional<SubresourceState>(SubresourceState{ srcState.usageType, dstQueueFamilyIndex, srcState.taskIndex });
+        }, imageBarriers);
+      }
+
+      for (auto &bufferState : bufferStates)
       {
-        bufferBarriers.push_back(*maybeBarrier);
+        if (bufferState.second.queueFamilyIndex != srcQueueFamilyIndex)
+          continue;
+        auto usageType = bufferState.second.usageType;
+        if(auto maybeBarrier = CreateBufferBufferBarrierIfNeeded(bufferState.first, usageType, usageType, srcQueueFamilyIndex, dstQueueFamilyIndex))
+        {
+          maybeBarrier->srcTaskIndex = bufferState.second.taskIndex;
+          bufferBarriers.push_back(*maybeBarrier);
+        }
+        bufferState.second.queueFamilyIndex = dstQueueFamilyIndex;
       }
-      return bufferBarriers;
     }
 
-    
-    std::map<ImageSubresource, legit::ImageUsageTypes> imgSubresourceToCurrUsage;
-    std::map<const legit::Buffer*, legit::BufferUsageTypes> bufferToCurrUsage;
+    //usages of long-lived resources at a frame boundary. transient resources are left out, they start every frame without contents
+    struct PersistentUsages
+    {
+      struct ImageUsages
+      {
+        const legit::ImageData *imageData;
+        std::vector<ImageUsageTypes> subresources; //same order as ImageState
+        bool operator ==(const ImageUsages &other) const
+        {
+          return imageData == other.imageData && subresources == other.subresources;
+        }
+      };
+      std::vector<ImageUsages> images;
+      std::vector<std::pair<const legit::Buffer*, BufferUsageTypes> > buffers;
+      bool operator ==(const PersistentUsages &other) const
+      {
+        return images == other.images && buffers == other.buffers;
+      }
+      bool operator !=(const PersistentUsages &other) const
+      {
+        return !(*this == other);
+      }
+    };
+    //current usages of the given resources. called before any transitions it returns what the frame starts from
+    void GetPersistentUsages(legit::Span<const legit::ImageData * const> imageDatas, legit::Span<const legit::Buffer * const> buffers, PersistentUsages &dstUsages) const
+    {
+      dstUsages.images.resize(imageDatas.size());
+      size_t imageIndex = 0;
+      for (auto imageData : imageDatas)
+      {
+        auto &imageUsages = dstUsages.images[imageIndex++];
+        imageUsages.imageData = imageData;
+        imageUsages.subresources.resize(size_t(imageData->GetMipsCount()) * imageData->GetArrayLayersCount());
+        for (uint32_t mipLevel = 0; mipLevel < imageData->GetMipsCount(); mipLevel++)
+        {
+          for (uint32_t arrayLayer = 0; arrayLayer < imageData->GetArrayLayersCount(); arrayLayer++)
+            imageUsages.subresources[mipLevel * imageData->GetArrayLayersCount() + arrayLayer] = GetImageSubresourceUsage({ imageData, mipLevel, arrayLayer });
+        }
+      }
+      dstUsages.buffers.clear();
+      for (auto buffer : buffers)
+        dstUsages.buffers.push_back({ buffer, GetBufferUsage(buffer) });
+    }
+    //stores the usages in the resources, trackers of the following frames start from them
+    static void CommitPersistentUsages(const PersistentUsages &usages)
+    {
+      for (auto &imageUsages : usages.images)
+      {
+        auto imageData = imageUsages.imageData;
+        for (uint32_t mipLevel = 0; mipLevel < imageData->GetMipsCount(); mipLevel++)
+        {
+          for (uint32_t arrayLayer = 0; arrayLayer < imageData->GetArrayLayersCount(); arrayLayer++)
+            imageData->mipInfos[mipLevel].layerInfos[arrayLayer].lastUsageType = imageUsages.subresources[mipLevel * imageData->GetArrayLayersCount() + arrayLayer];
+        }
+      }
+      for (auto &bufferUsage : usages.buffers)
+        bufferUsage.first->lastUsageType = bufferUsage.second;
+    }
+
+    struct BufferState
+    {
+      legit::BufferUsageTypes usageType;
+      uint32_t queueFamilyIndex;
+      size_t taskIndex;
+    };
+    std::unordered_map<const legit::ImageData*, ImageState> imageStates;
+    std::unordered_map<const legit::Buffer*, BufferState> bufferStates;
+
+    //queue family that executes the following transitions. stays VK_QUEUE_FAMILY_IGNORED unless work is split between several queue families
+    uint32_t queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    //owner of resources that haven't been transitioned yet
+    uint32_t baseQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    //task the following transitions are made by, it becomes the srcTaskIndex of barriers out of the usages it leaves behind
+    size_t taskIndex = NoTask;
+  private:
+    ImageState &GetImageState(const legit::ImageData *imageData)
+    {
+      auto it = imageStates.find(imageData);
+      if (it != imageStates.end())
+        return it->second;
+
+      // VUID-VkImageMemoryBarrier-oldLayout-01197
+      // If srcQueueFamilyIndex and dstQueueFamilyIndex define a queue family ownership transfer or oldLayout and newLayout define an image layout transition,
+      // oldLayout must be VK_IMAGE_LAYOUT_UNDEFINED or the current layout of the image subresources affected by the barrier
+      auto &imageState = imageStates[imageData];
+      imageState.arrayLayersCount = imageData->GetArrayLayersCount();
+      imageState.subresources.resize(size_t(imageData->GetMipsCount()) * imageData->GetArrayLayersCount());
+      for (uint32_t mipLevel = 0; mipLevel < imageData->GetMipsCount(); mipLevel++)
+      {
+        for (uint32_t arrayLayer = 0; arrayLayer < imageData->GetArrayLayersCount(); arrayLayer++)
+          imageState.Get(mipLevel, arrayLayer) = { imageData->GetSubresourceLastUsageType(mipLevel, arrayLayer), baseQueueFamilyIndex, NoTask };
+      }
+      return imageState;
+    }
+
+    static bool IsSameExceptRange(const ImageBarrier &left, const ImageBarrier &right)
+    {
+      const auto &leftBarrier = left.imageMemoryBarrier;
+      const auto &rightBarrier = right.imageMemoryBarrier;
+      return
+        left.srcStage == right.srcStage &&
+        left.dstStage == right.dstStage &&
+        left.srcTaskIndex == right.srcTaskIndex &&
+        leftBarrier.image == rightBarrier.image &&
+        leftBarrier.srcAccessMask == rightBarrier.srcAccessMask &&
+        leftBarrier.dstAccessMask == rightBarrier.dstAccessMask &&
+        leftBarrier.oldLayout == rightBarrier.oldLayout &&
+        leftBarrier.newLayout == rightBarrier.newLayout &&
+        leftBarrier.srcQueueFamilyIndex == rightBarrier.srcQueueFamilyIndex &&
+        leftBarrier.dstQueueFamilyIndex == rightBarrier.dstQueueFamilyIndex &&
+        leftBarrier.subresourceRange.aspectMask == rightBarrier.subresourceRange.aspectMask;
+    }
+    static bool IsSameExceptLayers(const ImageBarrier &left, const ImageBarrier &right)
+    {
+      const auto &leftRange = left.imageMemoryBarrier.subresourceRange;
+      const auto &rightRange = right.imageMemoryBarrier.subresourceRange;
+      return
+        IsSameExceptRange(left, right) &&
+        leftRange.baseMipLevel == rightRange.baseMipLevel &&
+        leftRange.levelCount == rightRange.levelCount;
+    }
+    static bool AreAdjacent(uint64_t leftBase, uint64_t leftCount, uint64_t rightBase, uint64_t rightCount)
+    {
+      return leftBase + leftCount == rightBase || rightBase + rightCount == leftBase;
+    }
+
+    //extends dstBarrier by srcBarrier if the result is still a single barrier
+    static bool TryMergeImageBarriers(ImageBarrier &dstBarrier, const ImageBarrier &srcBarrier)
+    {
+      if (!IsSameExceptRange(dstBarrier, srcBarrier))
+        return false;
+      auto &dstRange = dstBarrier.imageMemoryBarrier.subresourceRange;
+      const auto &srcRange = srcBarrier.imageMemoryBarrier.subresourceRange;
+      bool isSameMips = dstRange.baseMipLevel == srcRange.baseMipLevel && dstRange.levelCount == srcRange.levelCount;
+      bool isSameLayers = dstRange.baseArrayLayer == srcRange.baseArrayLayer && dstRange.layerCount == srcRange.layerCount;
+      if (isSameMips && isSameLayers)
+        return true;
+      if (isSameMips && AreAdjacent(dstRange.baseArrayLayer, dstRange.layerCount, srcRange.baseArrayLayer, srcRange.layerCount))
+      {
+        dstRange.baseArrayLayer = std::min(dstRange.baseArrayLayer, srcRange.baseArrayLayer);
+        dstRange.layerCount += srcRange.layerCount;
+        return true;
+      }
+      if (isSameLayers && AreAdjacent(dstRange.baseMipLevel, dstRange.levelCount, srcRange.baseMipLevel, srcRange.levelCount))
+      {
+        dstRange.baseMipLevel = std::min(dstRange.baseMipLevel, srcRange.baseMipLevel);
+        dstRange.levelCount += srcRange.levelCount;
+        return true;
+      }
+      return false;
+    }
+    static bool TryMergeBufferBarriers(BufferBarrier &dstBarrier, const BufferBarrier &srcBarrier)
+    {
+      auto &dstMemoryBarrier = dstBarrier.bufferMemoryBarrier;
+      const auto &srcMemoryBarrier = srcBarrier.bufferMemoryBarrier;
+      if (
+        dstBarrier.srcStage != srcBarrier.srcStage ||
+        dstBarrier.dstStage != srcBarrier.dstStage ||
+        dstBarrier.srcTaskIndex != srcBarrier.srcTaskIndex ||
+        dstMemoryBarrier.buffer != srcMemoryBarrier.buffer ||
+        dstMemoryBarrier.srcAccessMask != srcMemoryBarrier.srcAccessMask ||
+        dstMemoryBarrier.dstAccessMask != srcMemoryBarrier.dstAccessMask ||
+        dstMemoryBarrier.srcQueueFamilyIndex != srcMemoryBarrier.srcQueueFamilyIndex ||
+        dstMemoryBarrier.dstQueueFamilyIndex != srcMemoryBarrier.dstQueueFamilyIndex)
+        return false;
+      if (dstMemoryBarrier.offset == srcMemoryBarrier.offset && dstMemoryBarrier.size == srcMemoryBarrier.size)
+        return true;
+      if (
+        dstMemoryBarrier.size != VK_WHOLE_SIZE && srcMemoryBarrier.size != VK_WHOLE_SIZE &&
+        AreAdjacent(dstMemoryBarrier.offset, dstMemoryBarrier.size, srcMemoryBarrier.offset, srcMemoryBarrier.size))
+      {
+        dstMemoryBarrier.offset = std::min(dstMemoryBarrier.offset, srcMemoryBarrier.offset);
+        dstMemoryBarrier.size += srcMemoryBarrier.size;
+        return true;
+      }
+      return false;
+    }
+    //order is preserved, a barrier grown by a merge is compared against the rest again since it may touch barriers it didn't before
+    template<typename Barrier, typename MergeFunc>
+    static void CoalesceBarrierList(std::vector<Barrier> &barriers, MergeFunc tryMerge)
+    {
+      for (size_t barrierIndex = 0; barrierIndex < barriers.size(); barrierIndex++)
+      {
+        for (size_t otherIndex = barrierIndex + 1; otherIndex < barriers.size();)
+        {
+          if (tryMerge(barriers[barrierIndex], barriers[otherIndex]))
+          {
+            barriers.erase(barriers.begin() + otherIndex);
+            otherIndex = barrierIndex + 1;
+          }
+          else
+          {
+            otherIndex++;
+          }
+        }
+      }
+    }
+
+    //getDstState returns the new state of a subresource given its current one, or nothing to leave it alone. consecutive mips of a layer going
+    //through the same transition share a barrier, and a barrier is extended to the next layer if that layer has the same one
+    template<typename DstStateFunc>
+    void TransitionImageRange(const legit::ImageData *imageData, uint32_t baseMipLevel, uint32_t mipLevelsCount, uint32_t baseArrayLayer, uint32_t arrayLayersCount, DstStateFunc getDstState, std::vector<ImageBarrier> &dstBarriers)
+    {
+      auto &imageState = GetImageState(imageData);
+      prevLayerBarrierIndices.clear();
+
+      auto addBarrier = [&](vk::ImageSubresourceRange range, SubresourceState srcState, SubresourceState dstState)
+      {
+        auto maybeBarrier = CreateImageBarrierIfNeeded(imageData, range, srcState.usageType, dstState.usageType, srcState.queueFamilyIndex, dstState.queueFamilyIndex);
+        if (!maybeBarrier)
+          return;
+        maybeBarrier->srcTaskIndex = srcState.taskIndex;
+        for (size_t barrierIndex : prevLayerBarrierIndices)
+        {
+          auto &prevBarrier = dstBarriers[barrierIndex];
+          auto &prevRange = prevBarrier.imageMemoryBarrier.subresourceRange;
+          if (prevRange.baseArrayLayer + prevRange.layerCount == range.baseArrayLayer && IsSameExceptLayers(prevBarrier, *maybeBarrier))
+          {
+            prevRange.layerCount++;
+            layerBarrierIndices.push_back(barrierIndex);
+            return;
+          }
+        }
+        layerBarrierIndices.push_back(dstBarriers.size());
+        dstBarriers.push_back(*maybeBarrier);
+      };
+
+      for (uint32_t arrayLayer = baseArrayLayer; arrayLayer < baseArrayLayer + arrayLayersCount; arrayLayer++)
+      {
+        layerBarrierIndices.clear();
+        auto range = vk::ImageSubresourceRange()
+          .setAspectMask(imageData->GetAspectFlags())
+          .setBaseArrayLayer(arrayLayer)
+          .setLayerCount(1)
+          .setBaseMipLevel(baseMipLevel)
+          .setLevelCount(0);
+        std::optional<SubresourceState> runSrcState;
+        std::optional<SubresourceState> runDstState;
+        for (uint32_t mipLevel = baseMipLevel; mipLevel < baseMipLevel + mipLevelsCount; mipLevel++)
+        {
+          auto &subresourceState = imageState.Get(mipLevel, arrayLayer);
+          auto dstState = getDstState(subresourceState);
+          if (runSrcState != subresourceState || runDstState != dstState)
+          {
+            if (runSrcState && runDstState)
+              addBarrier(range, *runSrcState, *runDstState);
+            range
+              .setBaseMipLevel(mipLevel)
+              .setLevelCount(0);
+            runSrcState = subresourceState;
+            runDstState = dstState;
+          }
+          range.levelCount++;
+          if (dstState)
+            subresourceState = *dstState;
+        }
+        if (runSrcState && runDstState)
+          addBarrier(range, *runSrcState, *runDstState);
+        std::swap(prevLayerBarrierIndices, layerBarrierIndices);
+      }
+    }
+    //barriers of the previous and the current layer in TransitionImageRange(), kept around to avoid allocating on every call
+    std::vector<size_t> prevLayerBarrierIndices;
+    std::vector<size_t> layerBarrierIndices;
   };
 }
\ No newline at end of file
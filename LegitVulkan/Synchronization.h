@@ -386,4 +386,41 @@ namespace legit
     //could be smarter
     return true;
   }
+
+  //synchronization2 versions of the masks above. the bits of the legacy flags keep their values, top of pipe as a source and bottom of pipe
+  //as a destination mean no stage at all
+  static vk::PipelineStageFlags2 GetSrcStageMask2(vk::PipelineStageFlags stage)
+  {
+    if (stage == vk::PipelineStageFlagBits::eTopOfPipe)
+      return vk::PipelineStageFlagBits2::eNone;
+    return vk::PipelineStageFlags2(VkPipelineStageFlags2(VkPipelineStageFlags(stage)));
+  }
+  static vk::PipelineStageFlags2 GetDstStageMask2(vk::PipelineStageFlags stage)
+  {
+    if (stage == vk::PipelineStageFlagBits::eBottomOfPipe)
+      return vk::PipelineStageFlagBits2::eNone;
+    return vk::PipelineStageFlags2(VkPipelineStageFlags2(VkPipelineStageFlags(stage)));
+  }
+  //images are read through samplers in read-only layouts and as storage images in the general layout
+  static vk::AccessFlags2 GetImageAccessMask2(vk::AccessFlags accessMask, vk::ImageLayout layout)
+  {
+    auto shaderAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    auto accessMask2 = vk::AccessFlags2(VkAccessFlags2(VkAccessFlags(accessMask & ~shaderAccessMask)));
+    if (accessMask & vk::AccessFlagBits::eShaderRead)
+      accessMask2 |= (layout == vk::ImageLayout::eGeneral) ? vk::AccessFlagBits2::eShaderStorageRead : vk::AccessFlagBits2::eShaderSampledRead;
+    if (accessMask & vk::AccessFlagBits::eShaderWrite)
+      accessMask2 |= vk::AccessFlagBits2::eShaderStorageWrite;
+    return accessMask2;
+  }
+  //tracked buffers are only accessed by shaders as storage buffers, uniforms come from ShaderMemoryPool
+  static vk::AccessFlags2 GetBufferAccessMask2(vk::AccessFlags accessMask)
+  {
+    auto shaderAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    auto accessMask2 = vk::AccessFlags2(VkAccessFlags2(VkAccessFlags(accessMask & ~shaderAccessMask)));
+    if (accessMask & vk::AccessFlagBits::eShaderRead)
+      accessMask2 |= vk::AccessFlagBits2::eShaderStorageRead;
+    if (accessMask & vk::AccessFlagBits::eShaderWrite)
+      accessMask2 |= vk::AccessFlagBits2::eShaderStorageWrite;
+    return accessMask2;
+  }
 }
\ No newline at end of file
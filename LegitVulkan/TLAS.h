@@ -5,12 +5,11 @@ namespace legit
     legit::BLAS* blas;
     glm::mat4 transform;
   };
-  std::unique_ptr<legit::Buffer> CreateInstanceBuffer(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, std::vector<BLASInstance> instances)
+  std::unique_ptr<legit::Buffer> CreateInstanceBuffer(legit::MemoryAllocator *memoryAllocator, std::vector<BLASInstance> instances)
   {
     std::unique_ptr<legit::Buffer> instanceBuffer;
     instanceBuffer.reset(new legit::Buffer(
-      physicalDevice,
-      logicalDevice,
+      memoryAllocator,
       sizeof(vk::AccelerationStructureInstanceKHR) * instances.size(),
       vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
       vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
@@ -33,9 +32,10 @@ namespace legit
   class TLAS
   {
   public:
-    TLAS(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, const legit::ExecuteOnceQueue &queue, std::vector<BLASInstance> instances)
+    TLAS(legit::MemoryAllocator *memoryAllocator, const legit::ExecuteOnceQueue &queue, std::vector<BLASInstance> instances)
     {
-      auto instanceBuffer = CreateInstanceBuffer(physicalDevice, logicalDevice, instances);
+      vk::Device logicalDevice = memoryAllocator->GetLogicalDevice();
+      auto instanceBuffer = CreateInstanceBuffer(memoryAllocator, instances);
 
       auto accelerationStructureGeometry = vk::AccelerationStructureGeometryKHR()
         .setGeometryType(vk::GeometryTypeKHR::eInstances)
@@ -60,11 +60,10 @@ namespace legit
         buildGeomInfo,
         primitiveCounts);
 
-      accelerationStructure.reset(new legit::AccelerationStructure(physicalDevice, logicalDevice, vk::AccelerationStructureTypeKHR::eTopLevel, buildSizesInfo));
+      accelerationStructure.reset(new legit::AccelerationStructure(memoryAllocator, vk::AccelerationStructureTypeKHR::eTopLevel, buildSizesInfo));
       
       legit::Buffer scratchBuffer(
-        physicalDevice,
-        logicalDevice,
+        memoryAllocator,
         buildSizesInfo.buildScratchSize,
         vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
         vk::MemoryPropertyFlagBits::eDeviceLocal);
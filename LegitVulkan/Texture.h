@@ -6,7 +6,7 @@ namespace legit
       imageCreateInfo(imageCreateInfo),
       debugName(debugName)
     {
-      image.reset(new legit::Image(core->GetPhysicalDevice(), core->GetLogicalDevice(), imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal));
+      image.reset(new legit::Image(core->GetMemoryAllocator(), imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal));
       CreateImageViews(core, imageCreateInfo, debugName);
       core->SetObjectDebugName(image->GetImageData()->GetHandle(), debugName + "[image]");
     }
@@ -14,7 +14,7 @@ namespace legit
       imageCreateInfo(imageCreateInfo),
       debugName(debugName)
     {
-      image.reset(new legit::Image(core->GetPhysicalDevice(), core->GetLogicalDevice(), imageCreateInfo, commandBuffer, baseUsageType, vk::MemoryPropertyFlagBits::eDeviceLocal));
+      image.reset(new legit::Image(core->GetMemoryAllocator(), imageCreateInfo, commandBuffer, baseUsageType, vk::MemoryPropertyFlagBits::eDeviceLocal));
       CreateImageViews(core, imageCreateInfo, debugName);
       core->SetObjectDebugName(image->GetImageData()->GetHandle(), debugName + "[image]");
     }
@@ -0,0 +1,411 @@
+#include <deque>
+#include <numeric>
+
+namespace legit
+{
+  //uploads data through a persistently mapped staging ring on the transfer queue. copies are batched into one submission until Flush()
+  //or until the batch gets big, and every upload returns a token that can be polled or waited on instead of stalling the gpu.
+  //destination resources must not be in use by the gpu, they end up owned by the graphics queue in dstUsageType
+  class UploadManager
+  {
+  public:
+    using UploadToken = uint64_t;
+
+    UploadManager(legit::Core *core, vk::DeviceSize stagingRingSize = 64 * 1024 * 1024)
+    {
+      this->core = core;
+      this->stagingRingSize = stagingRingSize;
+
+      auto queueFamilyIndices = core->GetQueueFamilyIndices();
+      this->transferFamilyIndex = queueFamilyIndices.transferFamilyIndex;
+      this->graphicsFamilyIndex = queueFamilyIndices.graphicsFamilyIndex;
+
+      auto commandPoolInfo = vk::CommandPoolCreateInfo()
+        .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+        .setQueueFamilyIndex(transferFamilyIndex);
+      transferCommandPool = core->GetLogicalDevice().createCommandPoolUnique(commandPoolInfo);
+      if (IsQueueOwnershipTransferred())
+      {
+        commandPoolInfo.setQueueFamilyIndex(graphicsFamilyIndex);
+        graphicsCommandPool = core->GetLogicalDevice().createCommandPoolUnique(commandPoolInfo);
+      }
+
+      stagingRing = std::unique_ptr<legit::Buffer>(new legit::Buffer(core->GetMemoryAllocator(), stagingRingSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+      stagingRingData = stagingRing->Map();
+    }
+    ~UploadManager()
+    {
+      WaitIdle();
+      stagingRing->Unmap();
+    }
+
+    UploadToken UploadBuffer(const void *bufferData, vk::DeviceSize bufferSize, legit::Buffer *dstBuffer, legit::BufferUsageTypes dstUsageType, vk::DeviceSize dstOffset = 0)
+    {
+      vk::Buffer stagingBuffer;
+      vk::DeviceSize stagingOffset;
+      void *stagingData = AllocateStaging(bufferSize, 4, stagingBuffer, stagingOffset);
+      memcpy(stagingData, bufferData, size_t(bufferSize));
+
+      auto copyRegion = vk::BufferCopy()
+        .setSrcOffset(stagingOffset)
+        .setDstOffset(dstOffset)
+        .setSize(bufferSize);
+
+      auto &batch = GetRecordingBatch();
+      batch.transferCommandBuffer->copyBuffer(stagingBuffer, dstBuffer->GetHandle(), { copyRegion });
+      if (auto maybeBarrier = StateTracker::CreateBufferBufferBarrierIfNeeded(dstBuffer, BufferUsageTypes::TransferDst, dstUsageType, transferFamilyIndex, graphicsFamilyIndex))
+      {
+        batch.bufferBarriers.push_back(*maybeBarrier);
+      }
+      dstBuffer->SetLastUsageType(dstUsageType);
+      return FinishUpload(bufferSize);
+    }
+
+    UploadToken UploadTexelData(const ImageTexelData *texelData, legit::ImageData *dstImageData, legit::ImageUsageTypes dstUsageType = legit::ImageUsageTypes::GraphicsShaderRead)
+    {
+      //buffer offsets of buffer to image copies have to be multiples of both the texel size and 4
+      vk::DeviceSize alignment = std::lcm(vk::DeviceSize(texelData->texelSize), vk::DeviceSize(4));
+      vk::DeviceSize texelsSize = texelData->texels.size();
+      vk::Buffer stagingBuffer;
+      vk::DeviceSize stagingOffset;
+      void *stagingData = AllocateStaging(texelsSize, alignment, stagingBuffer, stagingOffset);
+      memcpy(stagingData, texelData->texels.data(), size_t(texelsSize));
+
+      auto copyRegions = GetTexelDataCopyRegions(texelData, stagingOffset);
+      auto range = vk::ImageSubresourceRange()
+        .setAspectMask(dstImageData->GetAspectFlags())
+        .setBaseArrayLayer(0)
+        .setLayerCount(dstImageData->GetArrayLayersCount())
+        .setBaseMipLevel(0)
+        .setLevelCount(dstImageData->GetMipsCount());
+
+      auto &batch = GetRecordingBatch();
+      std::vector<StateTracker::ImageBarrier> transferDstBarriers;
+      if (auto maybeBarrier = StateTracker::CreateImageBarrierIfNeeded(dstImageData, range, ImageUsageTypes::None, ImageUsageTypes::TransferDst))
+      {
+        transferDstBarriers.push_back(*maybeBarrier);
+      }
+      RenderGraph::SubmitBarriers(batch.transferCommandBuffer.get(), transferDstBarriers, {}, core->GetRenderGraph()->IsSynchronization2Enabled());
+      batch.transferCommandBuffer->copyBufferToImage(stagingBuffer, dstImageData->GetHandle(), vk::ImageLayout::eTransferDstOptimal, copyRegions);
+      if (auto maybeBarrier = StateTracker::CreateImageBarrierIfNeeded(dstImageData, range, ImageUsageTypes::TransferDst, dstUsageType, transferFamilyIndex, graphicsFamilyIndex))
+      {
+        batch.imageBarriers.push_back(*maybeBarrier);
+      }
+      dstImageData->SetLastUsageType(dstUsageType);
+      return FinishUpload(texelsSize);
+    }
+
+    //submits the batch that is being recorded. returns the token of the last upload
+    UploadToken Flush()
+    {
+      if (recordingBatch)
+        SubmitBatch();
+      return nextToken - 1;
+    }
+
+    bool IsComplete(UploadToken token)
+    {
+      RetireCompletedBatches();
+      return token <= lastCompletedToken;
+    }
+
+    void Wait(UploadToken token)
+    {
+      if (recordingBatch && token >= recordingBatch->token)
+        SubmitBatch();
+      while (token > lastCompletedToken && !inFlightBatches.empty())
+      {
+        core->WaitForFence(inFlightBatches.front().fence.get());
+        RetireCompletedBatches();
+      }
+    }
+
+    void WaitIdle()
+    {
+      Wait(Flush());
+    }
+
+    struct Stats
+    {
+      size_t submittedBatchesCount = 0;
+      size_t uploadsCount = 0;
+      vk::DeviceSize uploadedSize = 0;
+      size_t stagingStallsCount = 0; //uploads that had to wait for the gpu to free staging memory
+      size_t dedicatedStagingBuffersCount = 0;
+    };
+    const Stats &GetStats() const
+    {
+      return stats;
+    }
+  private:
+    struct Batch
+    {
+      UploadToken token;
+      vk::UniqueCommandBuffer transferCommandBuffer;
+      vk::UniqueCommandBuffer graphicsCommandBuffer;
+      vk::UniqueSemaphore transferToGraphicsSemaphore;
+      vk::UniqueFence fence;
+
+      //applied after all copies of the batch, split into a release and an acquire when the queue families differ
+      std::vector<StateTracker::ImageBarrier> imageBarriers;
+      std::vector<StateTracker::BufferBarrier> bufferBarriers;
+
+      std::vector<std::unique_ptr<legit::Buffer> > dedicatedStagingBuffers;
+      vk::DeviceSize stagedSize = 0;
+      vk::DeviceSize ringUsedSize = 0;
+      vk::DeviceSize ringEnd = 0;
+    };
+
+    bool IsQueueOwnershipTransferred()
+    {
+      return transferFamilyIndex != graphicsFamilyIndex;
+    }
+
+    static vk::UniqueCommandBuffer BeginCommandBuffer(vk::Device logicalDevice, vk::CommandPool commandPool)
+    {
+      auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
+        .setCommandPool(commandPool)
+        .setLevel(vk::CommandBufferLevel::ePrimary)
+        .setCommandBufferCount(1u);
+      auto commandBuffer = std::move(logicalDevice.allocateCommandBuffersUnique(commandBufferAllocateInfo)[0]);
+      auto bufferBeginInfo = vk::CommandBufferBeginInfo()
+        .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+      commandBuffer->begin(bufferBeginInfo);
+      return commandBuffer;
+    }
+
+    Batch &GetRecordingBatch()
+    {
+      if (!recordingBatch)
+      {
+        recordingBatch.reset(new Batch());
+        recordingBatch->token = nextToken++;
+        recordingBatch->transferCommandBuffer = BeginCommandBuffer(core->GetLogicalDevice(), transferCommandPool.get());
+      }
+      return *recordingBatch;
+    }
+
+    UploadToken FinishUpload(vk::DeviceSize stagedSize)
+    {
+      auto &batch = *recordingBatch;
+      batch.stagedSize += stagedSize;
+      stats.uploadsCount++;
+      stats.uploadedSize += stagedSize;
+
+      UploadToken token = batch.token;
+      //big batches are submitted right away so that the gpu starts copying while the rest is being staged
+      if (batch.stagedSize >= stagingRingSize / 4)
+        SubmitBatch();
+      return token;
+    }
+
+    void SubmitBatch()
+    {
+      auto logicalDevice = core->GetLogicalDevice();
+      auto &batch = *recordingBatch;
+      batch.fence = logicalDevice.createFenceUnique(vk::FenceCreateInfo());
+
+      std::vector<StateTracker::ImageBarrier> releaseImageBarriers;
+      std::vector<StateTracker::BufferBarrier> releaseBufferBarriers;
+      std::vector<StateTracker::ImageBarrier> acquireImageBarriers;
+      std::vector<StateTracker::BufferBarrier> acquireBufferBarriers;
+      for (auto &imageBarrier : batch.imageBarriers)
+      {
+        if (StateTracker::IsOwnershipTransfer(imageBarrier))
+        {
+          releaseImageBarriers.push_back(StateTracker::GetReleaseBarrier(imageBarrier));
+          acquireImageBarriers.push_back(StateTracker::GetAcquireBarrier(imageBarrier));
+        }
+        else
+        {
+          releaseImageBarriers.push_back(imageBarrier);
+        }
+      }
+      for (auto &bufferBarrier : batch.bufferBarriers)
+      {
+        if (StateTracker::IsOwnershipTransfer(bufferBarrier))
+        {
+          releaseBufferBarriers.push_back(StateTracker::GetReleaseBarrier(bufferBarrier));
+          acquireBufferBarriers.push_back(StateTracker::GetAcquireBarrier(bufferBarrier));
+        }
+        else
+        {
+          releaseBufferBarriers.push_back(bufferBarrier);
+        }
+      }
+
+      RenderGraph::SubmitBarriers(batch.transferCommandBuffer.get(), releaseImageBarriers, releaseBufferBarriers, core->GetRenderGraph()->IsSynchronization2Enabled());
+      batch.transferCommandBuffer->end();
+
+      bool hasAcquires = acquireImageBarriers.size() > 0 || acquireBufferBarriers.size() > 0;
+      vk::CommandBuffer transferCommandBuffer = batch.transferCommandBuffer.get();
+      auto transferSubmitInfo = vk::SubmitInfo()
+        .setCommandBuffers(transferCommandBuffer);
+      if (hasAcquires)
+      {
+        //the graphics queue acquires ownership once the copies are done, the fence covers both submissions
+        batch.transferToGraphicsSemaphore = logicalDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo());
+        vk::Semaphore transferToGraphicsSemaphore = batch.transferToGraphicsSemaphore.get();
+        transferSubmitInfo.setSignalSemaphores(transferToGraphicsSemaphore);
+        core->GetTransferQueue().submit({ transferSubmitInfo }, nullptr);
+
+        batch.graphicsCommandBuffer = BeginCommandBuffer(logicalDevice, graphicsCommandPool.get());
+        RenderGraph::SubmitBarriers(batch.graphicsCommandBuffer.get(), acquireImageBarriers, acquireBufferBarriers, core->GetRenderGraph()->IsSynchronization2Enabled());
+        batch.graphicsCommandBuffer->end();
+
+        vk::CommandBuffer graphicsCommandBuffer = batch.graphicsCommandBuffer.get();
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+        auto graphicsSubmitInfo = vk::SubmitInfo()
+          .setWaitSemaphores(transferToGraphicsSemaphore)
+          .setWaitDstStageMask(waitStage)
+          .setCommandBuffers(graphicsCommandBuffer);
+        core->GetGraphicsQueue().submit({ graphicsSubmitInfo }, batch.fence.get());
+      }
+      else
+      {
+        core->GetTransferQueue().submit({ transferSubmitInfo }, batch.fence.get());
+      }
+
+      batch.imageBarriers.clear();
+      batch.bufferBarriers.clear();
+      inFlightBatches.push_back(std::move(batch));
+      recordingBatch.reset();
+      stats.submittedBatchesCount++;
+    }
+
+    //batches are retired in submission order, so staging memory is always freed from the tail of the ring
+    void RetireCompletedBatches()
+    {
+      while (!inFlightBatches.empty())
+      {
+        auto &batch = inFlightBatches.front();
+        if (core->GetLogicalDevice().getFenceStatus(batch.fence.get()) != vk::Result::eSuccess)
+          break;
+        if (batch.ringUsedSize > 0)
+        {
+          ringTail = batch.ringEnd;
+          ringUsedSize -= batch.ringUsedSize;
+        }
+        lastCompletedToken = batch.token;
+        inFlightBatches.pop_front();
+      }
+    }
+
+    static vk::DeviceSize AlignSize(vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+      vk::DeviceSize resSize = size;
+      if (resSize % alignment != 0)
+        resSize += (alignment - (resSize % alignment));
+      return resSize;
+    }
+
+    bool FindStagingOffset(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize &offset)
+    {
+      if (ringUsedSize == 0)
+      {
+        ringHead = 0;
+        ringTail = 0;
+      }
+      else if (ringHead == ringTail)
+      {
+        return false;
+      }
+
+      vk::DeviceSize alignedHead = AlignSize(ringHead, alignment);
+      if (ringHead >= ringTail)
+      {
+        //free space is [head, end) and [0, tail)
+        if (alignedHead + size <= stagingRingSize)
+        {
+          offset = alignedHead;
+          return true;
+        }
+        if (size <= ringTail)
+        {
+          offset = 0;
+          return true;
+        }
+        return false;
+      }
+      //free space is [head, tail)
+      if (alignedHead + size <= ringTail)
+      {
+        offset = alignedHead;
+        return true;
+      }
+      return false;
+    }
+
+    void *AllocateStaging(vk::DeviceSize size, vk::DeviceSize alignment, vk::Buffer &stagingBuffer, vk::DeviceSize &stagingOffset)
+    {
+      //anything that would take most of the ring gets its own staging buffer that lives as long as the batch
+      if (size > stagingRingSize / 2)
+      {
+        auto &batch = GetRecordingBatch();
+        batch.dedicatedStagingBuffers.emplace_back(new legit::Buffer(core->GetMemoryAllocator(), size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+        stats.dedicatedStagingBuffersCount++;
+        stagingBuffer = batch.dedicatedStagingBuffers.back()->GetHandle();
+        stagingOffset = 0;
+        //freeing the memory along with the batch unmaps it
+        return batch.dedicatedStagingBuffers.back()->Map();
+      }
+
+      vk::DeviceSize offset;
+      if (!FindStagingOffset(size, alignment, offset))
+      {
+        stats.stagingStallsCount++;
+        if (recordingBatch && recordingBatch->ringUsedSize > 0)
+          SubmitBatch();
+        while (!FindStagingOffset(size, alignment, offset))
+        {
+          assert(!inFlightBatches.empty());
+          core->WaitForFence(inFlightBatches.front().fence.get());
+          RetireCompletedBatches();
+        }
+      }
+
+      auto &batch = GetRecordingBatch();
+      vk::DeviceSize consumedSize = (offset >= ringHead ? offset - ringHead : stagingRingSize - ringHead + offset) + size;
+      ringUsedSize += consumedSize;
+      batch.ringUsedSize += consumedSize;
+      ringHead = offset + size;
+      batch.ringEnd = ringHead;
+
+      stagingBuffer = stagingRing->GetHandle();
+      stagingOffset = offset;
+      return (char*)stagingRingData + offset;
+    }
+
+    legit::Core *core;
+    uint32_t transferFamilyIndex;
+    uint32_t graphicsFamilyIndex;
+    vk::UniqueCommandPool transferCommandPool;
+    vk::UniqueCommandPool graphicsCommandPool;
+
+    std::unique_ptr<legit::Buffer> stagingRing;
+    void *stagingRingData;
+    vk::DeviceSize stagingRingSize;
+    vk::DeviceSize ringHead = 0;
+    vk::DeviceSize ringTail = 0;
+    vk::DeviceSize ringUsedSize = 0;
+
+    std::unique_ptr<Batch> recordingBatch;
+    std::deque<Batch> inFlightBatches;
+    UploadToken nextToken = 1;
+    UploadToken lastCompletedToken = 0;
+
+    Stats stats;
+  };
+
+  //copies are submitted by the next Flush(), at the latest right before the next frame or ExecuteOnceQueue submission.
+  //buffers stay in TransferDst by default so that the render graph makes the data visible on their first use
+  static UploadManager::UploadToken LoadBufferData(legit::Core *core, const void *bufferData, size_t bufferSize, legit::Buffer *dstBuffer, legit::BufferUsageTypes dstUsageType = legit::BufferUsageTypes::TransferDst)
+  {
+    return core->GetUploadManager()->UploadBuffer(bufferData, bufferSize, dstBuffer, dstUsageType);
+  }
+
+  static UploadManager::UploadToken LoadTexelData(legit::Core *core, const ImageTexelData *texelData, legit::ImageData *dstImageData, legit::ImageUsageTypes dstUsageType = legit::ImageUsageTypes::GraphicsShaderRead)
+  {
+    return core->GetUploadManager()->UploadTexelData(texelData, dstImageData, dstUsageType);
+  }
+}
@@ -45,6 +45,14 @@ namespace legit
         .setOffset(offset);
       vertexAttributes.push_back(vertexAttribute);
     }
+    void AddVertexInputBinding(vk::VertexInputBindingDescription bindingDesc)
+    {
+      bindingDescriptors.push_back(bindingDesc);
+    }
+    void AddVertexAttribute(vk::VertexInputAttributeDescription vertexAttribute)
+    {
+      vertexAttributes.push_back(vertexAttribute);
+    }
     const std::vector<vk::VertexInputBindingDescription> &GetBindingDescriptors() const
     {
       return bindingDescriptors;
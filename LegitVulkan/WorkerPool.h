@@ -0,0 +1,191 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+
+namespace legit
+{
+  //runs batches of independent jobs on a fixed set of threads. the calling thread takes part in every batch as worker 0
+  class WorkerPool
+  {
+  public:
+    using JobFunc = std::function<void(size_t jobIndex, size_t workerIndex)>;
+
+    WorkerPool(size_t workersCount)
+    {
+      assert(workersCount > 0);
+      for (size_t workerIndex = 1; workerIndex < workersCount; workerIndex++)
+      {
+        threads.emplace_back([this, workerIndex]() { ThreadFunc(workerIndex); });
+      }
+    }
+    ~WorkerPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+      }
+      startCondition.notify_all();
+      for (auto &thread : threads)
+        thread.join();
+    }
+
+    size_t GetWorkersCount() const
+    {
+      return threads.size() + 1;
+    }
+
+    //blocks until every job of the batch is finished
+    void Run(size_t jobsCount, const JobFunc &jobFunc)
+    {
+      if (jobsCount == 0)
+        return;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        currJobFunc = &jobFunc;
+        currJobsCount = jobsCount;
+        nextJobIndex = 0;
+        busyThreadsCount = threads.size();
+        batchIndex++;
+      }
+      startCondition.notify_all();
+
+      ProcessJobs(0);
+
+      std::unique_lock<std::mutex> lock(mutex);
+      finishCondition.wait(lock, [this]() { return busyThreadsCount == 0; });
+      currJobFunc = nullptr;
+    }
+  private:
+    void ProcessJobs(size_t workerIndex)
+    {
+      while (true)
+      {
+        size_t jobIndex = nextJobIndex.fetch_add(1);
+        if (jobIndex >= currJobsCount)
+          break;
+        (*currJobFunc)(jobIndex, workerIndex);
+      }
+    }
+
+    void ThreadFunc(size_t workerIndex)
+    {
+      size_t processedBatchIndex = 0;
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          startCondition.wait(lock, [&]() { return isStopping || batchIndex != processedBatchIndex; });
+          if (isStopping)
+            return;
+          processedBatchIndex = batchIndex;
+        }
+
+        ProcessJobs(workerIndex);
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          busyThreadsCount--;
+        }
+        finishCondition.notify_one();
+      }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable finishCondition;
+
+    const JobFunc *currJobFunc = nullptr;
+    size_t currJobsCount = 0;
+    std::atomic<size_t> nextJobIndex = 0;
+    size_t busyThreadsCount = 0;
+    size_t batchIndex = 0;
+    bool isStopping = false;
+  };
+
+  //fire and forget jobs executed in the background by a fixed set of threads, unlike WorkerPool nobody waits for them
+  class JobQueue
+  {
+  public:
+    using JobFunc = std::function<void()>;
+
+    JobQueue(size_t threadsCount)
+    {
+      assert(threadsCount > 0);
+      for (size_t threadIndex = 0; threadIndex < threadsCount; threadIndex++)
+      {
+        threads.emplace_back([this]() { ThreadFunc(); });
+      }
+    }
+    //jobs that haven't started yet are dropped, running ones are finished
+    ~JobQueue()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+        pendingJobs.clear();
+      }
+      jobCondition.notify_all();
+      for (auto &thread : threads)
+        thread.join();
+    }
+
+    void Push(JobFunc jobFunc)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingJobs.push_back(std::move(jobFunc));
+      }
+      jobCondition.notify_one();
+    }
+
+    //blocks until every pushed job is finished
+    void WaitIdle()
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      idleCondition.wait(lock, [this]() { return pendingJobs.empty() && runningJobsCount == 0; });
+    }
+
+    size_t GetPendingJobsCount()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return pendingJobs.size() + runningJobsCount;
+    }
+  private:
+    void ThreadFunc()
+    {
+      while (true)
+      {
+        JobFunc jobFunc;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          jobCondition.wait(lock, [this]() { return isStopping || !pendingJobs.empty(); });
+          if (isStopping)
+            return;
+          jobFunc = std::move(pendingJobs.front());
+          pendingJobs.pop_front();
+          runningJobsCount++;
+        }
+
+        jobFunc();
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          runningJobsCount--;
+        }
+        idleCondition.notify_all();
+      }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable jobCondition;
+    std::condition_variable idleCondition;
+    std::deque<JobFunc> pendingJobs;
+    size_t runningJobsCount = 0;
+    bool isStopping = false;
+  };
+}